@@ -5,12 +5,15 @@
 #include <memory>
 #include <stdexcept>
 #include <chrono>
+#include <cmath>
 
 #include "conversion.hh"
 #include "udp_socket.hh"
 #include "sdl.hh"
 #include "protocol.hh"
 #include "vp9_decoder.hh"
+#include "timestamp.hh"
+#include "clock_sync.hh"
 
 using namespace std;
 using namespace chrono;
@@ -26,8 +29,15 @@ void print_usage(const string & program_name)
   "                     1: decode but not display frames\n"
   "                     2: neither decode nor display frames\n"
   "-o, --output <file>  file to output performance results to\n"
-  "-v, --verbose        enable more logging for debugging"
+  "-v, --verbose        enable more logging for debugging\n"
   "--streamtime         total streaming time in seconds\n"
+  "--dump <dir>         save displayed frames in dir as PNGs (in the\n"
+  "                     background; dropped if saving falls behind)\n"
+  "--record <file>      record decoded frames into a y4m file, one per\n"
+  "                     frame ID (repeating the previous frame for frames\n"
+  "                     skipped) so that it aligns with the source\n"
+  "--motion <speed>     move the viewport continuously between viewpoints at\n"
+  "                     this speed (pixels/s) instead of jumping every 2s"
   << endl;
 }
 
@@ -38,8 +48,11 @@ int main(int argc, char * argv[])
   unsigned int target_bitrate = 0; // kbps
   int lazy_level = 0;
   string output_path;
+  string dump_dir;
+  string record_path;
   bool verbose = false;
   uint16_t total_stream_time = 60;
+  double motion_speed = 0;
 
   const option cmd_line_opts[] = {
     {"fps",     required_argument, nullptr, 'F'},
@@ -48,6 +61,9 @@ int main(int argc, char * argv[])
     {"output",  required_argument, nullptr, 'o'},
     {"verbose", no_argument,       nullptr, 'v'},
     {"streamtime", required_argument, nullptr, 'T'},
+    {"dump",    required_argument, nullptr, 'D'},
+    {"record",  required_argument, nullptr, 'R'},
+    {"motion",  required_argument, nullptr, 'm'},
     { nullptr,  0,                 nullptr,  0 },
   };
 
@@ -76,6 +92,15 @@ int main(int argc, char * argv[])
       case 'T':
         total_stream_time = narrow_cast<uint16_t>(strict_stoi(optarg));
         break;
+      case 'm':
+        motion_speed = stod(optarg);
+        break;
+      case 'D':
+        dump_dir = optarg;
+        break;
+      case 'R':
+        record_path = optarg;
+        break;
       default:
         print_usage(argv[0]);
         return EXIT_FAILURE;
@@ -116,9 +141,17 @@ int main(int argc, char * argv[])
   const SignalMsg init_signal_msg(target_bitrate); 
   signal_sock.send(init_signal_msg.serialize_to_string());
   cerr <<  "init_signal_msg sent" << endl;
+
+  // clock synchronization replies are polled for without blocking
+  signal_sock.set_blocking(false);
+  ClockSync clock_sync;
   
   // initialize decoders
-  Decoder decoder(display_width, display_height, lazy_level, output_path);
+  unique_ptr<Y4MRecorder> recorder;
+  if (not record_path.empty()) {
+    recorder = make_unique<Y4MRecorder>(record_path, display_width, display_height, frame_rate);
+  }
+  Decoder decoder(display_width, display_height, lazy_level, output_path, dump_dir, move(recorder));
   decoder.set_verbose(verbose);
 
   // timer for sending signal messages
@@ -127,9 +160,22 @@ int main(int argc, char * argv[])
 
   unsigned int event_count = 0;
   unsigned int event_idx = 0;
-  // vector<unsigned int> viewpoint_x_list = {2000, 2200, 2400, 2600};
-  // vector<unsigned int> viewpoint_x_list = {4000, 4200, 4400, 4600};
-  vector<unsigned int> viewpoint_x_list = {400, 450, 500, 550};
+  // viewport centers to cycle through in the full frame
+  // vector<pair<double, double>> viewpoint_list = {{2000, 1000}, {2200, 1100}, {2400, 1200}, {2600, 1300}};
+  // vector<pair<double, double>> viewpoint_list = {{4000, 2000}, {4200, 2100}, {4400, 2200}, {4600, 2300}};
+  vector<pair<double, double>> viewpoint_list = {{400, 200}, {450, 225}, {500, 250}, {550, 275}};
+
+  // with continuous motion: the current viewport center and update interval
+  pair<double, double> viewpoint = viewpoint_list.front();
+  const auto motion_interval = duration<double>(1.0 / frame_rate);
+
+  // requests a viewport from the sender and crops to it locally as well
+  const auto request_viewport = [&](const double x, const double y)
+  {
+    ViewportMsg viewport_msg(x, y, display_width, display_height, timestamp_us());
+    signal_sock.send(viewport_msg.serialize_to_string());
+    decoder.set_viewport(CropWindow(x, y, display_width, display_height));
+  };
 
 
   // main loop
@@ -139,8 +185,9 @@ int main(int argc, char * argv[])
     if (not datagram.parse_from_string(video_sock.recv().value())) {
       throw runtime_error("failed to parse a datagram");
     }
+    datagram.recv_ts = timestamp_us();
 
-    // send an ACK back to sender
+    // send an ACK back to sender (echoing when it arrived)
     AckMsg ack(datagram);
     video_sock.send(ack.serialize_to_string());
 
@@ -149,6 +196,41 @@ int main(int argc, char * argv[])
            << " frag_id=" << datagram.frag_id << endl;
     }
 
+    // synchronize clocks with the sender over the signal socket
+    const uint64_t now = timestamp_us();
+    if (clock_sync.request_due(now)) {
+      signal_sock.send(ClockMsg(now).serialize_to_string());
+    }
+
+    while (clock_sync.awaiting_reply()) {
+      const auto raw_reply = signal_sock.recv();
+      if (not raw_reply) { // EWOULDBLOCK; try again after the next datagram
+        break;
+      }
+
+      const shared_ptr<Msg> msg = Msg::parse_from_string(*raw_reply);
+      if (msg == nullptr or msg->type != Msg::Type::CLOCK) {
+        continue;
+      }
+
+      const auto reply = dynamic_pointer_cast<ClockMsg>(msg);
+      const uint64_t reply_recv_ts = timestamp_us();
+      clock_sync.add_sample(reply->origin_ts, reply->receive_ts,
+                            reply->transmit_ts, reply_recv_ts);
+
+      const auto offset = clock_sync.offset_us(reply_recv_ts);
+      if (offset) {
+        decoder.set_sender_clock_offset(*offset);
+
+        if (clock_sync.num_samples() % 10 == ClockSync::NUM_INITIAL % 10) {
+          cerr << "Sender clock offset (ms): " << double_to_string(*offset / 1000.0)
+               << ", skew (ppm): " << double_to_string(clock_sync.skew_ppm())
+               << ", delay (ms): " << double_to_string(*clock_sync.delay_us() / 1000.0)
+               << endl;
+        }
+      }
+    }
+
     // process the received datagram in the decoder
     decoder.add_datagram(move(datagram)); // the parameter is a temporary object, so we need to move() it to avoid copying it. 
 
@@ -157,13 +239,37 @@ int main(int argc, char * argv[])
       decoder.consume_next_frame();
     }
 
-    // send a new signal message every 2s
-    if (steady_clock::now() - last_time > seconds(2)) {
-      event_idx = event_count % viewpoint_x_list.size();
+    if (motion_speed > 0) {
+      // move towards the next viewpoint once per frame interval
+      const auto now = steady_clock::now();
+      const double elapsed = duration<double>(now - last_time).count();
+
+      if (elapsed >= motion_interval.count()) {
+        last_time = now;
+
+        const auto & [target_x, target_y] = viewpoint_list[event_idx];
+        const double distance = hypot(target_x - viewpoint.first,
+                                      target_y - viewpoint.second);
+        const double step = motion_speed * elapsed;
+
+        if (distance <= step) {
+          viewpoint = {target_x, target_y};
+          event_idx = ++event_count % viewpoint_list.size();
+        } else {
+          viewpoint.first += (target_x - viewpoint.first) * step / distance;
+          viewpoint.second += (target_y - viewpoint.second) * step / distance;
+        }
+
+        request_viewport(viewpoint.first, viewpoint.second);
+      }
+    }
+    // request a new viewport every 2s
+    else if (steady_clock::now() - last_time > seconds(2)) {
+      event_idx = event_count % viewpoint_list.size();
       event_count++; 
       last_time = steady_clock::now();
-      SignalMsg signal_msg(viewpoint_x_list[event_idx]);
-      signal_sock.send(signal_msg.serialize_to_string());
+      const auto & [viewpoint_x, viewpoint_y] = viewpoint_list[event_idx];
+      request_viewport(viewpoint_x, viewpoint_y);
     }
 
     // Streaming time up
@@ -5,14 +5,20 @@
 #include <stdexcept>
 #include <utility>
 #include <chrono>
+#include <cmath>
+#include <algorithm>
 
 #include "conversion.hh"
 #include "timerfd.hh"
 #include "udp_socket.hh"
 #include "poller.hh"
-#include "yuv4mpeg.hh"
+#include "video_source.hh"
+#include "prefetch_video_input.hh"
+#include "frame_pool.hh"
+#include "perf_counters.hh"
 #include "protocol.hh"
 #include "vp9_encoder.hh"
+#include "viewport_predictor.hh"
 #include "timestamp.hh"
 
 using namespace std;
@@ -21,16 +27,35 @@ using namespace chrono;
 // global variables in an unnamed namespace
 namespace {
   constexpr unsigned int BILLION = 1000 * 1000 * 1000;
+
+  // viewport speed (pixels/s) above which its motion is predicted
+  constexpr double MIN_PREDICT_SPEED = 20.0;
+
+  // frame intervals without a viewport update after which it has stopped
+  constexpr unsigned int PREDICT_TIMEOUT_FRAMES = 4;
 }
 
 void print_usage(const string & program_name)
 {
   cerr <<
-  "Usage: " << program_name << " [options] port y4m\n\n"
+  "Usage: " << program_name << " [options] port input\n\n"
+  "Input:\n"
+  "<y4m>                      a y4m file\n"
+  "synthetic[:<options>]      procedurally generated frames, e.g.,\n"
+  "                           synthetic:complexity=0.8,scene=120\n\n"
   "Options:\n"
   "--mtu <MTU>                MTU for deciding UDP payload size\n"
   "-o, --output <file>        file to output performance results to\n"
-  "-v, --verbose              enable more logging for debugging"
+  "-v, --verbose              enable more logging for debugging\n"
+  "--buffer <size>            number of raw frames to read ahead (default: 8)\n"
+  "--hugetlb                  back raw frames with reserved huge pages instead\n"
+  "                           of transparent huge pages\n"
+  "--pan-time <ms>            glide to a new viewport over this duration with\n"
+  "                           subpixel steps instead of jumping (default: 0)\n"
+  "--predict                  while the viewport moves, encode an enlarged crop\n"
+  "                           covering where it is predicted to be on display\n"
+  "--predict-margin <frac>    extra size of a predicted crop as a fraction of\n"
+  "                           the viewport (default: 0.1)"
   << endl;
 }
 
@@ -72,13 +97,21 @@ int main(int argc, char * argv[])
   // argument parsing
   string output_path;
   bool verbose = false;
-  int raw_img_buffer_size = 60;
+  int prefetch_size = 8;
+  auto huge_pages = FramePool::HugePages::TRANSPARENT;
+  unsigned int pan_time_ms = 0;
+  bool predict = false;
+  double predict_margin = 0.1;
 
   const option cmd_line_opts[] = {
     {"mtu",     required_argument, nullptr, 'M'},
     {"output",  required_argument, nullptr, 'o'},
     {"verbose", no_argument,       nullptr, 'v'},
     {"buffer",  required_argument, nullptr, 'B'},
+    {"hugetlb", no_argument,       nullptr, 'H'},
+    {"pan-time", required_argument, nullptr, 'P'},
+    {"predict", no_argument,       nullptr, 'R'},
+    {"predict-margin", required_argument, nullptr, 'm'},
     { nullptr,  0,                 nullptr,  0 },
   };
 
@@ -99,7 +132,19 @@ int main(int argc, char * argv[])
         verbose = true;
         break;
       case 'B':
-        raw_img_buffer_size = strict_stoi(optarg);
+        prefetch_size = strict_stoi(optarg);
+        break;
+      case 'H':
+        huge_pages = FramePool::HugePages::EXPLICIT;
+        break;
+      case 'P':
+        pan_time_ms = strict_stoi(optarg);
+        break;
+      case 'R':
+        predict = true;
+        break;
+      case 'm':
+        predict_margin = stod(optarg);
         break;
       default:
         print_usage(argv[0]);
@@ -114,7 +159,7 @@ int main(int argc, char * argv[])
 
   const auto video_port = narrow_cast<uint16_t>(strict_stoi(argv[optind]));
   const auto signal_port = narrow_cast<uint16_t>(video_port + 1);
-  const string y4m_path = argv[optind + 1];
+  const string input_spec = argv[optind + 1];
   UDPSocket video_sock;
   video_sock.bind({"0", video_port});
   cerr << "Local address: " << video_sock.local_address().str() << endl;
@@ -147,31 +192,36 @@ int main(int argc, char * argv[])
   signal_sock.set_blocking(false);
 
   // open the video file
-  YUV4MPEG video_input(y4m_path, init_width, init_height);
-
-  // allocate a raw image
-  // float viewpoint_x = 2048.0;
-  float viewpoint_x = init_width / 2;
-  float viewpoint_y = init_height / 2;
-  const auto crop_width = init_width / 2;
-  const auto crop_height = init_height / 2;
-
-  // initialize the raw image buffer implemented 
-  vector<CroppedImage*> raw_img_buffer;
-  raw_img_buffer.resize(raw_img_buffer_size);
-  for (int i = 0; i < raw_img_buffer_size; i++) {
-    raw_img_buffer[i] = new CroppedImage(init_width, init_height, crop_width, crop_height);
-  }
-  // read the raw video frames into the buffer
-  for (int i = 0; i < raw_img_buffer_size; i++) {
-    if (not video_input.read_frame(raw_img_buffer[i]->get_frame())) {
-      throw runtime_error("Faile to fill the raw frame buffer");
-    }
-  }
-  int frame_idx = 0;
-  cerr << "Raw frame buffer filled" << endl;
-
-  // CroppedImage crop_img(init_width, init_height, crop_width, crop_height);
+  // count page faults and dTLB misses (before any thread is created)
+  PerfCounters perf_counters;
+
+  // open the video input and read frames ahead in the background
+  PrefetchVideoInput video_input(
+    open_video_input(input_spec, init_width, init_height, init_frame_rate),
+    prefetch_size, huge_pages);
+  uint64_t last_underruns = 0;
+
+  // the encoder always receives crops of crop_width x crop_height
+  const uint16_t crop_width = init_width / 2;
+  const uint16_t crop_height = init_height / 2;
+
+  // viewport: window size in the full frame, and its current center, which
+  // glides from pan_start to pan_target after a viewport change
+  uint16_t window_width = crop_width;
+  uint16_t window_height = crop_height;
+  double viewpoint_x = init_width / 2.0;
+  double viewpoint_y = init_height / 2.0;
+  pair<double, double> pan_start {viewpoint_x, viewpoint_y};
+  pair<double, double> pan_target {viewpoint_x, viewpoint_y};
+  uint64_t pan_start_ts = 0;
+
+  // predicts the viewport motion from the requested viewports (which a
+  // moving client sends once per frame)
+  ViewportPredictor predictor(0.6, 0.2,
+                              PREDICT_TIMEOUT_FRAMES * BILLION / 1000 / init_frame_rate);
+
+  // crops (without copying whenever possible) the viewport out of raw frames
+  ImageCropper cropper(crop_width, crop_height);
 
   // initialize the encoder
   Encoder encoder(crop_width, crop_height, init_frame_rate, output_path);
@@ -194,31 +244,89 @@ int main(int argc, char * argv[])
         cerr << "Warning: skipping " << num_exp - 1 << " raw frames" << endl;
       }
 
+      // signal the skipped frames as repeats of the last one, so that frame
+      // IDs keep counting source frames (e.g., for recordings to stay aligned)
+      for (unsigned int i = 1; i < num_exp; i++) {
+        encoder.repeat_frame();
+      }
+
+      // borrow the last of the prefetched raw frames without copying
+      const RawImage * raw_img = nullptr;
       for (unsigned int i = 0; i < num_exp; i++) {
+        if (raw_img) {
+          video_input.release_frame();
+        }
+
+        raw_img = video_input.acquire_frame();
+        if (not raw_img) {
+          throw runtime_error("Reached the end of video input");
+        }
+      }
+
+      // glide towards the latest requested viewport
+      bool panning = false;
+      if (pan_time_ms > 0 and pan_start_ts > 0) {
+        const double progress = min(
+          (timestamp_us() - pan_start_ts) / (pan_time_ms * 1000.0), 1.0);
+        viewpoint_x = pan_start.first + (pan_target.first - pan_start.first) * progress;
+        viewpoint_y = pan_start.second + (pan_target.second - pan_start.second) * progress;
+        panning = progress < 1.0;
+      }
+
+      // encode the viewport, or while it moves (and prediction is enabled),
+      // an enlarged window that also covers where the viewport is predicted
+      // to be when the frame is displayed, i.e., about one RTT from now
+      // (viewport requests arrive half an RTT late and frames take another
+      // half to arrive); the receiver crops its viewport out of it
+      double encode_x = viewpoint_x;
+      double encode_y = viewpoint_y;
+      uint16_t encode_width = window_width;
+      uint16_t encode_height = window_height;
+
+      const uint64_t now = timestamp_us();
+      if (predict and predictor.moving(MIN_PREDICT_SPEED, now)) {
+        const uint64_t horizon_us = encoder.ewma_rtt_us().value_or(0)
+                                    + BILLION / 1000 / init_frame_rate;
+        const auto [predicted_x, predicted_y] = predictor.predict(now, horizon_us);
+
+        const double enlarged_width = window_width * (1 + predict_margin)
+                                      + abs(predicted_x - viewpoint_x);
+        const double enlarged_height = window_height * (1 + predict_margin)
+                                       + abs(predicted_y - viewpoint_y);
+
+        // keep the window within the frame and its dimensions even
+        encode_width = narrow_cast<uint16_t>(
+          min(lround(enlarged_width), static_cast<long>(init_width)) & ~1L);
+        encode_height = narrow_cast<uint16_t>(
+          min(lround(enlarged_height), static_cast<long>(init_height)) & ~1L);
+        encode_x = (viewpoint_x + predicted_x) / 2;
+        encode_y = (viewpoint_y + predicted_y) / 2;
+      }
+
+      // resample at subpixel positions; otherwise crop without copying
+      const bool subpixel = panning or encode_x != floor(encode_x)
+                            or encode_y != floor(encode_y);
+
+      const auto ts_before_cropping = timestamp_us();
+      const RawImage & cropped_img = cropper.crop(
+        *raw_img, encode_x, encode_y,
+        encode_width, encode_height, subpixel);
 
-        // // debug
-        // auto ts_before_reading = timestamp_us();   
-        // // fetch a raw frame into 'raw_img' from the video input
-        // if (not video_input.read_frame(crop_img.get_frame())) {
-        //   throw runtime_error("Reached the end of video input");
-        // }
-        // auto ts_after_reading = timestamp_us();
-        // cerr << "Reading time: " << ts_after_reading - ts_before_reading << endl;
-
-        // creat a reference to the raw frame in the buffer
-        frame_idx = (frame_idx + 1) % raw_img_buffer_size;
+      if (verbose) {
+        cerr << "Cropping time (us): " << timestamp_us() - ts_before_cropping << endl;
       }
 
-      // debug
-      auto ts_before_cropping = timestamp_us();      
- 
-      raw_img_buffer[frame_idx]->crop(viewpoint_x, viewpoint_y, crop_width, crop_height);
-      
-      auto ts_after_cropping = timestamp_us();
-      cerr << "Cropping time: " << ts_after_cropping - ts_before_cropping << endl;
+      // tell the receiver which region of the frame was actually encoded
+      const auto [origin_x, origin_y] = cropper.crop_origin();
+      encoder.set_crop_window(CropWindow(origin_x + encode_width / 2.0,
+                                         origin_y + encode_height / 2.0,
+                                         encode_width, encode_height));
 
-      // compress 'raw_img' into frame 'frame_id' and packetize it
-      encoder.compress_frame(raw_img_buffer[frame_idx]->get_cropped_frame());
+      // compress 'cropped_img' into frame 'frame_id' and packetize it
+      encoder.compress_frame(cropped_img);
+
+      // the crop might be a view into the raw frame, so hold on until here
+      video_input.release_frame();
 
       // interested in socket being writable if there are datagrams to send
       if (not encoder.send_buf().empty()) {
@@ -314,6 +422,14 @@ int main(int argc, char * argv[])
       }
       // output stats every second
       encoder.output_periodic_stats();
+      perf_counters.output_periodic_stats();
+
+      const uint64_t underruns = video_input.num_underruns();
+      if (underruns > last_underruns) {
+        cerr << "Warning: raw frames not ready in time "
+             << underruns - last_underruns << " times" << endl;
+        last_underruns = underruns;
+      }
     }
   );
 
@@ -324,18 +440,71 @@ int main(int argc, char * argv[])
       while (true) {
         const auto & raw_data = signal_sock.recv();
         if (not raw_data) { // EWOULDBLOCK; try again when data is available
-        cerr << "Unknown message type received on RTCP port." << endl;
           break;
         }
+        const uint64_t recv_ts = timestamp_us();
         const shared_ptr<Msg> sig_msg = Msg::parse_from_string(*raw_data);
 
+        // ignore invalid messages
+        if (sig_msg == nullptr) {
+          return;
+        }
+
+        // answer clock synchronization requests right away
+        if (sig_msg->type == Msg::Type::CLOCK) {
+          const auto clock = dynamic_pointer_cast<ClockMsg>(sig_msg);
+          if (not clock->is_reply()) {
+            signal_sock.send(clock->make_reply(recv_ts).serialize_to_string());
+          }
+          continue;
+        }
+
         // handle the signal message
-       if (sig_msg->type == Msg::Type::SIGNAL) {
+        if (sig_msg->type == Msg::Type::SIGNAL) {
           const auto signal = dynamic_pointer_cast<SignalMsg>(sig_msg);
-          viewpoint_x = signal->target_bitrate;
-          viewpoint_y = viewpoint_x / 2;
+
+          cerr << "Received signal: bitrate=" << signal->target_bitrate
+               << endl;
+
+          // update the encoder's configuration
+          encoder.set_target_bitrate(signal->target_bitrate);
+        }
+        else if (sig_msg->type == Msg::Type::VIEWPORT) {
+          const auto viewport = dynamic_pointer_cast<ViewportMsg>(sig_msg);
+
+          if (viewport->width == 0 or viewport->height == 0 or
+              viewport->width > init_width or viewport->height > init_height) {
+            cerr << "Ignored invalid viewport: " << viewport->width << "x"
+                 << viewport->height << endl;
+            return;
+          }
+
+          if (verbose) {
+            cerr << "Received viewport: center=(" << viewport->center_x()
+                 << ", " << viewport->center_y() << ") size="
+                 << viewport->width << "x" << viewport->height << endl;
+          }
+
+          // a resized viewport or a jump over a window restarts prediction
+          if (viewport->width != window_width or viewport->height != window_height
+              or abs(viewport->center_x() - pan_target.first) > window_width
+              or abs(viewport->center_y() - pan_target.second) > window_height) {
+            predictor.reset();
+          }
+          predictor.update(timestamp_us(), viewport->center_x(), viewport->center_y());
+
+          window_width = viewport->width;
+          window_height = viewport->height;
+          pan_start = {viewpoint_x, viewpoint_y};
+          pan_target = {viewport->center_x(), viewport->center_y()};
+          pan_start_ts = timestamp_us();
+
+          // jump right away unless gliding
+          if (pan_time_ms == 0) {
+            viewpoint_x = pan_target.first;
+            viewpoint_y = pan_target.second;
+          }
         }
-        // ignore invalid messages
         return;
       }
     }
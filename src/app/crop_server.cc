@@ -0,0 +1,563 @@
+#include <getopt.h>
+#include <iostream>
+#include <string>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include <map>
+#include <optional>
+#include <cmath>
+#include <algorithm>
+
+#include "conversion.hh"
+#include "timerfd.hh"
+#include "udp_socket.hh"
+#include "poller.hh"
+#include "mmap_yuv4mpeg.hh"
+#include "thread_pool.hh"
+#include "protocol.hh"
+#include "vp9_encoder.hh"
+#include "timestamp.hh"
+
+using namespace std;
+
+// global variables in an unnamed namespace
+namespace {
+  constexpr unsigned int BILLION = 1000 * 1000 * 1000;
+
+  // an encoder uses at most this many threads when the cores are not shared
+  constexpr unsigned int MAX_ENCODER_THREADS = 4;
+}
+
+void print_usage(const string & program_name)
+{
+  cerr <<
+  "Usage: " << program_name << " [options] port y4m width height\n\n"
+  "Serves independent viewport crops of one video to multiple viewers.\n\n"
+  "Options:\n"
+  "--mtu <MTU>                MTU for deciding UDP payload size\n"
+  "-o, --output <file>        file prefix to output performance results to\n"
+  "                           (one file per viewer: <file>.<viewer ID>)\n"
+  "-v, --verbose              enable more logging for debugging\n"
+  "--fps <FPS>                frame rate of every viewer (default: 30)\n"
+  "--threads <num>            crop/encode worker threads (default: #CPUs)\n"
+  "--timeout <sec>            drop a viewer silent for this long (default: 5)"
+  << endl;
+}
+
+// per-viewer pipeline: crops its own viewport out of the shared raw frames
+// and owns an independent encoder with its own bitrate and retransmissions
+struct Viewer
+{
+  unsigned int id;
+  Address video_addr;
+  std::optional<Address> signal_addr {};
+
+  ImageCropper cropper;
+  Encoder encoder;
+
+  // viewport: window size in the full frame and its center
+  uint16_t window_width;
+  uint16_t window_height;
+  double viewpoint_x;
+  double viewpoint_y;
+
+  uint64_t last_heard_ts; // last time any message arrived from the viewer
+
+  Viewer(const unsigned int _id, const Address & _video_addr,
+         const uint16_t frame_width, const uint16_t frame_height,
+         const uint16_t frame_rate, const string & output_path)
+    : id(_id), video_addr(_video_addr),
+      cropper(frame_width / 2, frame_height / 2),
+      encoder(frame_width / 2, frame_height / 2, frame_rate, output_path),
+      window_width(frame_width / 2), window_height(frame_height / 2),
+      viewpoint_x(frame_width / 2.0), viewpoint_y(frame_height / 2.0),
+      last_heard_ts(timestamp_us())
+  {}
+};
+
+// apply a SIGNAL or VIEWPORT message to a viewer
+void handle_signal(Viewer & viewer, const shared_ptr<Msg> & msg,
+                   const uint16_t frame_width, const uint16_t frame_height,
+                   const bool verbose)
+{
+  viewer.last_heard_ts = timestamp_us();
+
+  if (msg->type == Msg::Type::SIGNAL) {
+    const auto signal = dynamic_pointer_cast<SignalMsg>(msg);
+
+    cerr << "Viewer " << viewer.id << ": received signal: bitrate="
+         << signal->target_bitrate << endl;
+
+    viewer.encoder.set_target_bitrate(signal->target_bitrate);
+  }
+  else if (msg->type == Msg::Type::VIEWPORT) {
+    const auto viewport = dynamic_pointer_cast<ViewportMsg>(msg);
+
+    if (viewport->width == 0 or viewport->height == 0 or
+        viewport->width > frame_width or viewport->height > frame_height) {
+      cerr << "Viewer " << viewer.id << ": ignored invalid viewport: "
+           << viewport->width << "x" << viewport->height << endl;
+      return;
+    }
+
+    if (verbose) {
+      cerr << "Viewer " << viewer.id << ": received viewport: center=("
+           << viewport->center_x() << ", " << viewport->center_y()
+           << ") size=" << viewport->width << "x" << viewport->height << endl;
+    }
+
+    viewer.window_width = viewport->width;
+    viewer.window_height = viewport->height;
+    viewer.viewpoint_x = viewport->center_x();
+    viewer.viewpoint_y = viewport->center_y();
+  }
+}
+
+int main(int argc, char * argv[])
+{
+  // argument parsing
+  string output_path;
+  bool verbose = false;
+  uint16_t frame_rate = 30;
+  size_t num_threads = 0;
+  unsigned int timeout_s = 5;
+
+  const option cmd_line_opts[] = {
+    {"mtu",     required_argument, nullptr, 'M'},
+    {"output",  required_argument, nullptr, 'o'},
+    {"verbose", no_argument,       nullptr, 'v'},
+    {"fps",     required_argument, nullptr, 'F'},
+    {"threads", required_argument, nullptr, 'T'},
+    {"timeout", required_argument, nullptr, 't'},
+    { nullptr,  0,                 nullptr,  0 },
+  };
+
+  while (true) {
+    const int opt = getopt_long(argc, argv, "o:v", cmd_line_opts, nullptr);
+    if (opt == -1) {
+      break;
+    }
+
+    switch (opt) {
+      case 'M':
+        FrameDatagram::set_mtu(strict_stoi(optarg));
+        break;
+      case 'o':
+        output_path = optarg;
+        break;
+      case 'v':
+        verbose = true;
+        break;
+      case 'F':
+        frame_rate = narrow_cast<uint16_t>(strict_stoi(optarg));
+        break;
+      case 'T':
+        num_threads = narrow_cast<size_t>(strict_stoi(optarg));
+        break;
+      case 't':
+        timeout_s = narrow_cast<unsigned int>(strict_stoi(optarg));
+        break;
+      default:
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+
+  if (optind != argc - 4) {
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  if (frame_rate == 0) {
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  const auto video_port = narrow_cast<uint16_t>(strict_stoi(argv[optind]));
+  const auto signal_port = narrow_cast<uint16_t>(video_port + 1);
+  const string y4m_path = argv[optind + 1];
+  const auto frame_width = narrow_cast<uint16_t>(strict_stoi(argv[optind + 2]));
+  const auto frame_height = narrow_cast<uint16_t>(strict_stoi(argv[optind + 3]));
+
+  // both sockets remain unconnected and are shared by all viewers
+  UDPSocket video_sock;
+  video_sock.bind({"0", video_port});
+  cerr << "Local address: " << video_sock.local_address().str() << endl;
+  UDPSocket signal_sock;
+  signal_sock.bind({"0", signal_port});
+  cerr << "Local address: " << signal_sock.local_address().str() << endl;
+  video_sock.set_blocking(false);
+  signal_sock.set_blocking(false);
+
+  // map the video file into memory, shared by all viewers; the viewers only
+  // crop (read) the mapped frames so they never get copied
+  MMapYUV4MPEG video_input(y4m_path, frame_width, frame_height);
+  const RawImage * raw_img = video_input.next_frame();
+  cerr << "Mapped " << video_input.num_frames() << " raw frames" << endl;
+
+  // viewers keyed by their video address, and by their signal address once
+  // the latter is known
+  map<string, unique_ptr<Viewer>> viewers;
+  map<string, Viewer *> signal_viewers;
+  unsigned int next_viewer_id = 0;
+
+  // crop and encode the viewers in parallel
+  ThreadPool pool(num_threads);
+  cerr << "Crop/encode worker threads: " << pool.size() << endl;
+
+  // split the cores among the encoders of all viewers
+  const auto rebalance_threads = [&]()
+  {
+    if (viewers.empty()) {
+      return;
+    }
+
+    const unsigned int threads = clamp(
+      static_cast<unsigned int>(pool.size() / viewers.size()),
+      1u, MAX_ENCODER_THREADS);
+
+    for (auto & [key, viewer] : viewers) {
+      viewer->encoder.set_threads(threads);
+    }
+  };
+
+  // stats of crop + encode time per frame interval across all viewers
+  unsigned int num_ticks = 0;
+  double total_tick_ms = 0.0;
+  double max_tick_ms = 0.0;
+
+  Poller poller;
+
+  // a new viewer is admitted upon receiving its ConfigMsg
+  const auto add_viewer = [&](const Address & addr, const ConfigMsg & config)
+  {
+    if (config.width != frame_width or config.height != frame_height) {
+      cerr << "Rejected viewer " << addr.str() << ": requested "
+           << config.width << "x" << config.height << " but serving "
+           << frame_width << "x" << frame_height << endl;
+      return;
+    }
+
+    if (config.frame_rate != frame_rate) {
+      cerr << "Warning: viewer " << addr.str() << " requested FPS="
+           << config.frame_rate << " but serving FPS=" << frame_rate << endl;
+    }
+
+    const unsigned int id = next_viewer_id++;
+    const string viewer_output_path = output_path.empty() ?
+                                      "" : output_path + "." + to_string(id);
+
+    auto viewer = make_unique<Viewer>(id, addr, frame_width, frame_height,
+                                      frame_rate, viewer_output_path);
+    viewer->encoder.set_target_bitrate(config.target_bitrate);
+    viewer->encoder.set_verbose(verbose);
+
+    cerr << "Viewer " << id << " joined: video address=" << addr.str()
+         << " bitrate=" << config.target_bitrate << endl;
+
+    viewers.emplace(addr.str(), move(viewer));
+    rebalance_threads();
+  };
+
+  // create a periodic timer with the same period as the frame interval
+  Timerfd fps_timer;
+  const timespec frame_interval {0, static_cast<long>(BILLION / frame_rate)}; // {sec, nsec}
+  fps_timer.set_time(frame_interval, frame_interval); // {initial expiration, interval}
+
+  // crop and encode a frame for every viewer when the periodic timer fires
+  poller.register_event(fps_timer, Poller::In,
+    [&]()
+    {
+      // being lenient: advance 'num_exp' frames and use the last one
+      const auto num_exp = fps_timer.read_expirations();
+      if (num_exp > 1) {
+        cerr << "Warning: skipping " << num_exp - 1 << " raw frames" << endl;
+      }
+
+      // signal the skipped frames as repeats of the last one, so that frame
+      // IDs keep counting source frames (e.g., for recordings to stay aligned)
+      for (unsigned int i = 1; i < num_exp; i++) {
+        for (auto & [key, viewer] : viewers) {
+          viewer->encoder.repeat_frame();
+        }
+      }
+      for (unsigned int i = 0; i < num_exp; i++) {
+        raw_img = video_input.next_frame();
+      }
+
+      if (viewers.empty()) {
+        return;
+      }
+
+      vector<Viewer *> active;
+      for (auto & [key, viewer] : viewers) {
+        active.emplace_back(viewer.get());
+      }
+
+      const auto ts_before = timestamp_us();
+
+      pool.parallel_for(active.size(),
+        [&](const size_t i)
+        {
+          Viewer & viewer = *active[i];
+
+          // resample at subpixel positions; otherwise crop without copying
+          const bool subpixel = viewer.viewpoint_x != floor(viewer.viewpoint_x)
+                                or viewer.viewpoint_y != floor(viewer.viewpoint_y);
+
+          const RawImage & cropped_img = viewer.cropper.crop(
+            *raw_img, viewer.viewpoint_x, viewer.viewpoint_y,
+            viewer.window_width, viewer.window_height, subpixel);
+
+          // tell the viewer which region of the frame was actually encoded
+          const auto [origin_x, origin_y] = viewer.cropper.crop_origin();
+          viewer.encoder.set_crop_window(CropWindow(
+            origin_x + viewer.window_width / 2.0,
+            origin_y + viewer.window_height / 2.0,
+            viewer.window_width, viewer.window_height));
+
+          viewer.encoder.compress_frame(cropped_img);
+        }
+      );
+
+      const double tick_ms = (timestamp_us() - ts_before) / 1000.0;
+      num_ticks++;
+      total_tick_ms += tick_ms;
+      max_tick_ms = max(max_tick_ms, tick_ms);
+
+      // interested in socket being writable if there are datagrams to send
+      poller.activate(video_sock, Poller::Out);
+    }
+  );
+
+  // when the video socket is writable
+  poller.register_event(video_sock, Poller::Out,
+    [&]()
+    {
+      bool all_sent = true;
+
+      for (auto & [key, viewer] : viewers) {
+        deque<FrameDatagram> & send_buf = viewer->encoder.send_buf();
+
+        while (not send_buf.empty()) {
+          auto & datagram = send_buf.front();
+
+          // timestamp the sending time before sending
+          datagram.send_ts = timestamp_us();
+
+          if (video_sock.sendto(viewer->video_addr,
+                                datagram.serialize_to_string())) {
+            if (verbose) {
+              cerr << "Viewer " << viewer->id << ": sent datagram: frame_id="
+                   << datagram.frame_id << " frag_id=" << datagram.frag_id
+                   << " frag_cnt=" << datagram.frag_cnt
+                   << " rtx=" << datagram.num_rtx << endl;
+            }
+
+            // move the sent datagram to unacked if not a retransmission
+            if (datagram.num_rtx == 0) {
+              viewer->encoder.add_unacked(move(datagram));
+            }
+
+            send_buf.pop_front();
+          } else { // EWOULDBLOCK; try again later
+            datagram.send_ts = 0; // since it wasn't sent successfully
+            all_sent = false;
+            break;
+          }
+        }
+
+        if (not all_sent) {
+          break;
+        }
+      }
+
+      // not interested in socket being writable if no datagrams to send
+      if (all_sent) {
+        poller.deactivate(video_sock, Poller::Out);
+      }
+    }
+  );
+
+  // when the video socket is readable
+  poller.register_event(video_sock, Poller::In,
+    [&]()
+    {
+      while (true) {
+        const auto & [peer_addr, raw_data] = video_sock.recvfrom();
+
+        if (not raw_data) { // EWOULDBLOCK; try again when data is available
+          break;
+        }
+
+        const shared_ptr<Msg> msg = Msg::parse_from_string(*raw_data);
+        if (msg == nullptr) {
+          continue;
+        }
+
+        const auto it = viewers.find(peer_addr.str());
+
+        if (it == viewers.end()) {
+          // only a ConfigMsg can come from an unknown address
+          if (msg->type == Msg::Type::CONFIG) {
+            add_viewer(peer_addr, *dynamic_pointer_cast<ConfigMsg>(msg));
+          }
+          continue;
+        }
+
+        Viewer & viewer = *it->second;
+
+        if (msg->type == Msg::Type::ACK) {
+          const auto ack = dynamic_pointer_cast<AckMsg>(msg);
+
+          if (verbose) {
+            cerr << "Viewer " << viewer.id << ": received ACK: frame_id="
+                 << ack->frame_id << " frag_id=" << ack->frag_id << endl;
+          }
+
+          viewer.last_heard_ts = timestamp_us();
+
+          // RTT estimation, retransmission, etc.
+          viewer.encoder.handle_ack(ack);
+
+          // send_buf might contain datagrams to be retransmitted now
+          if (not viewer.encoder.send_buf().empty()) {
+            poller.activate(video_sock, Poller::Out);
+          }
+        } else {
+          handle_signal(viewer, msg, frame_width, frame_height, verbose);
+        }
+      }
+    }
+  );
+
+  // when the signal socket is readable
+  poller.register_event(signal_sock, Poller::In,
+    [&]()
+    {
+      while (true) {
+        const auto & [peer_addr, raw_data] = signal_sock.recvfrom();
+
+        if (not raw_data) { // EWOULDBLOCK; try again when data is available
+          break;
+        }
+
+        const uint64_t recv_ts = timestamp_us();
+        const shared_ptr<Msg> msg = Msg::parse_from_string(*raw_data);
+
+        // answer clock synchronization requests right away (from any viewer)
+        if (msg != nullptr and msg->type == Msg::Type::CLOCK) {
+          const auto clock = dynamic_pointer_cast<ClockMsg>(msg);
+          if (not clock->is_reply()) {
+            signal_sock.sendto(peer_addr, clock->make_reply(recv_ts).serialize_to_string());
+          }
+          continue;
+        }
+
+        if (msg == nullptr or (msg->type != Msg::Type::SIGNAL and
+                               msg->type != Msg::Type::VIEWPORT)) {
+          cerr << "Unknown message type received on signal port." << endl;
+          continue;
+        }
+
+        auto it = signal_viewers.find(peer_addr.str());
+
+        if (it == signal_viewers.end()) {
+          // pair a new signal address with the earliest viewer from the same
+          // host whose signal address is still unknown
+          Viewer * match = nullptr;
+          for (auto & [key, viewer] : viewers) {
+            if (not viewer->signal_addr and
+                viewer->video_addr.ip() == peer_addr.ip() and
+                (match == nullptr or viewer->id < match->id)) {
+              match = viewer.get();
+            }
+          }
+
+          if (match == nullptr) {
+            cerr << "Ignored signal from unknown viewer " << peer_addr.str()
+                 << endl;
+            continue;
+          }
+
+          match->signal_addr = peer_addr;
+          it = signal_viewers.emplace(peer_addr.str(), match).first;
+          cerr << "Viewer " << match->id << ": signal address="
+               << peer_addr.str() << endl;
+        }
+
+        handle_signal(*it->second, msg, frame_width, frame_height, verbose);
+      }
+    }
+  );
+
+  // create a periodic timer for outputting stats every second
+  Timerfd stats_timer;
+  const timespec stats_interval {1, 0};
+  stats_timer.set_time(stats_interval, stats_interval);
+  poller.register_event(stats_timer, Poller::In,
+    [&]()
+    {
+      if (stats_timer.read_expirations() == 0) {
+        return;
+      }
+
+      // drop viewers that went silent
+      const uint64_t now = timestamp_us();
+      bool removed = false;
+
+      for (auto it = viewers.begin(); it != viewers.end(); ) {
+        Viewer & viewer = *it->second;
+
+        if (now - viewer.last_heard_ts > timeout_s * 1000000ULL) {
+          cerr << "Viewer " << viewer.id << " timed out" << endl;
+
+          if (viewer.signal_addr) {
+            signal_viewers.erase(viewer.signal_addr->str());
+          }
+          it = viewers.erase(it);
+          removed = true;
+        } else {
+          it++;
+        }
+      }
+
+      if (removed) {
+        rebalance_threads();
+      }
+
+      if (viewers.empty()) {
+        return;
+      }
+
+      // output stats every second
+      cerr << "Viewers: " << viewers.size();
+      if (num_ticks > 0) {
+        cerr << ", avg/max crop+encode time per frame (ms): "
+             << double_to_string(total_tick_ms / num_ticks)
+             << "/" << double_to_string(max_tick_ms);
+      }
+      cerr << endl;
+
+      num_ticks = 0;
+      total_tick_ms = 0.0;
+      max_tick_ms = 0.0;
+
+      for (auto & [key, viewer] : viewers) {
+        cerr << "[Viewer " << viewer->id << "]" << endl;
+        viewer->encoder.output_periodic_stats();
+      }
+    }
+  );
+
+  cerr << "Waiting for viewers..." << endl;
+
+  // main loop
+  while (true) {
+    poller.poll(-1);
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,241 @@
+#include <getopt.h>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cstring>
+#include <stdexcept>
+
+#include "event_log.hh"
+#include "file_descriptor.hh"
+#include "mmap.hh"
+#include "exception.hh"
+#include "conversion.hh"
+
+using namespace std;
+
+void print_usage(const string & program_name)
+{
+  cerr <<
+  "Usage: " << program_name << " [options] log\n\n"
+  "Convert an event log written by a sender or receiver (-o), or by\n"
+  "ringmaster_relay (--queue-log), to text.\n\n"
+  "Options:\n"
+  "-f, --format <format>   csv (default): one line per frame as the sender\n"
+  "                        and receiver used to output, i.e.,\n"
+  "                          encoder: timestamp_us,frame_id,target_bitrate,\n"
+  "                            frame_size,encode_time_ms,total_rtx,\n"
+  "                            total_recoveries,rtt_ms\n"
+  "                          decoder: timestamp_us,frame_id,frame_size,\n"
+  "                            decode_time_ms,total_datagrams\n"
+  "                        plot: frame_id,frame_size,timestamp_us,time_ms\n"
+  "                          (encode or decode time) for src/plot/plot.py\n"
+  "                        latency: per-frame time (ms) spent in each stage\n"
+  "                          from capture to display (receiver logs only),\n"
+  "                          and the stage that took the longest\n"
+  "                        queue: one line per packet entering a link of\n"
+  "                          ringmaster_relay (--queue-log), i.e.,\n"
+  "                          timestamp_us,link,direction,size,queued_bytes,\n"
+  "                            queue_delay_ms,delay_ms,verdict\n"
+  "                        speed: one line per change of the sender's\n"
+  "                          speed control (--speed-control), i.e.,\n"
+  "                          timestamp_us,frame_id,cpu_used,frame_divisor,\n"
+  "                            prev_cpu_used,prev_frame_divisor,\n"
+  "                            p99_encode_ms,budget_ms\n"
+  "-o, --output <file>     file to output to (default: stdout)"
+  << endl;
+}
+
+void output_csv(ostream & out, const EventRecord & r)
+{
+  switch (r.type) {
+    case EventRecord::Type::FRAME_ENCODED:
+      out << r.timestamp_us << "," << r.frame_id << "," << r.u[0] << ","
+          << r.u[1] << "," << to_string(r.d[0]) << "," << r.u[2] << ","
+          << r.u[3] << "," << double_to_string(r.d[1]) << "\n";
+      break;
+    case EventRecord::Type::FRAME_DECODED:
+      out << r.timestamp_us << "," << r.frame_id << "," << r.u[0] << ","
+          << to_string(r.d[0]) << "," << r.u[1] << "\n";
+      break;
+    default:
+      break; // skip other events (e.g., FRAME_LATENCY)
+  }
+}
+
+void output_latency_header(ostream & out)
+{
+  out << "frame_id,capture_ts_us,frame_size";
+  for (const char * name : EventRecord::STAGE_INTERVALS) {
+    out << "," << name << "_ms";
+  }
+  out << ",total_ms,clock_offset_ms,slowest_stage\n";
+}
+
+void output_latency(ostream & out, const EventRecord & r)
+{
+  if (r.type != EventRecord::Type::FRAME_LATENCY) {
+    return;
+  }
+
+  out << r.frame_id << "," << r.timestamp_us << "," << static_cast<uint64_t>(r.d[1]);
+
+  // a stage not reached (a frame not displayed) is left empty
+  int32_t prev = 0;
+  double max_ms = -1;
+  const char * slowest = "";
+
+  for (size_t i = 0; i < EventRecord::NUM_STAGES; i++) {
+    const int32_t curr = r.stage(static_cast<EventRecord::Stage>(i));
+    if (curr == EventRecord::NO_STAGE) {
+      out << ",";
+      continue;
+    }
+
+    const double ms = (curr - prev) / 1000.0;
+    out << "," << double_to_string(ms, 3);
+    if (ms > max_ms) {
+      max_ms = ms;
+      slowest = EventRecord::STAGE_INTERVALS[i];
+    }
+    prev = curr;
+  }
+
+  out << "," << double_to_string(prev / 1000.0, 3) << ","
+      << double_to_string(r.d[0] / 1000.0, 3) << "," << slowest << "\n";
+}
+
+// indexed by LinkModel::Verdict
+const char * const VERDICT_NAMES[] = {"delivered", "lost", "overflowed", "aqm_dropped"};
+
+void output_queue(ostream & out, const EventRecord & r)
+{
+  if (r.type != EventRecord::Type::LINK_PACKET) {
+    return;
+  }
+
+  const size_t num_verdicts = sizeof(VERDICT_NAMES) / sizeof(VERDICT_NAMES[0]);
+  out << r.timestamp_us << "," << r.frame_id << ","
+      << (r.u[3] == 0 ? "to_client" : "to_server") << "," << r.u[1] << ","
+      << r.u[0] << "," << double_to_string(r.d[0], 3) << ","
+      << double_to_string(r.d[1], 3) << ","
+      << (r.u[2] < num_verdicts ? VERDICT_NAMES[r.u[2]] : "unknown") << "\n";
+}
+
+void output_speed(ostream & out, const EventRecord & r)
+{
+  if (r.type != EventRecord::Type::SPEED_CHANGE) {
+    return;
+  }
+
+  // cpu-used is signed
+  out << r.timestamp_us << "," << r.frame_id << "," << static_cast<int64_t>(r.u[0])
+      << "," << r.u[1] << "," << static_cast<int64_t>(r.u[2]) << "," << r.u[3]
+      << "," << double_to_string(r.d[0], 3) << "," << double_to_string(r.d[1], 3) << "\n";
+}
+
+void output_plot(ostream & out, const EventRecord & r)
+{
+  if (r.type == EventRecord::Type::FRAME_ENCODED) {
+    out << r.frame_id << "," << r.u[1] << "," << r.timestamp_us << ","
+        << to_string(r.d[0]) << "\n";
+  } else if (r.type == EventRecord::Type::FRAME_DECODED) {
+    out << r.frame_id << "," << r.u[0] << "," << r.timestamp_us << ","
+        << to_string(r.d[0]) << "\n";
+  }
+}
+
+int main(int argc, char * argv[])
+{
+  string format = "csv";
+  string output_path;
+
+  const option cmd_line_opts[] = {
+    {"format", required_argument, nullptr, 'f'},
+    {"output", required_argument, nullptr, 'o'},
+    { nullptr, 0,                 nullptr,  0 },
+  };
+
+  while (true) {
+    const int opt = getopt_long(argc, argv, "f:o:", cmd_line_opts, nullptr);
+    if (opt == -1) {
+      break;
+    }
+
+    switch (opt) {
+      case 'f':
+        format = optarg;
+        break;
+      case 'o':
+        output_path = optarg;
+        break;
+      default:
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+
+  if (optind != argc - 1 or
+      (format != "csv" and format != "plot" and format != "latency"
+       and format != "queue" and format != "speed")) {
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  FileDescriptor fd(check_syscall(open(argv[optind], O_RDONLY)));
+  const size_t file_size = fd.file_size();
+  if (file_size < sizeof(EventLogHeader)) {
+    throw runtime_error("not an event log: " + string(argv[optind]));
+  }
+
+  MMap log(file_size, PROT_READ, MAP_PRIVATE, fd.fd_num(), 0);
+  log.advise(MADV_SEQUENTIAL);
+
+  EventLogHeader header;
+  memcpy(&header, log.addr(), sizeof(header));
+  if (not header.valid()) {
+    throw runtime_error("not an event log (or of another version): "
+                        + string(argv[optind]));
+  }
+
+  ofstream output_file;
+  if (not output_path.empty()) {
+    output_file.open(output_path);
+    if (not output_file) {
+      throw runtime_error("failed to open " + output_path);
+    }
+  }
+  ostream & output = output_path.empty() ? cout : output_file;
+
+  // a record cut short (e.g., by a crash) is ignored
+  const size_t num_records = (file_size - sizeof(header)) / sizeof(EventRecord);
+  const uint8_t * records = log.addr() + sizeof(header);
+
+  if (format == "latency") {
+    output_latency_header(output);
+  } else if (format == "queue") {
+    output << "timestamp_us,link,direction,size,queued_bytes,queue_delay_ms,"
+              "delay_ms,verdict\n";
+  } else if (format == "speed") {
+    output << "timestamp_us,frame_id,cpu_used,frame_divisor,prev_cpu_used,"
+              "prev_frame_divisor,p99_encode_ms,budget_ms\n";
+  }
+
+  for (size_t i = 0; i < num_records; i++) {
+    EventRecord record;
+    memcpy(&record, records + i * sizeof(EventRecord), sizeof(record));
+
+    if (format == "csv") {
+      output_csv(output, record);
+    } else if (format == "plot") {
+      output_plot(output, record);
+    } else if (format == "queue") {
+      output_queue(output, record);
+    } else if (format == "speed") {
+      output_speed(output, record);
+    } else {
+      output_latency(output, record);
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -1,4 +1,7 @@
 #include <stdexcept>
+#include <algorithm>
+#include <cmath>
+
 #include "protocol.hh"
 #include "serialization.hh"
 
@@ -6,6 +9,21 @@
 
 using namespace std;
 
+CropWindow::CropWindow(const double _x, const double _y,
+                       const uint16_t _width, const uint16_t _height)
+  : x(static_cast<uint32_t>(lround(max(_x, 0.0) * SUBPIXEL_SCALE))),
+    y(static_cast<uint32_t>(lround(max(_y, 0.0) * SUBPIXEL_SCALE))),
+    width(_width), height(_height)
+{}
+
+bool CropWindow::contains(const CropWindow & other, const double tolerance) const
+{
+  return center_x() - width / 2.0 <= other.center_x() - other.width / 2.0 + tolerance
+     and center_x() + width / 2.0 >= other.center_x() + other.width / 2.0 - tolerance
+     and center_y() - height / 2.0 <= other.center_y() - other.height / 2.0 + tolerance
+     and center_y() + height / 2.0 >= other.center_y() + other.height / 2.0 - tolerance;
+}
+
 BaseDatagram::BaseDatagram(const uint32_t _frame_id,
                            const FrameType _frame_type,
                            const uint16_t _frag_id,
@@ -92,14 +110,17 @@ FrameDatagram::FrameDatagram(const uint32_t _frame_id,
     frame_width(_frame_width), frame_height(_frame_height)
 {}
 
-size_t FrameDatagram::max_payload = 1500 - 28 - FrameDatagram::HEADER_SIZE; // 28: IP + UDP headers
+// reserve room for the header extensions in every fragment for simplicity
+size_t FrameDatagram::max_payload = 1500 - 28 - FrameDatagram::HEADER_SIZE
+                                    - FrameDatagram::MAX_EXTENSION_SIZE; // 28: IP + UDP headers
 
 void FrameDatagram::set_mtu(const size_t mtu)
 {
   // if (mtu > 1500 or mtu < 512) {
   //   throw runtime_error("reasonable MTU is between 512 and 1500 bytes");
   // }
-  max_payload = mtu - 28 - FrameDatagram::HEADER_SIZE; // MTU - (IP + UDP headers) - Datagram header
+  max_payload = mtu - 28 - FrameDatagram::HEADER_SIZE
+                - FrameDatagram::MAX_EXTENSION_SIZE; // MTU - (IP + UDP headers) - Datagram header
 }
 
 bool FrameDatagram::parse_from_string(const string & binary)
@@ -110,12 +131,47 @@ bool FrameDatagram::parse_from_string(const string & binary)
 
   WireParser parser(binary);
   frame_id = parser.read_uint32();
-  frame_type = static_cast<FrameType>(parser.read_uint8());
+  const uint8_t type_and_flags = parser.read_uint8();
+  frame_type = static_cast<FrameType>(type_and_flags & FRAME_TYPE_MASK);
   frag_id = parser.read_uint16();
   frag_cnt = parser.read_uint16();
   frame_width = parser.read_uint16();
   frame_height = parser.read_uint16();
   send_ts = parser.read_uint64();
+
+  // header extensions
+  const size_t extension_size =
+    (type_and_flags & CROP_WINDOW_FLAG ? CropWindow::SIZE : 0)
+    + (type_and_flags & CAPTURE_TS_FLAG ? sizeof(uint64_t) : 0)
+    + (type_and_flags & ENCODE_TIMING_FLAG ? EncodeTiming::SIZE : 0)
+    + (type_and_flags & CLOCK_OFFSET_FLAG ? sizeof(int64_t) : 0);
+
+  if (binary.size() < HEADER_SIZE + extension_size) {
+    return false;
+  }
+
+  if (type_and_flags & CROP_WINDOW_FLAG) {
+    crop_window.emplace();
+    crop_window->x = parser.read_uint32();
+    crop_window->y = parser.read_uint32();
+    crop_window->width = parser.read_uint16();
+    crop_window->height = parser.read_uint16();
+  }
+
+  if (type_and_flags & CAPTURE_TS_FLAG) {
+    capture_ts = parser.read_uint64();
+  }
+
+  if (type_and_flags & ENCODE_TIMING_FLAG) {
+    encode_timing.emplace();
+    encode_timing->start_ts = send_ts - parser.read_uint32();
+    encode_timing->end_ts = send_ts - parser.read_uint32();
+  }
+
+  if (type_and_flags & CLOCK_OFFSET_FLAG) {
+    clock_offset_us = static_cast<int64_t>(parser.read_uint64());
+  }
+
   payload = parser.read_string();
 
   return true;
@@ -124,15 +180,52 @@ bool FrameDatagram::parse_from_string(const string & binary)
 string FrameDatagram::serialize_to_string() const
 {
   string binary;
-  binary.reserve(HEADER_SIZE + payload.size());
+  binary.reserve(HEADER_SIZE + MAX_EXTENSION_SIZE + payload.size());
+
+  uint8_t type_and_flags = static_cast<uint8_t>(frame_type);
+  if (crop_window) {
+    type_and_flags |= CROP_WINDOW_FLAG;
+  }
+  if (capture_ts) {
+    type_and_flags |= CAPTURE_TS_FLAG;
+  }
+  if (encode_timing) {
+    type_and_flags |= ENCODE_TIMING_FLAG;
+  }
+  if (clock_offset_us) {
+    type_and_flags |= CLOCK_OFFSET_FLAG;
+  }
 
   binary += put_number(frame_id);
-  binary += put_number(static_cast<uint8_t>(frame_type));
+  binary += put_number(type_and_flags);
   binary += put_number(frag_id);
   binary += put_number(frag_cnt);
   binary += put_number(frame_width);
   binary += put_number(frame_height);
   binary += put_number(send_ts);
+
+  // header extensions
+  if (crop_window) {
+    binary += put_number(crop_window->x);
+    binary += put_number(crop_window->y);
+    binary += put_number(crop_window->width);
+    binary += put_number(crop_window->height);
+  }
+  if (capture_ts) {
+    binary += put_number(*capture_ts);
+  }
+  if (encode_timing) {
+    // offsets from send_ts, which is stamped (again) right before sending
+    const auto before_send = [this](const uint64_t ts) {
+      return static_cast<uint32_t>(min<uint64_t>(send_ts - min(ts, send_ts), UINT32_MAX));
+    };
+    binary += put_number(before_send(encode_timing->start_ts));
+    binary += put_number(before_send(encode_timing->end_ts));
+  }
+  if (clock_offset_us) {
+    binary += put_number(static_cast<uint64_t>(*clock_offset_us));
+  }
+
   binary += payload;
 
   return binary;
@@ -165,6 +258,9 @@ shared_ptr<Msg> Msg::parse_from_string(const string & binary)
     ret->frame_id = parser.read_uint32();
     ret->frag_id = parser.read_uint16();
     ret->send_ts = parser.read_uint64();
+    if (binary.size() >= ret->serialized_size()) { // absent from older receivers
+      ret->recv_ts = parser.read_uint64();
+    }
     return ret;
   }
   else if (type == Type::CONFIG) {
@@ -180,6 +276,22 @@ shared_ptr<Msg> Msg::parse_from_string(const string & binary)
     ret->target_bitrate = parser.read_uint32();
     return ret;
   }
+  else if (type == Type::VIEWPORT) {
+    auto ret = make_shared<ViewportMsg>();
+    ret->x = parser.read_uint32();
+    ret->y = parser.read_uint32();
+    ret->width = parser.read_uint16();
+    ret->height = parser.read_uint16();
+    ret->timestamp_us = parser.read_uint64();
+    return ret;
+  }
+  else if (type == Type::CLOCK) {
+    auto ret = make_shared<ClockMsg>();
+    ret->origin_ts = parser.read_uint64();
+    ret->receive_ts = parser.read_uint64();
+    ret->transmit_ts = parser.read_uint64();
+    return ret;
+  }
   else {
     return nullptr;
   }
@@ -187,13 +299,13 @@ shared_ptr<Msg> Msg::parse_from_string(const string & binary)
 
 AckMsg::AckMsg(const BaseDatagram & datagram)
   : Msg(Type::ACK), frame_id(datagram.frame_id), frag_id(datagram.frag_id),
-    send_ts(datagram.send_ts)
+    send_ts(datagram.send_ts), recv_ts(datagram.recv_ts)
 {}
 
 size_t AckMsg::serialized_size() const
 {
   return Msg::serialized_size() + sizeof(uint16_t) + sizeof(uint32_t)
-         + sizeof(uint64_t);
+         + 2 * sizeof(uint64_t);
 }
 
 string AckMsg::serialize_to_string() const
@@ -205,6 +317,7 @@ string AckMsg::serialize_to_string() const
   binary += put_number(frame_id);
   binary += put_number(frag_id);
   binary += put_number(send_ts);
+  binary += put_number(recv_ts);
 
   return binary;
 }
@@ -257,3 +370,65 @@ string SignalMsg::serialize_to_string() const
 
   return binary;
 }
+
+// message for the viewport to crop
+ViewportMsg::ViewportMsg(const double _x, const double _y,
+                         const uint16_t _width, const uint16_t _height,
+                         const uint64_t _timestamp_us)
+  : Msg(Type::VIEWPORT),
+    x(static_cast<uint32_t>(lround(max(_x, 0.0) * SUBPIXEL_SCALE))),
+    y(static_cast<uint32_t>(lround(max(_y, 0.0) * SUBPIXEL_SCALE))),
+    width(_width), height(_height), timestamp_us(_timestamp_us)
+{}
+
+size_t ViewportMsg::serialized_size() const
+{
+  return Msg::serialized_size() + 2 * sizeof(uint32_t)
+         + 2 * sizeof(uint16_t) + sizeof(uint64_t);
+}
+
+string ViewportMsg::serialize_to_string() const
+{
+  string binary;
+  binary.reserve(serialized_size());
+
+  binary += Msg::serialize_to_string();
+  binary += put_number(x);
+  binary += put_number(y);
+  binary += put_number(width);
+  binary += put_number(height);
+  binary += put_number(timestamp_us);
+
+  return binary;
+}
+
+// message for clock synchronization
+ClockMsg::ClockMsg(const uint64_t _origin_ts)
+  : Msg(Type::CLOCK), origin_ts(_origin_ts)
+{}
+
+ClockMsg ClockMsg::make_reply(const uint64_t recv_ts) const
+{
+  ClockMsg reply(origin_ts);
+  reply.receive_ts = recv_ts;
+  reply.transmit_ts = timestamp_us();
+  return reply;
+}
+
+size_t ClockMsg::serialized_size() const
+{
+  return Msg::serialized_size() + 3 * sizeof(uint64_t);
+}
+
+string ClockMsg::serialize_to_string() const
+{
+  string binary;
+  binary.reserve(serialized_size());
+
+  binary += Msg::serialize_to_string();
+  binary += put_number(origin_ts);
+  binary += put_number(receive_ts);
+  binary += put_number(transmit_ts);
+
+  return binary;
+}
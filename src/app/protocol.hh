@@ -4,11 +4,47 @@
 #include <string>
 #include <memory>
 #include <utility> 
+#include <optional>
 
 enum class FrameType : uint8_t { 
   UNKNOWN = 0, // unknown
   KEY = 1,     // key frame
   NONKEY = 2,  // non-key frame
+  REPEAT = 3,  // no payload: repeat the previous frame (unchanged content)
+};
+
+// region of the full (uncropped) frame that a frame was encoded from
+struct CropWindow
+{
+  CropWindow() {}
+  CropWindow(const double _x, const double _y,
+             const uint16_t _width, const uint16_t _height);
+
+  // center of the window in units of 1/SUBPIXEL_SCALE pixels
+  uint32_t x {};
+  uint32_t y {};
+  uint16_t width {};
+  uint16_t height {};
+
+  static constexpr unsigned int SUBPIXEL_SCALE = 16;
+  static const size_t SIZE = 2 * sizeof(uint32_t) + 2 * sizeof(uint16_t);
+
+  // center of the window in pixels
+  double center_x() const { return static_cast<double>(x) / SUBPIXEL_SCALE; }
+  double center_y() const { return static_cast<double>(y) / SUBPIXEL_SCALE; }
+
+  // if the window entirely contains 'other', give or take 'tolerance' pixels
+  bool contains(const CropWindow & other, const double tolerance = 0.5) const;
+};
+
+// when a frame was encoded (sender's clock, in us)
+struct EncodeTiming
+{
+  uint64_t start_ts {};
+  uint64_t end_ts {};
+
+  // sent as two 32-bit offsets before the datagram's send_ts
+  static const size_t SIZE = 2 * sizeof(uint32_t);
 };
 
 // (frame_id, frag_id)
@@ -31,6 +67,7 @@ struct BaseDatagram
   uint16_t frag_id {};    
   uint16_t frag_cnt {};  
   uint64_t send_ts {};
+  uint64_t recv_ts {}; // set by the receiver on arrival (not serialized)
 
   std::string payload {}; 
 
@@ -60,7 +97,24 @@ struct FrameDatagram : public BaseDatagram
   static const size_t HEADER_SIZE  = sizeof(uint32_t) + 
     sizeof(FrameType) + 4 * sizeof(uint16_t) + sizeof(uint64_t);
 
-  
+  // optional header extensions, present only on the first fragment and
+  // flagged in the upper bits of the frame type byte
+  std::optional<CropWindow> crop_window {};
+  std::optional<uint64_t> capture_ts {}; // when the frame was captured (us)
+  std::optional<EncodeTiming> encode_timing {};
+
+  // the sender's estimate of the receiver's clock minus its own (us), for
+  // aligning the sender's timestamps above with the receiver's
+  std::optional<int64_t> clock_offset_us {};
+
+  static constexpr uint8_t FRAME_TYPE_MASK = 0x0F;
+  static constexpr uint8_t CROP_WINDOW_FLAG = 0x80;
+  static constexpr uint8_t CAPTURE_TS_FLAG = 0x40;
+  static constexpr uint8_t ENCODE_TIMING_FLAG = 0x20;
+  static constexpr uint8_t CLOCK_OFFSET_FLAG = 0x10;
+  static const size_t MAX_EXTENSION_SIZE = CropWindow::SIZE + sizeof(uint64_t)
+                                           + EncodeTiming::SIZE + sizeof(int64_t);
+
   static void set_mtu(const size_t mtu);
   static size_t max_payload;
 
@@ -103,7 +157,9 @@ struct Msg
     INVALID = 0, 
     ACK = 1,     
     CONFIG = 2,
-    SIGNAL = 3  
+    SIGNAL = 3,
+    VIEWPORT = 4,
+    CLOCK = 5
   };
 
   Type type {Type::INVALID};
@@ -128,6 +184,7 @@ struct AckMsg : Msg
   uint32_t frame_id {}; 
   uint16_t frag_id {};  
   uint64_t send_ts {};  
+  uint64_t recv_ts {}; // receiver's clock when the datagram arrived (0: unknown)
 
   size_t serialized_size() const override; 
   std::string serialize_to_string() const override;
@@ -159,4 +216,49 @@ struct SignalMsg : Msg
   std::string serialize_to_string() const override;
 };
 
+// viewport requested by the receiver, in pixels of the full (uncropped) frame
+struct ViewportMsg : Msg
+{
+  ViewportMsg() : Msg(Type::VIEWPORT) {}
+  ViewportMsg(const double _x, const double _y,
+              const uint16_t _width, const uint16_t _height,
+              const uint64_t _timestamp_us);
+
+  // center of the viewport in units of 1/SUBPIXEL_SCALE pixels
+  uint32_t x {};
+  uint32_t y {};
+  uint16_t width {};
+  uint16_t height {};
+  uint64_t timestamp_us {}; // when the viewport was requested
+
+  static constexpr unsigned int SUBPIXEL_SCALE = CropWindow::SUBPIXEL_SCALE;
+
+  // center of the viewport in pixels
+  double center_x() const { return static_cast<double>(x) / SUBPIXEL_SCALE; }
+  double center_y() const { return static_cast<double>(y) / SUBPIXEL_SCALE; }
+
+  size_t serialized_size() const override;
+  std::string serialize_to_string() const override;
+};
+
+// an NTP-style clock synchronization request (from the receiver) or reply
+// (from the sender) on the signal socket; each host stamps its own clock
+struct ClockMsg : Msg
+{
+  ClockMsg() : Msg(Type::CLOCK) {}
+  ClockMsg(const uint64_t _origin_ts); // a request
+
+  uint64_t origin_ts {};   // request sent (requester's clock)
+  uint64_t receive_ts {};  // request received (replier's clock; 0 in a request)
+  uint64_t transmit_ts {}; // reply sent (replier's clock; 0 in a request)
+
+  bool is_reply() const { return transmit_ts != 0; }
+
+  // the reply to this request, received at 'recv_ts' and sent now
+  ClockMsg make_reply(const uint64_t recv_ts) const;
+
+  size_t serialized_size() const override;
+  std::string serialize_to_string() const override;
+};
+
 #endif /* PROTOCOL_HH */
@@ -0,0 +1,521 @@
+#include <getopt.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <array>
+#include <memory>
+#include <random>
+#include <atomic>
+#include <thread>
+#include <stdexcept>
+#include <functional>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+
+#include "conversion.hh"
+#include "split.hh"
+#include "exception.hh"
+#include "timestamp.hh"
+#include "udp_socket.hh"
+#include "event_log.hh"
+#include "latency_histogram.hh"
+#include "video_source.hh"
+#include "protocol.hh"
+#include "vp9_encoder.hh"
+#include "vp9_decoder.hh"
+
+using namespace std;
+using namespace std::chrono;
+
+// count the allocations made through operator new (e.g., datagrams, frames
+// and their strings; not libvpx's own mallocs)
+namespace {
+  atomic<uint64_t> num_allocations {0};
+}
+
+void * operator new(size_t size)
+{
+  num_allocations.fetch_add(1, memory_order_relaxed);
+
+  void * ptr = malloc(size > 0 ? size : 1);
+  if (not ptr) {
+    throw bad_alloc();
+  }
+  return ptr;
+}
+
+void operator delete(void * ptr) noexcept
+{
+  free(ptr);
+}
+
+void operator delete(void * ptr, size_t) noexcept
+{
+  free(ptr);
+}
+
+void print_usage(const string & program_name)
+{
+  cerr <<
+  "Usage: " << program_name << " [options] width height input\n\n"
+  "Benchmark the whole pipeline from input to decoded frame in one process:\n"
+  "an Encoder and a Decoder (decoding but not displaying) joined by an\n"
+  "in-memory transport (or UDP over loopback), processing frames as fast as\n"
+  "possible (or at --fps with --realtime). The options taking a\n"
+  "comma-separated list are swept over, one run after another, and a CSV\n"
+  "line is output for each run with:\n"
+  "  - the throughput (frames and Mbps per second of wall time)\n"
+  "  - the p50 and p99 time spent in each stage of a frame (see\n"
+  "    event_log_dump -f latency; queue is reading the input), and in total\n"
+  "    from reading the input to decoded\n"
+  "  - CPU time (all threads) and C++ heap allocations per frame\n\n"
+  "Options:\n"
+  "--fps <fps>                frame rate the encoder targets (default: 30)\n"
+  "-n, --frames <n>           frames to encode per run (default: 300)\n"
+  "-b, --bitrate <kbps,...>   target bitrates (default: 1000)\n"
+  "--tiles <log2,...>         log2 of the column tiles (default: 2)\n"
+  "-l, --loss <rate,...>      random loss rates in each direction (default: 0)\n"
+  "--encoder-threads <n>      threads per encoder (default: 4)\n"
+  "--loopback                 send datagrams over UDP on 127.0.0.1\n"
+  "--realtime                 encode a frame every frame interval\n"
+  "--mtu <MTU>                MTU for deciding UDP payload size\n"
+  "-s, --seed <n>             seed of the random losses (default: 1)\n"
+  "--log-dir <dir>            keep the event logs of each run in <dir>\n"
+  "-o, --output <file>        file to output CSV to (default: stdout)\n"
+  "-v, --verbose              keep the encoder's and decoder's logs"
+  << endl;
+}
+
+// options shared by all the runs
+struct BenchOptions
+{
+  uint16_t width {0};
+  uint16_t height {0};
+  string input {};
+  uint16_t frame_rate {30};
+  unsigned int num_frames {300};
+  unsigned int encoder_threads {4};
+  bool loopback {false};
+  bool realtime {false};
+  uint32_t seed {1};
+};
+
+// parameters swept over
+struct BenchParams
+{
+  unsigned int bitrate_kbps {1000};
+  unsigned int log2_tiles {2};
+  double loss {0};
+
+  string str() const
+  {
+    return "bitrate=" + to_string(bitrate_kbps) + " tiles=" + to_string(1 << log2_tiles)
+           + " loss=" + double_to_string(loss, 4);
+  }
+};
+
+// stages of a frame until decoded (frames are not displayed)
+constexpr size_t NUM_STAGES = EventRecord::DISPLAY;
+
+struct BenchResult
+{
+  uint64_t frames_encoded {0};
+  uint64_t frames_decoded {0};
+  uint64_t bytes_received {0};
+  uint64_t datagrams_sent {0};
+  uint64_t datagrams_rtx {0};
+  uint64_t datagrams_lost {0};
+  double wall_s {0};
+  double cpu_s {0};
+  uint64_t allocations {0};
+  array<LatencyPercentiles, NUM_STAGES> stages {};
+  LatencyPercentiles total {}; // until decoded
+  string error {};
+};
+
+// user plus system time of all the threads so far (s)
+double cpu_seconds()
+{
+  rusage usage {};
+  check_syscall(getrusage(RUSAGE_SELF, &usage));
+
+  const auto seconds = [](const timeval & tv) { return tv.tv_sec + tv.tv_usec / 1e6; };
+  return seconds(usage.ru_utime) + seconds(usage.ru_stime);
+}
+
+// carries datagrams between the sender and the receiver, either in memory
+// or through a pair of UDP sockets connected to each other over loopback
+class Transport
+{
+public:
+  Transport(const bool loopback, const double loss, const uint32_t seed)
+    : loopback_(loopback), loss_(loss), rng_(seed)
+  {
+    if (loopback_) {
+      sender_sock_.bind({"127.0.0.1", 0});
+      receiver_sock_.bind({"127.0.0.1", 0});
+      sender_sock_.connect(receiver_sock_.local_address());
+      receiver_sock_.connect(sender_sock_.local_address());
+    }
+  }
+
+  // deliver 'data' to the other end (toward the receiver unless 'ack');
+  // nullopt if lost
+  optional<string> transmit(string && data, const bool ack)
+  {
+    if (loss_ > 0 and loss_dist_(rng_) < loss_) {
+      return nullopt;
+    }
+
+    if (not loopback_) {
+      return move(data);
+    }
+
+    // one datagram at a time, so the socket buffers never overflow
+    UDPSocket & from = ack ? receiver_sock_ : sender_sock_;
+    UDPSocket & to = ack ? sender_sock_ : receiver_sock_;
+    from.send(data);
+    return to.recv();
+  }
+
+private:
+  bool loopback_;
+  double loss_;
+  mt19937 rng_;
+  uniform_real_distribution<double> loss_dist_ {0.0, 1.0};
+  UDPSocket sender_sock_ {};
+  UDPSocket receiver_sock_ {};
+};
+
+// run a benchmark on the calling thread, with the decoder logging into
+// 'log_path' (to read the latency of each frame back from)
+BenchResult bench(const BenchOptions & options, const BenchParams & params,
+                  const string & log_path)
+{
+  BenchResult result;
+
+  unique_ptr<VideoInput> video_input = open_video_input(
+    options.input, options.width, options.height, options.frame_rate);
+  RawImage raw_img(options.width, options.height);
+
+  Encoder encoder(options.width, options.height, options.frame_rate);
+  encoder.set_threads(options.encoder_threads);
+  encoder.set_tile_columns(params.log2_tiles);
+  encoder.set_target_bitrate(params.bitrate_kbps);
+
+  auto decoder = make_unique<Decoder>(options.width, options.height,
+                                      Decoder::DECODE_ONLY, log_path);
+  decoder->set_sender_clock_offset(0); // same clock
+
+  Transport transport(options.loopback, params.loss, options.seed);
+
+  // a datagram arriving at the receiver, and its ACK at the sender
+  const auto receive_datagram = [&](const string & raw_data) {
+    FrameDatagram datagram;
+    if (not datagram.parse_from_string(raw_data)) {
+      throw runtime_error("failed to parse a datagram");
+    }
+    datagram.recv_ts = timestamp_us();
+    result.bytes_received += raw_data.size();
+
+    auto ack = transport.transmit(AckMsg(datagram).serialize_to_string(), true);
+
+    decoder->add_datagram(move(datagram));
+    while (decoder->next_frame_complete()) {
+      decoder->consume_next_frame();
+    }
+
+    if (ack) {
+      const shared_ptr<Msg> msg = Msg::parse_from_string(*ack);
+      if (msg == nullptr or msg->type != Msg::Type::ACK) {
+        throw runtime_error("failed to parse an ACK");
+      }
+      encoder.handle_ack(dynamic_pointer_cast<AckMsg>(msg));
+    }
+  };
+
+  // send until no datagrams (including retransmissions) are left to send
+  const auto send_datagrams = [&]() {
+    deque<FrameDatagram> & send_buf = encoder.send_buf();
+
+    while (not send_buf.empty()) {
+      FrameDatagram datagram = move(send_buf.front());
+      send_buf.pop_front();
+      datagram.send_ts = timestamp_us();
+
+      auto raw_data = transport.transmit(datagram.serialize_to_string(), false);
+
+      result.datagrams_sent++;
+      if (datagram.num_rtx == 0) {
+        encoder.add_unacked(move(datagram));
+      } else {
+        result.datagrams_rtx++;
+      }
+
+      if (raw_data) {
+        receive_datagram(*raw_data);
+      } else {
+        result.datagrams_lost++;
+      }
+    }
+  };
+
+  const uint64_t allocations_start = num_allocations.load(memory_order_relaxed);
+  const double cpu_start = cpu_seconds();
+  const auto wall_start = steady_clock::now();
+  const auto frame_interval = microseconds(1000 * 1000 / options.frame_rate);
+
+  for (unsigned int i = 0; i < options.num_frames; i++) {
+    if (options.realtime) {
+      this_thread::sleep_until(wall_start + i * frame_interval);
+    }
+
+    // the time spent reading the input counts as queuing
+    const uint64_t capture_ts = timestamp_us();
+    if (not video_input->read_frame(raw_img)) {
+      break; // reached the end of the input
+    }
+
+    encoder.compress_frame(raw_img, capture_ts);
+    result.frames_encoded++;
+
+    send_datagrams();
+  }
+
+  // wait for the decoder to finish the frames queued to it
+  decoder.reset();
+
+  result.wall_s = duration<double>(steady_clock::now() - wall_start).count();
+  result.cpu_s = cpu_seconds() - cpu_start;
+  result.allocations = num_allocations.load(memory_order_relaxed) - allocations_start;
+
+  // time spent in each stage by each decoded frame
+  array<LatencyHistogram, NUM_STAGES> stages;
+  LatencyHistogram total;
+
+  for (const EventRecord & record : EventLog::read(log_path)) {
+    if (record.type != EventRecord::Type::FRAME_LATENCY) {
+      continue;
+    }
+    result.frames_decoded++;
+
+    int32_t prev = 0;
+    for (size_t i = 0; i < NUM_STAGES; i++) {
+      const int32_t curr = record.stage(static_cast<EventRecord::Stage>(i));
+      if (curr == EventRecord::NO_STAGE) {
+        continue;
+      }
+      stages[i].record(max(curr - prev, 0));
+      prev = curr;
+    }
+    total.record(max(prev, 0));
+  }
+
+  for (size_t i = 0; i < NUM_STAGES; i++) {
+    result.stages[i] = stages[i].percentiles();
+  }
+  result.total = total.percentiles();
+
+  return result;
+}
+
+template <typename T>
+vector<T> parse_list(const string & str, const function<T(const string &)> & parse)
+{
+  vector<T> values;
+  for (const auto & token : split(str, ",")) {
+    values.emplace_back(parse(token));
+  }
+  if (values.empty()) {
+    throw runtime_error("Empty list: " + str);
+  }
+  return values;
+}
+
+int main(int argc, char * argv[])
+{
+  BenchOptions options;
+  vector<unsigned int> bitrates {1000};
+  vector<unsigned int> tiles {2};
+  vector<double> losses {0};
+  string log_dir;
+  string output_path;
+  bool verbose = false;
+
+  const auto to_uint = [](const string & s) { return static_cast<unsigned int>(strict_stoi(s)); };
+  const auto to_double = [](const string & s) { return stod(s); };
+
+  const option cmd_line_opts[] = {
+    {"fps",             required_argument, nullptr, 'F'},
+    {"frames",          required_argument, nullptr, 'n'},
+    {"bitrate",         required_argument, nullptr, 'b'},
+    {"tiles",           required_argument, nullptr, 't'},
+    {"loss",            required_argument, nullptr, 'l'},
+    {"encoder-threads", required_argument, nullptr, 'E'},
+    {"loopback",        no_argument,       nullptr, 'U'},
+    {"realtime",        no_argument,       nullptr, 'R'},
+    {"mtu",             required_argument, nullptr, 'M'},
+    {"seed",            required_argument, nullptr, 's'},
+    {"log-dir",         required_argument, nullptr, 'L'},
+    {"output",          required_argument, nullptr, 'o'},
+    {"verbose",         no_argument,       nullptr, 'v'},
+    { nullptr,          0,                 nullptr,  0 },
+  };
+
+  while (true) {
+    const int opt = getopt_long(argc, argv, "n:b:l:s:o:v", cmd_line_opts, nullptr);
+    if (opt == -1) {
+      break;
+    }
+
+    switch (opt) {
+      case 'F':
+        options.frame_rate = narrow_cast<uint16_t>(strict_stoi(optarg));
+        break;
+      case 'n':
+        options.num_frames = strict_stoi(optarg);
+        break;
+      case 'b':
+        bitrates = parse_list<unsigned int>(optarg, to_uint);
+        break;
+      case 't':
+        tiles = parse_list<unsigned int>(optarg, to_uint);
+        break;
+      case 'l':
+        losses = parse_list<double>(optarg, to_double);
+        break;
+      case 'E':
+        options.encoder_threads = strict_stoi(optarg);
+        break;
+      case 'U':
+        options.loopback = true;
+        break;
+      case 'R':
+        options.realtime = true;
+        break;
+      case 'M':
+        FrameDatagram::set_mtu(strict_stoi(optarg));
+        break;
+      case 's':
+        options.seed = strict_stoi(optarg);
+        break;
+      case 'L':
+        log_dir = optarg;
+        break;
+      case 'o':
+        output_path = optarg;
+        break;
+      case 'v':
+        verbose = true;
+        break;
+      default:
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+
+  if (optind != argc - 3) {
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  options.width = narrow_cast<uint16_t>(strict_stoi(argv[optind]));
+  options.height = narrow_cast<uint16_t>(strict_stoi(argv[optind + 1]));
+  options.input = argv[optind + 2];
+
+  if (options.frame_rate == 0 or options.num_frames == 0) {
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  if (is_live_video_input(options.input)) {
+    cerr << "Live inputs cannot be benchmarked" << endl;
+    return EXIT_FAILURE;
+  }
+
+  // every combination of the swept parameters
+  vector<BenchParams> runs;
+  for (const auto bitrate : bitrates) {
+    for (const auto log2_tiles : tiles) {
+      for (const auto loss : losses) {
+        runs.push_back({bitrate, log2_tiles, loss});
+      }
+    }
+  }
+
+  // the encoder and decoder log to cerr; progress goes to clog (sharing
+  // cerr's buffer but not its state)
+  if (not verbose) {
+    cerr.setstate(ios::failbit);
+  }
+
+  vector<BenchResult> results(runs.size());
+  for (size_t i = 0; i < runs.size(); i++) {
+    const string log_path = log_dir.empty()
+      ? "/tmp/ringmaster_bench." + to_string(getpid()) + ".log"
+      : log_dir + "/run" + to_string(i) + ".receiver.log";
+
+    try {
+      results[i] = bench(options, runs[i], log_path);
+    } catch (const exception & e) {
+      results[i].error = e.what();
+    }
+
+    if (log_dir.empty()) {
+      unlink(log_path.c_str());
+    }
+
+    const auto & r = results[i];
+    clog << "[" << i + 1 << "/" << runs.size() << "] " << runs[i].str() << ": "
+         << (r.error.empty() ? double_to_string(r.frames_encoded / max(r.wall_s, 1e-9))
+                               + " fps, latency " + r.total.str()
+                             : r.error) << endl;
+  }
+
+  ofstream output_file;
+  if (not output_path.empty()) {
+    output_file.open(output_path);
+    if (not output_file) {
+      throw runtime_error("Failed to open " + output_path);
+    }
+  }
+  ostream & out = output_path.empty() ? cout : output_file;
+
+  out << "width,height,bitrate_kbps,tiles,loss,transport,frames_encoded,"
+         "frames_decoded,fps,recv_mbps,datagrams_sent,datagrams_rtx,datagrams_lost";
+  for (size_t i = 0; i < NUM_STAGES; i++) {
+    const string name = EventRecord::STAGE_INTERVALS[i];
+    out << "," << name << "_p50_ms," << name << "_p99_ms";
+  }
+  out << ",total_p50_ms,total_p99_ms,cpu_ms_per_frame,allocs_per_frame,wall_s,error\n";
+
+  for (size_t i = 0; i < runs.size(); i++) {
+    const auto & p = runs[i];
+    const auto & r = results[i];
+    const auto ms = [](const uint64_t us) { return double_to_string(us / 1000.0, 3); };
+    const double frames = max<uint64_t>(r.frames_encoded, 1);
+    const double wall_s = max(r.wall_s, 1e-9);
+
+    out << options.width << "," << options.height << "," << p.bitrate_kbps << ","
+        << (1 << p.log2_tiles) << "," << double_to_string(p.loss, 4) << ","
+        << (options.loopback ? "loopback" : "memory") << ","
+        << r.frames_encoded << "," << r.frames_decoded << ","
+        << double_to_string(r.frames_encoded / wall_s) << ","
+        << double_to_string(r.bytes_received * 8 / wall_s / 1e6) << ","
+        << r.datagrams_sent << "," << r.datagrams_rtx << "," << r.datagrams_lost;
+    for (const auto & stage : r.stages) {
+      out << "," << ms(stage.p50) << "," << ms(stage.p99);
+    }
+    out << "," << ms(r.total.p50) << "," << ms(r.total.p99) << ","
+        << double_to_string(r.cpu_s * 1000 / frames, 3) << ","
+        << double_to_string(r.allocations / frames) << ","
+        << double_to_string(r.wall_s) << ","
+        << (r.error.empty() ? "" : "\"" + r.error + "\"") << "\n";
+  }
+
+  return EXIT_SUCCESS;
+}
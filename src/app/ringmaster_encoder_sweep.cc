@@ -0,0 +1,459 @@
+extern "C" {
+#include <vpx/vpx_decoder.h>
+#include <vpx/vp8dx.h>
+}
+
+#include <getopt.h>
+#include <sys/sysinfo.h>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <functional>
+#include <algorithm>
+
+#include "conversion.hh"
+#include "split.hh"
+#include "exception.hh"
+#include "timestamp.hh"
+#include "latency_histogram.hh"
+#include "video_source.hh"
+#include "image_scaler.hh"
+#include "quality.hh"
+#include "protocol.hh"
+#include "vp9_encoder.hh"
+
+using namespace std;
+
+void print_usage(const string & program_name)
+{
+  cerr <<
+  "Usage: " << program_name << " [options] width height input\n\n"
+  "Encode 'input' (a y4m file or synthetic[:<options>] of width x height)\n"
+  "with every combination of the encoder settings below, one after another,\n"
+  "and output a CSV line for each with the encoding speed (fps and p50/p99\n"
+  "time per frame), the bitrate achieved against the target, and the PSNR\n"
+  "of the decoded frames. Finally, recommend the settings that meet the\n"
+  "frame deadline (p99) at the highest resolution with the best PSNR.\n\n"
+  "Options:\n"
+  "--fps <fps>                frame rate (default: 30)\n"
+  "-n, --frames <n>           frames to encode per run (default: 300)\n"
+  "-b, --bitrate <kbps>       target bitrate (default: 1000)\n"
+  "--deadline <ms>            frame deadline (default: the frame interval)\n"
+  "--resolutions <WxH,...>    resolutions to scale the input to (default: its own)\n"
+  "-c, --cpu-used <n,...>     VP8E_SET_CPUUSED values (default: 5,7,9)\n"
+  "-t, --threads <n,...>      encoder threads (default: 1,4)\n"
+  "--tiles <log2,...>         log2 of the column tiles (default: 2)\n"
+  "--row-mt <0|1,...>         row-based multi-threading (default: 1)\n"
+  "--aq-mode <n,...>          adaptive quantization modes (default: 3)\n"
+  "--no-psnr                  skip decoding and scoring the frames\n"
+  "-o, --output <file>        file to output CSV to (default: stdout)\n"
+  "-v, --verbose              keep the encoder's logs"
+  << endl;
+}
+
+struct Resolution
+{
+  uint16_t width {0};
+  uint16_t height {0};
+
+  string str() const { return to_string(width) + "x" + to_string(height); }
+};
+
+// encoder settings swept over
+struct SweepParams
+{
+  Resolution resolution {};
+  int cpu_used {0};
+  unsigned int threads {0};
+  unsigned int log2_tiles {0};
+  bool row_mt {false};
+  unsigned int aq_mode {0};
+
+  string str() const
+  {
+    return resolution.str() + " cpu-used=" + to_string(cpu_used)
+           + " threads=" + to_string(threads) + " tiles=" + to_string(1 << log2_tiles)
+           + " row-mt=" + to_string(row_mt) + " aq-mode=" + to_string(aq_mode);
+  }
+};
+
+struct SweepResult
+{
+  uint64_t frames {0};
+  double encode_s {0};
+  LatencyPercentiles encode_time {}; // per frame (us)
+  uint64_t bytes {0};
+  optional<double> psnr {}; // mean over the decoded frames
+  string error {};
+
+  double fps() const { return encode_s > 0 ? frames / encode_s : 0; }
+};
+
+// decodes the frames an Encoder outputs, to score them against its input
+class VerifyingDecoder
+{
+public:
+  VerifyingDecoder()
+  {
+    vpx_codec_dec_cfg_t cfg {};
+    check_call(vpx_codec_dec_init(&context_, &vpx_codec_vp9_dx_algo, &cfg, 0),
+               VPX_CODEC_OK, "vpx_codec_dec_init");
+  }
+
+  ~VerifyingDecoder()
+  {
+    if (vpx_codec_destroy(&context_) != VPX_CODEC_OK) {
+      cerr << "Failed to destroy the verifying decoder" << endl;
+    }
+  }
+
+  // decode the payload of a frame; nullptr if no frame came out
+  vpx_image * decode(const string & frame)
+  {
+    check_call(vpx_codec_decode(&context_, reinterpret_cast<const uint8_t *>(frame.data()),
+                                frame.size(), nullptr, 0),
+               VPX_CODEC_OK, "vpx_codec_decode");
+
+    vpx_codec_iter_t iter = nullptr;
+    return vpx_codec_get_frame(&context_, &iter);
+  }
+
+  // forbid copying and moving
+  VerifyingDecoder(const VerifyingDecoder & other) = delete;
+  const VerifyingDecoder & operator=(const VerifyingDecoder & other) = delete;
+
+private:
+  vpx_codec_ctx_t context_ {};
+};
+
+SweepResult sweep(const string & input, const Resolution & source,
+                  const uint16_t frame_rate, const unsigned int num_frames,
+                  const unsigned int bitrate_kbps, const bool psnr,
+                  const SweepParams & params)
+{
+  SweepResult result;
+
+  unique_ptr<VideoInput> video_input = open_video_input(
+    input, source.width, source.height, frame_rate);
+  RawImage source_img(source.width, source.height);
+
+  // the input scaled to the resolution encoded, if different
+  const Resolution & resolution = params.resolution;
+  const bool scaled = resolution.width != source.width or resolution.height != source.height;
+  unique_ptr<RawImage> scaled_img;
+  if (scaled) {
+    scaled_img = make_unique<RawImage>(resolution.width, resolution.height);
+  }
+  const RawImage & encoded_img = scaled ? *scaled_img : source_img;
+
+  Encoder encoder(resolution.width, resolution.height, frame_rate);
+  encoder.set_target_bitrate(bitrate_kbps);
+  encoder.set_threads(params.threads);
+  encoder.set_tile_columns(params.log2_tiles);
+  encoder.set_row_mt(params.row_mt);
+  encoder.set_aq_mode(params.aq_mode);
+  encoder.set_cpu_used(params.cpu_used);
+
+  unique_ptr<VerifyingDecoder> decoder;
+  unique_ptr<QualityScorer> scorer;
+  if (psnr) {
+    decoder = make_unique<VerifyingDecoder>();
+    scorer = make_unique<QualityScorer>(nullptr, false);
+  }
+
+  LatencyHistogram encode_time;
+  double total_psnr = 0;
+  unsigned int num_scored = 0;
+  string frame;
+
+  for (unsigned int i = 0; i < num_frames; i++) {
+    if (not video_input->read_frame(source_img)) {
+      break; // reached the end of the input
+    }
+    if (scaled) {
+      scale_image(source_img, 0, 0, source.width, source.height, *scaled_img);
+    }
+
+    // encoding and packetizing (negligible in comparison)
+    const uint64_t start_ts = timestamp_us();
+    encoder.compress_frame(encoded_img);
+    const uint64_t elapsed_us = timestamp_us() - start_ts;
+
+    encode_time.record(elapsed_us);
+    result.encode_s += elapsed_us / 1e6;
+    result.frames++;
+
+    // reassemble the frame from its datagrams, which are never sent
+    frame.clear();
+    for (const auto & datagram : encoder.send_buf()) {
+      frame += datagram.payload;
+    }
+    encoder.send_buf().clear();
+    result.bytes += frame.size();
+
+    if (decoder and not frame.empty()) {
+      vpx_image * decoded = decoder->decode(frame);
+      if (decoded) {
+        total_psnr += scorer->score(encoded_img, RawImage(decoded)).psnr;
+        num_scored++;
+      }
+    }
+  }
+
+  result.encode_time = encode_time.percentiles();
+  if (num_scored > 0) {
+    result.psnr = total_psnr / num_scored;
+  }
+
+  return result;
+}
+
+template <typename T>
+vector<T> parse_list(const string & str, const function<T(const string &)> & parse)
+{
+  vector<T> values;
+  for (const auto & token : split(str, ",")) {
+    values.emplace_back(parse(token));
+  }
+  if (values.empty()) {
+    throw runtime_error("Empty list: " + str);
+  }
+  return values;
+}
+
+int main(int argc, char * argv[])
+{
+  uint16_t frame_rate = 30;
+  unsigned int num_frames = 300;
+  unsigned int bitrate_kbps = 1000;
+  optional<double> deadline_ms;
+  vector<Resolution> resolutions;
+  vector<int> cpu_used {5, 7, 9};
+  vector<unsigned int> threads {1, 4};
+  vector<unsigned int> tiles {2};
+  vector<unsigned int> row_mt {1};
+  vector<unsigned int> aq_modes {3};
+  bool psnr = true;
+  string output_path;
+  bool verbose = false;
+
+  const auto to_int = [](const string & s) { return strict_stoi(s); };
+  const auto to_uint = [](const string & s) { return static_cast<unsigned int>(strict_stoi(s)); };
+  const auto to_resolution = [](const string & s) {
+    const auto dims = split(s, "x");
+    if (dims.size() != 2) {
+      throw runtime_error("Invalid resolution: " + s);
+    }
+    return Resolution {narrow_cast<uint16_t>(strict_stoi(dims[0])),
+                       narrow_cast<uint16_t>(strict_stoi(dims[1]))};
+  };
+
+  const option cmd_line_opts[] = {
+    {"fps",         required_argument, nullptr, 'F'},
+    {"frames",      required_argument, nullptr, 'n'},
+    {"bitrate",     required_argument, nullptr, 'b'},
+    {"deadline",    required_argument, nullptr, 'D'},
+    {"resolutions", required_argument, nullptr, 'R'},
+    {"cpu-used",    required_argument, nullptr, 'c'},
+    {"threads",     required_argument, nullptr, 't'},
+    {"tiles",       required_argument, nullptr, 'T'},
+    {"row-mt",      required_argument, nullptr, 'W'},
+    {"aq-mode",     required_argument, nullptr, 'A'},
+    {"no-psnr",     no_argument,       nullptr, 'P'},
+    {"output",      required_argument, nullptr, 'o'},
+    {"verbose",     no_argument,       nullptr, 'v'},
+    { nullptr,      0,                 nullptr,  0 },
+  };
+
+  while (true) {
+    const int opt = getopt_long(argc, argv, "n:b:c:t:o:v", cmd_line_opts, nullptr);
+    if (opt == -1) {
+      break;
+    }
+
+    switch (opt) {
+      case 'F':
+        frame_rate = narrow_cast<uint16_t>(strict_stoi(optarg));
+        break;
+      case 'n':
+        num_frames = strict_stoi(optarg);
+        break;
+      case 'b':
+        bitrate_kbps = strict_stoi(optarg);
+        break;
+      case 'D':
+        deadline_ms = stod(optarg);
+        break;
+      case 'R':
+        resolutions = parse_list<Resolution>(optarg, to_resolution);
+        break;
+      case 'c':
+        cpu_used = parse_list<int>(optarg, to_int);
+        break;
+      case 't':
+        threads = parse_list<unsigned int>(optarg, to_uint);
+        break;
+      case 'T':
+        tiles = parse_list<unsigned int>(optarg, to_uint);
+        break;
+      case 'W':
+        row_mt = parse_list<unsigned int>(optarg, to_uint);
+        break;
+      case 'A':
+        aq_modes = parse_list<unsigned int>(optarg, to_uint);
+        break;
+      case 'P':
+        psnr = false;
+        break;
+      case 'o':
+        output_path = optarg;
+        break;
+      case 'v':
+        verbose = true;
+        break;
+      default:
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+
+  if (optind != argc - 3) {
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  const Resolution source {narrow_cast<uint16_t>(strict_stoi(argv[optind])),
+                           narrow_cast<uint16_t>(strict_stoi(argv[optind + 1]))};
+  const string input = argv[optind + 2];
+
+  if (frame_rate == 0 or num_frames == 0) {
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  if (is_live_video_input(input)) {
+    cerr << "Live inputs cannot be swept over" << endl;
+    return EXIT_FAILURE;
+  }
+
+  if (resolutions.empty()) {
+    resolutions.push_back(source);
+  }
+  const double deadline = deadline_ms.value_or(1000.0 / frame_rate);
+
+  // every combination of the swept settings
+  vector<SweepParams> runs;
+  for (const auto & resolution : resolutions) {
+    for (const auto c : cpu_used) {
+      for (const auto t : threads) {
+        for (const auto log2_tiles : tiles) {
+          for (const auto r : row_mt) {
+            for (const auto aq_mode : aq_modes) {
+              runs.push_back({resolution, c, t, log2_tiles, r != 0, aq_mode});
+            }
+          }
+        }
+      }
+    }
+  }
+
+  // the encoder logs to cerr; progress goes to clog (sharing cerr's buffer
+  // but not its state)
+  if (not verbose) {
+    cerr.setstate(ios::failbit);
+  }
+
+  clog << "Sweeping " << runs.size() << " encoder settings over " << num_frames
+       << " frames on " << get_nprocs() << " CPUs (deadline: "
+       << double_to_string(deadline) << " ms)" << endl;
+
+  vector<SweepResult> results(runs.size());
+  for (size_t i = 0; i < runs.size(); i++) {
+    try {
+      results[i] = sweep(input, source, frame_rate, num_frames, bitrate_kbps, psnr, runs[i]);
+    } catch (const exception & e) {
+      results[i].error = e.what();
+    }
+
+    const auto & r = results[i];
+    clog << "[" << i + 1 << "/" << runs.size() << "] " << runs[i].str() << ": "
+         << (r.error.empty() ? double_to_string(r.fps()) + " fps, p99 "
+                               + double_to_string(r.encode_time.p99 / 1000.0) + " ms"
+                             : r.error) << endl;
+  }
+
+  ofstream output_file;
+  if (not output_path.empty()) {
+    output_file.open(output_path);
+    if (not output_file) {
+      throw runtime_error("Failed to open " + output_path);
+    }
+  }
+  ostream & out = output_path.empty() ? cout : output_file;
+
+  out << "width,height,cpu_used,threads,tiles,row_mt,aq_mode,frames,encode_fps,"
+         "encode_p50_ms,encode_p99_ms,target_kbps,actual_kbps,bitrate_error_pct,"
+         "psnr_db,meets_deadline,error\n";
+
+  const auto meets_deadline = [&](const SweepResult & r) {
+    return r.error.empty() and r.frames > 0 and r.encode_time.p99 / 1000.0 <= deadline;
+  };
+
+  optional<size_t> best;
+  for (size_t i = 0; i < runs.size(); i++) {
+    const auto & p = runs[i];
+    const auto & r = results[i];
+    const double actual_kbps = r.frames > 0 ? r.bytes * 8.0 * frame_rate / r.frames / 1000 : 0;
+
+    out << p.resolution.width << "," << p.resolution.height << "," << p.cpu_used << ","
+        << p.threads << "," << (1 << p.log2_tiles) << "," << p.row_mt << ","
+        << p.aq_mode << "," << r.frames << "," << double_to_string(r.fps()) << ","
+        << double_to_string(r.encode_time.p50 / 1000.0, 3) << ","
+        << double_to_string(r.encode_time.p99 / 1000.0, 3) << ","
+        << bitrate_kbps << "," << double_to_string(actual_kbps) << ","
+        << double_to_string((actual_kbps / bitrate_kbps - 1) * 100) << ","
+        << (r.psnr ? double_to_string(*r.psnr) : "") << ","
+        << meets_deadline(r) << ","
+        << (r.error.empty() ? "" : "\"" + r.error + "\"") << "\n";
+
+    if (not meets_deadline(r)) {
+      continue;
+    }
+
+    // prefer the highest resolution, then the best PSNR, then the fastest
+    if (best) {
+      const auto & bp = runs[*best];
+      const auto & br = results[*best];
+      const auto pixels = [](const Resolution & res) { return res.width * res.height; };
+
+      if (pixels(p.resolution) != pixels(bp.resolution)) {
+        if (pixels(p.resolution) < pixels(bp.resolution)) {
+          continue;
+        }
+      } else if (r.psnr.value_or(0) != br.psnr.value_or(0)) {
+        if (r.psnr.value_or(0) < br.psnr.value_or(0)) {
+          continue;
+        }
+      } else if (r.encode_time.p99 >= br.encode_time.p99) {
+        continue;
+      }
+    }
+    best = i;
+  }
+
+  if (best) {
+    const auto & p = runs[*best];
+    const auto & r = results[*best];
+    clog << "Recommended: " << p.str() << " (" << double_to_string(r.fps()) << " fps, p99 "
+         << double_to_string(r.encode_time.p99 / 1000.0) << " ms"
+         << (r.psnr ? ", PSNR " + double_to_string(*r.psnr) + " dB" : "") << ")" << endl;
+  } else {
+    clog << "No settings met the deadline of " << double_to_string(deadline) << " ms" << endl;
+  }
+
+  return EXIT_SUCCESS;
+}
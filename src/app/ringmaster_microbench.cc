@@ -0,0 +1,379 @@
+#include <getopt.h>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <stdexcept>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "conversion.hh"
+#include "split.hh"
+#include "timestamp.hh"
+#include "serialization.hh"
+#include "image.hh"
+#include "protocol.hh"
+#include "vp9_decoder.hh"
+
+using namespace std;
+
+void print_usage(const string & program_name)
+{
+  cerr <<
+  "Usage: " << program_name << " [options]\n\n"
+  "Microbenchmark the hot primitives of the protocol (serializing and parsing\n"
+  "datagrams and messages), of frame reassembly (1 to 1000 fragments per\n"
+  "frame) and of the image kernels (720p to 8K), and output a CSV line for\n"
+  "each with the time and cycles (TSC ticks on x86, or else ns) per\n"
+  "operation and the throughput in MB/s of the bytes each operation\n"
+  "processes.\n\n"
+  "Options:\n"
+  "-f, --filter <text>        only run the benchmarks whose \"<name> <size>\"\n"
+  "                           contains <text>\n"
+  "--sizes <size,...>         frame sizes of the image kernels, among 720p,\n"
+  "                           1080p, 4k and 8k (default: all)\n"
+  "--min-time <ms>            run each benchmark for at least this long\n"
+  "                           (default: 200)\n"
+  "-o, --output <file>        file to output CSV to (default: stdout)\n"
+  "-v, --verbose              keep the logs of the benchmarked code"
+  << endl;
+}
+
+namespace {
+  // CPU timestamp counter, or nanoseconds where there is none
+  uint64_t cycles()
+  {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return timestamp_ns();
+#endif
+  }
+
+  // keep the compiler from optimizing away a result that is never used
+  template <typename T>
+  void keep(const T & value)
+  {
+    asm volatile("" : : "r,m"(value) : "memory");
+  }
+
+  struct FrameSize
+  {
+    string name;
+    uint16_t width;
+    uint16_t height;
+  };
+
+  const vector<FrameSize> FRAME_SIZES = {
+    {"720p", 1280, 720}, {"1080p", 1920, 1080}, {"4k", 3840, 2160}, {"8k", 7680, 4320}
+  };
+
+  // fill 'len' bytes at 'dst' with noise (faster than <random> at 8K)
+  void fill_noise(uint8_t * dst, const size_t len, uint32_t seed)
+  {
+    for (size_t i = 0; i < len; i++) {
+      seed = seed * 1664525 + 1013904223;
+      dst[i] = static_cast<uint8_t>(seed >> 24);
+    }
+  }
+
+  void fill_noise(RawImage & img)
+  {
+    for (int row = 0; row < img.display_height(); row++) {
+      fill_noise(img.y_plane() + row * img.y_stride(), img.display_width(), row);
+    }
+    for (int row = 0; row < img.display_height() / 2; row++) {
+      fill_noise(img.u_plane() + row * img.u_stride(), img.display_width() / 2, 2 * row);
+      fill_noise(img.v_plane() + row * img.v_stride(), img.display_width() / 2, 3 * row);
+    }
+  }
+}
+
+// runs each benchmark in batches of doubling iterations until a batch takes
+// at least the minimum time, and outputs the per-operation cost of that batch
+class Harness
+{
+public:
+  Harness(ostream & out, const string & filter, const uint64_t min_time_ns)
+    : out_(out), filter_(filter), min_time_ns_(min_time_ns)
+  {
+    out_ << "benchmark,size,iterations,ns_per_op,cycles_per_op,bytes_per_op,mb_per_s\n";
+  }
+
+  template <typename Op>
+  void run(const string & name, const string & size, const size_t bytes_per_op, Op && op)
+  {
+    if (not filter_.empty() and (name + " " + size).find(filter_) == string::npos) {
+      return;
+    }
+
+    op(); // warm up
+
+    uint64_t iterations = 1;
+    uint64_t elapsed_ns = 0, elapsed_cycles = 0;
+
+    while (true) {
+      const uint64_t start_ns = timestamp_ns();
+      const uint64_t start_cycles = cycles();
+      for (uint64_t i = 0; i < iterations; i++) {
+        op();
+      }
+      elapsed_cycles = cycles() - start_cycles;
+      elapsed_ns = timestamp_ns() - start_ns;
+
+      if (elapsed_ns >= min_time_ns_) {
+        break;
+      }
+      iterations *= 2;
+    }
+
+    const double ns_per_op = static_cast<double>(elapsed_ns) / iterations;
+    const double mb_per_s = bytes_per_op * 1000 / ns_per_op; // bytes per ns * 1e3
+
+    out_ << name << "," << size << "," << iterations << ","
+         << double_to_string(ns_per_op, 1) << ","
+         << double_to_string(static_cast<double>(elapsed_cycles) / iterations, 1) << ","
+         << bytes_per_op << "," << double_to_string(mb_per_s, 1) << endl;
+
+    clog << name << " (" << size << "): " << double_to_string(ns_per_op, 1) << " ns/op"
+         << (bytes_per_op > 0 ? ", " + double_to_string(mb_per_s, 1) + " MB/s" : "") << endl;
+  }
+
+private:
+  ostream & out_;
+  string filter_;
+  uint64_t min_time_ns_;
+};
+
+void bench_protocol(Harness & harness)
+{
+  const string payload(FrameDatagram::max_payload, 'x');
+
+  // the first fragment of a frame carries the header extensions
+  FrameDatagram first(1, FrameType::KEY, 0, 10, 1280, 720, payload);
+  first.capture_ts = 1000;
+  first.encode_timing = EncodeTiming {1000, 5000};
+  first.clock_offset_us = -20;
+  first.send_ts = 6000;
+
+  FrameDatagram middle(1, FrameType::KEY, 1, 10, 1280, 720, payload);
+  middle.send_ts = 6000;
+
+  const auto bench_datagram = [&](const string & size, const FrameDatagram & datagram) {
+    const string raw = datagram.serialize_to_string();
+
+    harness.run("FrameDatagram::serialize_to_string", size, raw.size(),
+                [&] { keep(datagram.serialize_to_string()); });
+
+    harness.run("FrameDatagram::parse_from_string", size, raw.size(),
+                [&] { FrameDatagram parsed; keep(parsed.parse_from_string(raw)); });
+  };
+  bench_datagram("first", first);
+  bench_datagram("middle", middle);
+
+  // a buffer of integers, and of the fixed fields of datagram headers
+  const string buffer(4096, 'x');
+
+  harness.run("WireParser::read_uint64", "4KB", buffer.size(), [&] {
+    WireParser parser(buffer);
+    uint64_t sum = 0;
+    for (size_t i = 0; i < buffer.size() / sizeof(uint64_t); i++) {
+      sum += parser.read_uint64();
+    }
+    keep(sum);
+  });
+
+  const size_t num_headers = buffer.size() / FrameDatagram::HEADER_SIZE;
+  harness.run("WireParser header fields", "4KB", num_headers * FrameDatagram::HEADER_SIZE, [&] {
+    WireParser parser(buffer);
+    uint64_t sum = 0;
+    for (size_t i = 0; i < num_headers; i++) {
+      sum += parser.read_uint32() + parser.read_uint8() + parser.read_uint16()
+             + parser.read_uint16() + parser.read_uint16() + parser.read_uint16()
+             + parser.read_uint64();
+    }
+    keep(sum);
+  });
+
+  AckMsg ack(middle);
+  ack.recv_ts = 7000;
+  const string raw_ack = ack.serialize_to_string();
+
+  harness.run("Msg::parse_from_string", "ack", raw_ack.size(),
+              [&] { keep(Msg::parse_from_string(raw_ack)); });
+}
+
+void bench_reassembly(Harness & harness)
+{
+  const string payload(FrameDatagram::max_payload, 'x');
+
+  for (const uint16_t frag_cnt : {1, 10, 100, 1000}) {
+    vector<FrameDatagram> frags;
+    for (uint16_t frag_id = 0; frag_id < frag_cnt; frag_id++) {
+      frags.emplace_back(0, FrameType::NONKEY, frag_id, frag_cnt, 1280, 720, payload);
+    }
+
+    const string size = to_string(frag_cnt) + " frags";
+    const size_t frame_size = frag_cnt * payload.size();
+
+    harness.run("Frame::insert_frag", size, frame_size, [&] {
+      Frame frame(0, FrameType::NONKEY, frag_cnt);
+      for (const auto & frag : frags) {
+        frame.insert_frag(frag);
+      }
+      keep(frame.complete());
+    });
+
+    // receiving a whole frame and handing it over to (not) be decoded
+    Decoder decoder(1280, 720, Decoder::NO_DECODE_DISPLAY);
+    uint32_t frame_id = 0;
+
+    harness.run("Decoder::next_frame_complete", size, frame_size, [&] {
+      for (auto & frag : frags) {
+        frag.frame_id = frame_id;
+        decoder.add_datagram(frag);
+      }
+      keep(decoder.next_frame_complete());
+      decoder.consume_next_frame();
+      frame_id++;
+    });
+  }
+
+  // waiting for a lost fragment while later frames pile up, so that every
+  // call looks for a complete key frame ahead
+  for (const uint32_t num_frames : {10, 100, 1000}) {
+    Decoder decoder(1280, 720, Decoder::NO_DECODE_DISPLAY);
+    for (uint32_t frame_id = 1; frame_id <= num_frames; frame_id++) {
+      decoder.add_datagram(FrameDatagram(frame_id, FrameType::NONKEY, 0, 1, 1280, 720, payload));
+    }
+
+    harness.run("Decoder::next_frame_complete (stalled)", to_string(num_frames) + " frames",
+                0, [&] { keep(decoder.next_frame_complete()); });
+  }
+}
+
+void bench_images(Harness & harness, const vector<FrameSize> & sizes)
+{
+  for (const auto & size : sizes) {
+    const uint16_t width = size.width, height = size.height;
+    const size_t num_pixels = static_cast<size_t>(width) * height;
+    const size_t i420_size = num_pixels * 3 / 2;
+
+    RawImage img(width, height);
+    fill_noise(img);
+
+    string yuyv(num_pixels * 2, 0);
+    fill_noise(reinterpret_cast<uint8_t *>(yuyv.data()), yuyv.size(), 1);
+    harness.run("RawImage::copy_from_yuyv", size.name, yuyv.size(),
+                [&] { img.copy_from_yuyv(yuyv); });
+
+    vector<uint8_t> rgbx(num_pixels * 4);
+    harness.run("RawImage::to_rgbx", size.name, rgbx.size(),
+                [&] { img.to_rgbx(rgbx.data(), width * 4, ColorSpace()); });
+
+    // 4x4 tiles, as tile_sender does
+    TiledImage tiled(width, height, 4, 4);
+    fill_noise(tiled.get_frame());
+    harness.run("TiledImage::partition", size.name, i420_size, [&] { tiled.partition(); });
+    harness.run("TiledImage::merge", size.name, i420_size, [&] { tiled.merge(); });
+
+    // a window of the output size is a view; a larger one is resampled
+    const uint16_t crop_width = width / 2, crop_height = height / 2;
+    CroppedImage cropped(width, height, crop_width, crop_height);
+    fill_noise(cropped.get_frame());
+    const size_t crop_size = static_cast<size_t>(crop_width) * crop_height * 3 / 2;
+
+    harness.run("CroppedImage::crop (view)", size.name, crop_size, [&] {
+      cropped.crop(width / 2.0, height / 2.0, crop_width, crop_height);
+    });
+    harness.run("CroppedImage::crop (scaled)", size.name, crop_size, [&] {
+      cropped.crop(width / 2.0, height / 2.0, crop_width * 6 / 5, crop_height * 6 / 5);
+    });
+  }
+}
+
+int main(int argc, char * argv[])
+{
+  string filter;
+  vector<FrameSize> sizes = FRAME_SIZES;
+  uint64_t min_time_ms = 200;
+  string output_path;
+  bool verbose = false;
+
+  const option cmd_line_opts[] = {
+    {"filter",   required_argument, nullptr, 'f'},
+    {"sizes",    required_argument, nullptr, 'S'},
+    {"min-time", required_argument, nullptr, 'T'},
+    {"output",   required_argument, nullptr, 'o'},
+    {"verbose",  no_argument,       nullptr, 'v'},
+    { nullptr,   0,                 nullptr,  0 },
+  };
+
+  while (true) {
+    const int opt = getopt_long(argc, argv, "f:o:v", cmd_line_opts, nullptr);
+    if (opt == -1) {
+      break;
+    }
+
+    switch (opt) {
+      case 'f':
+        filter = optarg;
+        break;
+      case 'S':
+        sizes.clear();
+        for (const auto & name : split(optarg, ",")) {
+          const auto it = find_if(FRAME_SIZES.begin(), FRAME_SIZES.end(),
+                                  [&](const FrameSize & size) { return size.name == name; });
+          if (it == FRAME_SIZES.end()) {
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+          }
+          sizes.push_back(*it);
+        }
+        break;
+      case 'T':
+        min_time_ms = strict_stoll(optarg);
+        break;
+      case 'o':
+        output_path = optarg;
+        break;
+      case 'v':
+        verbose = true;
+        break;
+      default:
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+
+  if (optind != argc) {
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  // the decoder logs to cerr; progress goes to clog (sharing cerr's buffer
+  // but not its state)
+  if (not verbose) {
+    cerr.setstate(ios::failbit);
+  }
+
+  ofstream output_file;
+  if (not output_path.empty()) {
+    output_file.open(output_path);
+    if (not output_file) {
+      throw runtime_error("Failed to open " + output_path);
+    }
+  }
+  ostream & out = output_path.empty() ? cout : output_file;
+
+  Harness harness(out, filter, min_time_ms * 1000 * 1000);
+  bench_protocol(harness);
+  bench_reassembly(harness);
+  bench_images(harness, sizes);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,508 @@
+#include <getopt.h>
+#include <sys/prctl.h>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <queue>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <cmath>
+
+#include "conversion.hh"
+#include "split.hh"
+#include "clock.hh"
+#include "timestamp.hh"
+#include "timerfd.hh"
+#include "udp_socket.hh"
+#include "epoller.hh"
+#include "exception.hh"
+#include "link_model.hh"
+#include "link_trace.hh"
+#include "event_log.hh"
+
+using namespace std;
+
+void print_usage(const string & program_name)
+{
+  cerr <<
+  "Usage: " << program_name << " [options] listen_port server_host server_port\n\n"
+  "Relay UDP between clients on listen_port (and the next --ports - 1 ports)\n"
+  "and server_port (and the next ones) on server_host through an emulated\n"
+  "link, e.g., to run udp_receiver against this relay rather than directly\n"
+  "against udp_sender (whose video and signal ports are consecutive). The\n"
+  "link conditions apply to both directions unless noted; the bottleneck\n"
+  "is toward the client, where the video goes.\n\n"
+  "Options:\n"
+  "--ports <n>                port pairs to relay (default: 2)\n"
+  "-d, --delay <ms>           one-way propagation delay (default: 0)\n"
+  "-J, --jitter <ms>          vary the delay uniformly by up to +/- this\n"
+  "--reorder <prob>           probability of a packet skipping the delay\n"
+  "-l, --loss <prob>          random loss rate\n"
+  "--ge <p,r[,bad_loss]>      Gilbert-Elliott loss: good-to-bad and bad-to-good\n"
+  "                           transition probabilities, and the loss rate in\n"
+  "                           the bad state (default: 1); --loss applies in\n"
+  "                           the good state\n"
+  "-r, --rate <kbps>          bottleneck rate toward the client (default: unlimited)\n"
+  "--up-rate <kbps>           bottleneck rate toward the server (default: unlimited)\n"
+  "--burst <bytes>            token bucket depth (default: one packet)\n"
+  "-t, --trace <file>         replay a trace at the bottleneck toward the client\n"
+  "                           instead of --rate: mahimahi (a delivery opportunity\n"
+  "                           per line, in ms) or throughput (\"<seconds> <Mbps>\"\n"
+  "                           per line, e.g., LTE/5G measurements)\n"
+  "--up-trace <file>          same toward the server\n"
+  "--no-loop                  let a link go dead when its trace ends\n"
+  "-q, --queue <ms>           queue capacity at the bottleneck (or the trace's\n"
+  "                           average) rate (default: 100)\n"
+  "--queue-bytes <n>          queue capacity in bytes, overriding --queue\n"
+  "--codel                    use CoDel rather than drop-tail at the bottleneck\n"
+  "--codel-target <ms>        CoDel target sojourn time (default: 5)\n"
+  "--codel-interval <ms>      CoDel interval (default: 100)\n"
+  "-s, --seed <n>             seed of the random loss, jitter and reordering\n"
+  "--links <n>                split the port pairs into n groups of consecutive\n"
+  "                           ones (e.g., one per receiver), each relayed over\n"
+  "                           a link of its own (default: 1)\n"
+  "--queue-log <file>         log each packet entering a link (queue occupancy,\n"
+  "                           delays and fate) into an event log; convert it\n"
+  "                           with event_log_dump -f queue\n"
+  "-v, --verbose              print per-link stats every second"
+  << endl;
+}
+
+namespace {
+  uint64_t ms_to_us(const string & ms)
+  {
+    const double value = stod(ms);
+    if (value < 0) {
+      throw runtime_error("Negative duration: " + ms);
+    }
+    return llround(value * 1000);
+  }
+}
+
+// a pair of sockets relaying between one client and one server port
+struct PortPair
+{
+  UDPSocket client_sock {};
+  UDPSocket server_sock {};
+  optional<Address> client_addr {}; // the latest client seen
+  size_t link {0}; // index of the emulated link relaying it
+};
+
+// a datagram in flight on the emulated link
+struct Delivery
+{
+  uint64_t ts_us;
+  uint64_t seq; // keeps datagrams due at the same time in order
+  size_t pair;
+  bool to_client;
+  string payload;
+
+  bool operator>(const Delivery & other) const
+  {
+    return ts_us != other.ts_us ? ts_us > other.ts_us : seq > other.seq;
+  }
+};
+
+// counters of a direction not kept by its LinkModel
+struct DirectionStats
+{
+  uint64_t bytes_in {0};
+  uint64_t delivered {0};
+  uint64_t bytes_delivered {0};
+  uint64_t send_failures {0}; // EWOULDBLOCK on the outgoing socket
+  uint64_t dropped {0};       // by the LinkModel (as of the last output)
+};
+
+// one direction of an emulated link
+struct Direction
+{
+  explicit Direction(const LinkModel::Config & config) : link(config) {}
+
+  LinkModel link;
+  DirectionStats stats {};
+  DirectionStats last {}; // as of the last stats output
+};
+
+struct EmulatedLink
+{
+  EmulatedLink(const LinkModel::Config & to_client_config,
+               const LinkModel::Config & to_server_config)
+    : to_client(to_client_config), to_server(to_server_config)
+  {}
+
+  Direction to_client;
+  Direction to_server;
+};
+
+int main(int argc, char * argv[])
+{
+  unsigned int num_ports = 2;
+  LinkModel::Config config;
+  uint64_t down_rate_kbps = 0;
+  uint64_t up_rate_kbps = 0;
+  string down_trace_path, up_trace_path;
+  bool loop = true;
+  uint64_t queue_ms = 100;
+  optional<uint64_t> queue_bytes;
+  unsigned int num_links = 1;
+  string queue_log_path;
+  bool verbose = false;
+
+  const option cmd_line_opts[] = {
+    {"ports",          required_argument, nullptr, 'P'},
+    {"delay",          required_argument, nullptr, 'd'},
+    {"jitter",         required_argument, nullptr, 'J'},
+    {"reorder",        required_argument, nullptr, 'R'},
+    {"loss",           required_argument, nullptr, 'l'},
+    {"ge",             required_argument, nullptr, 'G'},
+    {"rate",           required_argument, nullptr, 'r'},
+    {"up-rate",        required_argument, nullptr, 'U'},
+    {"burst",          required_argument, nullptr, 'B'},
+    {"trace",          required_argument, nullptr, 't'},
+    {"up-trace",       required_argument, nullptr, 'u'},
+    {"no-loop",        no_argument,       nullptr, 'N'},
+    {"queue",          required_argument, nullptr, 'q'},
+    {"queue-bytes",    required_argument, nullptr, 'Y'},
+    {"codel",          no_argument,       nullptr, 'C'},
+    {"codel-target",   required_argument, nullptr, 'T'},
+    {"codel-interval", required_argument, nullptr, 'I'},
+    {"seed",           required_argument, nullptr, 's'},
+    {"links",          required_argument, nullptr, 'K'},
+    {"queue-log",      required_argument, nullptr, 'O'},
+    {"verbose",        no_argument,       nullptr, 'v'},
+    { nullptr,         0,                 nullptr,  0 },
+  };
+
+  while (true) {
+    const int opt = getopt_long(argc, argv, "d:J:l:r:t:q:s:v", cmd_line_opts, nullptr);
+    if (opt == -1) {
+      break;
+    }
+
+    switch (opt) {
+      case 'P':
+        num_ports = strict_stoi(optarg);
+        break;
+      case 'd':
+        config.delay_us = ms_to_us(optarg);
+        break;
+      case 'J':
+        config.jitter_us = ms_to_us(optarg);
+        break;
+      case 'R':
+        config.reorder = stod(optarg);
+        break;
+      case 'l':
+        config.loss = stod(optarg);
+        break;
+      case 'G': {
+        const auto values = split(optarg, ",");
+        if (values.size() < 2 or values.size() > 3) {
+          print_usage(argv[0]);
+          return EXIT_FAILURE;
+        }
+        config.ge_p = stod(values[0]);
+        config.ge_r = stod(values[1]);
+        if (values.size() == 3) {
+          config.ge_bad_loss = stod(values[2]);
+        }
+        break;
+      }
+      case 'r':
+        down_rate_kbps = strict_stoll(optarg);
+        break;
+      case 'U':
+        up_rate_kbps = strict_stoll(optarg);
+        break;
+      case 'B':
+        config.burst_bytes = strict_stoll(optarg);
+        break;
+      case 't':
+        down_trace_path = optarg;
+        break;
+      case 'u':
+        up_trace_path = optarg;
+        break;
+      case 'N':
+        loop = false;
+        break;
+      case 'q':
+        queue_ms = strict_stoll(optarg);
+        break;
+      case 'Y':
+        queue_bytes = strict_stoll(optarg);
+        break;
+      case 'C':
+        config.queue = LinkModel::Queue::CODEL;
+        break;
+      case 'T':
+        config.codel_target_us = ms_to_us(optarg);
+        break;
+      case 'I':
+        config.codel_interval_us = ms_to_us(optarg);
+        break;
+      case 's':
+        config.seed = strict_stoi(optarg);
+        break;
+      case 'K':
+        num_links = strict_stoi(optarg);
+        break;
+      case 'O':
+        queue_log_path = optarg;
+        break;
+      case 'v':
+        verbose = true;
+        break;
+      default:
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+
+  if (optind != argc - 3 or num_ports == 0 or num_links == 0 or
+      num_ports % num_links != 0) {
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  const auto listen_port = narrow_cast<uint16_t>(strict_stoi(argv[optind]));
+  const string server_host = argv[optind + 1];
+  const auto server_port = narrow_cast<uint16_t>(strict_stoi(argv[optind + 2]));
+
+  // deliveries are scheduled on a CLOCK_MONOTONIC timerfd
+  if (strcmp(monotonic_clock_name(), "monotonic") != 0) {
+    throw runtime_error("The relay cannot run on " + string(monotonic_clock_name())
+                        + " (unset RINGMASTER_CLOCK)");
+  }
+
+  // wake up within a microsecond of the timer rather than the default 50
+  check_syscall(prctl(PR_SET_TIMERSLACK, 1000, 0, 0, 0));
+
+  // a direction's config: a trace (shared by all links) or a rate
+  const auto direction_config = [&](const uint64_t rate_kbps, const string & trace_path) {
+    LinkModel::Config direction = config;
+    direction.rate_kbps = rate_kbps;
+
+    uint64_t queue_rate_kbps = rate_kbps;
+    if (not trace_path.empty()) {
+      direction.trace = make_shared<LinkTrace>(LinkTrace::load(trace_path));
+      direction.trace_loop = loop;
+      queue_rate_kbps = llround(direction.trace->average_kbps());
+
+      cerr << "Loaded " << trace_path << ": " << direction.trace->size()
+           << " opportunities over " << double_to_string(direction.trace->period_us() / 1e6)
+           << " s (average " << double_to_string(queue_rate_kbps / 1000.0) << " Mbps)" << endl;
+    }
+
+    direction.queue_bytes = queue_bytes.value_or(queue_rate_kbps * queue_ms / 8);
+    return direction;
+  };
+
+  const LinkModel::Config down_config = direction_config(down_rate_kbps, down_trace_path);
+  const LinkModel::Config up_config = direction_config(up_rate_kbps, up_trace_path);
+
+  // every direction of every link draws from an independent random stream
+  vector<unique_ptr<EmulatedLink>> links;
+  for (unsigned int i = 0; i < num_links; i++) {
+    LinkModel::Config to_client = down_config, to_server = up_config;
+    to_client.seed = config.seed + 2 * i;
+    to_server.seed = config.seed + 2 * i + 1;
+    links.emplace_back(make_unique<EmulatedLink>(to_client, to_server));
+  }
+
+  // each packet entering a link, if requested
+  unique_ptr<EventLog> queue_log;
+  EventLog::Producer * queue_events = nullptr;
+  if (not queue_log_path.empty()) {
+    queue_log = make_unique<EventLog>(queue_log_path, 1 << 16);
+    queue_events = &queue_log->add_producer();
+  }
+
+  vector<unique_ptr<PortPair>> pairs;
+  for (unsigned int i = 0; i < num_ports; i++) {
+    auto pair = make_unique<PortPair>();
+    pair->link = i / (num_ports / num_links);
+    pair->client_sock.bind({"0", narrow_cast<uint16_t>(listen_port + i)});
+    pair->server_sock.connect({server_host, narrow_cast<uint16_t>(server_port + i)});
+    pair->client_sock.set_blocking(false);
+    pair->server_sock.set_blocking(false);
+
+    cerr << "Relaying " << pair->client_sock.local_address().str() << " <-> "
+         << pair->server_sock.peer_address().str() << " over link " << pair->link << endl;
+    pairs.emplace_back(move(pair));
+  }
+
+  priority_queue<Delivery, vector<Delivery>, greater<Delivery>> in_flight;
+  uint64_t next_seq = 0;
+
+  // one-shot timer armed for the earliest delivery
+  Timerfd delivery_timer(CLOCK_MONOTONIC);
+  uint64_t armed_ts = 0; // 0: disarmed
+
+  const auto rearm = [&]() {
+    const uint64_t next_ts = in_flight.empty() ? 0 : in_flight.top().ts_us;
+    if (next_ts != armed_ts) {
+      delivery_timer.set_absolute(next_ts * 1000);
+      armed_ts = next_ts;
+    }
+  };
+
+  const auto deliver = [&](const Delivery & delivery) {
+    PortPair & pair = *pairs[delivery.pair];
+    EmulatedLink & link = *links[pair.link];
+    DirectionStats & stats = (delivery.to_client ? link.to_client : link.to_server).stats;
+
+    const bool sent = delivery.to_client
+                      ? pair.client_sock.sendto(*pair.client_addr, delivery.payload)
+                      : pair.server_sock.send(delivery.payload);
+    if (sent) {
+      stats.delivered++;
+      stats.bytes_delivered += delivery.payload.size();
+    } else {
+      stats.send_failures++;
+    }
+  };
+
+  // a datagram entering the emulated link
+  const auto enter = [&](const size_t pair, const bool to_client, string && payload) {
+    const uint64_t now = timestamp_us();
+    const size_t link_index = pairs[pair]->link;
+    Direction & direction = to_client ? links[link_index]->to_client
+                                      : links[link_index]->to_server;
+    direction.stats.bytes_in += payload.size();
+
+    const auto arrival_ts = direction.link.transmit(payload.size(), now);
+
+    if (queue_events) {
+      const LinkModel::Outcome & outcome = direction.link.last_outcome();
+
+      EventRecord record;
+      record.type = EventRecord::Type::LINK_PACKET;
+      record.timestamp_us = now;
+      record.frame_id = link_index;
+      record.u[0] = outcome.queued_bytes;
+      record.u[1] = payload.size();
+      record.u[2] = static_cast<uint64_t>(outcome.verdict);
+      record.u[3] = to_client ? 0 : 1;
+      record.d[0] = outcome.depart_us >= now ? (outcome.depart_us - now) / 1000.0 : -1;
+      record.d[1] = arrival_ts ? (*arrival_ts - now) / 1000.0 : -1;
+      queue_events->log(record);
+    }
+
+    if (not arrival_ts) {
+      return;
+    }
+
+    in_flight.push({*arrival_ts, next_seq++, pair, to_client, move(payload)});
+  };
+
+  Epoller epoller;
+
+  for (size_t i = 0; i < pairs.size(); i++) {
+    PortPair & pair = *pairs[i];
+
+    epoller.register_event(pair.client_sock, Epoller::In,
+      [&, i]()
+      {
+        while (true) {
+          auto [addr, data] = pair.client_sock.recvfrom();
+          if (not data) { // EWOULDBLOCK
+            break;
+          }
+          pair.client_addr = addr;
+          enter(i, false, move(*data));
+        }
+        rearm();
+      }
+    );
+
+    epoller.register_event(pair.server_sock, Epoller::In,
+      [&, i]()
+      {
+        while (true) {
+          auto data = pair.server_sock.recv();
+          if (not data) { // EWOULDBLOCK
+            break;
+          }
+          if (pair.client_addr) { // nowhere to relay to before a client shows up
+            enter(i, true, move(*data));
+          }
+        }
+        rearm();
+      }
+    );
+  }
+
+  epoller.register_event(delivery_timer, Epoller::In,
+    [&]()
+    {
+      delivery_timer.read_expirations();
+      armed_ts = 0; // one-shot
+
+      const uint64_t now = timestamp_us();
+      while (not in_flight.empty() and in_flight.top().ts_us <= now) {
+        deliver(in_flight.top());
+        in_flight.pop();
+      }
+      rearm();
+    }
+  );
+
+  // stats every second
+  Timerfd stats_timer;
+  if (verbose) {
+    stats_timer.set_time({1, 0}, {1, 0});
+    epoller.register_event(stats_timer, Epoller::In,
+      [&]()
+      {
+        if (stats_timer.read_expirations() == 0) {
+          return;
+        }
+
+        const uint64_t now = timestamp_us();
+        const auto print = [now](const string & name, Direction & direction) {
+          LinkModel & link = direction.link;
+          DirectionStats & stats = direction.stats;
+          DirectionStats & last = direction.last;
+
+          stats.dropped = link.num_lost() + link.num_overflowed() + link.num_aqm_dropped();
+          cerr << name << ": in/out (kbps) "
+               << double_to_string((stats.bytes_in - last.bytes_in) * 8 / 1000.0) << "/"
+               << double_to_string((stats.bytes_delivered - last.bytes_delivered) * 8 / 1000.0)
+               << ", delivered " << stats.delivered - last.delivered
+               << ", dropped " << stats.dropped - last.dropped
+               << " (total lost/overflowed/aqm/reordered: " << link.num_lost() << "/"
+               << link.num_overflowed() << "/" << link.num_aqm_dropped() << "/"
+               << link.num_reordered() << ")"
+               << ", queued (bytes) " << link.queued_bytes(now);
+          if (stats.send_failures > 0) {
+            cerr << ", send failures " << stats.send_failures;
+          }
+          cerr << endl;
+
+          last = stats;
+        };
+
+        for (size_t i = 0; i < links.size(); i++) {
+          const string prefix = links.size() > 1 ? "Link " + to_string(i) + " to " : "To ";
+          print(prefix + "client", links[i]->to_client);
+          print(prefix + "server", links[i]->to_server);
+        }
+
+        if (queue_log and queue_log->num_dropped() > 0) {
+          cerr << "Packets dropped from the queue log (total): "
+               << queue_log->num_dropped() << endl;
+        }
+      }
+    );
+  }
+
+  // main loop
+  while (true) {
+    epoller.poll(-1);
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,528 @@
+#include <getopt.h>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <functional>
+#include <chrono>
+#include <cmath>
+
+#include "conversion.hh"
+#include "split.hh"
+#include "timestamp.hh"
+#include "virtual_clock.hh"
+#include "link_model.hh"
+#include "link_trace.hh"
+#include "latency_histogram.hh"
+#include "thread_pool.hh"
+#include "video_source.hh"
+#include "protocol.hh"
+#include "vp9_encoder.hh"
+#include "vp9_decoder.hh"
+
+using namespace std;
+using namespace std::chrono;
+
+void print_usage(const string & program_name)
+{
+  cerr <<
+  "Usage: " << program_name << " [options] width height input\n\n"
+  "Stream 'input' (a y4m file or synthetic[:<options>]) from an Encoder to a\n"
+  "Decoder over a simulated link, all in one process on a virtual clock, so\n"
+  "that a run takes as long as encoding does rather than --streamtime. The\n"
+  "options taking a comma-separated list are swept over (every combination\n"
+  "is run, in parallel), and a CSV line is output for each run.\n\n"
+  "Options:\n"
+  "--fps <fps>                frame rate (default: 30)\n"
+  "--streamtime <s>           simulated streaming time (default: 60)\n"
+  "-b, --bitrate <kbps,...>   target bitrates (default: 1000)\n"
+  "-r, --rate <kbps,...>      link rates (default: 0, i.e., unlimited)\n"
+  "-t, --trace <file,...>     link traces replayed in place of --rate, in\n"
+  "                           mahimahi or throughput (\"<seconds> <Mbps>\")\n"
+  "                           format; see ringmaster_relay\n"
+  "-d, --rtt <ms,...>         round-trip propagation delays (default: 40)\n"
+  "-l, --loss <rate,...>      random loss rates in each direction (default: 0)\n"
+  "--queue <ms>               drop-tail queue at the link (or the trace's\n"
+  "                           average) rate (default: 100)\n"
+  "-s, --seeds <n>            runs with seeds 1..n for each combination (default: 1)\n"
+  "-j, --jobs <n>             runs in parallel (default: all CPUs)\n"
+  "--encoder-threads <n>      threads per encoder (default: 1)\n"
+  "--mtu <MTU>                MTU for deciding UDP payload size\n"
+  "--log-dir <dir>            save event logs of each run into <dir>\n"
+  "-o, --output <file>        file to output CSV to (default: stdout)\n"
+  "-v, --verbose              keep the encoders' and decoders' logs"
+  << endl;
+}
+
+// options shared by all the runs of a sweep
+struct SimOptions
+{
+  uint16_t width {0};
+  uint16_t height {0};
+  string input {};
+  uint16_t frame_rate {30};
+  unsigned int stream_time_s {60};
+  unsigned int queue_ms {100};
+  unsigned int encoder_threads {1};
+  string log_dir {};
+  map<string, shared_ptr<const LinkTrace>> traces {}; // loaded once for all runs
+};
+
+// parameters swept over
+struct SimParams
+{
+  unsigned int bitrate_kbps {1000};
+  uint64_t rate_kbps {0};
+  string trace {}; // replaces rate_kbps unless empty
+  double rtt_ms {40};
+  double loss {0};
+  uint32_t seed {1};
+
+  string str() const
+  {
+    return "bitrate=" + to_string(bitrate_kbps)
+           + (trace.empty() ? " rate=" + to_string(rate_kbps) : " trace=" + trace)
+           + " rtt=" + double_to_string(rtt_ms) + " loss=" + double_to_string(loss, 4)
+           + " seed=" + to_string(seed);
+  }
+};
+
+struct SimResult
+{
+  uint64_t frames_encoded {0};
+  uint64_t frames_delivered {0};
+  uint64_t bytes_received {0};
+  uint64_t datagrams_sent {0};
+  uint64_t datagrams_rtx {0};
+  uint64_t datagrams_lost {0};     // randomly lost on the link
+  uint64_t datagrams_overflow {0}; // dropped by the queue
+  uint64_t acks_lost {0};
+  LatencyPercentiles latency {};   // from capture until the frame is complete
+  double sim_s {0};
+  double wall_s {0};
+  string error {};
+};
+
+// one sender and one receiver joined by a pair of LinkModels, driven by a
+// VirtualClock in place of the Poller, the Timerfds and the sockets of
+// udp_sender and udp_receiver (and doing what they do in the callbacks)
+class Simulation
+{
+public:
+  Simulation(VirtualClock & clock, const SimOptions & options,
+             const SimParams & params, const string & log_prefix)
+    : clock_(clock), options_(options), params_(params),
+      encoder_(options.width, options.height, options.frame_rate,
+               log_prefix.empty() ? "" : log_prefix + ".sender.log"),
+      decoder_(options.width, options.height, Decoder::NO_DECODE_DISPLAY,
+               log_prefix.empty() ? "" : log_prefix + ".receiver.log"),
+      uplink_(link_config(true)), downlink_(link_config(false))
+  {
+    if (is_live_video_input(options.input)) {
+      throw runtime_error("Live inputs cannot be simulated");
+    }
+    video_input_ = open_video_input(options.input, options.width,
+                                    options.height, options.frame_rate);
+
+    encoder_.set_threads(options.encoder_threads);
+    encoder_.set_target_bitrate(params.bitrate_kbps);
+  }
+
+  SimResult run()
+  {
+    const uint64_t start_ts = clock_.now_us();
+
+    // encode a frame every frame interval, as the fps timer does
+    clock_.schedule_periodic(1000 * 1000 / options_.frame_rate,
+                             [this]() { capture_frame(); });
+    clock_.run_until(start_ts + options_.stream_time_s * 1000 * 1000ULL);
+
+    result_.sim_s = (clock_.now_us() - start_ts) / 1e6;
+    result_.datagrams_lost = uplink_.num_lost();
+    result_.datagrams_overflow = uplink_.num_overflowed();
+    result_.acks_lost = downlink_.num_lost();
+    result_.latency = latency_.percentiles();
+    return result_;
+  }
+
+private:
+  VirtualClock & clock_;
+  const SimOptions & options_;
+  SimParams params_;
+
+  unique_ptr<VideoInput> video_input_ {};
+  RawImage raw_img_ {options_.width, options_.height};
+  Encoder encoder_;
+  Decoder decoder_;
+  LinkModel uplink_;   // sender to receiver
+  LinkModel downlink_; // receiver to sender (ACKs)
+
+  map<uint32_t, uint64_t> capture_ts_ {}; // frame ID -> capture timestamp
+  LatencyHistogram latency_ {};
+  SimResult result_ {};
+
+  LinkModel::Config link_config(const bool uplink) const
+  {
+    LinkModel::Config config;
+    config.delay_us = llround(params_.rtt_ms * 1000 / 2);
+    config.loss = params_.loss;
+
+    // the bottleneck is on the way to the receiver, where the video goes
+    if (uplink) {
+      uint64_t rate_kbps = params_.rate_kbps;
+      if (not params_.trace.empty()) {
+        config.trace = options_.traces.at(params_.trace);
+        rate_kbps = llround(config.trace->average_kbps());
+      }
+
+      config.rate_kbps = params_.rate_kbps;
+      config.queue_bytes = rate_kbps * options_.queue_ms / 8;
+      config.seed = params_.seed;
+    } else {
+      config.seed = params_.seed + 0x9e3779b9; // an independent stream
+    }
+
+    return config;
+  }
+
+  void capture_frame()
+  {
+    if (not video_input_->read_frame(raw_img_)) {
+      clock_.stop(); // reached the end of the input
+      return;
+    }
+
+    const uint64_t now = clock_.now_us();
+    capture_ts_[encoder_.frame_id()] = now;
+    encoder_.compress_frame(raw_img_, now);
+    result_.frames_encoded++;
+
+    send_datagrams();
+  }
+
+  // the video socket is always writable: the link queue is the bottleneck
+  void send_datagrams()
+  {
+    deque<FrameDatagram> & send_buf = encoder_.send_buf();
+
+    while (not send_buf.empty()) {
+      auto & datagram = send_buf.front();
+      datagram.send_ts = clock_.now_us();
+
+      string raw_data = datagram.serialize_to_string();
+      const auto arrival_ts = uplink_.transmit(raw_data.size(), clock_.now_us());
+      if (arrival_ts) {
+        clock_.schedule_at(*arrival_ts,
+          [this, raw_data = move(raw_data)]() { receive_datagram(raw_data); });
+      }
+
+      result_.datagrams_sent++;
+      if (datagram.num_rtx == 0) {
+        encoder_.add_unacked(move(datagram));
+      } else {
+        result_.datagrams_rtx++;
+      }
+
+      send_buf.pop_front();
+    }
+  }
+
+  void receive_datagram(const string & raw_data)
+  {
+    FrameDatagram datagram;
+    if (not datagram.parse_from_string(raw_data)) {
+      throw runtime_error("failed to parse a datagram");
+    }
+    datagram.recv_ts = clock_.now_us();
+
+    // send an ACK back to the sender
+    const string ack = AckMsg(datagram).serialize_to_string();
+    const auto arrival_ts = downlink_.transmit(ack.size(), clock_.now_us());
+    if (arrival_ts) {
+      clock_.schedule_at(*arrival_ts, [this, ack]() { receive_ack(ack); });
+    }
+
+    decoder_.add_datagram(move(datagram));
+
+    while (decoder_.next_frame_complete()) {
+      const uint32_t frame_id = decoder_.next_frame();
+      decoder_.consume_next_frame();
+
+      const auto it = capture_ts_.find(frame_id);
+      if (it != capture_ts_.end()) {
+        latency_.record(clock_.now_us() - it->second);
+        capture_ts_.erase(capture_ts_.begin(), next(it));
+      }
+
+      result_.frames_delivered++;
+    }
+
+    result_.bytes_received += raw_data.size();
+  }
+
+  void receive_ack(const string & raw_data)
+  {
+    const shared_ptr<Msg> msg = Msg::parse_from_string(raw_data);
+    if (msg == nullptr or msg->type != Msg::Type::ACK) {
+      return;
+    }
+
+    encoder_.handle_ack(dynamic_pointer_cast<AckMsg>(msg));
+    send_datagrams();
+  }
+};
+
+// run a simulation on the calling thread, reporting errors in the result
+SimResult simulate(const SimOptions & options, const SimParams & params,
+                   const string & log_prefix)
+{
+  const auto wall_start = steady_clock::now();
+  SimResult result;
+
+  // timestamps taken by the Encoder and Decoder (from their construction
+  // on) read the virtual clock
+  VirtualClock clock;
+  set_thread_clock(&clock);
+
+  try {
+    Simulation sim(clock, options, params, log_prefix);
+    result = sim.run();
+  } catch (const exception & e) {
+    result.error = e.what();
+  }
+  set_thread_clock(nullptr);
+
+  result.wall_s = duration<double>(steady_clock::now() - wall_start).count();
+  return result;
+}
+
+template <typename T>
+vector<T> parse_list(const string & str, const function<T(const string &)> & parse)
+{
+  vector<T> values;
+  for (const auto & token : split(str, ",")) {
+    values.emplace_back(parse(token));
+  }
+  if (values.empty()) {
+    throw runtime_error("Empty list: " + str);
+  }
+  return values;
+}
+
+int main(int argc, char * argv[])
+{
+  SimOptions options;
+  vector<unsigned int> bitrates {1000};
+  vector<uint64_t> rates {0};
+  vector<string> traces;
+  vector<double> rtts {40};
+  vector<double> losses {0};
+  unsigned int num_seeds = 1;
+  size_t num_jobs = 0;
+  string output_path;
+  bool verbose = false;
+
+  const auto to_uint = [](const string & s) { return static_cast<unsigned int>(strict_stoi(s)); };
+  const auto to_u64 = [](const string & s) { return static_cast<uint64_t>(strict_stoll(s)); };
+  const auto to_double = [](const string & s) { return stod(s); };
+
+  const option cmd_line_opts[] = {
+    {"fps",             required_argument, nullptr, 'F'},
+    {"streamtime",      required_argument, nullptr, 'T'},
+    {"bitrate",         required_argument, nullptr, 'b'},
+    {"rate",            required_argument, nullptr, 'r'},
+    {"trace",           required_argument, nullptr, 't'},
+    {"rtt",             required_argument, nullptr, 'd'},
+    {"loss",            required_argument, nullptr, 'l'},
+    {"queue",           required_argument, nullptr, 'Q'},
+    {"seeds",           required_argument, nullptr, 's'},
+    {"jobs",            required_argument, nullptr, 'j'},
+    {"encoder-threads", required_argument, nullptr, 'E'},
+    {"mtu",             required_argument, nullptr, 'M'},
+    {"log-dir",         required_argument, nullptr, 'L'},
+    {"output",          required_argument, nullptr, 'o'},
+    {"verbose",         no_argument,       nullptr, 'v'},
+    { nullptr,          0,                 nullptr,  0 },
+  };
+
+  while (true) {
+    const int opt = getopt_long(argc, argv, "b:r:t:d:l:s:j:o:v", cmd_line_opts, nullptr);
+    if (opt == -1) {
+      break;
+    }
+
+    switch (opt) {
+      case 'F':
+        options.frame_rate = narrow_cast<uint16_t>(strict_stoi(optarg));
+        break;
+      case 'T':
+        options.stream_time_s = strict_stoi(optarg);
+        break;
+      case 'b':
+        bitrates = parse_list<unsigned int>(optarg, to_uint);
+        break;
+      case 'r':
+        rates = parse_list<uint64_t>(optarg, to_u64);
+        break;
+      case 't':
+        traces = parse_list<string>(optarg, [](const string & s) { return s; });
+        break;
+      case 'd':
+        rtts = parse_list<double>(optarg, to_double);
+        break;
+      case 'l':
+        losses = parse_list<double>(optarg, to_double);
+        break;
+      case 'Q':
+        options.queue_ms = strict_stoi(optarg);
+        break;
+      case 's':
+        num_seeds = strict_stoi(optarg);
+        break;
+      case 'j':
+        num_jobs = strict_stoi(optarg);
+        break;
+      case 'E':
+        options.encoder_threads = strict_stoi(optarg);
+        break;
+      case 'M':
+        FrameDatagram::set_mtu(strict_stoi(optarg));
+        break;
+      case 'L':
+        options.log_dir = optarg;
+        break;
+      case 'o':
+        output_path = optarg;
+        break;
+      case 'v':
+        verbose = true;
+        break;
+      default:
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+
+  if (optind != argc - 3) {
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  options.width = narrow_cast<uint16_t>(strict_stoi(argv[optind]));
+  options.height = narrow_cast<uint16_t>(strict_stoi(argv[optind + 1]));
+  options.input = argv[optind + 2];
+
+  if (options.frame_rate == 0 or num_seeds == 0) {
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  // the links swept over: each trace if any, or else each rate
+  vector<pair<uint64_t, string>> links;
+  for (const auto & trace : traces) {
+    const auto loaded = make_shared<LinkTrace>(LinkTrace::load(trace));
+    options.traces.emplace(trace, loaded);
+    links.emplace_back(0, trace);
+
+    clog << "Loaded " << trace << ": " << loaded->size() << " opportunities over "
+         << double_to_string(loaded->period_us() / 1e6) << " s (average "
+         << double_to_string(loaded->average_kbps() / 1000) << " Mbps)" << endl;
+  }
+  if (traces.empty()) {
+    for (const auto rate : rates) {
+      links.emplace_back(rate, "");
+    }
+  }
+
+  // every combination of the swept parameters
+  vector<SimParams> runs;
+  for (const auto bitrate : bitrates) {
+    for (const auto & [rate, trace] : links) {
+      for (const auto rtt : rtts) {
+        for (const auto loss : losses) {
+          for (uint32_t seed = 1; seed <= num_seeds; seed++) {
+            runs.push_back({bitrate, rate, trace, rtt, loss, seed});
+          }
+        }
+      }
+    }
+  }
+
+  // the encoders and decoders log to cerr, which would interleave across
+  // runs; progress goes to clog (sharing cerr's buffer but not its state)
+  if (not verbose) {
+    cerr.setstate(ios::failbit);
+  }
+
+  ThreadPool pool(num_jobs);
+  clog << "Simulating " << runs.size() << " runs of " << options.stream_time_s
+       << " s on " << pool.size() << " threads" << endl;
+
+  vector<SimResult> results(runs.size());
+  mutex progress_mtx;
+  size_t num_done = 0;
+
+  const auto sweep_start = steady_clock::now();
+  pool.parallel_for(runs.size(),
+    [&](const size_t i)
+    {
+      const string log_prefix = options.log_dir.empty() ? ""
+                                : options.log_dir + "/run" + to_string(i);
+      results[i] = simulate(options, runs[i], log_prefix);
+
+      lock_guard<mutex> lock(progress_mtx);
+      clog << "[" << ++num_done << "/" << runs.size() << "] " << runs[i].str()
+           << (results[i].error.empty() ? "" : ": " + results[i].error)
+           << " (" << double_to_string(results[i].wall_s) << " s)" << endl;
+    }
+  );
+  const double sweep_s = duration<double>(steady_clock::now() - sweep_start).count();
+
+  ofstream output_file;
+  if (not output_path.empty()) {
+    output_file.open(output_path);
+    if (not output_file) {
+      throw runtime_error("Failed to open " + output_path);
+    }
+  }
+  ostream & out = output_path.empty() ? cout : output_file;
+
+  out << "bitrate_kbps,rate_kbps,trace,rtt_ms,loss,seed,frames_encoded,frames_delivered,"
+         "recv_kbps,datagrams_sent,datagrams_rtx,datagrams_lost,"
+         "datagrams_overflow,acks_lost,latency_p50_ms,latency_p90_ms,"
+         "latency_p99_ms,latency_max_ms,sim_s,wall_s,error\n";
+
+  double total_sim_s = 0;
+  for (size_t i = 0; i < runs.size(); i++) {
+    const auto & p = runs[i];
+    const auto & r = results[i];
+    const auto ms = [](const uint64_t us) { return double_to_string(us / 1000.0); };
+
+    out << p.bitrate_kbps << "," << p.rate_kbps << "," << p.trace << ","
+        << double_to_string(p.rtt_ms)
+        << "," << double_to_string(p.loss, 4) << "," << p.seed << ","
+        << r.frames_encoded << "," << r.frames_delivered << ","
+        << double_to_string(r.sim_s > 0 ? r.bytes_received * 8 / r.sim_s / 1000 : 0)
+        << "," << r.datagrams_sent << "," << r.datagrams_rtx << ","
+        << r.datagrams_lost << "," << r.datagrams_overflow << "," << r.acks_lost << ","
+        << ms(r.latency.p50) << "," << ms(r.latency.p90) << ","
+        << ms(r.latency.p99) << "," << ms(r.latency.max) << ","
+        << double_to_string(r.sim_s) << "," << double_to_string(r.wall_s) << ","
+        << (r.error.empty() ? "" : "\"" + r.error + "\"") << "\n";
+
+    total_sim_s += r.sim_s;
+  }
+  out.flush();
+
+  clog << "Simulated " << double_to_string(total_sim_s) << " s in "
+       << double_to_string(sweep_s) << " s ("
+       << double_to_string(sweep_s > 0 ? total_sim_s / sweep_s : 0)
+       << "x real time)" << endl;
+
+  return EXIT_SUCCESS;
+}
@@ -11,7 +11,10 @@
 #include "timerfd.hh"
 #include "udp_socket.hh"
 #include "poller.hh"
-#include "yuv4mpeg.hh"
+#include "video_source.hh"
+#include "prefetch_video_input.hh"
+#include "frame_pool.hh"
+#include "perf_counters.hh"
 #include "protocol.hh"
 #include "vp9_encoder.hh"
 #include "timestamp.hh"
@@ -27,14 +30,24 @@ namespace {
 void print_usage(const string & program_name)
 {
   cerr <<
-  "Usage: " << program_name << " [options] port y4m\n\n"
+  "Usage: " << program_name << " [options] port input\n\n"
+  "Input:\n"
+  "<y4m>                      a y4m file\n"
+  "synthetic[:<options>]      procedurally generated frames, e.g.,\n"
+  "                           synthetic:complexity=0.8,scene=120\n\n"
   "Options:\n"
   "--mtu <MTU>                MTU for deciding UDP payload size\n"
   "-o, --output <file>        file to output performance results to\n"
   "-v, --verbose              enable more logging for debugging"
-  "--buffer <size>       size of the raw image buffer in frames\n"
+  "--buffer <size>       number of raw frames to read ahead (default: 8)\n"
+  "--hugetlb             back raw frames with reserved huge pages instead of\n"
+  "                      transparent huge pages\n"
   "--row <size>          number of rows of tiling\n"
   "--col <size>          number of columns of tiling\n"
+  "--static-threshold <diff>  mean absolute pixel difference from when a tile\n"
+  "                           was last encoded up to which it is unchanged and\n"
+  "                           skipped (default: 0, i.e.,\n"
+  "                           identical pixels); negative to encode all tiles\n"
   << endl;
 }
 
@@ -76,9 +89,11 @@ int main(int argc, char * argv[])
   // argument parsing
   string output_path;
   bool verbose = false;
-  int raw_img_buffer_size = 240;
+  int prefetch_size = 8;
+  auto huge_pages = FramePool::HugePages::TRANSPARENT;
   uint16_t n_row = 4;
   uint16_t n_col = 4;
+  double static_threshold = 0;
 
 
   const option cmd_line_opts[] = {
@@ -86,6 +101,8 @@ int main(int argc, char * argv[])
     {"output",  required_argument, nullptr, 'o'},
     {"verbose", no_argument,       nullptr, 'v'},
     {"buffer",  required_argument, nullptr, 'B'},
+    {"hugetlb", no_argument,       nullptr, 'H'},
+    {"static-threshold", required_argument, nullptr, 'S'},
     { nullptr,  0,                 nullptr,  0 }
   };
 
@@ -106,7 +123,13 @@ int main(int argc, char * argv[])
         verbose = true;
         break;
       case 'B':
-        raw_img_buffer_size = strict_stoi(optarg);
+        prefetch_size = strict_stoi(optarg);
+        break;
+      case 'H':
+        huge_pages = FramePool::HugePages::EXPLICIT;
+        break;
+      case 'S':
+        static_threshold = stod(optarg);
         break;
       default:
         print_usage(argv[0]);
@@ -121,7 +144,7 @@ int main(int argc, char * argv[])
 
   const auto video_port = narrow_cast<uint16_t>(strict_stoi(argv[optind]));
   const auto signal_port = narrow_cast<uint16_t>(video_port + 1);
-  const string y4m_path = argv[optind + 1];
+  const string input_spec = argv[optind + 1];
   UDPSocket video_sock; 
   video_sock.bind({"0", video_port});
   cerr << "Local address: " << video_sock.local_address().str() << endl;
@@ -161,24 +184,22 @@ int main(int argc, char * argv[])
   signal_sock.set_blocking(false);
 
   // open the video file
-  YUV4MPEG video_input(y4m_path, frame_width, frame_height);
+  // count page faults and dTLB misses (before any thread is created)
+  PerfCounters perf_counters;
 
-  // initialize the raw image buffer
-  vector<TiledImage*> raw_img_buffer;
-  raw_img_buffer.resize(raw_img_buffer_size);
-  for (int i = 0; i < raw_img_buffer_size; i++) {
-    raw_img_buffer[i] = new TiledImage(frame_width, frame_height, n_row, n_col);
-  }
-  // read the raw video frames into the buffer
-  for (int i = 0; i < raw_img_buffer_size; i++) {
-    if (not video_input.read_frame(raw_img_buffer[i]->get_frame())) {
-      throw runtime_error("Faile to fill the raw frame buffer");
-    }
-    if (i % 10 == 9) {
-      cerr << "Raw frame buffer filled: " << i + 1 << " frames" << endl;
-    }
-  }
-  int frame_idx = 0;  // index of the next raw frame to be sent
+  // open the video input and read frames ahead in the background
+  PrefetchVideoInput video_input(
+    open_video_input(input_spec, frame_width, frame_height, init_frame_rate),
+    prefetch_size, huge_pages);
+  uint64_t last_underruns = 0;
+
+  // the current frame, and the content last encoded for each tile (a tile
+  // is compared against it rather than against the previous frame, so that
+  // gradual changes below the threshold still add up to an encoded tile)
+  FramePool frame_pool(frame_width, frame_height, 2, huge_pages);
+  FramePool tile_pool(tile_width, tile_height, 2 * n_row * n_col, huge_pages);
+  TiledImage curr_img {frame_width, frame_height, n_row, n_col, &frame_pool, &tile_pool};
+  TiledImage ref_img {frame_width, frame_height, n_row, n_col, &frame_pool, &tile_pool};
 
 
   // initialize the encoder
@@ -200,8 +221,15 @@ int main(int argc, char * argv[])
   const timespec frame_interval {0, static_cast<long>(BILLION / init_frame_rate)}; // {sec, nsec}
   fps_timer.set_time(frame_interval, frame_interval); // {initial expiration, interval}
 
-  // threads
-  vector<thread> threads;
+  // if ref_img holds the content of every tile (i.e., after the first frame)
+  bool has_ref = false;
+
+  // stats of skipping unchanged tiles
+  unsigned int num_skipped_tiles = 0;
+  unsigned int num_total_tiles = 0;
+  uint64_t last_encoded_bytes = 0; // by all tile encoders
+  double total_diff_time_ms = 0.0;
+  double total_encode_time_ms = 0.0;
 
   // read a raw frame when the periodic timer fires
   poller.register_event(fps_timer, Poller::In,
@@ -212,8 +240,19 @@ int main(int argc, char * argv[])
       if (num_exp > 1) {
         cerr << "Warning: skipping " << num_exp - 1 << " raw frames" << endl;
       }
+
+      // signal the skipped frames as repeats of the last one, so that frame
+      // IDs keep counting source frames (e.g., for recordings to stay aligned)
+      for (unsigned int i = 1; i < num_exp; i++) {
+        for (auto encoder : encoders) {
+          encoder->repeat_frame();
+        }
+      }
+      TiledImage * img = &curr_img;
       for (unsigned int i = 0; i < num_exp; i++) {
-        frame_idx = (frame_idx + 1) % raw_img_buffer_size;
+        if (not video_input.read_frame(img->get_frame())) {
+          throw runtime_error("Reached the end of video input");
+        }
       }
 
       //debug
@@ -234,33 +273,65 @@ int main(int argc, char * argv[])
       //   }
       // }
 
-      raw_img_buffer[frame_idx]->partition(); 
-      TiledImage * img = raw_img_buffer[frame_idx];
+      // detect the tiles that changed since they were last encoded
+      vector<bool> dirty(n_row * n_col, true);
+      if (has_ref and static_threshold >= 0) {
+        const auto diff_start = steady_clock::now();
+        dirty = img->changed_tiles(ref_img, static_threshold);
+        total_diff_time_ms += duration<double, milli>(
+                              steady_clock::now() - diff_start).count();
+      }
+
+      // a tile waiting for loss recovery must be encoded regardless
+      for (int k = 0; k < n_row * n_col; k++) {
+        if (encoders[k]->recovery_pending()) {
+          dirty[k] = true;
+        }
+      }
+
+      img->partition(dirty);
+      ref_img.copy_tiles(*img, dirty);
+      has_ref = true;
 
       // Create a vector to hold all the threads
       std::vector<std::thread> encoding_threads;
 
+      const auto encode_start = steady_clock::now();
       for (int i = 0; i < n_row; i++) {
           for (int j = 0; j < n_col; j++) {
-              encoding_threads.emplace_back([&, i, j]() {
+              const int k = i * n_col + j;
+
+              // unchanged tiles are only signaled to be repeated
+              if (not dirty[k]) {
+                  encoders[k]->repeat_frame();
+                  num_skipped_tiles++;
+                  continue;
+              }
+
+              encoding_threads.emplace_back([&, i, j, k]() {
                   RawImage & tile = img->get_tile(i, j);
-                  encoders[i * n_col + j]->compress_frame(tile);
+                  encoders[k]->compress_frame(tile);
               });
           }
       }
+      num_total_tiles += n_row * n_col;
 
       // Wait for all encoding threads to complete
       for (std::thread &t : encoding_threads) {
           t.join();
       }
+      total_encode_time_ms += duration<double, milli>(
+                              steady_clock::now() - encode_start).count();
+
+      // datagrams carry no tile index and the receiver decodes the stream
+      // of the first tile only, so the other tiles are encoded (and their
+      // bytes counted) but not sent
+      for (int k = 1; k < n_row * n_col; k++) {
+          encoders[k]->send_buf().clear();
+      }
 
-      // After all threads have completed, check the send buffers and activate poller
-      for (int i = 0; i < n_row; i++) {
-          for (int j = 0; j < n_col; j++) {
-              if (not encoders[i * n_col + j]->send_buf().empty()) {
-                  poller.activate(video_sock, Poller::Out);
-              }
-          }
+      if (not encoders[0]->send_buf().empty()) {
+          poller.activate(video_sock, Poller::Out);
       }
 
 
@@ -355,6 +426,42 @@ int main(int argc, char * argv[])
       }
       // output stats every second
       encoders[0]->output_periodic_stats();
+      perf_counters.output_periodic_stats();
+
+      // bytes encoded by all tiles in the last ~1s, and the bytes saved by
+      // skipping estimated from the average size of the tiles encoded
+      uint64_t encoded_bytes = 0;
+      for (const auto encoder : encoders) {
+        encoded_bytes += encoder->total_encoded_bytes();
+      }
+      const uint64_t interval_bytes = encoded_bytes - last_encoded_bytes;
+      last_encoded_bytes = encoded_bytes;
+
+      if (num_total_tiles > 0) {
+        const unsigned int num_encoded_tiles = num_total_tiles - num_skipped_tiles;
+        const double saved_bytes = num_encoded_tiles > 0 ?
+          static_cast<double>(interval_bytes) / num_encoded_tiles * num_skipped_tiles : 0;
+
+        cerr << "  - Unchanged tiles skipped: " << num_skipped_tiles << "/"
+             << num_total_tiles << " (change detection/encoding time in ms: "
+             << double_to_string(total_diff_time_ms) << "/"
+             << double_to_string(total_encode_time_ms) << ")" << endl;
+        cerr << "  - Encoded by all tiles in the last ~1s (kbit): "
+             << double_to_string(interval_bytes * 8 / 1000.0)
+             << " (est. saved by skipping: "
+             << double_to_string(saved_bytes * 8 / 1000.0) << ")" << endl;
+      }
+      num_skipped_tiles = 0;
+      num_total_tiles = 0;
+      total_diff_time_ms = 0.0;
+      total_encode_time_ms = 0.0;
+
+      const uint64_t underruns = video_input.num_underruns();
+      if (underruns > last_underruns) {
+        cerr << "Warning: raw frames not ready in time "
+             << underruns - last_underruns << " times" << endl;
+        last_underruns = underruns;
+      }
     }
   );
 
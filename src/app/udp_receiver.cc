@@ -11,6 +11,8 @@
 #include "sdl.hh"
 #include "protocol.hh"
 #include "vp9_decoder.hh"
+#include "timestamp.hh"
+#include "clock_sync.hh"
 
 using namespace std;
 using namespace chrono;
@@ -28,6 +30,13 @@ void print_usage(const string & program_name)
   "-o, --output <file>  file to output performance results to\n"
   "-v, --verbose        enable more logging for debugging"
   "--streamtime         total streaming time in seconds\n"
+  "--dump <dir>         save displayed frames in dir as PNGs (in the\n"
+  "                     background; dropped if saving falls behind)\n"
+  "--record <file>      record decoded frames into a y4m file, one per\n"
+  "                     frame ID (repeating the previous frame for frames\n"
+  "                     skipped) so that it aligns with the source\n"
+  "--score <y4m>        score decoded frames live (PSNR/SSIM) against a\n"
+  "                     local copy of the sender's y4m input\n"
   << endl;
 }
 
@@ -38,6 +47,9 @@ int main(int argc, char * argv[])
   unsigned int target_bitrate = 0; // kbps
   int lazy_level = 0;
   string output_path;
+  string dump_dir;
+  string record_path;
+  string score_path;
   bool verbose = false;
   uint16_t total_stream_time = 60;
 
@@ -48,6 +60,9 @@ int main(int argc, char * argv[])
     {"output",  required_argument, nullptr, 'o'},
     {"verbose", no_argument,       nullptr, 'v'},
     {"streamtime", required_argument, nullptr, 'T'},
+    {"dump",    required_argument, nullptr, 'D'},
+    {"record",  required_argument, nullptr, 'R'},
+    {"score",   required_argument, nullptr, 'S'},
     { nullptr,  0,                 nullptr,  0 },
   };
 
@@ -76,6 +91,15 @@ int main(int argc, char * argv[])
       case 'T':
         total_stream_time = narrow_cast<uint16_t>(strict_stoi(optarg));
         break;
+      case 'D':
+        dump_dir = optarg;
+        break;
+      case 'R':
+        record_path = optarg;
+        break;
+      case 'S':
+        score_path = optarg;
+        break;
       default:
         print_usage(argv[0]);
         return EXIT_FAILURE;
@@ -113,9 +137,22 @@ int main(int argc, char * argv[])
   const SignalMsg init_signal_msg(target_bitrate); 
   signal_sock.send(init_signal_msg.serialize_to_string());
   cerr <<  "init_signal_msg sent" << endl;
+
+  // clock synchronization replies are polled for without blocking
+  signal_sock.set_blocking(false);
+  ClockSync clock_sync;
   
   // initialize decoders
-  Decoder decoder(width, height, lazy_level, output_path);
+  unique_ptr<Y4MRecorder> recorder;
+  if (not record_path.empty()) {
+    recorder = make_unique<Y4MRecorder>(record_path, width, height, frame_rate);
+  }
+  unique_ptr<QualityMonitor> monitor;
+  if (not score_path.empty()) {
+    monitor = make_unique<QualityMonitor>(score_path, width, height);
+  }
+  Decoder decoder(width, height, lazy_level, output_path, dump_dir,
+                  move(recorder), move(monitor));
   decoder.set_verbose(verbose);
 
   // timer for sending signal messages
@@ -129,8 +166,9 @@ int main(int argc, char * argv[])
     if (not datagram.parse_from_string(video_sock.recv().value())) {
       throw runtime_error("failed to parse a datagram");
     }
+    datagram.recv_ts = timestamp_us();
 
-    // send an ACK back to sender
+    // send an ACK back to sender (echoing when it arrived)
     AckMsg ack(datagram);
     video_sock.send(ack.serialize_to_string());
 
@@ -139,6 +177,41 @@ int main(int argc, char * argv[])
            << " frag_id=" << datagram.frag_id << endl;
     }
 
+    // synchronize clocks with the sender over the signal socket
+    const uint64_t now = timestamp_us();
+    if (clock_sync.request_due(now)) {
+      signal_sock.send(ClockMsg(now).serialize_to_string());
+    }
+
+    while (clock_sync.awaiting_reply()) {
+      const auto raw_reply = signal_sock.recv();
+      if (not raw_reply) { // EWOULDBLOCK; try again after the next datagram
+        break;
+      }
+
+      const shared_ptr<Msg> msg = Msg::parse_from_string(*raw_reply);
+      if (msg == nullptr or msg->type != Msg::Type::CLOCK) {
+        continue;
+      }
+
+      const auto reply = dynamic_pointer_cast<ClockMsg>(msg);
+      const uint64_t reply_recv_ts = timestamp_us();
+      clock_sync.add_sample(reply->origin_ts, reply->receive_ts,
+                            reply->transmit_ts, reply_recv_ts);
+
+      const auto offset = clock_sync.offset_us(reply_recv_ts);
+      if (offset) {
+        decoder.set_sender_clock_offset(*offset);
+
+        if (clock_sync.num_samples() % 10 == ClockSync::NUM_INITIAL % 10) {
+          cerr << "Sender clock offset (ms): " << double_to_string(*offset / 1000.0)
+               << ", skew (ppm): " << double_to_string(clock_sync.skew_ppm())
+               << ", delay (ms): " << double_to_string(*clock_sync.delay_us() / 1000.0)
+               << endl;
+        }
+      }
+    }
+
     // process the received datagram in the decoder
     decoder.add_datagram(move(datagram)); // the parameter is a temporary object, so we need to move() it to avoid copying it. 
 
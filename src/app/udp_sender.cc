@@ -10,7 +10,8 @@
 #include "timerfd.hh"
 #include "udp_socket.hh"
 #include "poller.hh"
-#include "yuv4mpeg.hh"
+#include "video_source.hh"
+#include "capture_thread.hh"
 #include "protocol.hh"
 #include "vp9_encoder.hh"
 #include "timestamp.hh"
@@ -26,9 +27,27 @@ namespace {
 void print_usage(const string & program_name)
 {
   cerr <<
-  "Usage: " << program_name << " [options] port y4m\n\n"
+  "Usage: " << program_name << " [options] port input\n\n"
+  "Input:\n"
+  "<y4m>                      a y4m file, read at the requested frame rate\n"
+  "file-camera:<y4m>          a y4m file played back like a live camera\n"
+  "/dev/videoN, v4l2:<dev>    a V4L2 camera\n"
+  "synthetic[:<options>]      procedurally generated frames, e.g.,\n"
+  "                           synthetic:complexity=0.8,scene=120\n"
+  "Live inputs are captured on a dedicated thread, and the latest frame is\n"
+  "encoded as soon as it is captured (older unencoded frames are dropped).\n\n"
   "Options:\n"
   "--mtu <MTU>                MTU for deciding UDP payload size\n"
+  "--speed-control <fraction> raise cpu-used when the p99 encoding time\n"
+  "                           exceeds this fraction of the frame interval\n"
+  "                           (and lower it back when well within)\n"
+  "--min-cpu-used <n>         under speed control, the slowest (best quality)\n"
+  "                           cpu-used to go back to (default: 5)\n"
+  "--max-cpu-used <n>         under speed control, the fastest cpu-used\n"
+  "                           (default: 9)\n"
+  "--max-frame-divisor <N>    under speed control, also encode only 1 of\n"
+  "                           every 2, 4, ..., N frames once at the fastest\n"
+  "                           cpu-used (default: 1, i.e., never)\n"
   "-o, --output <file>        file to output performance results to\n"
   "-v, --verbose              enable more logging for debugging"
   << endl;
@@ -72,12 +91,18 @@ int main(int argc, char * argv[])
   // argument parsing
   string output_path;
   bool verbose = false;
+  bool speed_control = false;
+  SpeedController::Config speed_config;
 
   const option cmd_line_opts[] = {
-    {"mtu",     required_argument, nullptr, 'M'},
-    {"output",  required_argument, nullptr, 'o'},
-    {"verbose", no_argument,       nullptr, 'v'},
-    { nullptr,  0,                 nullptr,  0 },
+    {"mtu",               required_argument, nullptr, 'M'},
+    {"speed-control",     required_argument, nullptr, 'S'},
+    {"max-frame-divisor", required_argument, nullptr, 'D'},
+    {"min-cpu-used",      required_argument, nullptr, 'C'},
+    {"max-cpu-used",      required_argument, nullptr, 'X'},
+    {"output",            required_argument, nullptr, 'o'},
+    {"verbose",           no_argument,       nullptr, 'v'},
+    { nullptr,            0,                 nullptr,  0 },
   };
 
   while (true) {
@@ -90,6 +115,19 @@ int main(int argc, char * argv[])
       case 'M':
         FrameDatagram::set_mtu(strict_stoi(optarg));
         break;
+      case 'S':
+        speed_control = true;
+        speed_config.budget = stod(optarg);
+        break;
+      case 'D':
+        speed_config.max_divisor = strict_stoi(optarg);
+        break;
+      case 'C':
+        speed_config.min_cpu_used = strict_stoi(optarg);
+        break;
+      case 'X':
+        speed_config.max_cpu_used = strict_stoi(optarg);
+        break;
       case 'o':
         output_path = optarg;
         break;
@@ -102,14 +140,16 @@ int main(int argc, char * argv[])
     }
   }
 
-  if (optind != argc - 2) {
+  if (optind != argc - 2 or (speed_control and
+      (speed_config.budget <= 0 or speed_config.max_divisor == 0
+       or speed_config.min_cpu_used > speed_config.max_cpu_used))) {
     print_usage(argv[0]);
     return EXIT_FAILURE;
   }
 
   const auto video_port = narrow_cast<uint16_t>(strict_stoi(argv[optind]));
   const auto signal_port = narrow_cast<uint16_t>(video_port + 1);
-  const string y4m_path = argv[optind + 1];
+  const string input_spec = argv[optind + 1];
   UDPSocket video_sock;
   video_sock.bind({"0", video_port});
   cerr << "Local address: " << video_sock.local_address().str() << endl;
@@ -141,8 +181,10 @@ int main(int argc, char * argv[])
   video_sock.set_blocking(false);
   signal_sock.set_blocking(false);
 
-  // open the video file
-  YUV4MPEG video_input(y4m_path, init_width, init_height);
+  // open the video input
+  const bool live = is_live_video_input(input_spec);
+  unique_ptr<VideoInput> video_input = open_video_input(
+    input_spec, init_width, init_height, init_frame_rate);
 
   // allocate a raw image
   RawImage raw_img(init_width, init_height);
@@ -151,12 +193,18 @@ int main(int argc, char * argv[])
   Encoder encoder(init_width, init_height, init_frame_rate, output_path);
   encoder.set_target_bitrate(init_target_bitrate);
   encoder.set_verbose(verbose);
+  if (speed_control) {
+    encoder.enable_speed_control(speed_config);
+  }
 
   // create a periodic timer with the same period as the frame interval
+  // (unless frames are captured live and encoded as soon as they arrive)
   Poller poller;
   Timerfd fps_timer;
   const timespec frame_interval {0, static_cast<long>(BILLION / init_frame_rate)}; // {sec, nsec}
-  fps_timer.set_time(frame_interval, frame_interval); // {initial expiration, interval}
+  if (not live) {
+    fps_timer.set_time(frame_interval, frame_interval); // {initial expiration, interval}
+  }
 
   // // a counter for the number of frames sent
   // unsigned int num_frames_sent = 0;
@@ -171,9 +219,15 @@ int main(int argc, char * argv[])
         cerr << "Warning: skipping " << num_exp - 1 << " raw frames" << endl;
       }
 
+      // signal the skipped frames as repeats of the last one, so that frame
+      // IDs keep counting source frames (e.g., for recordings to stay aligned)
+      for (unsigned int i = 1; i < num_exp; i++) {
+        encoder.repeat_frame();
+      }
+
       for (unsigned int i = 0; i < num_exp; i++) {
         // fetch a raw frame into 'raw_img' from the video input
-        if (not video_input.read_frame(raw_img)) {
+        if (not video_input->read_frame(raw_img)) {
           throw runtime_error("Reached the end of video input");
         }
       }
@@ -195,6 +249,36 @@ int main(int argc, char * argv[])
     }
   );
 
+  // capture live inputs on a dedicated thread and encode each latest frame
+  unique_ptr<CaptureThread> capture;
+  if (live) {
+    capture = make_unique<CaptureThread>(move(video_input));
+
+    poller.register_event(capture->notify_fd(), Poller::In,
+      [&]()
+      {
+        const auto frame = capture->take_latest();
+        if (not frame) {
+          if (capture->ended()) {
+            throw runtime_error("Reached the end of video input");
+          }
+          return;
+        }
+
+        // frames dropped before encoding are repeats of the last one too
+        while (encoder.frame_id() < frame->seq) {
+          encoder.repeat_frame();
+        }
+
+        encoder.compress_frame(*frame->img, frame->capture_ts_us);
+
+        if (not encoder.send_buf().empty()) {
+          poller.activate(video_sock, Poller::Out);
+        }
+      }
+    );
+  }
+
   // when the video socket is writable
   poller.register_event(video_sock, Poller::Out,
     [&]()
@@ -270,6 +354,8 @@ int main(int argc, char * argv[])
   );
 
   // create a periodic timer for outputting stats every second
+  uint64_t last_captured = 0;
+  uint64_t last_dropped = 0;
   Timerfd stats_timer;
   const timespec stats_interval {1, 0};
   stats_timer.set_time(stats_interval, stats_interval);
@@ -281,6 +367,15 @@ int main(int argc, char * argv[])
       }
       // output stats every second
       encoder.output_periodic_stats();
+
+      if (capture) {
+        const uint64_t captured = capture->num_captured();
+        const uint64_t dropped = capture->num_dropped();
+        cerr << "  - Frames captured/dropped before encoding: "
+             << captured - last_captured << "/" << dropped - last_dropped << endl;
+        last_captured = captured;
+        last_dropped = dropped;
+      }
     }
   );
 
@@ -291,10 +386,22 @@ int main(int argc, char * argv[])
       while (true) {
         const auto & raw_data = signal_sock.recv();
         if (not raw_data) { // EWOULDBLOCK; try again when data is available
-        cerr << "Unknown message type received on RTCP port." << endl;
           break;
         }
+        const uint64_t recv_ts = timestamp_us();
         const shared_ptr<Msg> sig_msg = Msg::parse_from_string(*raw_data);
+        if (sig_msg == nullptr) {
+          return;
+        }
+
+        // answer clock synchronization requests right away
+        if (sig_msg->type == Msg::Type::CLOCK) {
+          const auto clock = dynamic_pointer_cast<ClockMsg>(sig_msg);
+          if (not clock->is_reply()) {
+            signal_sock.send(clock->make_reply(recv_ts).serialize_to_string());
+          }
+          continue;
+        }
 
         // handle the signal message
        if (sig_msg->type == Msg::Type::SIGNAL) {
@@ -3,6 +3,7 @@
 #include <iostream>
 #include <stdexcept>
 #include <algorithm>
+#include <cmath>
 
 #include "vp9_decoder.hh"
 #include "exception.hh"
@@ -13,6 +14,25 @@
 using namespace std;
 using namespace chrono;
 
+namespace {
+  // zero-copy crops on the sender are snapped to even pixels
+  constexpr double CROP_ALIGNMENT_TOLERANCE = 2.0;
+
+  // the frame just decoded in 'context', if it is to be shown
+  vpx_image * get_decoded_frame(vpx_codec_ctx_t & context)
+  {
+    vpx_codec_iter_t iter = nullptr;
+    vpx_image * raw_img = vpx_codec_get_frame(&context, &iter);
+
+    // there should be exactly one frame decoded
+    if (raw_img and vpx_codec_get_frame(&context, &iter)) {
+      throw runtime_error("Multiple frames were decoded at once");
+    }
+
+    return raw_img;
+  }
+}
+
 Frame::Frame(const uint32_t frame_id,
              const FrameType frame_type,
              const uint16_t frag_cnt)
@@ -57,6 +77,20 @@ void Frame::validate_datagram(const FrameDatagram & datagram) const
   }
 }
 
+void Frame::update_timestamps(const FrameDatagram & datagram)
+{
+  // datagrams not stamped on arrival count as arriving now
+  const uint64_t recv_ts = datagram.recv_ts ? datagram.recv_ts : timestamp_us();
+
+  first_recv_ts_ = min(first_recv_ts_, recv_ts);
+  if (complete()) {
+    complete_ts_ = recv_ts;
+  }
+
+  first_send_ts_ = min(first_send_ts_, datagram.send_ts);
+  last_send_ts_ = max(last_send_ts_, datagram.send_ts);
+}
+
 void Frame::insert_frag(const FrameDatagram & datagram)
 {
   validate_datagram(datagram);
@@ -65,6 +99,7 @@ void Frame::insert_frag(const FrameDatagram & datagram)
   if (not frags_[datagram.frag_id]) {
     frame_size_ += datagram.payload.size();
     null_frags_--;
+    update_timestamps(datagram);
     frags_[datagram.frag_id] = datagram;
   }
 }
@@ -77,6 +112,7 @@ void Frame::insert_frag(FrameDatagram && datagram)
   if (not frags_[datagram.frag_id]) {
     frame_size_ += datagram.payload.size();
     null_frags_--;
+    update_timestamps(datagram);
     frags_[datagram.frag_id] = move(datagram);
   }
 }
@@ -84,9 +120,13 @@ void Frame::insert_frag(FrameDatagram && datagram)
 Decoder::Decoder(const uint16_t display_width,
                  const uint16_t display_height,
                  const int lazy_level,
-                 const string & output_path)
+                 const string & output_path,
+                 const string & dump_dir,
+                 unique_ptr<Y4MRecorder> recorder,
+                 unique_ptr<QualityMonitor> monitor)
   : display_width_(display_width), display_height_(display_height),
-    lazy_level_(), output_fd_(), decoder_epoch_(steady_clock::now())
+    lazy_level_(), event_log_(), dump_dir_(dump_dir),
+    recorder_(move(recorder)), monitor_(move(monitor)), decoder_epoch_(steady_clock::now())
 {
   // validate lazy level
   if (lazy_level < DECODE_DISPLAY or lazy_level > NO_DECODE_DISPLAY) {
@@ -94,13 +134,14 @@ Decoder::Decoder(const uint16_t display_width,
   }
   lazy_level_ = static_cast<LazyLevel>(lazy_level);
 
-  // both main and worker threads start from the same time for stats output
-  last_stats_time_ = decoder_epoch_;
+  // the main thread times its stats on timestamp_us(), so that they follow
+  // the virtual clock when simulated, and the worker on decoder_epoch_
+  last_stats_ts_ = timestamp_us();
 
-  // open the output file
+  // open the output file (an event log; convert it with event_log_dump)
   if (not output_path.empty()) {
-    output_fd_ = FileDescriptor(check_syscall(
-        open(output_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)));
+    event_log_ = make_unique<EventLog>(output_path);
+    events_ = &event_log_->add_producer();
   }
 
   // start the worker thread only if we are going to decode or display frames
@@ -111,6 +152,19 @@ Decoder::Decoder(const uint16_t display_width,
 
 }
 
+Decoder::~Decoder()
+{
+  {
+    lock_guard<mutex> lock(mtx_);
+    stop_ = true;
+  }
+  cv_.notify_one();
+
+  if (worker_.joinable()) {
+    worker_.join();
+  }
+}
+
 bool Decoder::add_datagram_common(const FrameDatagram & datagram)
 {
   const auto frame_id = datagram.frame_id;
@@ -190,23 +244,31 @@ void Decoder::consume_next_frame()
   total_decodable_frame_size_ += frame_size;
   total_datagrams_recv_ += frame.frags().size();
 
+  frame.set_consume_ts(timestamp_us());
+  assembly_delay_.record(frame.consume_ts() - frame.first_recv_ts());
+
   // output stats 
-  const auto stats_now = steady_clock::now();
-  while (stats_now >= last_stats_time_ + 1s) {
+  const uint64_t stats_now = frame.consume_ts();
+  while (stats_now >= last_stats_ts_ + 1000 * 1000) {
     cerr << "Decodable frames in the last ~1s: "
          << num_decodable_frames_ << endl;
 
-    const double diff_ms = duration<double, milli>(
-                           stats_now - last_stats_time_).count();
+    const double diff_ms = (stats_now - last_stats_ts_) / 1000.0;
     if (diff_ms > 0) {
       cerr << "  - Bitrate (kbps): "
            << double_to_string(total_decodable_frame_size_ * 8 / diff_ms)
            << endl;
     }
 
+    const auto [interval, run] = assembly_delay_.take_interval();
+    if (interval.count > 0) {
+      cerr << "  - Frame assembly delay " << interval.str() << endl
+           << "    (run: " << run.str() << ")" << endl;
+    }
+
     num_decodable_frames_ = 0;
     total_decodable_frame_size_ = 0;
-    last_stats_time_ += 1s;
+    last_stats_ts_ += 1000 * 1000;
   }
 
   // put the frame into the shared queue
@@ -279,34 +341,140 @@ double Decoder::decode_frame(vpx_codec_ctx_t & context, const Frame & frame)
 }
 
 
-void Decoder::display_decoded_frame(vpx_codec_ctx_t & context,
-                                    VideoDisplay & display)
+void Decoder::set_viewport(const CropWindow & viewport)
 {
-  vpx_codec_iter_t iter = nullptr;
-  vpx_image * raw_img;
-  unsigned int frame_decoded = 0;
+  // bound the pending viewports in case no frame ever covers them
+  static constexpr size_t MAX_PENDING_VIEWPORTS = 256;
 
-  // display the decoded frame stored in 'context_'
-  while ((raw_img = vpx_codec_get_frame(&context, &iter))) {
-    frame_decoded++;
+  lock_guard<mutex> lock(viewport_mtx_);
+  viewport_ = viewport;
 
-    // there should be exactly one frame decoded  
-    if (frame_decoded > 1) {
-      throw runtime_error("Multiple frames were decoded at once");
+  pending_viewports_.emplace_back(timestamp_us(), viewport);
+  if (pending_viewports_.size() > MAX_PENDING_VIEWPORTS) {
+    pending_viewports_.pop_front();
+  }
+}
+
+optional<double> Decoder::motion_to_photon(const CropWindow & window)
+{
+
+  // latency (ms) from requesting a viewport until showing a frame covering
+  // it; a covered viewport also retires the earlier (superseded) ones
+  const uint64_t now = timestamp_us();
+
+  lock_guard<mutex> lock(viewport_mtx_);
+
+  for (auto it = pending_viewports_.rbegin(); it != pending_viewports_.rend(); it++) {
+    if (window.contains(it->second, CROP_ALIGNMENT_TOLERANCE)) {
+      const double latency_ms = (now - it->first) / 1000.0;
+      pending_viewports_.erase(pending_viewports_.begin(), it.base());
+      return latency_ms;
     }
+  }
 
-    // construct a temporary RawImage that does not own the raw_img
-    display.show_frame(RawImage(raw_img));
+  return nullopt;
+}
 
-    ///////////////////////////////////////////
-    // string filepath = "/home/tungi/Downloads/2M_4k.png";
-    // RawImage(raw_img).save_frame(filepath);
-    ///////////////////////////////////////////
+void Decoder::display_decoded_frame(const RawImage & decoded_img,
+                                    VideoDisplay & display,
+                                    const optional<CropWindow> & window,
+                                    unique_ptr<ImageCropper> & cropper)
+{
+  optional<CropWindow> viewport;
+  {
+    lock_guard<mutex> lock(viewport_mtx_);
+    viewport = viewport_;
+  }
 
+  // show as is if encoded from the viewport
+  if (not window or not viewport or
+      (window->width == viewport->width and window->height == viewport->height
+       and abs(window->center_x() - viewport->center_x()) <= CROP_ALIGNMENT_TOLERANCE
+       and abs(window->center_y() - viewport->center_y()) <= CROP_ALIGNMENT_TOLERANCE)) {
+    display.show_frame(decoded_img);
+    return;
   }
+
+  // the frame was encoded from a different region than the viewport:
+  // crop the viewport out of it locally (best effort if not covered)
+  const double scale_x = static_cast<double>(decoded_img.display_width()) / window->width;
+  const double scale_y = static_cast<double>(decoded_img.display_height()) / window->height;
+
+  const double center_x = (viewport->center_x() - window->center_x()) * scale_x
+                          + decoded_img.display_width() / 2.0;
+  const double center_y = (viewport->center_y() - window->center_y()) * scale_y
+                          + decoded_img.display_height() / 2.0;
+
+  const auto crop_width = static_cast<uint16_t>(clamp(
+    lround(viewport->width * scale_x), 2L, static_cast<long>(decoded_img.display_width())));
+  const auto crop_height = static_cast<uint16_t>(clamp(
+    lround(viewport->height * scale_y), 2L, static_cast<long>(decoded_img.display_height())));
+
+  if (not cropper) {
+    cropper = make_unique<ImageCropper>(display_width_, display_height_);
+  }
+
+  display.show_frame(cropper->crop(decoded_img, center_x, center_y,
+                                   crop_width, crop_height, true));
 }
 
 
+void Decoder::set_sender_clock_offset(const double offset_us)
+{
+  sender_clock_offset_us_.store(llround(offset_us), memory_order_relaxed);
+}
+
+optional<int64_t> Decoder::receiver_clock_offset(const FrameDatagram & first_frag) const
+{
+  const int64_t sender_offset = sender_clock_offset_us_.load(memory_order_relaxed);
+  if (sender_offset != NO_CLOCK_OFFSET) {
+    return -sender_offset;
+  }
+
+  return first_frag.clock_offset_us;
+}
+
+void Decoder::log_latency(const Frame & frame, const uint64_t decode_end_ts,
+                          const optional<uint64_t> display_ts)
+{
+  // the sender's timestamps travel with the first fragment
+  const FrameDatagram & first_frag = frame.frags().front().value();
+  if (not first_frag.encode_timing) {
+    return; // an older sender
+  }
+
+  const EncodeTiming & encode = *first_frag.encode_timing;
+  const uint64_t base_ts = first_frag.capture_ts.value_or(encode.start_ts);
+  const int64_t clock_offset_us = receiver_clock_offset(first_frag).value_or(0);
+
+  // offsets from base_ts, mapping receiver timestamps to the sender's clock
+  const auto sender_offset = [base_ts](const uint64_t sender_ts) {
+    return static_cast<int32_t>(clamp<int64_t>(
+      static_cast<int64_t>(sender_ts - base_ts), INT32_MIN + 1, INT32_MAX));
+  };
+  const auto receiver_offset = [&](const uint64_t receiver_ts) {
+    return sender_offset(receiver_ts - clock_offset_us);
+  };
+
+  EventRecord record;
+  record.timestamp_us = base_ts;
+  record.frame_id = frame.id();
+  record.type = EventRecord::Type::FRAME_LATENCY;
+  record.set_stage(EventRecord::ENCODE_START, sender_offset(encode.start_ts));
+  record.set_stage(EventRecord::ENCODE_END, sender_offset(encode.end_ts));
+  record.set_stage(EventRecord::FIRST_SEND, sender_offset(frame.first_send_ts()));
+  record.set_stage(EventRecord::LAST_SEND, sender_offset(frame.last_send_ts()));
+  record.set_stage(EventRecord::FIRST_RECV, receiver_offset(frame.first_recv_ts()));
+  record.set_stage(EventRecord::COMPLETE, receiver_offset(frame.complete_ts()));
+  record.set_stage(EventRecord::DECODE_END, receiver_offset(decode_end_ts));
+  record.set_stage(EventRecord::DISPLAY, display_ts ? receiver_offset(*display_ts)
+                                                    : EventRecord::NO_STAGE);
+  record.d[0] = clock_offset_us;
+  record.d[1] = frame.frame_size().value();
+
+  events_->log(record);
+}
+
 void Decoder::worker_main()
 {
   // worker does nothing if not decode or display
@@ -323,12 +491,32 @@ void Decoder::worker_main()
   cerr << "[worker] Initialized decoder (max threads: "
        << max_threads << ")" << endl;
 
-  // initialize video displayer
+  // initialize video displayer (and a cropper of the viewport if needed)
   unique_ptr<VideoDisplay> display;
+  unique_ptr<ImageCropper> cropper;
   if (lazy_level_ == DECODE_DISPLAY) {
     display = make_unique<VideoDisplay>(display_width_, display_height_);
   }
 
+  // save decoded frames in the background if requested
+  unique_ptr<FrameDumper> dumper;
+  if (not dump_dir_.empty()) {
+    dumper = make_unique<FrameDumper>(display_width_, display_height_);
+  }
+
+  // print percentiles over the last ~1s and over the run so far (or of
+  // the run only at the end)
+  const auto print_latency = [](const string & name, LatencyStats & stats,
+                                const bool run_only) {
+    const auto [interval, run] = stats.take_interval();
+    if (run_only and run.count > 0) {
+      cerr << "[worker] " << name << " of the run " << run.str() << endl;
+    } else if (not run_only and interval.count > 0) {
+      cerr << "[worker] " << name << " " << interval.str() << endl
+           << "         (run: " << run.str() << ")" << endl;
+    }
+  };
+
   // local queue of each thread
   deque<Frame> local_queue;
 
@@ -336,7 +524,14 @@ void Decoder::worker_main()
   unsigned int num_decoded_frames = 0;
   double total_decode_time_ms = 0.0;
   double max_decode_time_ms = 0.0;
+  unsigned int num_viewport_changes = 0;
+  double total_m2p_ms = 0.0;
+  double max_m2p_ms = 0.0;
+  unsigned int num_captured_frames = 0;
+  double total_c2d_ms = 0.0;
+  double max_c2d_ms = 0.0;
   auto last_stats_time = decoder_epoch_;
+  uint64_t last_missing = 0; // frames missing from quality scoring
 
   while (true) {
     if (display and display->signal_quit()) {
@@ -345,7 +540,11 @@ void Decoder::worker_main()
 
     {  
       unique_lock<mutex> lock(mtx_);
-      cv_.wait(lock, [this] { return not shared_queue_.empty(); }); // wait until the queue is not empty
+      cv_.wait(lock, [this] { return stop_ or not shared_queue_.empty(); }); // wait until the queue is not empty
+
+      if (shared_queue_.empty()) { // stop_ must be true
+        break;
+      }
 
       while (not shared_queue_.empty()) { // worker owns the lock after wait and should copy shared queue quickly
         local_queue.emplace_back(move(shared_queue_.front()));
@@ -355,32 +554,105 @@ void Decoder::worker_main()
 
     while (not local_queue.empty()) {
       const Frame & frame = local_queue.front();
-      const double decode_time_ms = decode_frame(context, frame);
-
-      if (output_fd_) {
-        const auto frame_decoded_ts = timestamp_us();
-        output_fd_->write(to_string(frame_decoded_ts) + "," + // timestamp in us
-                          to_string(frame.id()) + "," +  // frame ID
-                          to_string(frame.frame_size().value()) + "," + // frame size
-                          to_string(decode_time_ms) + "," +
-                          to_string(total_datagrams_recv_) + "\n" // decode time
-                          );
+
+      // a repeated frame carries nothing to decode; keep showing the last one
+      const bool repeated = frame.type() == FrameType::REPEAT;
+      const double decode_time_ms = repeated ? 0.0 : decode_frame(context, frame);
+      const uint64_t decode_end_ts = timestamp_us();
+      optional<uint64_t> display_ts;
+
+      if (events_) {
+        EventRecord record;
+        record.timestamp_us = decode_end_ts;
+        record.frame_id = frame.id();
+        record.type = EventRecord::Type::FRAME_DECODED;
+        record.u[0] = frame.frame_size().value();
+        record.u[1] = total_datagrams_recv_;
+        record.d[0] = decode_time_ms;
+        events_->log(record);
+      }
+
+      // the crop window, if any, is carried by the first fragment
+      const auto & window = frame.frags().front().value().crop_window;
+
+      if (not repeated and (display or dumper or recorder_ or monitor_)) {
+        vpx_image * raw_img = get_decoded_frame(context);
+
+        if (raw_img) {
+          // construct a temporary RawImage that does not own the raw_img
+          const RawImage decoded_img(raw_img);
+
+          // the recorder, the monitor and the dumper only copy the frame here
+          if (recorder_) {
+            recorder_->record(decoded_img, frame.id());
+          }
+
+          if (monitor_) {
+            monitor_->submit(decoded_img, frame.id());
+          }
+
+          if (dumper) {
+            dumper->dump(decoded_img, dump_dir_ + "/frame_" + to_string(frame.id()) + ".png");
+          }
+
+          if (display) {
+            display_decoded_frame(decoded_img, *display, window, cropper);
+            display_ts = timestamp_us();
+            display_delay_.record(*display_ts - frame.consume_ts());
+          }
+        }
+      } else if (repeated) {
+        if (recorder_) {
+          recorder_->repeat(frame.id());
+        }
+
+        if (monitor_) {
+          monitor_->repeat(frame.id());
+        }
+      }
+
+      if (events_ and not repeated) {
+        log_latency(frame, decode_end_ts, display_ts);
       }
 
-      if (display) {
-        display_decoded_frame(context, *display); 
+      // latency from capture (on the sender's clock, mapped to ours if the
+      // offset is known, or else assumed to be the same) until displayed
+      const auto & first_frag = frame.frags().front().value();
+      if (first_frag.capture_ts and not repeated) {
+        const uint64_t now = timestamp_us();
+        const uint64_t capture_ts = *first_frag.capture_ts
+                                    + receiver_clock_offset(first_frag).value_or(0);
+        if (now >= capture_ts) {
+          const double c2d_ms = (now - capture_ts) / 1000.0;
+          num_captured_frames++;
+          total_c2d_ms += c2d_ms;
+          max_c2d_ms = max(max_c2d_ms, c2d_ms);
+        }
+      }
+
+      if (window and not repeated) {
+        const auto m2p_ms = motion_to_photon(*window);
+        if (m2p_ms) {
+          num_viewport_changes++;
+          total_m2p_ms += *m2p_ms;
+          max_m2p_ms = max(max_m2p_ms, *m2p_ms);
+        }
       }
 
       local_queue.pop_front();
 
-      // update stats
-      num_decoded_frames++;
-      total_decode_time_ms += decode_time_ms;
-      max_decode_time_ms = max(max_decode_time_ms, decode_time_ms);
+      // update stats (of the frames actually decoded)
+      if (not repeated) {
+        num_decoded_frames++;
+        total_decode_time_ms += decode_time_ms;
+        max_decode_time_ms = max(max_decode_time_ms, decode_time_ms);
+        decode_time_.record(llround(decode_time_ms * 1000));
+      }
 
-      // worker thread also outputs stats roughly every second
+      // worker thread also outputs stats roughly every second (once, even
+      // after an idle gap, so that totals aren't repeated)
       const auto stats_now = steady_clock::now();
-      while (stats_now >= last_stats_time + 1s) {  
+      if (stats_now >= last_stats_time + 1s) {
         if (num_decoded_frames > 0) {
           cerr << "[worker] Avg/Max decoding time (ms) of "
                << num_decoded_frames << " frames: "
@@ -388,14 +660,83 @@ void Decoder::worker_main()
                << "/" << double_to_string(max_decode_time_ms) << endl;
         }
 
+        print_latency("Decoding time", decode_time_, false);
+        print_latency("Display delay", display_delay_, false);
+
+        if (num_viewport_changes > 0) {
+          cerr << "[worker] Avg/Max motion-to-photon latency (ms) of "
+               << num_viewport_changes << " viewport changes: "
+               << double_to_string(total_m2p_ms / num_viewport_changes)
+               << "/" << double_to_string(max_m2p_ms) << endl;
+        }
+
+        if (num_captured_frames > 0) {
+          cerr << "[worker] Avg/Max capture-to-display latency (ms) of "
+               << num_captured_frames << " frames: "
+               << double_to_string(total_c2d_ms / num_captured_frames)
+               << "/" << double_to_string(max_c2d_ms) << endl;
+        }
+
+        if (recorder_) {
+          cerr << "[worker] Frames recorded/repeated/dropped: "
+               << recorder_->num_recorded() << "/" << recorder_->num_repeated()
+               << "/" << recorder_->num_dropped() << endl;
+        }
+
+        if (dumper) {
+          cerr << "[worker] Frames dumped/dropped: " << dumper->num_dumped()
+               << "/" << dumper->num_dropped() << endl;
+        }
+
+        if (event_log_ and event_log_->num_dropped() > 0) {
+          cerr << "[worker] Events dropped from the log (total): "
+               << event_log_->num_dropped() << endl;
+        }
+
+        if (monitor_) {
+          const auto quality = monitor_->take_interval();
+          if (quality.num_frames > 0) {
+            cerr << "[worker] Avg PSNR (dB)/SSIM of " << quality.num_frames
+                 << " frames: " << double_to_string(quality.avg_psnr)
+                 << "/" << double_to_string(quality.avg_ssim, 4) << endl;
+          }
+
+          // frames never decoded (or not displayable) are left out
+          if (monitor_->num_missing() > last_missing) {
+            cerr << "[worker] Warning: " << monitor_->num_missing() - last_missing
+                 << " frames missing from quality scoring (not decoded)" << endl;
+            last_missing = monitor_->num_missing();
+          }
+        }
+
         // reset stats
         num_decoded_frames = 0;
         total_decode_time_ms = 0.0;
         max_decode_time_ms = 0.0;
-        last_stats_time += 1s;
+        num_viewport_changes = 0;
+        total_m2p_ms = 0.0;
+        max_m2p_ms = 0.0;
+        num_captured_frames = 0;
+        total_c2d_ms = 0.0;
+        max_c2d_ms = 0.0;
+
+        // skip the seconds without frames to report
+        while (stats_now >= last_stats_time + 1s) {
+          last_stats_time += 1s;
+        }
       }
     }
   }
 
+  print_latency("Decoding time", decode_time_, true);
+  print_latency("Display delay", display_delay_, true);
+
+  if (monitor_) {
+    monitor_->flush();
+    cerr << "[worker] Quality of " << monitor_->num_scored() << " frames scored ("
+         << monitor_->num_dropped() << " dropped, " << monitor_->num_missing()
+         << " missing):\n" << monitor_->summary();
+  }
+
   check_call(vpx_codec_destroy(&context), VPX_CODEC_OK, "vpx_codec_destroy");
 }
\ No newline at end of file
@@ -14,10 +14,15 @@ extern "C" {
 #include <mutex>
 #include <condition_variable>
 #include <thread>
+#include <atomic>
 
 #include "protocol.hh"
 #include "sdl.hh"
-#include "file_descriptor.hh"
+#include "event_log.hh"
+#include "latency_histogram.hh"
+#include "frame_dumper.hh"
+#include "y4m_recorder.hh"
+#include "quality_monitor.hh"
 
 // decoder's view of a video frame
 class Frame
@@ -51,6 +56,17 @@ public:
 
   unsigned int null_frags() const { return null_frags_; }
 
+  // when the first and the last (completing) fragments arrived, and when
+  // the complete frame was handed to the worker (receiver's clock, us)
+  uint64_t first_recv_ts() const { return first_recv_ts_; }
+  uint64_t complete_ts() const { return complete_ts_; }
+  uint64_t consume_ts() const { return consume_ts_; }
+  void set_consume_ts(const uint64_t ts) { consume_ts_ = ts; }
+
+  // send_ts of the earliest and latest sent fragments (sender's clock, us)
+  uint64_t first_send_ts() const { return first_send_ts_; }
+  uint64_t last_send_ts() const { return last_send_ts_; }
+
 private:
   uint32_t id_;    // frame ID
   FrameType type_; // frame type
@@ -58,9 +74,17 @@ private:
   std::vector<std::optional<FrameDatagram>> frags_; // fragments of this frame
   unsigned int null_frags_; // number of uninitialized fragments
   size_t frame_size_ {0}; // frame size so far
+  uint64_t first_recv_ts_ {UINT64_MAX};
+  uint64_t complete_ts_ {0};
+  uint64_t consume_ts_ {0};
+  uint64_t first_send_ts_ {UINT64_MAX};
+  uint64_t last_send_ts_ {0};
 
   // validate if a datagram belongs to this frame
   void validate_datagram(const FrameDatagram & datagram) const;
+
+  // account for the timestamps of a newly inserted datagram
+  void update_timestamps(const FrameDatagram & datagram);
 };
 
 class Decoder
@@ -75,7 +99,13 @@ public:
   Decoder(const uint16_t display_width,
           const uint16_t display_height,
           const int lazy_level = 0,
-          const std::string & output_path = "");
+          const std::string & output_path = "",
+          const std::string & dump_dir = "",
+          std::unique_ptr<Y4MRecorder> recorder = nullptr,
+          std::unique_ptr<QualityMonitor> monitor = nullptr);
+
+  // finishes decoding (and recording) the queued frames
+  ~Decoder();
 
   // add a received datagram
   void add_datagram(const FrameDatagram & datagram);
@@ -90,6 +120,16 @@ public:
   // output stats every second and reset
   void output_periodic_stats();
 
+  // the sender's clock minus ours (us), as estimated by a ClockSync; used
+  // over the sender's own estimate (carried in the frames) to map the
+  // sender's timestamps to our clock
+  void set_sender_clock_offset(const double offset_us);
+
+  // viewport currently requested by the receiver in the full frame; a frame
+  // encoded from a different (e.g., enlarged) crop window is cropped to it
+  // locally before display
+  void set_viewport(const CropWindow & viewport);
+
   // accessors
   uint32_t next_frame() const { return next_frame_; }
 
@@ -107,7 +147,11 @@ private:
   uint16_t display_width_;
   uint16_t display_height_;
   LazyLevel lazy_level_;
-  std::optional<FileDescriptor> output_fd_; // only one thread should output
+  std::unique_ptr<EventLog> event_log_; // binary per-frame log, if requested
+  EventLog::Producer * events_ {nullptr}; // used by the worker thread only
+  std::string dump_dir_; // save decoded frames as PNGs in it if not empty
+  std::unique_ptr<Y4MRecorder> recorder_; // used by the worker thread only
+  std::unique_ptr<QualityMonitor> monitor_; // used by the worker thread only
   std::chrono::time_point<std::chrono::steady_clock> decoder_epoch_;
 
   // print debugging info
@@ -122,13 +166,31 @@ private:
   // performance stats
   unsigned int num_decodable_frames_ {0};
   size_t total_decodable_frame_size_ {0}; // bytes
-  std::chrono::time_point<std::chrono::steady_clock> last_stats_time_ {};
+  uint64_t last_stats_ts_ {0}; // on timestamp_us() (virtual in simulations)
   unsigned int total_datagrams_recv_ {0};
 
+  // latency distributions (us): from the first fragment until the frame is
+  // complete (main thread), and decoding and from complete until displayed
+  // (worker thread)
+  LatencyStats assembly_delay_ {};
+  LatencyStats decode_time_ {};
+  LatencyStats display_delay_ {};
+
   // shared between main (Decoder) and worker threads
   std::mutex mtx_ {};
   std::condition_variable cv_ {};
   std::deque<Frame> shared_queue_ {};
+  bool stop_ {false};
+
+  // set by the main thread and read by the worker (NO_CLOCK_OFFSET if unset)
+  std::atomic<int64_t> sender_clock_offset_us_ {NO_CLOCK_OFFSET};
+  static constexpr int64_t NO_CLOCK_OFFSET = INT64_MIN;
+
+  // shared between main and worker threads: the latest viewport, and the
+  // requested viewports (with request timestamps) not yet displayed
+  std::mutex viewport_mtx_ {};
+  std::optional<CropWindow> viewport_ {};
+  std::deque<std::pair<uint64_t, CropWindow>> pending_viewports_ {};
 
   // worker thread for decoding and displaying frames
   std::thread worker_ {};
@@ -144,7 +206,14 @@ private:
 
   // worker thread calls the functions below
   double decode_frame(vpx_codec_ctx_t & context, const Frame & frame);
-  void display_decoded_frame(vpx_codec_ctx_t & context, VideoDisplay & display); 
+  void display_decoded_frame(const RawImage & decoded_img, VideoDisplay & display,
+                             const std::optional<CropWindow> & window,
+                             std::unique_ptr<ImageCropper> & cropper);
+  std::optional<double> motion_to_photon(const CropWindow & window);
+  // our clock minus the sender's (us) for a frame, if known
+  std::optional<int64_t> receiver_clock_offset(const FrameDatagram & first_frag) const;
+  void log_latency(const Frame & frame, const uint64_t decode_end_ts,
+                   const std::optional<uint64_t> display_ts);
   void worker_main();
 };
 
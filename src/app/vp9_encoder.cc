@@ -6,6 +6,7 @@
 #include <chrono>
 #include <algorithm>
 #include <limits>
+#include <cmath>
 
 #include "vp9_encoder.hh"
 #include "conversion.hh"
@@ -19,12 +20,12 @@ Encoder::Encoder(const uint16_t default_width,
                  const uint16_t frame_rate,
                  const string & output_path)
   : default_width_(default_width), default_height_(default_height),
-    frame_rate_(frame_rate), output_fd_()
+    frame_rate_(frame_rate), event_log_()
     {
-  // open the output file
+  // open the output file (an event log; convert it with event_log_dump)
   if (not output_path.empty()) {
-    output_fd_ = FileDescriptor(check_syscall(
-        open(output_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)));
+    event_log_ = make_unique<EventLog>(output_path);
+    events_ = &event_log_->add_producer();
   }
 
   // populate VP9 configuration with default values
@@ -62,14 +63,14 @@ Encoder::Encoder(const uint16_t default_width,
   cfg_.rc_target_bitrate = target_bitrate_;
 
   // use no more than 16 or the number of avaialble CPUs
-  const unsigned int cpu_used = min(get_nprocs(), 16);
+  cpu_used_ = min(get_nprocs(), 16);
 
   // more encoder settings
   check_call(vpx_codec_enc_init(&context_, &vpx_codec_vp9_cx_algo, &cfg_, 0),
              VPX_CODEC_OK, "vpx_codec_enc_init");
 
   // this value affects motion estimation and *dominates* the encoding speed
-  codec_control(&context_, VP8E_SET_CPUUSED, cpu_used);
+  codec_control(&context_, VP8E_SET_CPUUSED, cpu_used_);
 
   // enable encoder to skip static/low content blocks
   codec_control(&context_, VP8E_SET_STATIC_THRESHOLD, 1);
@@ -92,7 +93,7 @@ Encoder::Encoder(const uint16_t default_width,
   // enable denoiser (but not on ARM since optimization is pending)
   codec_control(&context_, VP9E_SET_NOISE_SENSITIVITY, 1);
 
-  cerr << "Initialized VP9 encoder (CPU used: " << cpu_used << ")" << endl;
+  cerr << "Initialized VP9 encoder (CPU used: " << cpu_used_ << ")" << endl;
 
   // // interface that allows using real-time rate control
   // VP9RateControlRtcConfig rctrl_cfg;
@@ -110,30 +111,89 @@ Encoder::~Encoder()
   }
 }
 
-void Encoder::compress_frame(const RawImage & raw_img)
+void Encoder::compress_frame(const RawImage & raw_img,
+                             const optional<uint64_t> capture_ts)
 {
+  // speed control may reduce the frame rate by skipping frames, but never
+  // one that must recover from a lost datagram
+  if (speed_control_ and not speed_control_->should_encode()
+      and not recovery_pending()) {
+    send_repeat();
+    num_skipped_frames_++;
+    return;
+  }
+
   const auto frame_generation_ts = timestamp_us();
   // encode raw_img into encoder_pkt buffered in the ctx
   encode_frame(raw_img);
   // packetize encoder_pkt into datagrams
+  capture_ts_ = capture_ts;
+  const auto packetize_start = timestamp_us();
   const size_t frame_size = packetize_encoded_frame(default_width_, default_height_);
+  total_encoded_bytes_ += frame_size;
+  packetize_time_.record(timestamp_us() - packetize_start);
+
+  if (capture_ts) {
+    const double capture_delay_ms = (timestamp_us() - *capture_ts) / 1000.0;
+    num_captured_frames_++;
+    total_capture_delay_ms_ += capture_delay_ms;
+    max_capture_delay_ms_ = max(max_capture_delay_ms_, capture_delay_ms);
+  }
   // output logging
-  if (output_fd_) {
+  if (events_) {
     const auto frame_encoded_ts = timestamp_us();
-    const double encode_time_ms = (frame_encoded_ts - frame_generation_ts) / 1000.0;
-
-    output_fd_->write(to_string(timestamp_us()) + "," + // timestamp in us
-                      to_string(frame_id_) + "," +  // frame ID
-                      to_string(target_bitrate_) + "," + // target bitrate
-                      to_string(frame_size) + "," + // frame size in bytes
-                      to_string(encode_time_ms) + "," +  // encode time in ms
-                      to_string(total_num_rtx_) + "," + // total number of retransmissions
-                      to_string(total_num_recovery_) + "," + // total number of recoveries
-                      double_to_string(*ewma_rtt_us_ / 1000.0) + "\n"); // rtt in ms
+    log_frame(frame_size, (frame_encoded_ts - frame_generation_ts) / 1000.0);
   }
   frame_id_++;
 }
 
+void Encoder::repeat_frame()
+{
+  send_repeat();
+  num_repeated_frames_++;
+}
+
+void Encoder::send_repeat()
+{
+  // a single header-only datagram tells the receiver to keep the last frame
+  send_buf_.emplace_back(frame_id_, FrameType::REPEAT, 0, 1,
+                         default_width_, default_height_, string_view {});
+  send_buf_.back().crop_window = crop_window_;
+
+  if (events_) {
+    log_frame(0, 0.0);
+  }
+  frame_id_++;
+}
+
+bool Encoder::recovery_pending() const
+{
+  if (unacked_.empty()) {
+    return false;
+  }
+
+  // same condition as the recovery performed in encode_frame()
+  const auto & first_unacked = unacked_.cbegin()->second;
+  return timestamp_us() - first_unacked.send_ts > MAX_UNACKED_US;
+}
+
+void Encoder::log_frame(const size_t frame_size, const double encode_time_ms)
+{
+  EventRecord record;
+  record.timestamp_us = timestamp_us();
+  record.frame_id = frame_id_;
+  record.type = EventRecord::Type::FRAME_ENCODED;
+  record.u[0] = target_bitrate_;
+  record.u[1] = frame_size;
+  record.u[2] = total_num_rtx_;
+  record.u[3] = total_num_recovery_;
+  record.d[0] = encode_time_ms;
+  record.d[1] = ewma_rtt_us_.value_or(0) / 1000.0;
+
+  // only copied into a ring buffer; written to disk in the background
+  events_->log(record);
+}
+
 void Encoder::encode_frame(const RawImage & raw_img)
 {
   // sanity check
@@ -174,18 +234,59 @@ void Encoder::encode_frame(const RawImage & raw_img)
   }
 
   // encode a frame and calculate encoding time
+  encode_timing_.start_ts = timestamp_us();
   const auto encode_start = steady_clock::now();
   check_call(vpx_codec_encode(&context_, raw_img.get_vpx_image(), frame_id_, 1,
                               encode_flags, VPX_DL_REALTIME),
              VPX_CODEC_OK, "failed to encode a frame");
   const auto encode_end = steady_clock::now();
+  encode_timing_.end_ts = timestamp_us();
   const double encode_time_ms = duration<double, milli>(
                                 encode_end - encode_start).count();
+  const uint64_t encode_time_us = duration_cast<microseconds>(
+                                  encode_end - encode_start).count();
 
   // track stats in the current period
   num_encoded_frames_++;
   total_encode_time_ms_ += encode_time_ms;
   max_encode_time_ms_ = max(max_encode_time_ms_, encode_time_ms);
+  encode_time_.record(encode_time_us);
+
+  if (speed_control_) {
+    const auto decision = speed_control_->record(encode_time_us);
+    if (decision) {
+      apply_speed_decision(*decision);
+    }
+  }
+}
+
+void Encoder::apply_speed_decision(const SpeedController::Decision & decision)
+{
+  // the frame rate is reduced by compress_frame() skipping frames
+  if (decision.to.cpu_used != cpu_used_) {
+    set_cpu_used(decision.to.cpu_used);
+  }
+
+  cerr << "Speed control: cpu-used " << decision.from.cpu_used << " -> "
+       << decision.to.cpu_used << ", encoding 1/" << decision.from.divisor
+       << " -> 1/" << decision.to.divisor << " of frames (p99 encoding time "
+       << double_to_string(decision.p99_us / 1000.0) << " ms, budget now "
+       << double_to_string(decision.budget_us / 1000.0) << " ms)" << endl;
+
+  if (events_) {
+    EventRecord record;
+    record.timestamp_us = timestamp_us();
+    record.frame_id = frame_id_ + 1; // the first frame under the new setting
+    record.type = EventRecord::Type::SPEED_CHANGE;
+    record.u[0] = static_cast<uint64_t>(static_cast<int64_t>(decision.to.cpu_used));
+    record.u[1] = decision.to.divisor;
+    record.u[2] = static_cast<uint64_t>(static_cast<int64_t>(decision.from.cpu_used));
+    record.u[3] = decision.from.divisor;
+    record.d[0] = decision.p99_us / 1000.0;
+    record.d[1] = decision.budget_us / 1000.0;
+
+    events_->log(record);
+  }
 }
 
 size_t Encoder::packetize_encoded_frame(uint16_t width, uint16_t height)
@@ -227,6 +328,16 @@ size_t Encoder::packetize_encoded_frame(uint16_t width, uint16_t height)
         send_buf_.emplace_back(frame_id_, frame_type, frag_id, frag_cnt, width, height,
           string_view {reinterpret_cast<const char *>(buf_ptr), payload_size});
 
+        // header extensions only go with the first fragment
+        if (frag_id == 0) {
+          send_buf_.back().crop_window = crop_window_;
+          send_buf_.back().capture_ts = capture_ts_;
+          send_buf_.back().encode_timing = encode_timing_;
+          if (clock_offset_us_) {
+            send_buf_.back().clock_offset_us = llround(*clock_offset_us_);
+          }
+        }
+
         buf_ptr += payload_size;
       }
     }
@@ -265,6 +376,7 @@ void Encoder::handle_ack(const shared_ptr<AckMsg> & ack)
 
   // observed an RTT sample
   add_rtt_sample(curr_ts - ack->send_ts);
+  add_clock_offset_sample(*ack, curr_ts);
 
   // find the acked datagram in 'unacked_'
   const auto acked_seq_num = make_pair(ack->frame_id, ack->frag_id);
@@ -303,6 +415,8 @@ void Encoder::handle_ack(const shared_ptr<AckMsg> & ack)
 
 void Encoder::add_rtt_sample(const unsigned int rtt_us)
 {
+  rtt_.record(rtt_us);
+
   // min RTT
   if (not min_rtt_us_ or rtt_us < *min_rtt_us_) { 
     min_rtt_us_ = rtt_us;
@@ -317,6 +431,29 @@ void Encoder::add_rtt_sample(const unsigned int rtt_us)
   }
 }
 
+void Encoder::add_clock_offset_sample(const AckMsg & ack, const uint64_t ack_recv_ts)
+{
+  if (ack.recv_ts == 0 or not min_rtt_us_ or ack_recv_ts < ack.send_ts) {
+    return;
+  }
+
+  const uint64_t rtt_us = ack_recv_ts - ack.send_ts;
+  if (rtt_us > *min_rtt_us_ * NEAR_MIN_RTT) {
+    return;
+  }
+
+  // assuming symmetric one-way delays, the datagram arrived half an RTT
+  // after it was sent
+  const double offset_us = static_cast<double>(ack.recv_ts)
+                           - (ack.send_ts + rtt_us / 2.0);
+
+  if (not clock_offset_us_) {
+    clock_offset_us_ = offset_us;
+  } else {
+    clock_offset_us_ = ALPHA * offset_us + (1 - ALPHA) * (*clock_offset_us_);
+  }
+}
+
 void Encoder::output_periodic_stats()
 {
   cerr << "Frames encoded in the last ~1s: " << num_encoded_frames_ << endl;
@@ -327,15 +464,65 @@ void Encoder::output_periodic_stats()
          << "/" << double_to_string(max_encode_time_ms_) << endl;
   }
 
+  if (num_repeated_frames_ > 0) {
+    cerr << "  - Repeated (unchanged or skipped) frames: " << num_repeated_frames_ << endl;
+  }
+
+  if (speed_control_) {
+    const auto & setting = speed_control_->setting();
+    cerr << "  - Speed control: cpu-used " << setting.cpu_used
+         << ", encoding 1/" << setting.divisor << " of frames within "
+         << double_to_string(speed_control_->budget_us() / 1000.0)
+         << " ms (speed-ups/slow-downs so far: " << speed_control_->num_speed_ups()
+         << "/" << speed_control_->num_slow_downs() << ")" << endl;
+
+    if (num_skipped_frames_ > 0) {
+      cerr << "  - Frames skipped by speed control: " << num_skipped_frames_ << endl;
+    }
+  }
+
+  if (num_captured_frames_ > 0) {
+    cerr << "  - Avg/Max delay from capture to encoded (ms): "
+         << double_to_string(total_capture_delay_ms_ / num_captured_frames_)
+         << "/" << double_to_string(max_capture_delay_ms_) << endl;
+  }
+
   if (min_rtt_us_ and ewma_rtt_us_) {
     cerr << "  - Min/EWMA RTT (ms): " << double_to_string(*min_rtt_us_ / 1000.0)
          << "/" << double_to_string(*ewma_rtt_us_ / 1000.0) << endl;
   }
 
+  if (clock_offset_us_) {
+    cerr << "  - Receiver clock offset (ms): "
+         << double_to_string(*clock_offset_us_ / 1000.0) << endl;
+  }
+
+  // percentiles over the last ~1s and over the run so far
+  const auto print_latency = [](const string & name, LatencyStats & stats) {
+    const auto [interval, run] = stats.take_interval();
+    if (interval.count > 0) {
+      cerr << "  - " << name << " " << interval.str() << endl
+           << "    (run: " << run.str() << ")" << endl;
+    }
+  };
+  print_latency("Encoding time", encode_time_);
+  print_latency("Packetization time", packetize_time_);
+  print_latency("RTT", rtt_);
+
+  if (event_log_ and event_log_->num_dropped() > 0) {
+    cerr << "  - Events dropped from the log (total): "
+         << event_log_->num_dropped() << endl;
+  }
+
   // reset all but RTT-related stats
   num_encoded_frames_ = 0;
   total_encode_time_ms_ = 0.0;
   max_encode_time_ms_ = 0.0;
+  num_repeated_frames_ = 0;
+  num_skipped_frames_ = 0;
+  num_captured_frames_ = 0;
+  total_capture_delay_ms_ = 0.0;
+  max_capture_delay_ms_ = 0.0;
 }
 
 void Encoder::set_target_bitrate(const unsigned int bitrate_kbps)
@@ -346,3 +533,50 @@ void Encoder::set_target_bitrate(const unsigned int bitrate_kbps)
   check_call(vpx_codec_enc_config_set(&context_, &cfg_),
              VPX_CODEC_OK, "set_target_bitrate");
 }
+
+void Encoder::set_threads(const unsigned int num_threads)
+{
+  cfg_.g_threads = num_threads;
+  check_call(vpx_codec_enc_config_set(&context_, &cfg_),
+             VPX_CODEC_OK, "set_threads");
+}
+
+void Encoder::set_tile_columns(const unsigned int log2_columns)
+{
+  codec_control(&context_, VP9E_SET_TILE_COLUMNS, log2_columns);
+}
+
+void Encoder::set_cpu_used(const int cpu_used)
+{
+  cpu_used_ = cpu_used;
+  codec_control(&context_, VP8E_SET_CPUUSED, cpu_used_);
+}
+
+void Encoder::enable_speed_control(const SpeedController::Config & config)
+{
+  // start from the current setting, if within the controller's range
+  speed_control_.emplace(frame_rate_, cpu_used_, config);
+  if (speed_control_->setting().cpu_used != cpu_used_) {
+    set_cpu_used(speed_control_->setting().cpu_used);
+  }
+
+  cerr << "Enabled speed control (cpu-used " << config.min_cpu_used << " to "
+       << config.max_cpu_used << ", starting at " << cpu_used_ << "; budget: "
+       << double_to_string(speed_control_->budget_us() / 1000.0)
+       << " ms per frame)" << endl;
+
+  if (not speed_control_->can_adjust()) {
+    cerr << "Warning: speed control has a single setting to choose from "
+         << "and will never act" << endl;
+  }
+}
+
+void Encoder::set_row_mt(const bool row_mt)
+{
+  codec_control(&context_, VP9E_SET_ROW_MT, row_mt ? 1 : 0);
+}
+
+void Encoder::set_aq_mode(const unsigned int aq_mode)
+{
+  codec_control(&context_, VP9E_SET_AQ_MODE, aq_mode);
+}
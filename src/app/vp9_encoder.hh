@@ -14,7 +14,9 @@ extern "C" {
 #include "exception.hh"    
 #include "image.hh"
 #include "protocol.hh"
-#include "file_descriptor.hh" 
+#include "event_log.hh"
+#include "latency_histogram.hh"
+#include "speed_controller.hh"
 
 class Encoder
 {
@@ -26,8 +28,18 @@ public:
           const std::string & output_path = "");
   ~Encoder();
 
-  // encode raw_img and packetize into datagrams
-  void compress_frame(const RawImage & raw_img);
+  // encode raw_img and packetize into datagrams; the capture timestamp, if
+  // given, goes with the first fragment and is reported back in the stats;
+  // under speed control, the frame may be skipped (see repeat_frame())
+  void compress_frame(const RawImage & raw_img,
+                      const std::optional<uint64_t> capture_ts = std::nullopt);
+
+  // skip encoding a frame (unchanged, or skipped to catch up) and only
+  // signal the receiver to repeat the previous one
+  void repeat_frame();
+
+  // if the next frame must be encoded to recover from a lost datagram
+  bool recovery_pending() const;
 
   // add a transmitted but unacked datagram (except retransmissions) to unacked
   void add_unacked(const FrameDatagram & datagram);
@@ -41,12 +53,35 @@ public:
 
   // accessors
   uint32_t frame_id() const { return frame_id_; }
+  uint64_t total_encoded_bytes() const { return total_encoded_bytes_; }
+  int cpu_used() const { return cpu_used_; }
+  std::optional<double> ewma_rtt_us() const { return ewma_rtt_us_; }
+  std::optional<double> clock_offset_us() const { return clock_offset_us_; }
   std::deque<FrameDatagram> & send_buf() { return send_buf_; }
   std::map<SeqNum, FrameDatagram> & unacked() { return unacked_; }
 
   // mutators
   void set_verbose(const bool verbose) { verbose_ = verbose; }
   void set_target_bitrate(const unsigned int bitrate_kbps);
+  void set_threads(const unsigned int num_threads);
+
+  // encode frames in 2 ** log2_columns column tiles (default: 4)
+  void set_tile_columns(const unsigned int log2_columns);
+
+  // speed of encoding (VP8E_SET_CPUUSED): higher is faster and lower quality
+  void set_cpu_used(const int cpu_used);
+
+  // adjust cpu-used (and optionally the frame rate) from now on to keep
+  // encoding within a fraction of the frame interval (see SpeedController)
+  void enable_speed_control(const SpeedController::Config & config);
+
+  // row-based multi-threading (default: on) and adaptive quantization mode
+  // (VP9E_SET_AQ_MODE; default: 3, i.e., cyclic refresh)
+  void set_row_mt(const bool row_mt);
+  void set_aq_mode(const unsigned int aq_mode);
+
+  // crop window attached to the first fragment of subsequent frames
+  void set_crop_window(const std::optional<CropWindow> & window) { crop_window_ = window; }
 
   // forbid copying and moving
   Encoder(const Encoder & other) = delete;
@@ -58,7 +93,11 @@ private:
   uint16_t default_width_;
   uint16_t default_height_;
   uint16_t frame_rate_;
-  std::optional<FileDescriptor> output_fd_;
+  std::unique_ptr<EventLog> event_log_; // binary per-frame log, if requested
+  EventLog::Producer * events_ {nullptr};
+  std::optional<CropWindow> crop_window_ {};
+  std::optional<uint64_t> capture_ts_ {}; // of the frame being compressed
+  EncodeTiming encode_timing_ {}; // of the frame being compressed
 
   // print debugging info
   bool verbose_ {false};
@@ -66,6 +105,12 @@ private:
   // current target bitrate
   unsigned int target_bitrate_ {0};
 
+  // current speed setting
+  int cpu_used_ {0};
+
+  // adjusts the speed setting, if enabled
+  std::optional<SpeedController> speed_control_ {};
+
   // VPX encoding configuration and context
   vpx_codec_enc_cfg_t cfg_ {};
   vpx_codec_ctx_t context_ {};
@@ -84,10 +129,27 @@ private:
   std::optional<double> ewma_rtt_us_ {};
   static constexpr double ALPHA = 0.2;
 
+  // receiver's clock minus ours, from ACKs echoing our send_ts along with
+  // the receiver's arrival time; only samples with an RTT near the minimum
+  // (least queuing, hence most symmetric) are averaged in
+  std::optional<double> clock_offset_us_ {};
+  static constexpr double NEAR_MIN_RTT = 1.25;
+
   // performance stats
   unsigned int num_encoded_frames_ {0};
+  uint64_t total_encoded_bytes_ {0}; // of all frames (never reset)
   double total_encode_time_ms_ {0.0};
   double max_encode_time_ms_ {0.0};
+  unsigned int num_repeated_frames_ {0};
+  unsigned int num_skipped_frames_ {0}; // by speed control
+  unsigned int num_captured_frames_ {0}; // with a capture timestamp
+  double total_capture_delay_ms_ {0.0};  // from capture until encoded
+  double max_capture_delay_ms_ {0.0};
+
+  // latency distributions (us) for the tails the averages above hide
+  LatencyStats encode_time_ {};
+  LatencyStats packetize_time_ {};
+  LatencyStats rtt_ {};
 
   unsigned int total_num_rtx_ {0};
   unsigned int total_num_recovery_ {0};
@@ -100,12 +162,24 @@ private:
   // track RTT
   void add_rtt_sample(const unsigned int rtt_us);
 
+  // track the clock offset from an ACK received at 'ack_recv_ts'
+  void add_clock_offset_sample(const AckMsg & ack, const uint64_t ack_recv_ts);
+
   // encode the raw frame stored in 'raw_img'
   void encode_frame(const RawImage & raw_img);
 
+  // signal the receiver to keep displaying the previous frame
+  void send_repeat();
+
+  // apply and report a decision of speed control
+  void apply_speed_decision(const SpeedController::Decision & decision);
+
   // packetize the just encoded frame (stored in context_) and return its size
   size_t packetize_encoded_frame(uint16_t width, uint16_t height);
 
+  // output a line of frame information to output_fd_
+  void log_frame(const size_t frame_size, const double encode_time_ms);
+
   // VPX API wrappers
   // vpx_codec_control(ctx,id,data): macro allows for type safe conversions across the variadic parameter
   template <typename ... Args>
@@ -0,0 +1,153 @@
+#include <sys/uio.h>
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+
+#include "buffered_reader.hh"
+#include "exception.hh"
+
+using namespace std;
+
+BufferedReader::BufferedReader(FileDescriptor & fd, const size_t capacity)
+  : fd_(fd), buf_(capacity)
+{
+  if (capacity == 0) {
+    throw runtime_error("BufferedReader: capacity must be positive");
+  }
+}
+
+bool BufferedReader::fill()
+{
+  // move the remaining data to the front to make room at the end
+  if (head_ > 0) {
+    memmove(buf_.data(), buf_.data() + head_, buffered());
+    tail_ -= head_;
+    head_ = 0;
+  }
+
+  if (tail_ == buf_.size()) {
+    throw runtime_error("BufferedReader: buffer is full");
+  }
+
+  const size_t bytes_read = check_syscall(
+    ::read(fd_.fd_num(), buf_.data() + tail_, buf_.size() - tail_));
+
+  if (bytes_read == 0) {
+    eof_ = true;
+    return false;
+  }
+
+  tail_ += bytes_read;
+  return true;
+}
+
+string BufferedReader::getline()
+{
+  string ret;
+  size_t scanned = 0; // bytes already searched for '\n'
+
+  while (true) {
+    const char * const start = buf_.data() + head_;
+    const void * nl = memchr(start + scanned, '\n', buffered() - scanned);
+
+    if (nl) {
+      const size_t len = static_cast<const char *>(nl) - start;
+      ret.append(start, len);
+      head_ += len + 1;
+      return ret;
+    }
+
+    // a line longer than the buffer is returned in pieces of the buffer
+    if (buffered() == buf_.size()) {
+      ret.append(start, buffered());
+      head_ = tail_ = 0;
+      scanned = 0;
+    } else {
+      scanned = buffered();
+    }
+
+    if (not fill()) {
+      // return the last line without a trailing '\n'
+      ret.append(buf_.data() + head_, buffered());
+      head_ = tail_ = 0;
+      return ret;
+    }
+  }
+}
+
+size_t BufferedReader::readn(char * dst, const size_t n, const bool allow_partial_read)
+{
+  // serve from the buffer first
+  size_t total_read = min(n, buffered());
+  memcpy(dst, buf_.data() + head_, total_read);
+  head_ += total_read;
+
+  if (head_ == tail_) {
+    head_ = tail_ = 0;
+  }
+
+  // then read the rest directly into 'dst', refilling the buffer with
+  // whatever follows in the same syscall
+  while (total_read < n) {
+    iovec iov[2];
+    iov[0].iov_base = dst + total_read;
+    iov[0].iov_len = n - total_read;
+    iov[1].iov_base = buf_.data();
+    iov[1].iov_len = buf_.size();
+
+    const size_t bytes_read = check_syscall(readv(fd_.fd_num(), iov, 2));
+
+    if (bytes_read == 0) {
+      eof_ = true;
+
+      if (allow_partial_read) {
+        return total_read;
+      }
+      throw runtime_error("BufferedReader::readn(): unexpected EOF");
+    }
+
+    if (bytes_read > n - total_read) {
+      tail_ = bytes_read - (n - total_read);
+      total_read = n;
+    } else {
+      total_read += bytes_read;
+    }
+  }
+
+  return total_read;
+}
+
+size_t BufferedReader::readn(uint8_t * dst, const size_t n, const bool allow_partial_read)
+{
+  return readn(reinterpret_cast<char *>(dst), n, allow_partial_read);
+}
+
+string_view BufferedReader::peek(const size_t n)
+{
+  if (n > buf_.size()) {
+    throw runtime_error("BufferedReader: cannot peek beyond the buffer capacity");
+  }
+
+  while (buffered() < n and fill()) {}
+
+  return {buf_.data() + head_, min(n, buffered())};
+}
+
+void BufferedReader::skip(const size_t n)
+{
+  if (n <= buffered()) {
+    head_ += n;
+    return;
+  }
+
+  // skip the rest with a seek rather than reading it
+  fd_.seek(n - buffered(), SEEK_CUR);
+  head_ = tail_ = 0;
+}
+
+void BufferedReader::reset_offset()
+{
+  fd_.reset_offset();
+  head_ = tail_ = 0;
+  eof_ = false;
+}
@@ -0,0 +1,65 @@
+#ifndef BUFFERED_READER_HH
+#define BUFFERED_READER_HH
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "file_descriptor.hh"
+
+// blocking reads of lines and fixed-size records from a FileDescriptor,
+// served from an internal buffer that is refilled with large reads; reading
+// a record also refills the buffer in the same syscall (readv), so a short
+// header that follows a record usually costs no syscall at all
+class BufferedReader
+{
+public:
+  explicit BufferedReader(FileDescriptor & fd,
+                          const size_t capacity = DEFAULT_CAPACITY);
+
+  // read one line without the trailing '\n'; empty string indicates EOF
+  // (or an empty line: check eof())
+  std::string getline();
+
+  // read exactly 'n' bytes into 'dst'; return the bytes read, which is less
+  // than 'n' only at EOF and only if 'allow_partial_read'
+  size_t readn(char * dst, const size_t n, const bool allow_partial_read = false);
+  size_t readn(uint8_t * dst, const size_t n, const bool allow_partial_read = false);
+
+  // return up to 'n' upcoming bytes without consuming them
+  std::string_view peek(const size_t n);
+
+  // skip 'n' bytes ahead
+  void skip(const size_t n);
+
+  // discard buffered data and reset the file offset to the beginning
+  void reset_offset();
+
+  // no more data in the buffer or the file
+  bool eof() const { return head_ == tail_ and eof_; }
+
+  // forbid copying
+  BufferedReader(const BufferedReader & other) = delete;
+  const BufferedReader & operator=(const BufferedReader & other) = delete;
+
+private:
+  static constexpr size_t DEFAULT_CAPACITY = 64 * 1024; // 64 KB
+
+  FileDescriptor & fd_;
+
+  // buffered data is [head_, tail_)
+  std::vector<char> buf_;
+  size_t head_ {0};
+  size_t tail_ {0};
+
+  // the file has reached EOF
+  bool eof_ {false};
+
+  size_t buffered() const { return tail_ - head_; }
+
+  // read more data into the buffer; return false at EOF
+  bool fill();
+};
+
+#endif /* BUFFERED_READER_HH */
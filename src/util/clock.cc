@@ -0,0 +1,46 @@
+#include <time.h>
+#include <cstdlib>
+#include <cstring>
+
+#include "clock.hh"
+#include "exception.hh"
+
+using namespace std;
+
+namespace {
+  bool use_raw_clock()
+  {
+    const char * clock = getenv("RINGMASTER_CLOCK");
+    return clock and strcmp(clock, "raw") == 0;
+  }
+
+  // chosen once, as the first read
+  clockid_t monotonic_clock_id()
+  {
+    static const clockid_t clock_id = use_raw_clock() ? CLOCK_MONOTONIC_RAW
+                                                      : CLOCK_MONOTONIC;
+    return clock_id;
+  }
+
+  uint64_t read_clock_ns(const clockid_t clock_id)
+  {
+    timespec ts;
+    check_syscall(clock_gettime(clock_id, &ts));
+    return static_cast<uint64_t>(ts.tv_sec) * 1000 * 1000 * 1000 + ts.tv_nsec;
+  }
+}
+
+uint64_t monotonic_ns()
+{
+  return read_clock_ns(monotonic_clock_id());
+}
+
+const char * monotonic_clock_name()
+{
+  return monotonic_clock_id() == CLOCK_MONOTONIC_RAW ? "monotonic_raw" : "monotonic";
+}
+
+uint64_t wall_clock_us()
+{
+  return read_clock_ns(CLOCK_REALTIME) / 1000;
+}
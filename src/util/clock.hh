@@ -0,0 +1,20 @@
+#ifndef CLOCK_HH
+#define CLOCK_HH
+
+#include <cstdint>
+
+// nanoseconds since an arbitrary point (typically boot) on a clock that is
+// never stepped, so that intervals stay correct when NTP adjusts the wall
+// clock: CLOCK_MONOTONIC by default, or CLOCK_MONOTONIC_RAW (immune to NTP
+// frequency corrections too) if the environment variable RINGMASTER_CLOCK
+// is "raw"; both are read through the vDSO without entering the kernel
+uint64_t monotonic_ns();
+
+// name of the clock monotonic_ns() reads ("monotonic" or "monotonic_raw")
+const char * monotonic_clock_name();
+
+// microseconds since the epoch on the wall clock, only for labeling output
+// (never for measuring intervals)
+uint64_t wall_clock_us();
+
+#endif /* CLOCK_HH */
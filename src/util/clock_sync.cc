@@ -0,0 +1,122 @@
+#include <algorithm>
+#include <cmath>
+
+#include "clock_sync.hh"
+
+using namespace std;
+
+void ClockSync::add_sample(const uint64_t t0, const uint64_t t1,
+                           const uint64_t t2, const uint64_t t3)
+{
+  awaiting_reply_ = false;
+
+  // ignore exchanges that can't be right (e.g., a stale reply)
+  if (t3 < t0 or t2 < t1 or t3 - t0 < t2 - t1) {
+    return;
+  }
+
+  Sample sample;
+  sample.local_ts = t0 + (t3 - t0) / 2;
+  sample.offset_us = ((static_cast<double>(t1) - t0) + (static_cast<double>(t2) - t3)) / 2;
+  sample.delay_us = (t3 - t0) - (t2 - t1);
+  num_samples_++;
+
+  recent_.push_back(sample);
+  if (recent_.size() > FILTER_SIZE) {
+    recent_.pop_front();
+  }
+
+  best_ = *min_element(recent_.begin(), recent_.end(),
+    [](const Sample & a, const Sample & b) { return a.delay_us < b.delay_us; });
+
+  // a new least delayed exchange is a new point to fit the skew to
+  if (filtered_.empty() or filtered_.back().local_ts != best_->local_ts) {
+    filtered_.push_back(*best_);
+    if (filtered_.size() > SKEW_WINDOW) {
+      filtered_.pop_front();
+    }
+    update_skew();
+  }
+}
+
+void ClockSync::update_skew()
+{
+  // too short a span to tell skew from noise
+  if (filtered_.size() < 3 or
+      filtered_.back().local_ts - filtered_.front().local_ts < MIN_SKEW_SPAN_US) {
+    return;
+  }
+
+  // least squares, relative to the first point to keep the sums small
+  const double x0 = filtered_.front().local_ts;
+  const double y0 = filtered_.front().offset_us;
+  double sum_x = 0, sum_y = 0, sum_xx = 0, sum_xy = 0;
+
+  for (const auto & s : filtered_) {
+    const double x = s.local_ts - x0;
+    const double y = s.offset_us - y0;
+    sum_x += x;
+    sum_y += y;
+    sum_xx += x * x;
+    sum_xy += x * y;
+  }
+
+  const double n = filtered_.size();
+  const double denom = n * sum_xx - sum_x * sum_x;
+  if (denom > 0) {
+    skew_ = clamp((n * sum_xy - sum_x * sum_y) / denom, -MAX_SKEW, MAX_SKEW);
+  }
+}
+
+optional<double> ClockSync::offset_us(const uint64_t local_ts) const
+{
+  if (not best_) {
+    return nullopt;
+  }
+
+  // the offset drifts by the skew since the exchange it comes from
+  return best_->offset_us
+         + skew_ * (static_cast<double>(local_ts) - best_->local_ts);
+}
+
+optional<uint64_t> ClockSync::to_remote(const uint64_t local_ts) const
+{
+  const auto offset = offset_us(local_ts);
+  if (not offset) {
+    return nullopt;
+  }
+
+  return llround(local_ts + *offset);
+}
+
+optional<uint64_t> ClockSync::to_local(const uint64_t remote_ts) const
+{
+  if (not best_) {
+    return nullopt;
+  }
+
+  // the local time, ignoring skew, is close enough to evaluate the offset at
+  const double local_ts = remote_ts - best_->offset_us;
+  return llround(remote_ts - *offset_us(llround(local_ts)));
+}
+
+optional<uint64_t> ClockSync::delay_us() const
+{
+  if (not best_) {
+    return nullopt;
+  }
+
+  return best_->delay_us;
+}
+
+bool ClockSync::request_due(const uint64_t now)
+{
+  if (now < next_request_ts_) {
+    return false;
+  }
+
+  next_request_ts_ = now + (num_samples_ < NUM_INITIAL ? INITIAL_INTERVAL_US
+                                                       : REQUEST_INTERVAL_US);
+  awaiting_reply_ = true;
+  return true;
+}
@@ -0,0 +1,77 @@
+#ifndef CLOCK_SYNC_HH
+#define CLOCK_SYNC_HH
+
+#include <cstdint>
+#include <deque>
+#include <optional>
+
+// estimates the offset and skew of a remote clock relative to the local one
+// from NTP-style request/reply exchanges: t0 (request sent, local clock),
+// t1 (request received, remote), t2 (reply sent, remote) and t3 (reply
+// received, local); like NTP's clock filter, the offset is taken from the
+// exchange with the least round-trip delay among the recent ones (the least
+// queuing, hence the most symmetric), and the skew is the least-squares
+// slope of those offsets over time
+class ClockSync
+{
+public:
+  void add_sample(const uint64_t t0, const uint64_t t1,
+                  const uint64_t t2, const uint64_t t3);
+
+  // remote clock minus local clock (us) at local time 'local_ts', if any
+  // exchange has completed
+  std::optional<double> offset_us(const uint64_t local_ts) const;
+
+  // map a local timestamp to the remote clock and vice versa
+  std::optional<uint64_t> to_remote(const uint64_t local_ts) const;
+  std::optional<uint64_t> to_local(const uint64_t remote_ts) const;
+
+  // rate of the remote clock relative to the local one, in parts per million
+  double skew_ppm() const { return skew_ * 1e6; }
+
+  // round-trip delay (us) of the exchange the offset comes from
+  std::optional<uint64_t> delay_us() const;
+
+  // whether to send a request at local time 'now' (every REQUEST_INTERVAL,
+  // or more often until a few exchanges have completed); marks a request
+  // as outstanding if so
+  bool request_due(const uint64_t now);
+
+  // a request is outstanding (its reply is worth polling for)
+  bool awaiting_reply() const { return awaiting_reply_; }
+
+  uint64_t num_samples() const { return num_samples_; }
+
+  static constexpr uint64_t REQUEST_INTERVAL_US = 1000 * 1000;
+  static constexpr uint64_t INITIAL_INTERVAL_US = 100 * 1000;
+  static constexpr unsigned int NUM_INITIAL = 8;
+
+private:
+  struct Sample
+  {
+    uint64_t local_ts; // midpoint of t0 and t3
+    double offset_us;
+    uint64_t delay_us;
+  };
+
+  // recent exchanges, to pick the least delayed from
+  std::deque<Sample> recent_ {};
+  static constexpr size_t FILTER_SIZE = 8;
+
+  // the least delayed exchange of each window, to fit the skew to
+  std::deque<Sample> filtered_ {};
+  static constexpr size_t SKEW_WINDOW = 64;
+  static constexpr uint64_t MIN_SKEW_SPAN_US = 10 * 1000 * 1000;
+  static constexpr double MAX_SKEW = 500e-6;
+
+  std::optional<Sample> best_ {};
+  double skew_ {0};
+
+  uint64_t num_samples_ {0};
+  uint64_t next_request_ts_ {0};
+  bool awaiting_reply_ {false};
+
+  void update_skew();
+};
+
+#endif /* CLOCK_SYNC_HH */
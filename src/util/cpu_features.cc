@@ -0,0 +1,41 @@
+#include <cstdlib>
+#include <string>
+
+#include "cpu_features.hh"
+
+using namespace std;
+
+namespace {
+  CPUFeatures detect_cpu_features()
+  {
+    CPUFeatures features;
+
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    features.sse2 = __builtin_cpu_supports("sse2");
+    features.avx2 = __builtin_cpu_supports("avx2");
+#elif defined(__aarch64__) || defined(__ARM_NEON)
+    features.neon = true;
+#endif
+
+    // optionally cap the features for benchmarking or debugging
+    const char * cap = getenv("RINGMASTER_SIMD");
+    if (cap) {
+      const string level = cap;
+
+      if (level == "scalar") {
+        features = CPUFeatures();
+      } else if (level == "sse2") {
+        features.avx2 = false;
+      }
+    }
+
+    return features;
+  }
+}
+
+const CPUFeatures & cpu_features()
+{
+  static const CPUFeatures features = detect_cpu_features();
+  return features;
+}
@@ -0,0 +1,16 @@
+#ifndef CPU_FEATURES_HH
+#define CPU_FEATURES_HH
+
+// SIMD instruction sets usable on the running CPU (detected once)
+struct CPUFeatures
+{
+  bool sse2 {false};
+  bool avx2 {false};
+  bool neon {false};
+};
+
+// setting the environment variable RINGMASTER_SIMD to "scalar", "sse2" or
+// "avx2" caps the detected features, e.g., to compare kernels
+const CPUFeatures & cpu_features();
+
+#endif /* CPU_FEATURES_HH */
@@ -0,0 +1,175 @@
+#include <cstring>
+#include <iostream>
+#include <chrono>
+#include <stdexcept>
+
+#include "event_log.hh"
+#include "exception.hh"
+#include "timestamp.hh"
+#include "clock.hh"
+
+using namespace std;
+
+void EventRecord::set_stage(const Stage stage, const int32_t offset_us)
+{
+  const unsigned int shift = stage % 2 * 32;
+  uint64_t & slot = u[stage / 2];
+  slot = (slot & ~(0xFFFFFFFFULL << shift))
+         | (static_cast<uint64_t>(static_cast<uint32_t>(offset_us)) << shift);
+}
+
+int32_t EventRecord::stage(const Stage stage) const
+{
+  return static_cast<int32_t>(static_cast<uint32_t>(u[stage / 2] >> (stage % 2 * 32)));
+}
+
+bool EventLogHeader::valid() const
+{
+  return memcmp(magic, MAGIC, sizeof(magic)) == 0 and version == VERSION
+         and record_size == sizeof(EventRecord);
+}
+
+EventLog::Producer::Producer(const size_t capacity)
+  : ring_(), mask_()
+{
+  size_t size = 1;
+  while (size < capacity) {
+    size *= 2;
+  }
+
+  ring_.resize(size);
+  mask_ = size - 1;
+}
+
+bool EventLog::Producer::log(const EventRecord & record)
+{
+  const uint64_t head = head_.load(memory_order_relaxed);
+
+  if (head - tail_.load(memory_order_acquire) > mask_) { // ring is full
+    num_dropped_.fetch_add(1, memory_order_relaxed);
+    return false;
+  }
+
+  ring_[head & mask_] = record;
+  head_.store(head + 1, memory_order_release);
+  return true;
+}
+
+void EventLog::Producer::drain(string & buf)
+{
+  const uint64_t tail = tail_.load(memory_order_relaxed);
+  const uint64_t head = head_.load(memory_order_acquire);
+
+  for (uint64_t i = tail; i < head; i++) {
+    buf.append(reinterpret_cast<const char *>(&ring_[i & mask_]), sizeof(EventRecord));
+  }
+
+  tail_.store(head, memory_order_release);
+}
+
+EventLog::EventLog(const string & file_path, const size_t capacity,
+                   const unsigned int flush_interval_ms)
+  : fd_(check_syscall(open(file_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644))),
+    capacity_(capacity), flush_interval_ms_(flush_interval_ms)
+{
+  if (capacity == 0) {
+    throw runtime_error("EventLog: capacity must be positive");
+  }
+
+  EventLogHeader header;
+  memcpy(header.magic, EventLogHeader::MAGIC, sizeof(header.magic));
+  header.start_ts_us = timestamp_us();
+  header.start_wall_us = wall_clock_us();
+  fd_.write_all({reinterpret_cast<const char *>(&header), sizeof(header)});
+
+  flusher_ = thread(&EventLog::flusher_main, this);
+}
+
+EventLog::~EventLog()
+{
+  {
+    lock_guard<mutex> lock(mtx_);
+    stop_ = true;
+  }
+  cv_.notify_one();
+
+  if (flusher_.joinable()) {
+    flusher_.join();
+  }
+}
+
+EventLog::Producer & EventLog::add_producer()
+{
+  lock_guard<mutex> lock(mtx_);
+  producers_.emplace_back(make_unique<Producer>(capacity_));
+  return *producers_.back();
+}
+
+uint64_t EventLog::num_dropped() const
+{
+  lock_guard<mutex> lock(mtx_);
+
+  uint64_t num_dropped = 0;
+  for (const auto & producer : producers_) {
+    num_dropped += producer->num_dropped();
+  }
+  return num_dropped;
+}
+
+vector<EventRecord> EventLog::read(const string & file_path)
+{
+  FileDescriptor fd(check_syscall(open(file_path.c_str(), O_RDONLY)));
+  const string data = fd.readn(fd.file_size());
+
+  EventLogHeader header;
+  if (data.size() < sizeof(header)) {
+    throw runtime_error("not an event log: " + file_path);
+  }
+  memcpy(&header, data.data(), sizeof(header));
+  if (not header.valid()) {
+    throw runtime_error("not an event log (or of another version): " + file_path);
+  }
+
+  // a record cut short (e.g., by a crash) is ignored
+  vector<EventRecord> records((data.size() - sizeof(header)) / sizeof(EventRecord));
+  memcpy(records.data(), data.data() + sizeof(header), records.size() * sizeof(EventRecord));
+  return records;
+}
+
+void EventLog::flush()
+{
+  string buf;
+  {
+    lock_guard<mutex> lock(mtx_);
+    for (const auto & producer : producers_) {
+      producer->drain(buf);
+    }
+  }
+
+  if (not buf.empty()) {
+    fd_.write_all(buf);
+  }
+}
+
+void EventLog::flusher_main()
+{
+  while (true) {
+    bool stop;
+    {
+      unique_lock<mutex> lock(mtx_);
+      stop = cv_.wait_for(lock, chrono::milliseconds(flush_interval_ms_),
+                          [this] { return stop_; });
+    }
+
+    // a failed write loses the records but never blocks the producers
+    try {
+      flush();
+    } catch (const exception & e) {
+      cerr << "EventLog: " << e.what() << endl;
+    }
+
+    if (stop) {
+      return;
+    }
+  }
+}
@@ -0,0 +1,168 @@
+#ifndef EVENT_LOG_HH
+#define EVENT_LOG_HH
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+#include "file_descriptor.hh"
+
+// a fixed-size binary record of a per-frame event; the fields depend on the
+// type (see EventRecord::Type)
+struct EventRecord
+{
+  enum class Type : uint16_t {
+    // u = {target bitrate (kbps), frame size (bytes), total retransmissions,
+    //      total recoveries}, d = {encode time (ms), RTT (ms)}
+    FRAME_ENCODED = 1,
+
+    // u = {frame size (bytes), total datagrams received, 0, 0},
+    // d = {decode time (ms), 0}
+    FRAME_DECODED = 2,
+
+    // timestamp_us is when the frame was captured (or began encoding if
+    // not captured live) on the sender's clock, and u holds the signed
+    // offsets (us) of the stages below from it, with the receiver's
+    // timestamps mapped to the sender's clock; d = {clock offset applied
+    // (us), frame size (bytes)}
+    FRAME_LATENCY = 3,
+
+    // a packet entering an emulated link (ringmaster_relay): frame_id is
+    // the link, u = {bytes queued after it entered, packet size (bytes),
+    // LinkModel::Verdict, direction (0: to the client, 1: to the server)},
+    // d = {queuing delay (ms), one-way delay (ms)}, -1 if not reached
+    LINK_PACKET = 4,
+
+    // the encoder's speed control changed its setting before frame_id:
+    // u = {cpu-used, frame divisor (encoding 1 of every N frames), previous
+    //      cpu-used, previous divisor}, d = {p99 encode time (ms) of the
+    // window that led to it, budget (ms) of the new setting}
+    SPEED_CHANGE = 5,
+  };
+
+  enum Stage : size_t {
+    ENCODE_START, ENCODE_END, FIRST_SEND, LAST_SEND,
+    FIRST_RECV, COMPLETE, DECODE_END, DISPLAY, NUM_STAGES
+  };
+
+  // a FRAME_LATENCY stage not reached (e.g., a frame not displayed)
+  static constexpr int32_t NO_STAGE = INT32_MIN;
+
+  // the time spent until each stage above, i.e., since the previous stage
+  // (or since capture for the first)
+  static constexpr const char * STAGE_INTERVALS[NUM_STAGES] = {
+    "queue", "encode", "packetize", "send", "network", "assembly", "decode", "display"
+  };
+
+  uint64_t timestamp_us {0};
+  uint32_t frame_id {0};
+  Type type {};
+  uint16_t reserved {0};
+  uint64_t u[4] {};
+  double d[2] {};
+
+  // FRAME_LATENCY packs two 32-bit stage offsets into each of u
+  void set_stage(const Stage stage, const int32_t offset_us);
+  int32_t stage(const Stage stage) const;
+};
+
+static_assert(sizeof(EventRecord) == 64, "EventRecord must be 64 bytes");
+
+// header of an event log file, followed by EventRecords in host byte order
+// (so that the file can be mmap'ed and read as an array of records)
+struct EventLogHeader
+{
+  static constexpr char MAGIC[8] = {'R', 'M', 'E', 'V', 'L', 'O', 'G', '\0'};
+  static constexpr uint32_t VERSION = 1;
+
+  char magic[8] {};
+  uint32_t version {VERSION};
+  uint32_t record_size {sizeof(EventRecord)};
+  uint64_t start_ts_us {0};   // when the log was opened (timestamp_us)
+  uint64_t start_wall_us {0}; // same instant on the wall clock
+
+  // if this is the header of an event log of this version
+  bool valid() const;
+};
+
+static_assert(sizeof(EventLogHeader) == 32, "EventLogHeader must be 32 bytes");
+
+// logs EventRecords into a file without blocking the logging threads: each
+// thread logs into a Producer of its own, a single-producer single-consumer
+// ring buffer that a background thread drains into the file periodically;
+// an event logged into a full ring is dropped (and counted) instead
+class EventLog
+{
+public:
+  class Producer
+  {
+  public:
+    explicit Producer(const size_t capacity);
+
+    // copy 'record' into the ring (no allocation or system call); returns
+    // false if it was dropped because the ring is full
+    bool log(const EventRecord & record);
+
+    uint64_t num_dropped() const { return num_dropped_.load(std::memory_order_relaxed); }
+
+  private:
+    friend class EventLog;
+
+    std::vector<EventRecord> ring_; // capacity is a power of two
+    size_t mask_;
+
+    // written by the producer and the flusher respectively; kept on
+    // separate cache lines to avoid false sharing
+    alignas(64) std::atomic<uint64_t> head_ {0};
+    alignas(64) std::atomic<uint64_t> tail_ {0};
+    alignas(64) std::atomic<uint64_t> num_dropped_ {0};
+
+    // move the records logged so far to the end of 'buf'
+    void drain(std::string & buf);
+  };
+
+  // 'capacity' (rounded up to a power of two) is the number of records each
+  // producer can hold between flushes, every 'flush_interval_ms'
+  EventLog(const std::string & file_path, const size_t capacity = 4096,
+           const unsigned int flush_interval_ms = 20);
+
+  // flushes the records still buffered
+  ~EventLog();
+
+  // create a ring for a logging thread; valid until the log is destroyed
+  Producer & add_producer();
+
+  // records dropped across all producers
+  uint64_t num_dropped() const;
+
+  // read all the records of a (closed) event log into memory
+  static std::vector<EventRecord> read(const std::string & file_path);
+
+  // forbid copying and moving
+  EventLog(const EventLog & other) = delete;
+  const EventLog & operator=(const EventLog & other) = delete;
+  EventLog(EventLog && other) = delete;
+  EventLog & operator=(EventLog && other) = delete;
+
+private:
+  FileDescriptor fd_;
+  size_t capacity_;
+  unsigned int flush_interval_ms_;
+
+  mutable std::mutex mtx_ {};
+  std::condition_variable cv_ {};
+  std::vector<std::unique_ptr<Producer>> producers_ {};
+  bool stop_ {false};
+
+  std::thread flusher_ {};
+
+  void flush();
+  void flusher_main();
+};
+
+#endif /* EVENT_LOG_HH */
@@ -0,0 +1,138 @@
+#include <algorithm>
+#include <cmath>
+
+#include "latency_histogram.hh"
+#include "conversion.hh"
+
+using namespace std;
+
+string LatencyPercentiles::str() const
+{
+  const auto ms = [](const uint64_t us) { return double_to_string(us / 1000.0); };
+
+  return "p50/p90/p99/p99.9/max (ms) of " + to_string(count) + ": "
+         + ms(p50) + "/" + ms(p90) + "/" + ms(p99) + "/" + ms(p999)
+         + "/" + ms(max);
+}
+
+size_t LatencyHistogram::bucket_index(const uint64_t value_us)
+{
+  if (value_us < SUB_COUNT) {
+    return value_us;
+  }
+
+  // shift the value down to [HALF_COUNT, SUB_COUNT)
+  const unsigned int msb = 63 - __builtin_clzll(value_us);
+  const unsigned int shift = msb - (SUB_BITS - 1);
+
+  return SUB_COUNT + (shift - 1) * HALF_COUNT + ((value_us >> shift) - HALF_COUNT);
+}
+
+uint64_t LatencyHistogram::bucket_lower(const size_t index)
+{
+  if (index < SUB_COUNT) {
+    return index;
+  }
+
+  const size_t shift = (index - SUB_COUNT) / HALF_COUNT + 1;
+  const uint64_t sub = (index - SUB_COUNT) % HALF_COUNT + HALF_COUNT;
+  return sub << shift;
+}
+
+uint64_t LatencyHistogram::bucket_upper(const size_t index)
+{
+  if (index + 1 == NUM_BUCKETS) {
+    return UINT64_MAX;
+  }
+
+  return bucket_lower(index + 1) - 1;
+}
+
+void LatencyHistogram::add(const size_t index, const uint64_t count, const uint64_t max)
+{
+  // count first, and publish the bucket after it (paired with the acquire
+  // in move_into()), so that a value moved out of a bucket is always in
+  // count_ already and count_ never drops below zero
+  count_.fetch_add(count, memory_order_relaxed);
+  buckets_[index].fetch_add(count, memory_order_release);
+
+  uint64_t curr_max = max_.load(memory_order_relaxed);
+  while (max > curr_max and
+         not max_.compare_exchange_weak(curr_max, max, memory_order_relaxed)) {}
+}
+
+void LatencyHistogram::record(const uint64_t value_us)
+{
+  add(bucket_index(value_us), 1, value_us);
+}
+
+LatencyPercentiles LatencyHistogram::percentiles() const
+{
+  LatencyPercentiles result;
+  result.max = max_.load(memory_order_relaxed);
+
+  // a consistent total of the buckets read
+  array<uint64_t, NUM_BUCKETS> counts;
+  for (size_t i = 0; i < NUM_BUCKETS; i++) {
+    counts[i] = buckets_[i].load(memory_order_relaxed);
+    result.count += counts[i];
+  }
+
+  if (result.count == 0) {
+    return result;
+  }
+
+  // the smallest value with at least p of the values at or below it,
+  // reported as the middle of its bucket (but never above the max)
+  const pair<double, uint64_t *> targets[] = {
+    {0.5, &result.p50}, {0.9, &result.p90}, {0.99, &result.p99}, {0.999, &result.p999}
+  };
+
+  size_t index = 0;
+  uint64_t seen = 0;
+  for (const auto & [p, value] : targets) {
+    const uint64_t rank = max<uint64_t>(1, ceil(p * result.count));
+
+    while (seen + counts[index] < rank) {
+      seen += counts[index];
+      index++;
+    }
+
+    const uint64_t lower = bucket_lower(index);
+    *value = min(lower + (bucket_upper(index) - lower) / 2, result.max);
+  }
+
+  return result;
+}
+
+void LatencyHistogram::move_into(LatencyHistogram & total)
+{
+  uint64_t moved = 0;
+  for (size_t i = 0; i < NUM_BUCKETS; i++) {
+    const uint64_t count = buckets_[i].exchange(0, memory_order_acquire);
+    if (count > 0) {
+      total.add(i, count, 0);
+      moved += count;
+    }
+  }
+
+  count_.fetch_sub(moved, memory_order_relaxed);
+  const uint64_t max = max_.exchange(0, memory_order_relaxed);
+  total.add(0, 0, max);
+}
+
+void LatencyHistogram::reset()
+{
+  for (auto & bucket : buckets_) {
+    bucket.store(0, memory_order_relaxed);
+  }
+  count_.store(0, memory_order_relaxed);
+  max_.store(0, memory_order_relaxed);
+}
+
+pair<LatencyPercentiles, LatencyPercentiles> LatencyStats::take_interval()
+{
+  const LatencyPercentiles interval = interval_.percentiles();
+  interval_.move_into(run_);
+  return {interval, run_.percentiles()};
+}
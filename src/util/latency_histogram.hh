@@ -0,0 +1,76 @@
+#ifndef LATENCY_HISTOGRAM_HH
+#define LATENCY_HISTOGRAM_HH
+
+#include <cstdint>
+#include <string>
+#include <array>
+#include <utility>
+#include <atomic>
+
+// percentiles of the latencies recorded in a LatencyHistogram (in us)
+struct LatencyPercentiles
+{
+  uint64_t count {0};
+  uint64_t p50 {0}, p90 {0}, p99 {0}, p999 {0};
+  uint64_t max {0};
+
+  // e.g., "p50/p90/p99/p99.9/max (ms) of 30: 1.20/1.50/3.10/3.10/3.12"
+  std::string str() const;
+};
+
+// a log-linear (HDR-style) histogram of latencies in microseconds: values
+// below 2^SUB_BITS are counted exactly, and each power-of-two range above
+// is split into 2^(SUB_BITS - 1) linear buckets, so a percentile is within
+// ~3% of the true value; record() is wait-free and can be called from any
+// thread while another reads or resets the histogram
+class LatencyHistogram
+{
+public:
+  static constexpr unsigned int SUB_BITS = 6;
+
+  void record(const uint64_t value_us);
+
+  // percentiles of the values recorded so far (approximate if recorded to
+  // concurrently)
+  LatencyPercentiles percentiles() const;
+
+  // move the values recorded so far into 'total' (e.g., to keep per-run
+  // stats while reporting per-interval ones)
+  void move_into(LatencyHistogram & total);
+
+  void reset();
+
+  uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+
+  // bucket that 'value_us' is counted in, and the values it covers
+  static size_t bucket_index(const uint64_t value_us);
+  static uint64_t bucket_lower(const size_t index);
+  static uint64_t bucket_upper(const size_t index); // inclusive
+
+private:
+  static constexpr size_t SUB_COUNT = 1 << SUB_BITS;
+  static constexpr size_t HALF_COUNT = SUB_COUNT / 2;
+  static constexpr size_t NUM_BUCKETS = SUB_COUNT + (64 - SUB_BITS) * HALF_COUNT;
+
+  std::array<std::atomic<uint64_t>, NUM_BUCKETS> buckets_ {};
+  std::atomic<uint64_t> count_ {0};
+  std::atomic<uint64_t> max_ {0};
+
+  void add(const size_t index, const uint64_t count, const uint64_t max);
+};
+
+// latencies of the current interval and of the whole run
+class LatencyStats
+{
+public:
+  void record(const uint64_t value_us) { interval_.record(value_us); }
+
+  // percentiles of the interval and of the run so far; starts a new interval
+  std::pair<LatencyPercentiles, LatencyPercentiles> take_interval();
+
+private:
+  LatencyHistogram interval_ {};
+  LatencyHistogram run_ {};
+};
+
+#endif /* LATENCY_HISTOGRAM_HH */
@@ -0,0 +1,242 @@
+#include <algorithm>
+#include <stdexcept>
+#include <cmath>
+
+#include "link_model.hh"
+
+using namespace std;
+
+LinkModel::LinkModel(const Config & config)
+  : config_(config), rng_(config.seed)
+{
+  const auto check_probability = [](const double p, const string & name) {
+    if (p < 0 or p > 1) {
+      throw runtime_error("LinkModel: " + name + " must be between 0 and 1");
+    }
+  };
+  check_probability(config.loss, "loss");
+  check_probability(config.reorder, "reorder");
+  check_probability(config.ge_p, "ge_p");
+  check_probability(config.ge_r, "ge_r");
+  check_probability(config.ge_bad_loss, "ge_bad_loss");
+}
+
+nullopt_t LinkModel::drop(const Verdict verdict, uint64_t & counter)
+{
+  outcome_.verdict = verdict;
+  counter++;
+  return nullopt;
+}
+
+uint64_t LinkModel::queued_bytes(const uint64_t now_us)
+{
+  while (not backlog_.empty() and backlog_.front().first <= now_us) {
+    backlog_bytes_ -= backlog_.front().second;
+    backlog_.pop_front();
+  }
+
+  return backlog_bytes_;
+}
+
+optional<LinkModel::Departure> LinkModel::departure(const size_t size,
+                                                   const uint64_t now_us) const
+{
+  if (config_.trace) {
+    return trace_departure(size, now_us);
+  }
+
+  if (config_.rate_kbps == 0) {
+    return Departure {now_us, 0.0, 0, 0};
+  }
+
+  // the packet reaches the head of the queue once the previous one left;
+  // a bucket shallower than the packet would never let it through
+  const uint64_t head_ts = max(now_us, busy_until_us_);
+  const double depth = max<double>(config_.burst_bytes, size);
+  const double bytes_per_us = config_.rate_kbps / 8000.0;
+
+  double tokens = min(depth, tokens_ + (head_ts - tokens_ts_) * bytes_per_us);
+  uint64_t depart_ts = head_ts;
+
+  if (tokens < size) {
+    const auto wait_us = static_cast<uint64_t>(ceil((size - tokens) / bytes_per_us));
+    depart_ts += wait_us;
+    tokens = min(depth, tokens + wait_us * bytes_per_us);
+  }
+
+  return Departure {depart_ts, tokens - size, 0, 0};
+}
+
+optional<LinkModel::Departure> LinkModel::trace_departure(const size_t size,
+                                                         const uint64_t now_us) const
+{
+  const LinkTrace & trace = *config_.trace;
+  const bool loop = config_.trace_loop;
+  const uint64_t start_us = trace_start_us_.value();
+
+  // an idle link wastes its opportunities (as in mahimahi), so a packet
+  // arriving to an empty queue takes the next one; otherwise it goes on
+  // from where the previous packet left off
+  uint64_t index = trace_index_;
+  size_t bytes_left = trace_bytes_left_;
+
+  if (busy_until_us_ < now_us) {
+    const auto next = trace.first_at_or_after(now_us - start_us, loop);
+    if (not next) {
+      return nullopt;
+    }
+    index = *next;
+    bytes_left = LinkTrace::OPPORTUNITY_BYTES;
+  }
+
+  // a packet larger than what is left takes as many opportunities as needed
+  size_t remaining = size;
+  while (true) {
+    if (bytes_left == 0) {
+      index++;
+      bytes_left = LinkTrace::OPPORTUNITY_BYTES;
+    }
+
+    const size_t taken = min(remaining, bytes_left);
+    remaining -= taken;
+    bytes_left -= taken;
+
+    if (remaining == 0) {
+      break;
+    }
+  }
+
+  const auto depart_ts = trace.time_of(index, loop);
+  if (not depart_ts) {
+    return nullopt;
+  }
+
+  return Departure {start_us + *depart_ts, 0.0, index, bytes_left};
+}
+
+bool LinkModel::codel_drop(const uint64_t ts, const uint64_t sojourn_us)
+{
+  // the control law of RFC 8289: drop ever more often while the sojourn
+  // time stays above the target (evaluated once per departing packet)
+  const auto control_law = [this](const uint64_t t) {
+    return t + static_cast<uint64_t>(config_.codel_interval_us / sqrt(drop_count_));
+  };
+
+  bool ok_to_drop = false;
+  if (sojourn_us < config_.codel_target_us) {
+    first_above_time_ = 0;
+  } else if (first_above_time_ == 0) {
+    first_above_time_ = ts + config_.codel_interval_us;
+  } else if (ts >= first_above_time_) {
+    ok_to_drop = true;
+  }
+
+  if (dropping_) {
+    if (not ok_to_drop) {
+      dropping_ = false;
+    } else if (ts >= drop_next_) {
+      drop_count_++;
+      drop_next_ = control_law(drop_next_);
+      return true;
+    }
+  } else if (ok_to_drop) {
+    dropping_ = true;
+
+    // resume near the previous drop rate if the last episode just ended
+    const bool recent = ts < drop_next_ + 16 * config_.codel_interval_us;
+    drop_count_ = (recent and drop_count_ > 2) ? drop_count_ - 2 : 1;
+    drop_next_ = control_law(ts);
+    return true;
+  }
+
+  return false;
+}
+
+bool LinkModel::draw_loss()
+{
+  if (config_.ge_p > 0) {
+    const double transition = unit_dist_(rng_);
+    if (ge_bad_) {
+      ge_bad_ = transition >= config_.ge_r;
+    } else {
+      ge_bad_ = transition < config_.ge_p;
+    }
+
+    if (ge_bad_) {
+      return unit_dist_(rng_) < config_.ge_bad_loss;
+    }
+  }
+
+  return config_.loss > 0 and unit_dist_(rng_) < config_.loss;
+}
+
+uint64_t LinkModel::draw_delay()
+{
+  if (config_.jitter_us == 0) {
+    return config_.delay_us;
+  }
+
+  const double jitter = (unit_dist_(rng_) * 2 - 1) * config_.jitter_us;
+  return static_cast<uint64_t>(max(0.0, config_.delay_us + jitter));
+}
+
+optional<uint64_t> LinkModel::transmit(const size_t size, const uint64_t now_us)
+{
+  num_sent_++;
+  outcome_ = {};
+  outcome_.enter_us = now_us;
+
+  if (config_.trace and not trace_start_us_) {
+    trace_start_us_ = now_us;
+  }
+
+  outcome_.queued_bytes = queued_bytes(now_us);
+  if (config_.queue_bytes > 0 and outcome_.queued_bytes + size > config_.queue_bytes) {
+    return drop(Verdict::OVERFLOWED, num_overflowed_);
+  }
+
+  // the queue is FIFO and drains deterministically, so when the packet
+  // leaves it, and how long it waited, are known as it arrives
+  const auto departure_info = departure(size, now_us);
+  if (not departure_info) {
+    return drop(Verdict::OVERFLOWED, num_overflowed_); // the trace has ended
+  }
+
+  const Departure & dep = *departure_info;
+  outcome_.depart_us = dep.ts;
+
+  if (config_.queue == Queue::CODEL and codel_drop(dep.ts, dep.ts - now_us)) {
+    return drop(Verdict::AQM_DROPPED, num_aqm_dropped_); // taking no capacity
+  }
+
+  tokens_ = dep.tokens;
+  tokens_ts_ = dep.ts;
+  trace_index_ = dep.trace_index;
+  trace_bytes_left_ = dep.trace_bytes_left;
+  busy_until_us_ = dep.ts;
+
+  if (dep.ts > now_us) {
+    backlog_.emplace_back(dep.ts, size);
+    backlog_bytes_ += size;
+    outcome_.queued_bytes += size;
+  }
+
+  // draw the losses (after the bottleneck, which a lost packet occupies
+  // too) for every packet that got through, so that they only depend on the
+  // seed and the sequence of packets
+  if (draw_loss()) {
+    return drop(Verdict::LOST, num_lost_);
+  }
+
+  // reordered packets skip the delay and overtake the ones in flight;
+  // others never overtake each other however the delay varies
+  if (config_.reorder > 0 and unit_dist_(rng_) < config_.reorder) {
+    num_reordered_++;
+    outcome_.arrival_us = dep.ts;
+  } else {
+    last_arrival_us_ = max(last_arrival_us_, dep.ts + draw_delay());
+    outcome_.arrival_us = last_arrival_us_;
+  }
+
+  return outcome_.arrival_us;
+}
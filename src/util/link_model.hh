@@ -0,0 +1,153 @@
+#ifndef LINK_MODEL_HH
+#define LINK_MODEL_HH
+
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <deque>
+#include <memory>
+#include <utility>
+
+#include "link_trace.hh"
+
+// a one-way network path reduced to arithmetic on timestamps: a bottleneck
+// (a token bucket, or the delivery opportunities of a trace) behind a
+// drop-tail or CoDel queue, followed by a (jittered) propagation delay,
+// with random or Gilbert-Elliott (bursty) loss and optional reordering;
+// given when a packet enters the link, it tells when the packet comes out
+// (or that it is dropped) without reading any clock, so it works on both
+// real and virtual time
+class LinkModel
+{
+public:
+  enum class Queue {
+    DROP_TAIL, // drop arriving packets when the queue is full
+    CODEL      // also drop departing packets that waited too long (RFC 8289)
+  };
+
+  struct Config
+  {
+    uint64_t rate_kbps {0};    // bottleneck rate (0: unlimited)
+    uint64_t burst_bytes {0};  // token bucket depth (0: a single packet)
+
+    // replay this trace at the bottleneck instead (from the first packet
+    // on), and loop it or let the link go dead when it ends
+    std::shared_ptr<const LinkTrace> trace {};
+    bool trace_loop {true};
+
+    uint64_t delay_us {0};     // one-way propagation delay
+    uint64_t jitter_us {0};    // the delay varies uniformly by up to +/- this
+    double reorder {0.0};      // probability of a packet skipping the delay
+    double loss {0.0};         // probability of losing each packet (in the
+                               // good state if Gilbert-Elliott is enabled)
+
+    // Gilbert-Elliott loss (enabled if ge_p > 0): per packet, switch from
+    // the good to the bad state with probability ge_p, back with ge_r, and
+    // lose packets in the bad state with probability ge_bad_loss
+    double ge_p {0.0};
+    double ge_r {0.0};
+    double ge_bad_loss {1.0};
+
+    uint64_t queue_bytes {0};  // capacity of the queue (0: unlimited)
+    Queue queue {Queue::DROP_TAIL};
+    uint64_t codel_target_us {5000};
+    uint64_t codel_interval_us {100000};
+
+    uint32_t seed {1};         // of the random losses, jitter and reordering
+  };
+
+  // what happened to the last packet
+  enum class Verdict : uint8_t { DELIVERED, LOST, OVERFLOWED, AQM_DROPPED };
+
+  struct Outcome
+  {
+    Verdict verdict {Verdict::DELIVERED};
+    uint64_t enter_us {0};
+    uint64_t depart_us {0};   // left the queue (if not overflowed)
+    uint64_t arrival_us {0};  // at the other end (if delivered)
+    uint64_t queued_bytes {0}; // in the queue after the packet entered
+  };
+
+  explicit LinkModel(const Config & config);
+
+  // a packet of 'size' bytes enters the link at 'now_us'; returns when it
+  // arrives at the other end, or nullopt if it is lost or dropped; must be
+  // called with non-decreasing 'now_us'
+  std::optional<uint64_t> transmit(const size_t size, const uint64_t now_us);
+
+  // bytes queued at the bottleneck (not yet departed) at 'now_us'
+  uint64_t queued_bytes(const uint64_t now_us);
+
+  // accessors
+  const Config & config() const { return config_; }
+  const Outcome & last_outcome() const { return outcome_; }
+  uint64_t num_sent() const { return num_sent_; }
+  uint64_t num_lost() const { return num_lost_; }
+  uint64_t num_overflowed() const { return num_overflowed_; }
+  uint64_t num_aqm_dropped() const { return num_aqm_dropped_; }
+  uint64_t num_reordered() const { return num_reordered_; }
+
+private:
+  Config config_;
+  std::mt19937 rng_;
+  std::uniform_real_distribution<double> unit_dist_ {0.0, 1.0};
+
+  // when a packet leaves the bottleneck, and the bottleneck's state after it
+  struct Departure
+  {
+    uint64_t ts;
+    double tokens;            // token bucket: tokens left (bytes)
+    uint64_t trace_index;     // trace: opportunity the packet left in
+    size_t trace_bytes_left;  // and the bytes left in it
+  };
+
+  // token bucket: tokens (bytes) as of tokens_ts_
+  double tokens_ {0.0};
+  uint64_t tokens_ts_ {0};
+
+  // trace: the start of the trace, and the opportunity the latest packet
+  // left in (with the bytes left in it)
+  std::optional<uint64_t> trace_start_us_ {};
+  uint64_t trace_index_ {0};
+  size_t trace_bytes_left_ {0};
+
+  // when the last accepted packet leaves the bottleneck
+  uint64_t busy_until_us_ {0};
+
+  // packets in the queue: {departure, size}
+  std::deque<std::pair<uint64_t, size_t>> backlog_ {};
+  uint64_t backlog_bytes_ {0};
+
+  // latest arrival, which later packets don't overtake unless reordered
+  uint64_t last_arrival_us_ {0};
+
+  bool ge_bad_ {false}; // Gilbert-Elliott state
+
+  // CoDel state
+  uint64_t first_above_time_ {0};
+  uint64_t drop_next_ {0};
+  uint32_t drop_count_ {0};
+  bool dropping_ {false};
+
+  Outcome outcome_ {};
+  uint64_t num_sent_ {0};
+  uint64_t num_lost_ {0};
+  uint64_t num_overflowed_ {0};
+  uint64_t num_aqm_dropped_ {0};
+  uint64_t num_reordered_ {0};
+
+  // when a packet of 'size' bytes entering at 'now_us' would leave the
+  // bottleneck (nullopt: never, as the trace has ended)
+  std::optional<Departure> departure(const size_t size, const uint64_t now_us) const;
+  std::optional<Departure> trace_departure(const size_t size, const uint64_t now_us) const;
+
+  // CoDel's verdict on a packet leaving the queue at 'ts' after 'sojourn_us'
+  bool codel_drop(const uint64_t ts, const uint64_t sojourn_us);
+
+  bool draw_loss();
+  uint64_t draw_delay();
+
+  std::nullopt_t drop(const Verdict verdict, uint64_t & counter);
+};
+
+#endif /* LINK_MODEL_HH */
@@ -0,0 +1,160 @@
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <stdexcept>
+#include <cmath>
+
+#include "link_trace.hh"
+
+using namespace std;
+
+LinkTrace::LinkTrace(vector<uint64_t> && times_us, const uint64_t period_us)
+  : times_us_(move(times_us)), period_us_(period_us)
+{
+  if (times_us_.empty() or period_us_ == 0) {
+    throw runtime_error("LinkTrace: a trace needs opportunities and a positive period");
+  }
+
+  if (not is_sorted(times_us_.begin(), times_us_.end()) or
+      times_us_.back() > period_us_) {
+    throw runtime_error("LinkTrace: opportunities must be sorted and within the period");
+  }
+}
+
+LinkTrace LinkTrace::load(const string & path)
+{
+  ifstream file(path);
+  if (not file) {
+    throw runtime_error("LinkTrace: failed to open " + path);
+  }
+
+  // numbers on each non-empty line, ignoring '#' comments
+  vector<vector<double>> lines;
+  string line;
+  while (getline(file, line)) {
+    line = line.substr(0, line.find('#'));
+    replace(line.begin(), line.end(), ',', ' ');
+
+    istringstream fields(line);
+    vector<double> numbers;
+    double number;
+    while (fields >> number) {
+      numbers.push_back(number);
+    }
+    if (not fields.eof()) {
+      throw runtime_error("LinkTrace: invalid line in " + path + ": " + line);
+    }
+
+    if (not numbers.empty()) {
+      lines.emplace_back(move(numbers));
+    }
+  }
+
+  if (lines.empty()) {
+    throw runtime_error("LinkTrace: empty trace " + path);
+  }
+
+  return lines.front().size() == 1 ? from_mahimahi(lines) : from_throughput(lines);
+}
+
+LinkTrace LinkTrace::from_mahimahi(const vector<vector<double>> & lines)
+{
+  vector<uint64_t> times_us;
+  times_us.reserve(lines.size());
+
+  for (const auto & numbers : lines) {
+    if (numbers.size() != 1 or numbers[0] < 0) {
+      throw runtime_error("LinkTrace: a mahimahi trace has one timestamp (ms) per line");
+    }
+    times_us.push_back(llround(numbers[0] * 1000));
+  }
+
+  const uint64_t period_us = times_us.back();
+  return {move(times_us), period_us};
+}
+
+LinkTrace LinkTrace::from_throughput(const vector<vector<double>> & lines)
+{
+  if (lines.size() < 2) {
+    throw runtime_error("LinkTrace: a throughput trace needs at least two samples");
+  }
+
+  // segment i runs from line i's time to the next line's (or as long as the
+  // one before for the last)
+  vector<pair<double, double>> samples; // {start (us), rate (bytes/us)}
+  for (const auto & numbers : lines) {
+    if (numbers.size() != 2 or numbers[0] < 0 or numbers[1] < 0) {
+      throw runtime_error("LinkTrace: a throughput trace has \"<seconds> <Mbps>\" per line");
+    }
+    samples.emplace_back(numbers[0] * 1e6 - lines.front()[0] * 1e6, numbers[1] / 8);
+  }
+
+  const double last_length = samples.back().first - samples[samples.size() - 2].first;
+  const double end = samples.back().first + last_length;
+  if (last_length <= 0) {
+    throw runtime_error("LinkTrace: throughput samples must be in increasing time");
+  }
+
+  // an opportunity whenever another OPPORTUNITY_BYTES worth of capacity has
+  // accumulated, carrying leftovers across segments
+  vector<uint64_t> times_us;
+  double credit = 0;
+
+  for (size_t i = 0; i < samples.size(); i++) {
+    const auto [start, bytes_per_us] = samples[i];
+    const double seg_end = i + 1 < samples.size() ? samples[i + 1].first : end;
+    if (seg_end <= start) {
+      throw runtime_error("LinkTrace: throughput samples must be in increasing time");
+    }
+    if (bytes_per_us == 0) {
+      continue;
+    }
+
+    double t = start;
+    while (true) {
+      const double until_next = (OPPORTUNITY_BYTES - credit) / bytes_per_us;
+      if (t + until_next >= seg_end) {
+        credit += (seg_end - t) * bytes_per_us;
+        break;
+      }
+
+      t += until_next;
+      credit = 0;
+      times_us.push_back(llround(t));
+    }
+  }
+
+  if (times_us.empty()) {
+    throw runtime_error("LinkTrace: the throughput trace carries less than a packet");
+  }
+
+  return {move(times_us), static_cast<uint64_t>(llround(end))};
+}
+
+optional<uint64_t> LinkTrace::first_at_or_after(const uint64_t ts_us, const bool loop) const
+{
+  const uint64_t cycle = ts_us / period_us_;
+  const uint64_t offset = ts_us % period_us_;
+
+  const size_t i = lower_bound(times_us_.begin(), times_us_.end(), offset) - times_us_.begin();
+  const uint64_t index = cycle * times_us_.size() + i;
+
+  if (not loop and index >= times_us_.size()) {
+    return nullopt;
+  }
+  return index;
+}
+
+optional<uint64_t> LinkTrace::time_of(const uint64_t index, const bool loop) const
+{
+  if (not loop and index >= times_us_.size()) {
+    return nullopt;
+  }
+
+  return index / times_us_.size() * period_us_ + times_us_[index % times_us_.size()];
+}
+
+double LinkTrace::average_kbps() const
+{
+  return times_us_.size() * OPPORTUNITY_BYTES * 8 * 1000.0 / period_us_;
+}
@@ -0,0 +1,55 @@
+#ifndef LINK_TRACE_HH
+#define LINK_TRACE_HH
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <optional>
+
+// the packet delivery opportunities of a bottleneck over time, as replayed
+// from a trace: each opportunity lets OPPORTUNITY_BYTES through, and the
+// trace repeats every period (if looped)
+class LinkTrace
+{
+public:
+  // bytes per opportunity (an MTU, as in mahimahi)
+  static constexpr size_t OPPORTUNITY_BYTES = 1500;
+
+  // opportunities at 'times_us' (sorted, relative to the start of the
+  // trace) repeating every 'period_us'
+  LinkTrace(std::vector<uint64_t> && times_us, const uint64_t period_us);
+
+  // load a trace in either format below, told apart by their first line:
+  //   mahimahi: one opportunity per line, at the given ms since the start
+  //     (repeated for several opportunities at once); the period is the
+  //     last timestamp
+  //   throughput (e.g., LTE/5G measurements): "<seconds> <Mbps>" per line
+  //     (or comma-separated), each rate holding until the next line's time
+  //     and the last one for as long as the one before it; it is turned
+  //     into evenly spaced opportunities
+  static LinkTrace load(const std::string & path);
+
+  // index of the first opportunity at or after 'ts_us' since the start
+  // (counting on across repetitions), or nullopt if the trace has ended
+  std::optional<uint64_t> first_at_or_after(const uint64_t ts_us, const bool loop) const;
+
+  // time of opportunity 'index' since the start, or nullopt if the trace
+  // has ended
+  std::optional<uint64_t> time_of(const uint64_t index, const bool loop) const;
+
+  // accessors
+  uint64_t period_us() const { return period_us_; }
+  size_t size() const { return times_us_.size(); }
+
+  // average rate over a period
+  double average_kbps() const;
+
+private:
+  std::vector<uint64_t> times_us_;
+  uint64_t period_us_;
+
+  static LinkTrace from_mahimahi(const std::vector<std::vector<double>> & lines);
+  static LinkTrace from_throughput(const std::vector<std::vector<double>> & lines);
+};
+
+#endif /* LINK_TRACE_HH */
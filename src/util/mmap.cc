@@ -1,3 +1,4 @@
+#include <unistd.h>
 #include <iostream>
 
 #include "mmap.hh"
@@ -39,3 +40,22 @@ MMap & MMap::operator=(MMap && other)
 
   return *this;
 }
+
+void MMap::advise(const int advice) const
+{
+  advise(advice, 0, length_);
+}
+
+void MMap::advise(const int advice, const size_t offset, const size_t length) const
+{
+  if (offset + length > length_) {
+    throw runtime_error("MMap: advised range is out of bounds");
+  }
+
+  // madvise requires a page-aligned start address
+  static const size_t page_size = sysconf(_SC_PAGESIZE);
+  const size_t aligned_offset = offset / page_size * page_size;
+
+  check_syscall(madvise(addr_ + aligned_offset, length + offset - aligned_offset,
+                        advice));
+}
@@ -18,6 +18,11 @@ public:
   MMap(const MMap & other) = delete;
   const MMap & operator=(const MMap & other) = delete;
 
+  // advise the kernel on the expected access pattern of [offset, offset + length)
+  // (or of the whole mapping by default)
+  void advise(const int advice) const;
+  void advise(const int advice, const size_t offset, const size_t length) const;
+
   // accessors
   uint8_t * addr() const { return addr_; }
   size_t length() const { return length_; }
@@ -0,0 +1,69 @@
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <iostream>
+
+#include "perf_counters.hh"
+#include "exception.hh"
+
+using namespace std;
+
+PerfCounters::PerfCounters()
+{
+  perf_event_attr attr {};
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HW_CACHE;
+  attr.config = PERF_COUNT_HW_CACHE_DTLB
+                | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.inherit = 1;
+
+  // glibc provides no wrapper for perf_event_open
+  const int fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+  if (fd >= 0) {
+    dtlb_fd_.emplace(fd);
+  } else {
+    cerr << "Warning: dTLB miss counter unavailable ("
+         << unix_error().code().message() << ")" << endl;
+  }
+
+  last_ = read();
+}
+
+PerfCounters::Sample PerfCounters::read() const
+{
+  rusage usage {};
+  check_syscall(getrusage(RUSAGE_SELF, &usage));
+
+  Sample sample;
+  sample.minor_faults = usage.ru_minflt;
+  sample.major_faults = usage.ru_majflt;
+
+  if (dtlb_fd_) {
+    uint64_t count = 0;
+    if (check_syscall(::read(dtlb_fd_->fd_num(), &count, sizeof(count)))
+        == sizeof(count)) {
+      sample.dtlb_misses = count;
+    }
+  }
+
+  return sample;
+}
+
+void PerfCounters::output_periodic_stats()
+{
+  const Sample curr = read();
+
+  cerr << "Page faults: " << curr.minor_faults - last_.minor_faults
+       << " minor, " << curr.major_faults - last_.major_faults << " major";
+
+  if (curr.dtlb_misses and last_.dtlb_misses) {
+    cerr << ", dTLB load misses: " << *curr.dtlb_misses - *last_.dtlb_misses;
+  }
+  cerr << endl;
+
+  last_ = curr;
+}
@@ -0,0 +1,36 @@
+#ifndef PERF_COUNTERS_HH
+#define PERF_COUNTERS_HH
+
+#include <cstdint>
+#include <optional>
+
+#include "file_descriptor.hh"
+
+// counts the page faults of the process and, where perf events are
+// permitted (see /proc/sys/kernel/perf_event_paranoid), the dTLB load misses
+// of the constructing thread and of threads it creates afterwards (the
+// latter are only added once they exit)
+class PerfCounters
+{
+public:
+  struct Sample
+  {
+    uint64_t minor_faults {0};
+    uint64_t major_faults {0};
+    std::optional<uint64_t> dtlb_misses {}; // nullopt if unavailable
+  };
+
+  PerfCounters();
+
+  // current totals
+  Sample read() const;
+
+  // print the counts since the last call (or construction)
+  void output_periodic_stats();
+
+private:
+  std::optional<FileDescriptor> dtlb_fd_ {};
+  Sample last_ {};
+};
+
+#endif /* PERF_COUNTERS_HH */
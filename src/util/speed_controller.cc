@@ -0,0 +1,102 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "speed_controller.hh"
+
+using namespace std;
+
+SpeedController::SpeedController(const uint16_t frame_rate, const int cpu_used,
+                                  const Config & config)
+  : config_(config),
+    frame_interval_us_(frame_rate > 0 ? 1000000 / frame_rate : 0),
+    setting_({clamp(cpu_used, config.min_cpu_used, max(config.min_cpu_used,
+                                                       config.max_cpu_used)), 1})
+{
+  if (frame_rate == 0) {
+    throw runtime_error("SpeedController: frame rate must be positive");
+  }
+
+  if (config_.budget <= 0 or config_.window == 0 or config_.max_divisor == 0) {
+    throw runtime_error("SpeedController: invalid budget, window or divisor");
+  }
+
+  if (config_.min_cpu_used > config_.max_cpu_used) {
+    throw runtime_error("SpeedController: min_cpu_used exceeds max_cpu_used");
+  }
+}
+
+bool SpeedController::can_adjust() const
+{
+  return config_.min_cpu_used < config_.max_cpu_used or config_.max_divisor >= 2;
+}
+
+uint64_t SpeedController::budget_us(const Setting & setting) const
+{
+  // a frame may take as long as the frames skipped after it
+  return static_cast<uint64_t>(config_.budget * frame_interval_us_ * setting.divisor);
+}
+
+bool SpeedController::should_encode()
+{
+  return frame_count_++ % setting_.divisor == 0;
+}
+
+optional<SpeedController::Decision> SpeedController::record(const uint64_t encode_time_us)
+{
+  window_.record(encode_time_us);
+  if (window_.count() < config_.window) {
+    return nullopt;
+  }
+
+  const uint64_t p99_us = window_.percentiles().p99;
+  window_.reset();
+
+  Setting next = setting_;
+
+  if (p99_us > budget_us(setting_)) {
+    num_quiet_windows_ = 0;
+
+    if (next.cpu_used < config_.max_cpu_used) {
+      // a step for each multiple of the budget taken
+      const int steps = static_cast<int>(p99_us / max<uint64_t>(budget_us(setting_), 1));
+      next.cpu_used = min(config_.max_cpu_used, next.cpu_used + max(steps, 1));
+    } else if (next.divisor * 2 <= config_.max_divisor) {
+      next.divisor *= 2;
+    } else {
+      return nullopt; // already at the fastest
+    }
+
+    num_speed_ups_++;
+  } else {
+    // undo the last step taken to speed up
+    if (next.divisor > 1) {
+      next.divisor /= 2;
+    } else if (next.cpu_used > config_.min_cpu_used) {
+      next.cpu_used--;
+    } else {
+      return nullopt; // already at the slowest
+    }
+
+    // only if the frames would have been well within the budget of the
+    // slower setting for long enough
+    if (p99_us >= config_.slow_down_below * budget_us(next)) {
+      num_quiet_windows_ = 0;
+      return nullopt;
+    }
+
+    if (++num_quiet_windows_ < config_.slow_down_windows) {
+      return nullopt;
+    }
+
+    num_quiet_windows_ = 0;
+    num_slow_downs_++;
+  }
+
+  const Decision decision {setting_, next, p99_us, budget_us(next)};
+  setting_ = next;
+
+  // the frame just encoded starts a new period of 'divisor' frames
+  frame_count_ = 1;
+
+  return decision;
+}
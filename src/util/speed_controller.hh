@@ -0,0 +1,81 @@
+#ifndef SPEED_CONTROLLER_HH
+#define SPEED_CONTROLLER_HH
+
+#include <cstdint>
+#include <optional>
+
+#include "latency_histogram.hh"
+
+// closed-loop control of an encoder's speed to hold a per-frame deadline:
+// after each window of frames, the p99 encode time is compared to a budget
+// (a fraction of the frame interval); above it, the encoder is sped up by
+// raising cpu-used and, once at the fastest, optionally by encoding only
+// every other (then every fourth, ...) frame, whose budget grows
+// accordingly; well below it for several windows in a row, the steps are
+// undone in reverse order down to the slowest (best quality) cpu-used
+// allowed, so it speeds up quickly but slows down with care
+class SpeedController
+{
+public:
+  struct Config
+  {
+    double budget {0.8};            // fraction of the frame interval
+    int min_cpu_used {5};           // slowest (best quality) setting
+    int max_cpu_used {9};           // fastest setting (VP9 realtime)
+    unsigned int max_divisor {1};   // encode at least 1 of every N frames
+    unsigned int window {15};       // encoded frames per decision
+    double slow_down_below {0.5};   // fraction of the budget after slowing down
+    unsigned int slow_down_windows {3}; // in a row before slowing down
+  };
+
+  struct Setting
+  {
+    int cpu_used {0};
+    unsigned int divisor {1}; // encode 1 of every 'divisor' frames
+  };
+
+  struct Decision
+  {
+    Setting from {};
+    Setting to {};
+    uint64_t p99_us {0};    // over the window that led to the decision
+    uint64_t budget_us {0}; // for the setting decided on
+  };
+
+  // start from 'cpu_used' (e.g., the encoder's current setting), clamped
+  // to the configured range
+  SpeedController(const uint16_t frame_rate, const int cpu_used,
+                  const Config & config);
+
+  // whether to encode the next frame or skip it (to reduce the frame rate)
+  bool should_encode();
+
+  // record the time taken to encode a frame; returns the decision if the
+  // setting should change
+  std::optional<Decision> record(const uint64_t encode_time_us);
+
+  // accessors
+  const Setting & setting() const { return setting_; }
+  uint64_t budget_us() const { return budget_us(setting_); }
+  unsigned int num_speed_ups() const { return num_speed_ups_; }
+  unsigned int num_slow_downs() const { return num_slow_downs_; }
+
+  // if there is more than one setting to choose from
+  bool can_adjust() const;
+
+private:
+  Config config_;
+  uint64_t frame_interval_us_;
+  Setting setting_;
+
+  LatencyHistogram window_ {};
+  unsigned int num_quiet_windows_ {0}; // in a row, well within the budget
+  uint64_t frame_count_ {0};
+
+  unsigned int num_speed_ups_ {0};
+  unsigned int num_slow_downs_ {0};
+
+  uint64_t budget_us(const Setting & setting) const;
+};
+
+#endif /* SPEED_CONTROLLER_HH */
@@ -0,0 +1,99 @@
+#include <sys/sysinfo.h>
+#include <algorithm>
+
+#include "thread_pool.hh"
+
+using namespace std;
+
+ThreadPool::ThreadPool(const size_t num_threads)
+{
+  const size_t n = num_threads > 0 ? num_threads
+                   : static_cast<size_t>(max(get_nprocs(), 1));
+
+  for (size_t i = 0; i < n; i++) {
+    workers_.emplace_back(&ThreadPool::worker_main, this);
+  }
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    lock_guard<mutex> lock(mtx_);
+    stop_ = true;
+  }
+  task_cv_.notify_all();
+
+  for (auto & worker : workers_) {
+    worker.join();
+  }
+}
+
+void ThreadPool::submit(function<void()> task)
+{
+  {
+    lock_guard<mutex> lock(mtx_);
+    tasks_.emplace_back(move(task));
+    num_unfinished_++;
+  }
+  task_cv_.notify_one();
+}
+
+void ThreadPool::wait()
+{
+  unique_lock<mutex> lock(mtx_);
+  done_cv_.wait(lock, [this] { return num_unfinished_ == 0; });
+
+  if (error_) {
+    exception_ptr error = error_;
+    error_ = nullptr;
+    rethrow_exception(error);
+  }
+}
+
+void ThreadPool::parallel_for(const size_t n, const function<void(size_t)> & fn)
+{
+  for (size_t i = 0; i < n; i++) {
+    submit([&fn, i]() { fn(i); });
+  }
+
+  wait();
+}
+
+void ThreadPool::worker_main()
+{
+  while (true) {
+    function<void()> task;
+
+    {
+      unique_lock<mutex> lock(mtx_);
+      task_cv_.wait(lock, [this] { return stop_ or not tasks_.empty(); });
+
+      if (tasks_.empty()) { // stop_ must be true
+        return;
+      }
+
+      task = move(tasks_.front());
+      tasks_.pop_front();
+    }
+
+    exception_ptr error;
+    try {
+      task();
+    } catch (...) {
+      error = current_exception();
+    }
+
+    {
+      lock_guard<mutex> lock(mtx_);
+      if (error and not error_) {
+        error_ = error;
+      }
+
+      num_unfinished_--;
+      if (num_unfinished_ > 0) {
+        continue;
+      }
+    }
+    done_cv_.notify_all();
+  }
+}
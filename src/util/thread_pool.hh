@@ -0,0 +1,55 @@
+#ifndef THREAD_POOL_HH
+#define THREAD_POOL_HH
+
+#include <cstddef>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+
+// fixed set of worker threads executing submitted tasks
+class ThreadPool
+{
+public:
+  // spawn 'num_threads' workers (0: as many as available CPUs)
+  explicit ThreadPool(const size_t num_threads = 0);
+  ~ThreadPool();
+
+  // queue a task to run on a worker thread
+  void submit(std::function<void()> task);
+
+  // block until all submitted tasks have finished; rethrows the first
+  // exception thrown by any of them
+  void wait();
+
+  // run fn(i) for every i in [0, n) on the workers and wait for completion
+  // (must not be called from a worker thread)
+  void parallel_for(const size_t n, const std::function<void(size_t)> & fn);
+
+  // accessors
+  size_t size() const { return workers_.size(); }
+
+  // forbid copying and moving
+  ThreadPool(const ThreadPool & other) = delete;
+  const ThreadPool & operator=(const ThreadPool & other) = delete;
+  ThreadPool(ThreadPool && other) = delete;
+  ThreadPool & operator=(ThreadPool && other) = delete;
+
+private:
+  std::vector<std::thread> workers_ {};
+
+  std::mutex mtx_ {};
+  std::condition_variable task_cv_ {}; // signaled when a task is queued
+  std::condition_variable done_cv_ {}; // signaled when all tasks are done
+  std::deque<std::function<void()>> tasks_ {};
+  size_t num_unfinished_ {0}; // queued or running tasks
+  std::exception_ptr error_ {};
+  bool stop_ {false};
+
+  void worker_main();
+};
+
+#endif /* THREAD_POOL_HH */
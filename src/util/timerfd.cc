@@ -1,3 +1,5 @@
+#include <cerrno>
+
 #include "timerfd.hh"
 #include "exception.hh"
 #include "conversion.hh"
@@ -18,12 +20,25 @@ void Timerfd::set_time(const timespec & initial_expiration,
   check_syscall(timerfd_settime(fd_num(), 0, &its, nullptr));
 }
 
+void Timerfd::set_absolute(const uint64_t expiration_ns)
+{
+  itimerspec its {};
+  its.it_value.tv_sec = expiration_ns / 1000000000;
+  its.it_value.tv_nsec = expiration_ns % 1000000000;
+
+  check_syscall(timerfd_settime(fd_num(), TFD_TIMER_ABSTIME, &its, nullptr));
+}
+
 unsigned int Timerfd::read_expirations()
 {
   uint64_t num_exp = 0;
-  
-  if (check_syscall(::read(fd_num(), &num_exp, sizeof(num_exp)))
-      != sizeof(num_exp)) {
+
+  const ssize_t bytes_read = ::read(fd_num(), &num_exp, sizeof(num_exp));
+  if (bytes_read < 0 and errno == EAGAIN) {
+    return 0; // (re)armed since it became readable
+  }
+
+  if (check_syscall(bytes_read) != sizeof(num_exp)) {
     throw runtime_error("read error in timerfd");
   }
   // q: in what situration will num_exp in the fd be greater than 1?
@@ -14,6 +14,10 @@ public:
   void set_time(const timespec & initial_expiration,
                 const timespec & interval);
 
+  // expire once at 'expiration_ns' on the timer's clock (0: disarm)
+  void set_absolute(const uint64_t expiration_ns);
+
+  // expirations since the last read (0 if none yet, in nonblocking mode)
   unsigned int read_expirations();
 };
 
@@ -1,20 +1,31 @@
-#include <chrono>
 #include "timestamp.hh"
+#include "clock.hh"
 
-using namespace std;
-using namespace chrono;
+namespace {
+  thread_local const ClockSource * thread_clock = nullptr;
+
+  uint64_t now_ns()
+  {
+    return thread_clock ? thread_clock->now_ns() : monotonic_ns();
+  }
+}
 
 uint64_t timestamp_ns()
 {
-  return system_clock::now().time_since_epoch() / 1ns;
+  return now_ns();
 }
 
 uint64_t timestamp_us()
 {
-  return system_clock::now().time_since_epoch() / 1us;
+  return now_ns() / 1000;
 }
 
 uint64_t timestamp_ms()
 {
-  return system_clock::now().time_since_epoch() / 1ms;
+  return now_ns() / 1000000;
+}
+
+void set_thread_clock(const ClockSource * source)
+{
+  thread_clock = source;
 }
@@ -3,13 +3,32 @@
 
 #include <cstdint>
 
-/* nanoseconds since epoch */
+// timestamps on the monotonic clock (see clock.hh), i.e., since an
+// arbitrary point rather than the epoch; timestamps taken on different
+// hosts can only be compared after mapping them with a ClockSync estimate
+
+/* nanoseconds on the monotonic clock */
 uint64_t timestamp_ns();
 
-/* microseconds since epoch */
+/* microseconds on the monotonic clock */
 uint64_t timestamp_us();
 
-/* milliseconds since epoch */
+/* milliseconds on the monotonic clock */
 uint64_t timestamp_ms();
 
+// a clock to read the timestamps above from instead of the monotonic clock,
+// e.g., the virtual clock of a simulation (see virtual_clock.hh)
+class ClockSource
+{
+public:
+  virtual ~ClockSource() {}
+
+  virtual uint64_t now_ns() const = 0;
+};
+
+// make the timestamps taken on the calling thread read 'source' (nullptr:
+// the monotonic clock again); per thread, so that simulations running on
+// different threads keep separate clocks
+void set_thread_clock(const ClockSource * source);
+
 #endif /* TIMESTAMP_HH */
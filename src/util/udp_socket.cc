@@ -64,10 +64,17 @@ bool UDPSocket::check_bytes_received(const ssize_t bytes_received) const
   return true;
 }
 
+vector<char> & UDPSocket::recv_buffer()
+{
+  // allocated (and zeroed) once per thread rather than for every datagram
+  thread_local vector<char> buf(UDP_MTU);
+  return buf;
+}
+
 optional<string> UDPSocket::recv()
 {
   // data to receive
-  vector<char> buf(UDP_MTU);
+  vector<char> & buf = recv_buffer();
 
   const ssize_t bytes_received = ::recv(fd_num(), buf.data(),
                                         UDP_MTU, MSG_TRUNC);
@@ -81,7 +88,7 @@ optional<string> UDPSocket::recv()
 pair<Address, optional<string>> UDPSocket::recvfrom()
 {
   // data to receive and its source address
-  vector<char> buf(UDP_MTU);
+  vector<char> & buf = recv_buffer();
   sockaddr src_addr;
   socklen_t src_addr_len = sizeof(src_addr);
 
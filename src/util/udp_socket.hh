@@ -5,6 +5,7 @@
 #include <string_view>
 #include <utility>
 #include <optional>
+#include <vector>
 
 #include "socket.hh"
 #include "address.hh"
@@ -31,6 +32,9 @@ private:
   bool check_bytes_sent(const ssize_t bytes_sent, const size_t target) const;
   bool check_bytes_received(const ssize_t bytes_received) const;
 
+  // scratch buffer to receive datagrams into
+  static std::vector<char> & recv_buffer();
+
   static constexpr size_t UDP_MTU = 65536; // bytes
 };
 
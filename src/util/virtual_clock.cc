@@ -0,0 +1,58 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "virtual_clock.hh"
+
+using namespace std;
+
+VirtualClock::VirtualClock(const uint64_t start_us)
+  : now_us_(start_us)
+{}
+
+void VirtualClock::schedule_at(const uint64_t ts_us, Callback callback)
+{
+  events_.emplace(make_pair(max(ts_us, now_us_), next_seq_++), move(callback));
+}
+
+void VirtualClock::schedule_after(const uint64_t delay_us, Callback callback)
+{
+  schedule_at(now_us_ + delay_us, move(callback));
+}
+
+void VirtualClock::schedule_periodic(const uint64_t interval_us, Callback callback)
+{
+  if (interval_us == 0) {
+    throw runtime_error("VirtualClock: periodic interval must be positive");
+  }
+
+  // reschedule before running so that the callback may stop the clock
+  const uint64_t next_ts = now_us_ + interval_us;
+  schedule_at(next_ts,
+    [this, interval_us, callback = move(callback)]() mutable
+    {
+      schedule_periodic(interval_us, callback);
+      callback();
+    }
+  );
+}
+
+void VirtualClock::run_until(const uint64_t end_us)
+{
+  while (not stopped_ and not events_.empty()) {
+    auto it = events_.begin();
+    if (it->first.first > end_us) {
+      break;
+    }
+
+    now_us_ = it->first.first;
+    Callback callback = move(it->second);
+    events_.erase(it);
+
+    callback();
+    num_processed_++;
+  }
+
+  if (not stopped_) {
+    now_us_ = max(now_us_, end_us);
+  }
+}
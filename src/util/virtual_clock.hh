@@ -0,0 +1,58 @@
+#ifndef VIRTUAL_CLOCK_HH
+#define VIRTUAL_CLOCK_HH
+
+#include <cstdint>
+#include <map>
+#include <utility>
+#include <functional>
+
+#include "timestamp.hh"
+
+// a discrete-event scheduler on a virtual clock, standing in for Poller and
+// Timerfd when the sender, the receiver and the network all live in one
+// process: callbacks run in timestamp order (in scheduling order among
+// equal timestamps) and the clock jumps from one to the next, so a
+// simulation runs as fast as its callbacks do and the same callbacks always
+// run in the same order
+class VirtualClock : public ClockSource
+{
+public:
+  using Callback = std::function<void()>;
+
+  // start at 'start_us' rather than 0, which the protocol reads as "unset"
+  explicit VirtualClock(const uint64_t start_us = 1000 * 1000);
+
+  uint64_t now_ns() const override { return now_us_ * 1000; }
+  uint64_t now_us() const { return now_us_; }
+
+  // run 'callback' at 'ts_us' (or now if it has passed)
+  void schedule_at(const uint64_t ts_us, Callback callback);
+  void schedule_after(const uint64_t delay_us, Callback callback);
+
+  // run 'callback' every 'interval_us', starting one interval from now
+  // (like a periodic Timerfd, but never skipping expirations)
+  void schedule_periodic(const uint64_t interval_us, Callback callback);
+
+  // run the callbacks due by 'end_us' (including the ones they schedule),
+  // then advance the clock to 'end_us'
+  void run_until(const uint64_t end_us);
+
+  // stop running callbacks, e.g., when an input ends (from a callback)
+  void stop() { stopped_ = true; }
+  bool stopped() const { return stopped_; }
+
+  // accessors
+  size_t num_pending() const { return events_.size(); }
+  uint64_t num_processed() const { return num_processed_; }
+
+private:
+  uint64_t now_us_;
+  uint64_t next_seq_ {0}; // breaks ties between equal timestamps
+  bool stopped_ {false};
+  uint64_t num_processed_ {0};
+
+  // {timestamp, sequence number} -> callback
+  std::map<std::pair<uint64_t, uint64_t>, Callback> events_ {};
+};
+
+#endif /* VIRTUAL_CLOCK_HH */
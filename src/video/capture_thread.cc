@@ -0,0 +1,105 @@
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <cerrno>
+#include <stdexcept>
+
+#include "capture_thread.hh"
+#include "exception.hh"
+#include "timestamp.hh"
+
+using namespace std;
+
+static unique_ptr<VideoInput> check_input(unique_ptr<VideoInput> input)
+{
+  if (not input) {
+    throw runtime_error("CaptureThread: null input");
+  }
+
+  return input;
+}
+
+CaptureThread::CaptureThread(unique_ptr<VideoInput> input,
+                             const FramePool::HugePages huge_pages)
+  : input_(check_input(move(input))),
+    display_width_(input_->display_width()),
+    display_height_(input_->display_height()),
+    pool_(display_width_, display_height_, 3, huge_pages),
+    notify_fd_(check_syscall(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)))
+{
+  capturer_ = thread(&CaptureThread::capture_main, this);
+}
+
+CaptureThread::~CaptureThread()
+{
+  // a blocked read returns with the next frame, after which the thread exits
+  stop_ = true;
+
+  if (capturer_.joinable()) {
+    capturer_.join();
+  }
+}
+
+void CaptureThread::notify()
+{
+  const uint64_t one = 1;
+  check_syscall(::write(notify_fd_.fd_num(), &one, sizeof(one)));
+}
+
+void CaptureThread::capture_main()
+{
+  try {
+    uint64_t seq = 0;
+
+    while (not stop_) {
+      PooledImage img = pool_.acquire();
+
+      if (not input_->read_frame(*img)) {
+        break;
+      }
+
+      // timestamp as soon as the frame is dequeued
+      const uint64_t capture_ts = timestamp_us();
+
+      {
+        lock_guard<mutex> lock(mtx_);
+
+        // drop the oldest (only) frame in the mailbox
+        if (latest_) {
+          num_dropped_++;
+        }
+        latest_ = CapturedFrame {move(img), capture_ts, seq++};
+      }
+
+      num_captured_++;
+      notify();
+    }
+  } catch (...) {
+    error_ = current_exception();
+  }
+
+  ended_ = true;
+  notify();
+}
+
+optional<CapturedFrame> CaptureThread::take_latest()
+{
+  // clear the notification first so that no newer frame goes unnoticed
+  uint64_t count;
+  if (::read(notify_fd_.fd_num(), &count, sizeof(count)) < 0 and errno != EAGAIN) {
+    throw unix_error("CaptureThread: read");
+  }
+
+  lock_guard<mutex> lock(mtx_);
+
+  if (latest_) {
+    optional<CapturedFrame> frame = move(latest_);
+    latest_.reset();
+    return frame;
+  }
+
+  if (ended_ and error_) {
+    rethrow_exception(error_);
+  }
+
+  return nullopt;
+}
@@ -0,0 +1,84 @@
+#ifndef CAPTURE_THREAD_HH
+#define CAPTURE_THREAD_HH
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <exception>
+
+#include "video_input.hh"
+#include "frame_pool.hh"
+#include "file_descriptor.hh"
+
+// a captured frame and when it was captured (dequeued from the input)
+struct CapturedFrame
+{
+  PooledImage img;
+  uint64_t capture_ts_us;
+  uint64_t seq; // index of the frame among all captured frames
+};
+
+// reads frames from a (live) VideoInput on a dedicated thread as soon as
+// they are available, and hands the latest one to the consumer through a
+// single-slot mailbox: a frame not taken before the next one is captured
+// is dropped, so the consumer never works on a stale frame
+class CaptureThread
+{
+public:
+  CaptureThread(std::unique_ptr<VideoInput> input,
+                const FramePool::HugePages huge_pages = FramePool::HugePages::TRANSPARENT);
+  ~CaptureThread();
+
+  // take the latest frame if one was captured since the last call; throws
+  // if capturing failed, and returns nullopt once the input has ended
+  std::optional<CapturedFrame> take_latest();
+
+  // readable when a new frame is captured (or capturing stops), e.g., to be
+  // registered with a Poller; take_latest() clears it
+  const FileDescriptor & notify_fd() const { return notify_fd_; }
+
+  // if the input has ended (or failed)
+  bool ended() const { return ended_; }
+
+  uint16_t display_width() const { return display_width_; }
+  uint16_t display_height() const { return display_height_; }
+
+  // stats
+  uint64_t num_captured() const { return num_captured_.load(); }
+  uint64_t num_dropped() const { return num_dropped_.load(); }
+
+  // forbid copying and moving
+  CaptureThread(const CaptureThread & other) = delete;
+  const CaptureThread & operator=(const CaptureThread & other) = delete;
+  CaptureThread(CaptureThread && other) = delete;
+  CaptureThread & operator=(CaptureThread && other) = delete;
+
+private:
+  std::unique_ptr<VideoInput> input_;
+  uint16_t display_width_;
+  uint16_t display_height_;
+
+  // frames for capturing into, for the mailbox and for the consumer
+  FramePool pool_;
+
+  std::mutex mtx_ {};
+  std::optional<CapturedFrame> latest_ {};
+  std::exception_ptr error_ {}; // set before ended_
+
+  FileDescriptor notify_fd_; // eventfd
+
+  std::atomic<bool> ended_ {false};
+  std::atomic<bool> stop_ {false};
+  std::atomic<uint64_t> num_captured_ {0};
+  std::atomic<uint64_t> num_dropped_ {0};
+
+  std::thread capturer_ {};
+
+  void capture_main();
+  void notify();
+};
+
+#endif /* CAPTURE_THREAD_HH */
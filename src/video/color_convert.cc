@@ -0,0 +1,567 @@
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include <cstring>
+#include <algorithm>
+
+#include "color_convert.hh"
+#include "cpu_features.hh"
+
+using namespace std;
+
+namespace {
+  // a YUYV row of 'width' pixels into Y, and U and V of width / 2
+  void yuyv_row_scalar(const uint8_t * src, uint8_t * y, uint8_t * u,
+                       uint8_t * v, const uint16_t width)
+  {
+    for (uint16_t i = 0; i < width / 2; i++, src += 4) {
+      y[2 * i] = src[0];
+      u[i] = src[1];
+      y[2 * i + 1] = src[2];
+      v[i] = src[3];
+    }
+  }
+
+  // a YUYV row of 'width' pixels into Y only
+  void yuyv_luma_row_scalar(const uint8_t * src, uint8_t * y,
+                            const uint16_t width)
+  {
+    for (uint16_t i = 0; i < width; i++) {
+      y[i] = src[2 * i];
+    }
+  }
+
+  // an interleaved UV row of 'width' pairs into U and V
+  void split_uv_row_scalar(const uint8_t * src, uint8_t * u, uint8_t * v,
+                           const uint16_t width)
+  {
+    for (uint16_t i = 0; i < width; i++) {
+      u[i] = src[2 * i];
+      v[i] = src[2 * i + 1];
+    }
+  }
+
+  // fixed-point (x256) YUV -> RGB coefficients:
+  //   R = y * (Y - y_offset) + rv * (V - 128)
+  //   G = y * (Y - y_offset) - gu * (U - 128) - gv * (V - 128)
+  //   B = y * (Y - y_offset) + bu * (U - 128)
+  struct RGBCoeffs
+  {
+    int16_t y_offset, y, rv, gu, gv, bu;
+  };
+
+  RGBCoeffs rgb_coeffs(const ColorSpace & color_space)
+  {
+    if (color_space.matrix == ColorMatrix::BT709) {
+      return color_space.full_range ? RGBCoeffs {0, 256, 403, 48, 120, 475}
+                                    : RGBCoeffs {16, 298, 459, 55, 136, 541};
+    }
+    return color_space.full_range ? RGBCoeffs {0, 256, 359, 88, 183, 454}
+                                  : RGBCoeffs {16, 298, 409, 100, 208, 516};
+  }
+
+  uint8_t clamp_rgb(const int value)
+  {
+    return static_cast<uint8_t>(clamp(value >> 8, 0, 255));
+  }
+
+  // a row of 'width' pixels, with chroma rows of width / 2, into RGBX
+  void rgbx_row_scalar(const uint8_t * y, const uint8_t * u, const uint8_t * v,
+                       uint8_t * dst, const uint16_t width, const RGBCoeffs & k)
+  {
+    for (uint16_t i = 0; i < width; i++, dst += 4) {
+      const int c = y[i] - k.y_offset;
+      const int d = u[i / 2] - 128;
+      const int e = v[i / 2] - 128;
+
+      dst[0] = clamp_rgb(k.y * c + k.rv * e + 128);
+      dst[1] = clamp_rgb(k.y * c - k.gu * d - k.gv * e + 128);
+      dst[2] = clamp_rgb(k.y * c + k.bu * d + 128);
+      dst[3] = 255;
+    }
+  }
+
+  // an unaligned 32-bit load
+  uint32_t load_u32(const uint8_t * src)
+  {
+    uint32_t value;
+    memcpy(&value, src, sizeof(value));
+    return value;
+  }
+
+#if defined(__x86_64__)
+  // the even bytes of a and b (then each 16-bit word of them, packed)
+  __attribute__((target("sse2")))
+  inline __m128i even_bytes_sse2(const __m128i a, const __m128i b)
+  {
+    const __m128i mask = _mm_set1_epi16(0x00FF);
+    return _mm_packus_epi16(_mm_and_si128(a, mask), _mm_and_si128(b, mask));
+  }
+
+  __attribute__((target("sse2")))
+  inline __m128i odd_bytes_sse2(const __m128i a, const __m128i b)
+  {
+    return _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+  }
+
+  __attribute__((target("sse2")))
+  void yuyv_row_sse2(const uint8_t * src, uint8_t * y, uint8_t * u,
+                     uint8_t * v, const uint16_t width)
+  {
+    uint16_t i = 0;
+
+    // 32 pixels per iteration
+    for (; i + 32 <= width; i += 32) {
+      const __m128i * p = reinterpret_cast<const __m128i *>(src + 2 * i);
+      const __m128i a = _mm_loadu_si128(p);
+      const __m128i b = _mm_loadu_si128(p + 1);
+      const __m128i c = _mm_loadu_si128(p + 2);
+      const __m128i d = _mm_loadu_si128(p + 3);
+
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(y + i), even_bytes_sse2(a, b));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(y + i + 16), even_bytes_sse2(c, d));
+
+      // U0 V0 U1 V1 ... and then split
+      const __m128i uv0 = odd_bytes_sse2(a, b);
+      const __m128i uv1 = odd_bytes_sse2(c, d);
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(u + i / 2), even_bytes_sse2(uv0, uv1));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(v + i / 2), odd_bytes_sse2(uv0, uv1));
+    }
+
+    yuyv_row_scalar(src + 2 * i, y + i, u + i / 2, v + i / 2, width - i);
+  }
+
+  __attribute__((target("sse2")))
+  void yuyv_luma_row_sse2(const uint8_t * src, uint8_t * y,
+                          const uint16_t width)
+  {
+    uint16_t i = 0;
+
+    for (; i + 16 <= width; i += 16) {
+      const __m128i * p = reinterpret_cast<const __m128i *>(src + 2 * i);
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(y + i),
+                       even_bytes_sse2(_mm_loadu_si128(p), _mm_loadu_si128(p + 1)));
+    }
+
+    yuyv_luma_row_scalar(src + 2 * i, y + i, width - i);
+  }
+
+  __attribute__((target("sse2")))
+  void split_uv_row_sse2(const uint8_t * src, uint8_t * u, uint8_t * v,
+                         const uint16_t width)
+  {
+    uint16_t i = 0;
+
+    for (; i + 16 <= width; i += 16) {
+      const __m128i * p = reinterpret_cast<const __m128i *>(src + 2 * i);
+      const __m128i a = _mm_loadu_si128(p);
+      const __m128i b = _mm_loadu_si128(p + 1);
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(u + i), even_bytes_sse2(a, b));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(v + i), odd_bytes_sse2(a, b));
+    }
+
+    split_uv_row_scalar(src + 2 * i, u + i, v + i, width - i);
+  }
+
+  // same as the SSE2 versions, but packus works within 128-bit lanes so
+  // the 64-bit quarters are put back in order after packing
+  __attribute__((target("avx2")))
+  inline __m256i even_bytes_avx2(const __m256i a, const __m256i b)
+  {
+    const __m256i mask = _mm256_set1_epi16(0x00FF);
+    return _mm256_permute4x64_epi64(
+      _mm256_packus_epi16(_mm256_and_si256(a, mask), _mm256_and_si256(b, mask)), 0xD8);
+  }
+
+  __attribute__((target("avx2")))
+  inline __m256i odd_bytes_avx2(const __m256i a, const __m256i b)
+  {
+    return _mm256_permute4x64_epi64(
+      _mm256_packus_epi16(_mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8)), 0xD8);
+  }
+
+  __attribute__((target("avx2")))
+  void yuyv_row_avx2(const uint8_t * src, uint8_t * y, uint8_t * u,
+                     uint8_t * v, const uint16_t width)
+  {
+    uint16_t i = 0;
+
+    // 64 pixels per iteration
+    for (; i + 64 <= width; i += 64) {
+      const __m256i * p = reinterpret_cast<const __m256i *>(src + 2 * i);
+      const __m256i a = _mm256_loadu_si256(p);
+      const __m256i b = _mm256_loadu_si256(p + 1);
+      const __m256i c = _mm256_loadu_si256(p + 2);
+      const __m256i d = _mm256_loadu_si256(p + 3);
+
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(y + i), even_bytes_avx2(a, b));
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(y + i + 32), even_bytes_avx2(c, d));
+
+      const __m256i uv0 = odd_bytes_avx2(a, b);
+      const __m256i uv1 = odd_bytes_avx2(c, d);
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(u + i / 2), even_bytes_avx2(uv0, uv1));
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(v + i / 2), odd_bytes_avx2(uv0, uv1));
+    }
+
+    yuyv_row_sse2(src + 2 * i, y + i, u + i / 2, v + i / 2, width - i);
+  }
+
+  __attribute__((target("avx2")))
+  void yuyv_luma_row_avx2(const uint8_t * src, uint8_t * y,
+                          const uint16_t width)
+  {
+    uint16_t i = 0;
+
+    for (; i + 32 <= width; i += 32) {
+      const __m256i * p = reinterpret_cast<const __m256i *>(src + 2 * i);
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(y + i),
+                          even_bytes_avx2(_mm256_loadu_si256(p), _mm256_loadu_si256(p + 1)));
+    }
+
+    yuyv_luma_row_sse2(src + 2 * i, y + i, width - i);
+  }
+
+  __attribute__((target("avx2")))
+  void split_uv_row_avx2(const uint8_t * src, uint8_t * u, uint8_t * v,
+                         const uint16_t width)
+  {
+    uint16_t i = 0;
+
+    for (; i + 32 <= width; i += 32) {
+      const __m256i * p = reinterpret_cast<const __m256i *>(src + 2 * i);
+      const __m256i a = _mm256_loadu_si256(p);
+      const __m256i b = _mm256_loadu_si256(p + 1);
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(u + i), even_bytes_avx2(a, b));
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(v + i), odd_bytes_avx2(a, b));
+    }
+
+    split_uv_row_sse2(src + 2 * i, u + i, v + i, width - i);
+  }
+
+  // the vector kernels below compute the same integer arithmetic as
+  // rgbx_row_scalar() (with 32-bit products) and are thus bit-exact
+
+  // two 16-bit coefficients per 32-bit lane, for _mm_madd_epi16
+  __attribute__((target("sse2")))
+  inline __m128i coeff_pair_sse2(const int16_t a, const int16_t b)
+  {
+    return _mm_set1_epi32(static_cast<uint16_t>(a) | (static_cast<uint32_t>(b) << 16));
+  }
+
+  // (a * k1 + b * k2 + c * k3 + 128) >> 8 for 8 int16 lanes, saturated to
+  // int16, where k12 = (k1, k2) and k3r = (k3, 128) pairwise
+  __attribute__((target("sse2")))
+  inline __m128i weigh_sse2(const __m128i a, const __m128i b, const __m128i k12,
+                            const __m128i c, const __m128i k3r)
+  {
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128i lo = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(a, b), k12),
+                                     _mm_madd_epi16(_mm_unpacklo_epi16(c, one), k3r));
+    const __m128i hi = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(a, b), k12),
+                                     _mm_madd_epi16(_mm_unpackhi_epi16(c, one), k3r));
+    return _mm_packs_epi32(_mm_srai_epi32(lo, 8), _mm_srai_epi32(hi, 8));
+  }
+
+  __attribute__((target("sse2")))
+  void rgbx_row_sse2(const uint8_t * y, const uint8_t * u, const uint8_t * v,
+                     uint8_t * dst, const uint16_t width, const RGBCoeffs & k)
+  {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i y_offset = _mm_set1_epi16(k.y_offset);
+    const __m128i uv_offset = _mm_set1_epi16(128);
+    const __m128i max_value = _mm_set1_epi16(255);
+    const __m128i alpha = _mm_set1_epi16(static_cast<int16_t>(0xFF00));
+
+    const __m128i k_r = coeff_pair_sse2(k.y, k.rv);
+    const __m128i k_g = coeff_pair_sse2(k.y, -k.gu);
+    const __m128i k_b = coeff_pair_sse2(k.y, k.bu);
+    const __m128i k_g3 = coeff_pair_sse2(-k.gv, 128);
+    const __m128i k_rnd = coeff_pair_sse2(0, 128);
+
+    uint16_t i = 0;
+    for (; i + 8 <= width; i += 8) {
+      const __m128i luma = _mm_sub_epi16(_mm_unpacklo_epi8(
+        _mm_loadl_epi64(reinterpret_cast<const __m128i *>(y + i)), zero), y_offset);
+
+      __m128i cb = _mm_sub_epi16(_mm_unpacklo_epi8(
+        _mm_cvtsi32_si128(load_u32(u + i / 2)), zero), uv_offset);
+      __m128i cr = _mm_sub_epi16(_mm_unpacklo_epi8(
+        _mm_cvtsi32_si128(load_u32(v + i / 2)), zero), uv_offset);
+      cb = _mm_unpacklo_epi16(cb, cb);
+      cr = _mm_unpacklo_epi16(cr, cr);
+
+      const __m128i r = weigh_sse2(luma, cr, k_r, zero, k_rnd);
+      const __m128i g = weigh_sse2(luma, cb, k_g, cr, k_g3);
+      const __m128i b = weigh_sse2(luma, cb, k_b, zero, k_rnd);
+
+      // clamp to [0, 255] and interleave into RGBX
+      const __m128i rg = _mm_or_si128(
+        _mm_min_epi16(_mm_max_epi16(r, zero), max_value),
+        _mm_slli_epi16(_mm_min_epi16(_mm_max_epi16(g, zero), max_value), 8));
+      const __m128i bx = _mm_or_si128(
+        _mm_min_epi16(_mm_max_epi16(b, zero), max_value), alpha);
+
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 4 * i),
+                       _mm_unpacklo_epi16(rg, bx));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 4 * i + 16),
+                       _mm_unpackhi_epi16(rg, bx));
+    }
+
+    rgbx_row_scalar(y + i, u + i / 2, v + i / 2, dst + 4 * i, width - i, k);
+  }
+
+  __attribute__((target("avx2")))
+  inline __m256i coeff_pair_avx2(const int16_t a, const int16_t b)
+  {
+    return _mm256_set1_epi32(static_cast<uint16_t>(a) | (static_cast<uint32_t>(b) << 16));
+  }
+
+  __attribute__((target("avx2")))
+  inline __m256i weigh_avx2(const __m256i a, const __m256i b, const __m256i k12,
+                            const __m256i c, const __m256i k3r)
+  {
+    const __m256i one = _mm256_set1_epi16(1);
+    const __m256i lo = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), k12),
+                                        _mm256_madd_epi16(_mm256_unpacklo_epi16(c, one), k3r));
+    const __m256i hi = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), k12),
+                                        _mm256_madd_epi16(_mm256_unpackhi_epi16(c, one), k3r));
+    // unpacking and packing within 128-bit lanes keep the pixel order
+    return _mm256_packs_epi32(_mm256_srai_epi32(lo, 8), _mm256_srai_epi32(hi, 8));
+  }
+
+  // 8 chroma samples, minus 128, each repeated twice
+  __attribute__((target("avx2")))
+  inline __m256i chroma_avx2(const uint8_t * src)
+  {
+    const __m128i c = _mm_sub_epi16(
+      _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(src))),
+      _mm_set1_epi16(128));
+    return _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi16(c, c)),
+                                   _mm_unpackhi_epi16(c, c), 1);
+  }
+
+  __attribute__((target("avx2")))
+  void rgbx_row_avx2(const uint8_t * y, const uint8_t * u, const uint8_t * v,
+                     uint8_t * dst, const uint16_t width, const RGBCoeffs & k)
+  {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i y_offset = _mm256_set1_epi16(k.y_offset);
+    const __m256i max_value = _mm256_set1_epi16(255);
+    const __m256i alpha = _mm256_set1_epi16(static_cast<int16_t>(0xFF00));
+
+    const __m256i k_r = coeff_pair_avx2(k.y, k.rv);
+    const __m256i k_g = coeff_pair_avx2(k.y, -k.gu);
+    const __m256i k_b = coeff_pair_avx2(k.y, k.bu);
+    const __m256i k_g3 = coeff_pair_avx2(-k.gv, 128);
+    const __m256i k_rnd = coeff_pair_avx2(0, 128);
+
+    uint16_t i = 0;
+    for (; i + 16 <= width; i += 16) {
+      const __m256i luma = _mm256_sub_epi16(_mm256_cvtepu8_epi16(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(y + i))), y_offset);
+      const __m256i cb = chroma_avx2(u + i / 2);
+      const __m256i cr = chroma_avx2(v + i / 2);
+
+      const __m256i r = weigh_avx2(luma, cr, k_r, zero, k_rnd);
+      const __m256i g = weigh_avx2(luma, cb, k_g, cr, k_g3);
+      const __m256i b = weigh_avx2(luma, cb, k_b, zero, k_rnd);
+
+      const __m256i rg = _mm256_or_si256(
+        _mm256_min_epi16(_mm256_max_epi16(r, zero), max_value),
+        _mm256_slli_epi16(_mm256_min_epi16(_mm256_max_epi16(g, zero), max_value), 8));
+      const __m256i bx = _mm256_or_si256(
+        _mm256_min_epi16(_mm256_max_epi16(b, zero), max_value), alpha);
+
+      // pixels 0-3 and 8-11, and 4-7 and 12-15
+      const __m256i lo = _mm256_unpacklo_epi16(rg, bx);
+      const __m256i hi = _mm256_unpackhi_epi16(rg, bx);
+
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + 4 * i),
+                          _mm256_permute2x128_si256(lo, hi, 0x20));
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + 4 * i + 32),
+                          _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+
+    rgbx_row_scalar(y + i, u + i / 2, v + i / 2, dst + 4 * i, width - i, k);
+  }
+#elif defined(__aarch64__)
+  void yuyv_row_neon(const uint8_t * src, uint8_t * y, uint8_t * u,
+                     uint8_t * v, const uint16_t width)
+  {
+    uint16_t i = 0;
+
+    // 32 pixels per iteration, deinterleaved into Y0 U Y1 V
+    for (; i + 32 <= width; i += 32) {
+      const uint8x16x4_t yuyv = vld4q_u8(src + 2 * i);
+      vst2q_u8(y + i, uint8x16x2_t {{yuyv.val[0], yuyv.val[2]}});
+      vst1q_u8(u + i / 2, yuyv.val[1]);
+      vst1q_u8(v + i / 2, yuyv.val[3]);
+    }
+
+    yuyv_row_scalar(src + 2 * i, y + i, u + i / 2, v + i / 2, width - i);
+  }
+
+  void yuyv_luma_row_neon(const uint8_t * src, uint8_t * y,
+                          const uint16_t width)
+  {
+    uint16_t i = 0;
+
+    for (; i + 16 <= width; i += 16) {
+      vst1q_u8(y + i, vld2q_u8(src + 2 * i).val[0]);
+    }
+
+    yuyv_luma_row_scalar(src + 2 * i, y + i, width - i);
+  }
+
+  void split_uv_row_neon(const uint8_t * src, uint8_t * u, uint8_t * v,
+                         const uint16_t width)
+  {
+    uint16_t i = 0;
+
+    for (; i + 16 <= width; i += 16) {
+      const uint8x16x2_t uv = vld2q_u8(src + 2 * i);
+      vst1q_u8(u + i, uv.val[0]);
+      vst1q_u8(v + i, uv.val[1]);
+    }
+
+    split_uv_row_scalar(src + 2 * i, u + i, v + i, width - i);
+  }
+
+  // (k1 * a + k2 * b + k3 * c + 128) >> 8 for 8 int16 lanes, clamped to uint8
+  inline uint8x8_t weigh_neon(const int16x8_t a, const int16_t k1,
+                              const int16x8_t b, const int16_t k2,
+                              const int16x8_t c, const int16_t k3)
+  {
+    const int32x4_t rnd = vdupq_n_s32(128);
+    int32x4_t lo = vmlal_n_s16(vmlal_n_s16(vmlal_n_s16(rnd, vget_low_s16(a), k1),
+                                           vget_low_s16(b), k2), vget_low_s16(c), k3);
+    int32x4_t hi = vmlal_n_s16(vmlal_n_s16(vmlal_n_s16(rnd, vget_high_s16(a), k1),
+                                           vget_high_s16(b), k2), vget_high_s16(c), k3);
+    return vqmovun_s16(vcombine_s16(vmovn_s32(vshrq_n_s32(lo, 8)),
+                                    vmovn_s32(vshrq_n_s32(hi, 8))));
+  }
+
+  // 4 chroma samples, minus 128, each repeated twice
+  inline int16x8_t chroma_neon(const uint8_t * src)
+  {
+    const uint8x8_t c = vcreate_u8(load_u32(src));
+    return vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vzip_u8(c, c).val[0])),
+                     vdupq_n_s16(128));
+  }
+
+  void rgbx_row_neon(const uint8_t * y, const uint8_t * u, const uint8_t * v,
+                     uint8_t * dst, const uint16_t width, const RGBCoeffs & k)
+  {
+    const int16x8_t zero = vdupq_n_s16(0);
+
+    uint16_t i = 0;
+    for (; i + 8 <= width; i += 8) {
+      const int16x8_t luma = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vld1_u8(y + i))),
+                                       vdupq_n_s16(k.y_offset));
+      const int16x8_t cb = chroma_neon(u + i / 2);
+      const int16x8_t cr = chroma_neon(v + i / 2);
+
+      uint8x8x4_t rgbx;
+      rgbx.val[0] = weigh_neon(luma, k.y, cr, k.rv, zero, 0);
+      rgbx.val[1] = weigh_neon(luma, k.y, cb, -k.gu, cr, -k.gv);
+      rgbx.val[2] = weigh_neon(luma, k.y, cb, k.bu, zero, 0);
+      rgbx.val[3] = vdup_n_u8(255);
+      vst4_u8(dst + 4 * i, rgbx);
+    }
+
+    rgbx_row_scalar(y + i, u + i / 2, v + i / 2, dst + 4 * i, width - i, k);
+  }
+#endif
+
+  struct Kernels
+  {
+    const char * name;
+    void (*yuyv_row)(const uint8_t *, uint8_t *, uint8_t *, uint8_t *, const uint16_t);
+    void (*yuyv_luma_row)(const uint8_t *, uint8_t *, const uint16_t);
+    void (*split_uv_row)(const uint8_t *, uint8_t *, uint8_t *, const uint16_t);
+    void (*rgbx_row)(const uint8_t *, const uint8_t *, const uint8_t *, uint8_t *,
+                     const uint16_t, const RGBCoeffs &);
+  };
+
+  Kernels select_kernels()
+  {
+#if defined(__x86_64__)
+    if (cpu_features().avx2) {
+      return {"avx2", yuyv_row_avx2, yuyv_luma_row_avx2, split_uv_row_avx2,
+              rgbx_row_avx2};
+    }
+    if (cpu_features().sse2) {
+      return {"sse2", yuyv_row_sse2, yuyv_luma_row_sse2, split_uv_row_sse2,
+              rgbx_row_sse2};
+    }
+#elif defined(__aarch64__)
+    if (cpu_features().neon) {
+      return {"neon", yuyv_row_neon, yuyv_luma_row_neon, split_uv_row_neon,
+              rgbx_row_neon};
+    }
+#endif
+    return {"scalar", yuyv_row_scalar, yuyv_luma_row_scalar, split_uv_row_scalar,
+            rgbx_row_scalar};
+  }
+
+  const Kernels & kernels()
+  {
+    static const Kernels selected = select_kernels();
+    return selected;
+  }
+}
+
+void yuyv_to_i420(const uint8_t * src, const int src_stride,
+                  uint8_t * dst_y, const int dst_y_stride,
+                  uint8_t * dst_u, const int dst_u_stride,
+                  uint8_t * dst_v, const int dst_v_stride,
+                  const uint16_t width, const uint16_t height)
+{
+  const Kernels & k = kernels();
+
+  for (uint16_t row = 0; row + 1 < height; row += 2) {
+    k.yuyv_row(src + row * src_stride, dst_y + row * dst_y_stride,
+               dst_u + row / 2 * dst_u_stride, dst_v + row / 2 * dst_v_stride,
+               width);
+    k.yuyv_luma_row(src + (row + 1) * src_stride,
+                    dst_y + (row + 1) * dst_y_stride, width);
+  }
+}
+
+void nv12_uv_to_i420(const uint8_t * src_uv, const int src_stride,
+                     uint8_t * dst_u, const int dst_u_stride,
+                     uint8_t * dst_v, const int dst_v_stride,
+                     const uint16_t uv_width, const uint16_t uv_height)
+{
+  const Kernels & k = kernels();
+
+  for (uint16_t row = 0; row < uv_height; row++) {
+    k.split_uv_row(src_uv + row * src_stride, dst_u + row * dst_u_stride,
+                   dst_v + row * dst_v_stride, uv_width);
+  }
+}
+
+void i420_to_rgbx(const uint8_t * src_y, const int src_y_stride,
+                  const uint8_t * src_u, const int src_u_stride,
+                  const uint8_t * src_v, const int src_v_stride,
+                  uint8_t * dst, const int dst_stride,
+                  const uint16_t width, const uint16_t height,
+                  const ColorSpace & color_space)
+{
+  const Kernels & k = kernels();
+  const RGBCoeffs coeffs = rgb_coeffs(color_space);
+
+  for (uint16_t row = 0; row < height; row++) {
+    k.rgbx_row(src_y + row * src_y_stride, src_u + row / 2 * src_u_stride,
+               src_v + row / 2 * src_v_stride, dst + row * dst_stride, width,
+               coeffs);
+  }
+}
+
+const char * color_convert_kernel()
+{
+  return kernels().name;
+}
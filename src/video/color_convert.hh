@@ -0,0 +1,44 @@
+#ifndef COLOR_CONVERT_HH
+#define COLOR_CONVERT_HH
+
+#include <cstdint>
+
+// convert packed YUYV (4:2:2) to planar I420, taking the chroma of each
+// pair of rows from the upper row; width and height must be even
+void yuyv_to_i420(const uint8_t * src, const int src_stride,
+                  uint8_t * dst_y, const int dst_y_stride,
+                  uint8_t * dst_u, const int dst_u_stride,
+                  uint8_t * dst_v, const int dst_v_stride,
+                  const uint16_t width, const uint16_t height);
+
+// split the interleaved UV plane of NV12 into the U and V planes of I420
+// (uv_width and uv_height are the dimensions of the chroma planes)
+void nv12_uv_to_i420(const uint8_t * src_uv, const int src_stride,
+                     uint8_t * dst_u, const int dst_u_stride,
+                     uint8_t * dst_v, const int dst_v_stride,
+                     const uint16_t uv_width, const uint16_t uv_height);
+
+// YUV -> RGB conversion: the matrix, and if Y spans [0, 255] (full range)
+// or [16, 235] (limited range, as is usual for video)
+enum class ColorMatrix { BT601, BT709 };
+
+struct ColorSpace
+{
+  ColorMatrix matrix {ColorMatrix::BT601};
+  bool full_range {false};
+};
+
+// convert I420 to packed RGBX (4 bytes per pixel, X = 255), whose rows are
+// 'dst_stride' bytes apart; each pixel takes the chroma of its 2x2 block
+void i420_to_rgbx(const uint8_t * src_y, const int src_y_stride,
+                  const uint8_t * src_u, const int src_u_stride,
+                  const uint8_t * src_v, const int src_v_stride,
+                  uint8_t * dst, const int dst_stride,
+                  const uint16_t width, const uint16_t height,
+                  const ColorSpace & color_space = ColorSpace());
+
+// instruction set the conversions above dispatch to at runtime
+// ("avx2", "sse2", "neon" or "scalar"; see cpu_features.hh)
+const char * color_convert_kernel();
+
+#endif /* COLOR_CONVERT_HH */
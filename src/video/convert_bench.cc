@@ -0,0 +1,200 @@
+#include <getopt.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+
+#include "image.hh"
+#include "color_convert.hh"
+#include "conversion.hh"
+#include "thread_pool.hh"
+
+using namespace std;
+using namespace std::chrono;
+
+void print_usage(const string & program_name)
+{
+  cerr <<
+  "Usage: " << program_name << " [options] width height\n\n"
+  "Benchmark converting captured frames to I420 (and I420 to RGB) with the\n"
+  "SIMD kernels selected for this CPU (set RINGMASTER_SIMD=scalar|sse2 to\n"
+  "compare).\n\n"
+  "Options:\n"
+  "-n, --iterations <n>    number of frames to convert (default: 1000)"
+  << endl;
+}
+
+// time 'convert' over 'iterations' frames and print its throughput
+void bench(const string & name, const unsigned int iterations,
+           const size_t num_pixels, const function<void()> & convert)
+{
+  convert(); // warm up
+
+  const auto start = steady_clock::now();
+  for (unsigned int i = 0; i < iterations; i++) {
+    convert();
+  }
+  const double elapsed_s = duration<double>(steady_clock::now() - start).count();
+
+  cerr << name << ": "
+       << double_to_string(elapsed_s * 1000 / iterations) << " ms/frame, "
+       << double_to_string(num_pixels * iterations / elapsed_s / 1e6)
+       << " Mpixels/s" << endl;
+}
+
+// check every pixel against a straightforward conversion
+bool verify(const RawImage & img, const vector<uint8_t> & expected_y,
+            const vector<uint8_t> & expected_u, const vector<uint8_t> & expected_v)
+{
+  const uint16_t w = img.display_width();
+  const uint16_t h = img.display_height();
+
+  for (uint16_t row = 0; row < h; row++) {
+    for (uint16_t col = 0; col < w; col++) {
+      if (img.y_plane()[row * img.y_stride() + col] != expected_y[row * w + col]) {
+        return false;
+      }
+    }
+  }
+
+  for (uint16_t row = 0; row < h / 2; row++) {
+    for (uint16_t col = 0; col < w / 2; col++) {
+      if (img.u_plane()[row * img.u_stride() + col] != expected_u[row * w / 2 + col] or
+          img.v_plane()[row * img.v_stride() + col] != expected_v[row * w / 2 + col]) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+int main(int argc, char * argv[])
+{
+  unsigned int iterations = 1000;
+
+  const option cmd_line_opts[] = {
+    {"iterations", required_argument, nullptr, 'n'},
+    { nullptr,     0,                 nullptr,  0 },
+  };
+
+  while (true) {
+    const int opt = getopt_long(argc, argv, "n:", cmd_line_opts, nullptr);
+    if (opt == -1) {
+      break;
+    }
+
+    switch (opt) {
+      case 'n':
+        iterations = strict_stoi(optarg);
+        break;
+      default:
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+
+  if (optind != argc - 2) {
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  const uint16_t width = narrow_cast<uint16_t>(strict_stoi(argv[optind]));
+  const uint16_t height = narrow_cast<uint16_t>(strict_stoi(argv[optind + 1]));
+
+  if (width % 2 or height % 2) {
+    cerr << "Width and height must be even" << endl;
+    return EXIT_FAILURE;
+  }
+
+  const size_t num_pixels = static_cast<size_t>(width) * height;
+
+  // random planes and the same frame packed as YUYV and NV12
+  mt19937 rng(0);
+  uniform_int_distribution<int> dist(0, 255);
+
+  vector<uint8_t> y(num_pixels), u(num_pixels / 4), v(num_pixels / 4);
+  for (auto & p : y) { p = dist(rng); }
+  for (auto & p : u) { p = dist(rng); }
+  for (auto & p : v) { p = dist(rng); }
+
+  // YUYV has full vertical chroma resolution: repeat each chroma row twice
+  string yuyv(num_pixels * 2, 0);
+  for (uint16_t row = 0; row < height; row++) {
+    for (uint16_t col = 0; col < width; col += 2) {
+      const size_t i = (static_cast<size_t>(row) * width + col) * 2;
+      const size_t uv_i = row / 2 * (width / 2) + col / 2;
+      yuyv[i] = y[row * width + col];
+      yuyv[i + 1] = u[uv_i];
+      yuyv[i + 2] = y[row * width + col + 1];
+      yuyv[i + 3] = v[uv_i];
+    }
+  }
+
+  string nv12(y.begin(), y.end());
+  for (size_t i = 0; i < u.size(); i++) {
+    nv12 += static_cast<char>(u[i]);
+    nv12 += static_cast<char>(v[i]);
+  }
+
+  string i420(y.begin(), y.end());
+  i420.append(u.begin(), u.end());
+  i420.append(v.begin(), v.end());
+
+  cerr << "Kernel: " << color_convert_kernel() << ", frame: "
+       << width << "x" << height << ", iterations: " << iterations << endl;
+
+  RawImage img(width, height);
+
+  img.copy_from_yuyv(yuyv);
+  if (not verify(img, y, u, v)) {
+    cerr << "YUYV conversion is incorrect" << endl;
+    return EXIT_FAILURE;
+  }
+  bench("YUYV -> I420", iterations, num_pixels,
+        [&] { img.copy_from_yuyv(yuyv); });
+
+  img.copy_from_nv12(nv12);
+  if (not verify(img, y, u, v)) {
+    cerr << "NV12 conversion is incorrect" << endl;
+    return EXIT_FAILURE;
+  }
+  bench("NV12 -> I420", iterations, num_pixels,
+        [&] { img.copy_from_nv12(nv12); });
+
+  // capturing in YUV420 needs no conversion (and no copy if the frame is
+  // borrowed), so this is an upper bound on its cost
+  RawImage view(width, height, reinterpret_cast<uint8_t *>(i420.data()));
+  bench("I420 copy", iterations, num_pixels,
+        [&] { img.copy_from(view); });
+
+  // BT.601 limited range, checked against the integer formula
+  vector<uint8_t> rgbx(num_pixels * 4);
+  view.to_rgbx(rgbx.data(), width * 4, ColorSpace());
+
+  for (size_t i = 0; i < num_pixels; i++) {
+    const size_t uv_i = i / width / 2 * (width / 2) + i % width / 2;
+    const int c = y[i] - 16, d = u[uv_i] - 128, e = v[uv_i] - 128;
+    const int expected[3] = {(298 * c + 409 * e + 128) >> 8,
+                             (298 * c - 100 * d - 208 * e + 128) >> 8,
+                             (298 * c + 516 * d + 128) >> 8};
+
+    for (int ch = 0; ch < 3; ch++) {
+      if (rgbx[i * 4 + ch] != clamp(expected[ch], 0, 255)) {
+        cerr << "I420 -> RGB conversion is incorrect" << endl;
+        return EXIT_FAILURE;
+      }
+    }
+  }
+  bench("I420 -> RGBX", iterations, num_pixels,
+        [&] { view.to_rgbx(rgbx.data(), width * 4, ColorSpace()); });
+
+  ThreadPool pool;
+  bench("I420 -> RGBX (" + to_string(pool.size()) + " threads)", iterations, num_pixels,
+        [&] { view.to_rgbx(rgbx.data(), width * 4, ColorSpace(), &pool); });
+
+  return EXIT_SUCCESS;
+}
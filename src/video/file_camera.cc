@@ -0,0 +1,42 @@
+#include <thread>
+#include <stdexcept>
+
+#include "file_camera.hh"
+
+using namespace std;
+using namespace std::chrono;
+
+FileCamera::FileCamera(const string & video_file_path,
+                       const uint16_t display_width,
+                       const uint16_t display_height,
+                       const uint16_t frame_rate)
+  : video_(video_file_path, display_width, display_height, true /* loop */),
+    frame_interval_()
+{
+  if (frame_rate == 0) {
+    throw runtime_error("FileCamera: frame rate must be positive");
+  }
+
+  frame_interval_ = duration_cast<steady_clock::duration>(
+    duration<double>(1.0 / frame_rate));
+}
+
+bool FileCamera::read_frame(RawImage & raw_img)
+{
+  const auto now = steady_clock::now();
+
+  if (next_frame_time_ == steady_clock::time_point {}) {
+    next_frame_time_ = now; // the first frame is ready right away
+  } else if (now > next_frame_time_ + frame_interval_) {
+    // the frames in between were never picked up: catch up to the latest
+    const auto missed = (now - next_frame_time_) / frame_interval_;
+    num_missed_frames_ += missed;
+    next_frame_time_ += missed * frame_interval_;
+  } else {
+    this_thread::sleep_until(next_frame_time_);
+  }
+
+  next_frame_time_ += frame_interval_;
+
+  return video_.read_frame(raw_img);
+}
@@ -0,0 +1,38 @@
+#ifndef FILE_CAMERA_HH
+#define FILE_CAMERA_HH
+
+#include <string>
+#include <chrono>
+
+#include "video_input.hh"
+#include "yuv4mpeg.hh"
+
+// stands in for a camera (e.g., a v4l2loopback device fed from a file): a
+// y4m file played in a loop, where read_frame() blocks until the next frame
+// is "captured" at the given frame rate; like a camera, it does not queue
+// up frames that the reader falls behind on
+class FileCamera : public VideoInput
+{
+public:
+  FileCamera(const std::string & video_file_path,
+             const uint16_t display_width,
+             const uint16_t display_height,
+             const uint16_t frame_rate);
+
+  uint16_t display_width() const override { return video_.display_width(); }
+  uint16_t display_height() const override { return video_.display_height(); }
+
+  // wait for the next frame time and read the frame into raw_img
+  bool read_frame(RawImage & raw_img) override;
+
+  // number of frame times missed because the reader was late
+  uint64_t num_missed_frames() const { return num_missed_frames_; }
+
+private:
+  YUV4MPEG video_;
+  std::chrono::steady_clock::duration frame_interval_;
+  std::chrono::steady_clock::time_point next_frame_time_ {};
+  uint64_t num_missed_frames_ {0};
+};
+
+#endif /* FILE_CAMERA_HH */
@@ -0,0 +1,98 @@
+#include <stdexcept>
+
+#include "frame_dumper.hh"
+
+using namespace std;
+
+FrameDumper::FrameDumper(const uint16_t display_width,
+                         const uint16_t display_height,
+                         const size_t max_pending, const size_t num_threads)
+  : pool_(display_width, display_height, max_pending + 1),
+    max_pending_(max_pending), converters_(num_threads)
+{
+  if (max_pending == 0) {
+    throw runtime_error("FrameDumper: max_pending must be positive");
+  }
+
+  writer_ = thread(&FrameDumper::writer_main, this);
+}
+
+FrameDumper::~FrameDumper()
+{
+  {
+    lock_guard<mutex> lock(mtx_);
+    stop_ = true;
+  }
+  cv_.notify_one();
+
+  if (writer_.joinable()) {
+    writer_.join();
+  }
+}
+
+bool FrameDumper::dump(const RawImage & img, const string & file_path)
+{
+  return dump(img, file_path, img.color_space());
+}
+
+bool FrameDumper::dump(const RawImage & img, const string & file_path,
+                       const ColorSpace & color_space)
+{
+  {
+    lock_guard<mutex> lock(mtx_);
+
+    if (error_) {
+      exception_ptr error = error_;
+      error_ = nullptr;
+      rethrow_exception(error);
+    }
+
+    if (queue_.size() >= max_pending_) {
+      num_dropped_++;
+      return false;
+    }
+  }
+
+  const bool pooled = img.display_width() == pool_.display_width() and
+                      img.display_height() == pool_.display_height();
+  PooledImage copy = make_pooled_image(pooled ? &pool_ : nullptr,
+                                       img.display_width(), img.display_height());
+  copy->copy_from(img);
+
+  {
+    lock_guard<mutex> lock(mtx_);
+    queue_.push_back({move(copy), file_path, color_space});
+  }
+  cv_.notify_one();
+
+  return true;
+}
+
+void FrameDumper::writer_main()
+{
+  while (true) {
+    Job job;
+
+    {
+      unique_lock<mutex> lock(mtx_);
+      cv_.wait(lock, [this] { return stop_ or not queue_.empty(); });
+
+      if (queue_.empty()) { // stop_ must be true
+        return;
+      }
+
+      job = move(queue_.front());
+      queue_.pop_front();
+    }
+
+    try {
+      job.img->save_frame(job.file_path, job.color_space, &converters_);
+      num_dumped_++;
+    } catch (...) {
+      lock_guard<mutex> lock(mtx_);
+      if (not error_) {
+        error_ = current_exception();
+      }
+    }
+  }
+}
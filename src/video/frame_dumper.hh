@@ -0,0 +1,78 @@
+#ifndef FRAME_DUMPER_HH
+#define FRAME_DUMPER_HH
+
+#include <cstdint>
+#include <string>
+#include <deque>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <exception>
+
+#include "image.hh"
+#include "frame_pool.hh"
+#include "thread_pool.hh"
+
+// saves frames as PNG files on a background thread: dump() only copies the
+// frame into a pooled buffer and queues it, so that the caller never waits
+// for color conversion, compression or file I/O; the conversion of each
+// frame is split across a ThreadPool, and a frame dumped while 'max_pending'
+// frames are queued is dropped rather than blocking the caller
+class FrameDumper
+{
+public:
+  // frames of display_width x display_height are copied into pooled buffers
+  // (frames of other sizes are dumped too, into buffers of their own)
+  FrameDumper(const uint16_t display_width, const uint16_t display_height,
+              const size_t max_pending = 4, const size_t num_threads = 0);
+
+  // saves the frames still queued
+  ~FrameDumper();
+
+  // queue 'img' to be saved at 'file_path' in 'color_space' (by default,
+  // the one signaled in the image); returns false if the frame was dropped,
+  // and throws if saving an earlier frame failed
+  bool dump(const RawImage & img, const std::string & file_path);
+  bool dump(const RawImage & img, const std::string & file_path,
+            const ColorSpace & color_space);
+
+  // stats
+  uint64_t num_dumped() const { return num_dumped_.load(); }
+  uint64_t num_dropped() const { return num_dropped_.load(); }
+
+  // forbid copying and moving
+  FrameDumper(const FrameDumper & other) = delete;
+  const FrameDumper & operator=(const FrameDumper & other) = delete;
+  FrameDumper(FrameDumper && other) = delete;
+  FrameDumper & operator=(FrameDumper && other) = delete;
+
+private:
+  struct Job
+  {
+    PooledImage img {};
+    std::string file_path {};
+    ColorSpace color_space {};
+  };
+
+  // a buffer for each queued frame plus the one being saved
+  FramePool pool_;
+  size_t max_pending_;
+
+  ThreadPool converters_;
+
+  std::mutex mtx_ {};
+  std::condition_variable cv_ {};
+  std::deque<Job> queue_ {};
+  std::exception_ptr error_ {};
+  bool stop_ {false};
+
+  std::atomic<uint64_t> num_dumped_ {0};
+  std::atomic<uint64_t> num_dropped_ {0};
+
+  std::thread writer_ {};
+
+  void writer_main();
+};
+
+#endif /* FRAME_DUMPER_HH */
@@ -0,0 +1,172 @@
+#include <unistd.h>
+#include <iostream>
+#include <stdexcept>
+
+#include "frame_pool.hh"
+
+using namespace std;
+
+static size_t align_up(const size_t n, const size_t alignment)
+{
+  return (n + alignment - 1) / alignment * alignment;
+}
+
+void FrameRecycler::operator()(RawImage * img) const
+{
+  if (pool) {
+    pool->recycle(img);
+  } else {
+    delete img;
+  }
+}
+
+FramePool::FramePool(const uint16_t display_width,
+                     const uint16_t display_height,
+                     const size_t frames_per_arena,
+                     const HugePages huge_pages)
+  : display_width_(display_width), display_height_(display_height),
+    y_stride_(align_up(display_width, ALIGNMENT)),
+    uv_stride_(align_up(display_width / 2, ALIGNMENT)),
+    u_offset_(), v_offset_(), frame_size_(),
+    frames_per_arena_(frames_per_arena), huge_pages_(huge_pages)
+{
+  if (display_width == 0 or display_height == 0 or
+      display_width % 2 or display_height % 2) {
+    throw runtime_error("FramePool: invalid frame dimensions");
+  }
+
+  if (frames_per_arena == 0) {
+    throw runtime_error("FramePool: frames_per_arena must be positive");
+  }
+
+  // each plane (and thus each frame) starts on an ALIGNMENT boundary
+  u_offset_ = align_up(static_cast<size_t>(y_stride_) * display_height_, ALIGNMENT);
+  v_offset_ = u_offset_ + align_up(static_cast<size_t>(uv_stride_) * display_height_ / 2, ALIGNMENT);
+  frame_size_ = v_offset_ + align_up(static_cast<size_t>(uv_stride_) * display_height_ / 2, ALIGNMENT);
+
+  lock_guard<mutex> lock(mtx_);
+  add_arena();
+}
+
+FramePool::~FramePool()
+{
+  if (free_.size() != imgs_.size()) {
+    cerr << "Warning: FramePool destroyed with "
+         << imgs_.size() - free_.size() << " frames in use" << endl;
+  }
+}
+
+MMap FramePool::map_arena()
+{
+  // huge pages need the arena to be a multiple of the huge page size
+  const size_t granularity = huge_pages_ == HugePages::NONE ?
+                             sysconf(_SC_PAGESIZE) : HUGE_PAGE_SIZE;
+  const size_t length = align_up(frames_per_arena_ * frame_size_, granularity);
+
+  // MAP_POPULATE prefaults the arena so that no page faults are taken
+  // while frames are in use
+  const int prot = PROT_READ | PROT_WRITE;
+  const int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE;
+
+  if (huge_pages_ == HugePages::EXPLICIT) {
+    try {
+      return MMap(length, prot, flags | MAP_HUGETLB, -1, 0);
+    } catch (const exception & e) {
+      cerr << "Warning: no reserved huge pages available (see "
+           << "/proc/sys/vm/nr_hugepages); using transparent huge pages" << endl;
+      huge_pages_ = HugePages::TRANSPARENT;
+    }
+  }
+
+  MMap arena(length, prot, flags, -1, 0);
+
+  if (huge_pages_ == HugePages::TRANSPARENT) {
+    try {
+      arena.advise(MADV_HUGEPAGE);
+    } catch (const exception & e) {
+      cerr << "Warning: transparent huge pages unavailable ("
+           << e.what() << "); using regular pages" << endl;
+      huge_pages_ = HugePages::NONE;
+    }
+  }
+
+  return arena;
+}
+
+void FramePool::add_arena()
+{
+  MMap arena = map_arena();
+
+  // use up the whole arena, which may fit more frames than requested
+  const size_t num_frames = arena.length() / frame_size_;
+
+  for (size_t i = 0; i < num_frames; i++) {
+    uint8_t * const data = arena.addr() + i * frame_size_;
+
+    // let vpx_img_wrap fill in the format fields, then lay out the planes
+    auto vpx_img = make_unique<vpx_image_t>();
+    if (not vpx_img_wrap(vpx_img.get(), VPX_IMG_FMT_I420,
+                         display_width_, display_height_, 1, data)) {
+      throw runtime_error("FramePool: failed to wrap a frame");
+    }
+
+    vpx_img->planes[VPX_PLANE_Y] = data;
+    vpx_img->planes[VPX_PLANE_U] = data + u_offset_;
+    vpx_img->planes[VPX_PLANE_V] = data + v_offset_;
+    vpx_img->stride[VPX_PLANE_Y] = y_stride_;
+    vpx_img->stride[VPX_PLANE_U] = uv_stride_;
+    vpx_img->stride[VPX_PLANE_V] = uv_stride_;
+
+    imgs_.emplace_back(make_unique<RawImage>(vpx_img.get()));
+    vpx_imgs_.emplace_back(move(vpx_img));
+    free_.emplace_back(imgs_.back().get());
+  }
+
+  arenas_.emplace_back(move(arena));
+}
+
+PooledImage FramePool::acquire()
+{
+  lock_guard<mutex> lock(mtx_);
+
+  if (free_.empty()) {
+    add_arena();
+  }
+
+  RawImage * const img = free_.back();
+  free_.pop_back();
+
+  return PooledImage(img, FrameRecycler {this});
+}
+
+void FramePool::recycle(RawImage * img)
+{
+  lock_guard<mutex> lock(mtx_);
+
+  // reuse the most recently released frame first as it is likely cached
+  free_.emplace_back(img);
+}
+
+size_t FramePool::num_arenas() const
+{
+  lock_guard<mutex> lock(mtx_);
+  return arenas_.size();
+}
+
+size_t FramePool::num_frames() const
+{
+  lock_guard<mutex> lock(mtx_);
+  return imgs_.size();
+}
+
+size_t FramePool::num_free() const
+{
+  lock_guard<mutex> lock(mtx_);
+  return free_.size();
+}
+
+FramePool::HugePages FramePool::huge_pages() const
+{
+  lock_guard<mutex> lock(mtx_);
+  return huge_pages_;
+}
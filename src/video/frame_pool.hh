@@ -0,0 +1,95 @@
+#ifndef FRAME_POOL_HH
+#define FRAME_POOL_HH
+
+extern "C" {
+#include <vpx/vpx_image.h>
+}
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <mutex>
+
+#include "mmap.hh"
+#include "image.hh"
+
+// allocates I420 RawImages of a fixed size out of large anonymous arenas:
+// every plane starts on a 64-byte boundary and its rows are padded to a
+// multiple of 64 bytes; arenas are prefaulted and optionally backed by huge
+// pages, and released frames are recycled rather than freed; the pool grows
+// by one arena whenever it runs out of free frames
+class FramePool
+{
+public:
+  enum class HugePages {
+    NONE,        // regular pages
+    TRANSPARENT, // madvise(MADV_HUGEPAGE) the arenas
+    EXPLICIT     // reserved huge pages (MAP_HUGETLB), else TRANSPARENT
+  };
+
+  static constexpr size_t ALIGNMENT = 64;
+  static constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+  // the first arena is allocated upfront and fits at least frames_per_arena
+  FramePool(const uint16_t display_width, const uint16_t display_height,
+            const size_t frames_per_arena = 8,
+            const HugePages huge_pages = HugePages::TRANSPARENT);
+
+  // all frames must have been released by now
+  ~FramePool();
+
+  // take a free frame (with stale content), allocating an arena if needed;
+  // the frame returns to the pool once the PooledImage is released
+  PooledImage acquire();
+
+  uint16_t display_width() const { return display_width_; }
+  uint16_t display_height() const { return display_height_; }
+
+  // bytes taken by a single frame, including padding
+  size_t frame_size() const { return frame_size_; }
+
+  // numbers of arenas and frames allocated, and of frames not in use
+  size_t num_arenas() const;
+  size_t num_frames() const;
+  size_t num_free() const;
+
+  // the page mode in effect after any fallback
+  HugePages huge_pages() const;
+
+  // forbid copying and moving (frames hold a pointer to the pool)
+  FramePool(const FramePool & other) = delete;
+  const FramePool & operator=(const FramePool & other) = delete;
+  FramePool(FramePool && other) = delete;
+  FramePool & operator=(FramePool && other) = delete;
+
+private:
+  uint16_t display_width_;
+  uint16_t display_height_;
+
+  // plane layout within a frame
+  int y_stride_;
+  int uv_stride_;
+  size_t u_offset_;
+  size_t v_offset_;
+  size_t frame_size_;
+
+  size_t frames_per_arena_;
+  HugePages huge_pages_;
+
+  mutable std::mutex mtx_ {};
+  std::vector<MMap> arenas_ {};
+
+  // frames are never freed before the pool; free_ holds the ones not in use
+  std::vector<std::unique_ptr<vpx_image_t>> vpx_imgs_ {};
+  std::vector<std::unique_ptr<RawImage>> imgs_ {};
+  std::vector<RawImage *> free_ {};
+
+  // map a new arena and carve it into frames (mtx_ must be held)
+  void add_arena();
+  MMap map_arena();
+
+  void recycle(RawImage * img);
+  friend struct FrameRecycler;
+};
+
+#endif /* FRAME_POOL_HH */
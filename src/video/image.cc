@@ -3,46 +3,101 @@
 #include <thread>
 
 #include "image.hh"
+#include "frame_pool.hh"
+#include "image_diff.hh"
+#include "image_scaler.hh"
+#include "color_convert.hh"
+#include "thread_pool.hh"
 
 using namespace std;
 
-CroppedImage::CroppedImage(uint16_t frame_width, uint16_t frame_height, uint16_t  width, uint16_t  height)
-  : frame_width_(frame_width), frame_height_(frame_height), frame_img(frame_width, frame_height), cropped_img(width, height)
+ImageCropper::ImageCropper(const uint16_t output_width, const uint16_t output_height)
+  : output_width_(output_width), output_height_(output_height)
 {}
 
-void CroppedImage::crop(float viewpoint_x, float viewpoint_y, uint16_t width, uint16_t  height) {
-    // Calculate the starting indices for cropping. Round to nearest integers.
-    int start_x = round(viewpoint_x - width / 2.0f);
-    int start_y = round(viewpoint_y - height / 2.0f);
-
-    // Check for boundary conditions
-    if (start_x < 0) start_x = 0;
-    if (start_y < 0) start_y = 0;
-    if (start_x + width > frame_width_) start_x = frame_width_ - width;
-    if (start_y + height > frame_height_) start_y = frame_height_ - height;
-
-    // For the Y plane
-    uint8_t* dest_ptr_y = cropped_img.y_plane();
-    uint8_t* src_ptr_y = frame_img.y_plane() + start_y * frame_img.y_stride() + start_x;
-    for (int i = 0; i < height; ++i) {
-        memcpy(dest_ptr_y, src_ptr_y, width);
-        dest_ptr_y += cropped_img.y_stride();
-        src_ptr_y += frame_img.y_stride();
+const RawImage & ImageCropper::crop(const RawImage & frame,
+                                    const double viewpoint_x, const double viewpoint_y,
+                                    const uint16_t width, const uint16_t height,
+                                    const bool subpixel)
+{
+    const uint16_t frame_width = frame.display_width();
+    const uint16_t frame_height = frame.display_height();
+
+    if (width == 0 or height == 0 or width > frame_width or height > frame_height) {
+        throw runtime_error("ImageCropper: invalid crop window size");
+    }
+
+    // top left corner of the window, shifted to fit within the frame
+    const double start_x = clamp(viewpoint_x - width / 2.0, 0.0,
+                                 static_cast<double>(frame_width - width));
+    const double start_y = clamp(viewpoint_y - height / 2.0, 0.0,
+                                 static_cast<double>(frame_height - height));
+
+    if (subpixel or width != output_width_ or height != output_height_) {
+        if (not scaled_img_) {
+            scaled_img_ = make_unique<RawImage>(output_width_, output_height_);
+        }
+
+        scale_image(frame, start_x, start_y, width, height, *scaled_img_);
+        cropped_ = scaled_img_.get();
+        crop_x_ = start_x;
+        crop_y_ = start_y;
+        return *cropped_;
     }
 
-    // For the U and V planes
-    uint8_t* dest_ptr_u = cropped_img.u_plane();
-    uint8_t* src_ptr_u = frame_img.u_plane() + (start_y / 2) * frame_img.u_stride() + start_x / 2;
-    uint8_t* dest_ptr_v = cropped_img.v_plane();
-    uint8_t* src_ptr_v = frame_img.v_plane() + (start_y / 2) * frame_img.v_stride() + start_x / 2;
-    for (int i = 0; i < height / 2; ++i) {
-        memcpy(dest_ptr_u, src_ptr_u, width / 2);
-        memcpy(dest_ptr_v, src_ptr_v, width / 2);
-        dest_ptr_u += cropped_img.u_stride();
-        src_ptr_u += frame_img.u_stride();
-        dest_ptr_v += cropped_img.v_stride();
-        src_ptr_v += frame_img.v_stride();
+    // snap to even pixels so that the chroma planes stay aligned
+    const unsigned int x = static_cast<unsigned int>(lround(start_x)) & ~1u;
+    const unsigned int y = static_cast<unsigned int>(lround(start_y)) & ~1u;
+
+    // shallow copy of the frame's vpx_image: same strides but offset planes
+    view_vpx_img_ = *frame.get_vpx_image();
+    view_vpx_img_.img_data_owner = 0;
+    view_vpx_img_.self_allocd = 0;
+    view_vpx_img_.d_w = width;
+    view_vpx_img_.d_h = height;
+    view_vpx_img_.planes[VPX_PLANE_Y] = frame.y_plane() + y * frame.y_stride() + x;
+    view_vpx_img_.planes[VPX_PLANE_U] = frame.u_plane() + y / 2 * frame.u_stride() + x / 2;
+    view_vpx_img_.planes[VPX_PLANE_V] = frame.v_plane() + y / 2 * frame.v_stride() + x / 2;
+
+    view_.emplace(&view_vpx_img_);
+    cropped_ = &*view_;
+    crop_x_ = x;
+    crop_y_ = y;
+    return *cropped_;
+}
+
+const RawImage & ImageCropper::get_cropped_frame() const
+{
+    if (not cropped_) {
+        throw runtime_error("ImageCropper: no frame has been cropped yet");
     }
+
+    return *cropped_;
+}
+
+PooledImage make_pooled_image(FramePool * pool, const uint16_t display_width,
+                              const uint16_t display_height)
+{
+  if (not pool) {
+    return PooledImage(new RawImage(display_width, display_height));
+  }
+
+  if (pool->display_width() != display_width or
+      pool->display_height() != display_height) {
+    throw runtime_error("FramePool: frame dimensions don't match");
+  }
+
+  return pool->acquire();
+}
+
+CroppedImage::CroppedImage(uint16_t frame_width, uint16_t frame_height, uint16_t  width, uint16_t  height,
+                           FramePool * frame_pool)
+  : frame_width_(frame_width), frame_height_(frame_height),
+    frame_img(make_pooled_image(frame_pool, frame_width, frame_height)), cropper_(width, height)
+{}
+
+void CroppedImage::crop(float viewpoint_x, float viewpoint_y, uint16_t width, uint16_t  height) {
+    cropper_.crop(*frame_img, viewpoint_x, viewpoint_y, width, height);
 }
 
 
@@ -79,15 +134,15 @@ void CroppedImage::crop(float viewpoint_x, float viewpoint_y, uint16_t width, ui
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
 
-TiledImage::TiledImage(uint16_t frame_width, uint16_t frame_height, uint16_t n_row, uint16_t n_col)
-  : frame_img(frame_width, frame_height), n_row_(n_row), n_col_(n_col), 
-  frame_width_(frame_img.display_width()), frame_height_(frame_img.display_height()),
-  tile_width_(frame_img.display_width() / n_col_), tile_height_(frame_img.display_height() / n_row_), 
-  tiles([this](){
-    std::vector<RawImage*> tmp;
-    tmp.resize(n_row_ * n_col_);
+TiledImage::TiledImage(uint16_t frame_width, uint16_t frame_height, uint16_t n_row, uint16_t n_col,
+                       FramePool * frame_pool, FramePool * tile_pool)
+  : frame_img(make_pooled_image(frame_pool, frame_width, frame_height)), n_row_(n_row), n_col_(n_col), 
+  frame_width_(frame_img->display_width()), frame_height_(frame_img->display_height()),
+  tile_width_(frame_img->display_width() / n_col_), tile_height_(frame_img->display_height() / n_row_), 
+  tiles([this, tile_pool](){
+    std::vector<PooledImage> tmp;
     for (int i = 0; i < n_row_ * n_col_; ++i) {
-      tmp[i] = new RawImage(tile_width_, tile_height_);
+      tmp.emplace_back(make_pooled_image(tile_pool, tile_width_, tile_height_));
     }
     return tmp;
   }())
@@ -97,10 +152,10 @@ void TiledImage::threaded_partition_tile(uint16_t row, uint16_t col) {
     RawImage &tile = *tiles[row * n_col_ + col];
     for(int i = 0; i < tile_height_; ++i) {
         for(int j = 0; j < tile_width_; ++j) {
-            tile.y_plane()[i * tile.y_stride() + j] = frame_img.y_plane()[(row * tile_height_ + i) * frame_img.y_stride() + col * tile_width_ + j];
+            tile.y_plane()[i * tile.y_stride() + j] = frame_img->y_plane()[(row * tile_height_ + i) * frame_img->y_stride() + col * tile_width_ + j];
             if (i < tile_height_ / 2 && j < tile_width_ / 2) {
-                tile.u_plane()[i * tile.u_stride() + j] = frame_img.u_plane()[(row * tile_height_ / 2 + i) * frame_img.u_stride() + col * tile_width_ / 2 + j];
-                tile.v_plane()[i * tile.v_stride() + j] = frame_img.v_plane()[(row * tile_height_ / 2 + i) * frame_img.v_stride() + col * tile_width_ / 2 + j];
+                tile.u_plane()[i * tile.u_stride() + j] = frame_img->u_plane()[(row * tile_height_ / 2 + i) * frame_img->u_stride() + col * tile_width_ / 2 + j];
+                tile.v_plane()[i * tile.v_stride() + j] = frame_img->v_plane()[(row * tile_height_ / 2 + i) * frame_img->v_stride() + col * tile_width_ / 2 + j];
             }
         }
     }
@@ -118,14 +173,119 @@ void TiledImage::partition() {
     }
 }
 
+void TiledImage::partition(const vector<bool> & mask) {
+    if (mask.size() != tiles.size()) {
+        throw runtime_error("TiledImage: invalid tile mask size");
+    }
+
+    std::vector<std::thread> threads;
+    for (int row = 0; row < n_row_; ++row) {
+        for (int col = 0; col < n_col_; ++col) {
+            if (mask[row * n_col_ + col]) {
+                threads.emplace_back(&TiledImage::threaded_partition_tile, this, row, col);
+            }
+        }
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+}
+
+vector<bool> TiledImage::changed_tiles(const TiledImage & prev, const double threshold) const {
+    if (prev.frame_width_ != frame_width_ or prev.frame_height_ != frame_height_ or
+        prev.n_row_ != n_row_ or prev.n_col_ != n_col_) {
+        throw runtime_error("TiledImage: cannot compare differently tiled images");
+    }
+
+    const RawImage & curr_img = *frame_img;
+    const RawImage & prev_img = *prev.frame_img;
+    const uint16_t uv_width = tile_width_ / 2;
+    const uint16_t uv_height = tile_height_ / 2;
+
+    // a tile is changed once its SAD exceeds the threshold over all its pixels
+    const uint64_t limit = static_cast<uint64_t>(
+        threshold * (tile_width_ * tile_height_ + 2 * uv_width * uv_height));
+
+    vector<bool> mask(tiles.size());
+    for (int row = 0; row < n_row_; ++row) {
+        for (int col = 0; col < n_col_; ++col) {
+            const size_t y_offset = row * tile_height_;
+            const size_t x_offset = col * tile_width_;
+
+            // compare Y plane first as it's the most likely to differ
+            uint64_t sad = plane_sad(
+                curr_img.y_plane() + y_offset * curr_img.y_stride() + x_offset, curr_img.y_stride(),
+                prev_img.y_plane() + y_offset * prev_img.y_stride() + x_offset, prev_img.y_stride(),
+                tile_width_, tile_height_, limit);
+
+            if (sad <= limit) {
+                sad += plane_sad(
+                    curr_img.u_plane() + y_offset / 2 * curr_img.u_stride() + x_offset / 2, curr_img.u_stride(),
+                    prev_img.u_plane() + y_offset / 2 * prev_img.u_stride() + x_offset / 2, prev_img.u_stride(),
+                    uv_width, uv_height, limit - sad);
+            }
+
+            if (sad <= limit) {
+                sad += plane_sad(
+                    curr_img.v_plane() + y_offset / 2 * curr_img.v_stride() + x_offset / 2, curr_img.v_stride(),
+                    prev_img.v_plane() + y_offset / 2 * prev_img.v_stride() + x_offset / 2, prev_img.v_stride(),
+                    uv_width, uv_height, limit - sad);
+            }
+
+            mask[row * n_col_ + col] = sad > limit;
+        }
+    }
+
+    return mask;
+}
+
+void TiledImage::copy_tiles(const TiledImage & src, const vector<bool> & mask) {
+    if (src.frame_width_ != frame_width_ or src.frame_height_ != frame_height_ or
+        src.n_row_ != n_row_ or src.n_col_ != n_col_) {
+        throw runtime_error("TiledImage: cannot copy between differently tiled images");
+    }
+    if (mask.size() != tiles.size()) {
+        throw runtime_error("TiledImage: invalid tile mask size");
+    }
+
+    const RawImage & src_img = *src.frame_img;
+    RawImage & dst_img = *frame_img;
+
+    for (int row = 0; row < n_row_; ++row) {
+        for (int col = 0; col < n_col_; ++col) {
+            if (not mask[row * n_col_ + col]) {
+                continue;
+            }
+
+            const size_t y_offset = row * tile_height_;
+            const size_t x_offset = col * tile_width_;
+
+            for (int i = 0; i < tile_height_; ++i) {
+                memcpy(dst_img.y_plane() + (y_offset + i) * dst_img.y_stride() + x_offset,
+                       src_img.y_plane() + (y_offset + i) * src_img.y_stride() + x_offset,
+                       tile_width_);
+            }
+
+            for (int i = 0; i < tile_height_ / 2; ++i) {
+                memcpy(dst_img.u_plane() + (y_offset / 2 + i) * dst_img.u_stride() + x_offset / 2,
+                       src_img.u_plane() + (y_offset / 2 + i) * src_img.u_stride() + x_offset / 2,
+                       tile_width_ / 2);
+                memcpy(dst_img.v_plane() + (y_offset / 2 + i) * dst_img.v_stride() + x_offset / 2,
+                       src_img.v_plane() + (y_offset / 2 + i) * src_img.v_stride() + x_offset / 2,
+                       tile_width_ / 2);
+            }
+        }
+    }
+}
+
 void TiledImage::threaded_merge_tile(uint16_t row, uint16_t col) {
     const RawImage &tile = *tiles[row * n_col_ + col];
     for(int i = 0; i < tile_height_; ++i) {
         for(int j = 0; j < tile_width_; ++j) {
-            frame_img.y_plane()[(row * tile_height_ + i) * frame_img.y_stride() + col * tile_width_ + j] = tile.y_plane()[i * tile.y_stride() + j];
+            frame_img->y_plane()[(row * tile_height_ + i) * frame_img->y_stride() + col * tile_width_ + j] = tile.y_plane()[i * tile.y_stride() + j];
             if (i < tile_height_ / 2 && j < tile_width_ / 2) {
-                frame_img.u_plane()[(row * tile_height_ / 2 + i) * frame_img.u_stride() + col * tile_width_ / 2 + j] = tile.u_plane()[i * tile.u_stride() + j];
-                frame_img.v_plane()[(row * tile_height_ / 2 + i) * frame_img.v_stride() + col * tile_width_ / 2 + j] = tile.v_plane()[i * tile.v_stride() + j];
+                frame_img->u_plane()[(row * tile_height_ / 2 + i) * frame_img->u_stride() + col * tile_width_ / 2 + j] = tile.u_plane()[i * tile.u_stride() + j];
+                frame_img->v_plane()[(row * tile_height_ / 2 + i) * frame_img->v_stride() + col * tile_width_ / 2 + j] = tile.v_plane()[i * tile.v_stride() + j];
             }
         }
     }
@@ -143,12 +303,6 @@ void TiledImage::merge() {
     }
 }
 
-TiledImage::~TiledImage() {
-  for(auto tile : tiles) {
-    delete tile;
-  }
-}
-
 //////////////////////////////////////////////////////////////////////////////////////////////////
 
 // constructor that allocates and owns the vpx_image
@@ -179,6 +333,20 @@ RawImage::RawImage(vpx_image_t * const vpx_img)
   display_height_ = vpx_img->d_h;
 }
 
+// constructor that wraps (but never frees) an external I420 buffer
+RawImage::RawImage(const uint16_t display_width, const uint16_t display_height,
+                   uint8_t * const data)
+  : vpx_img_(vpx_img_wrap(nullptr, VPX_IMG_FMT_I420,
+                          display_width, display_height, 1, data)),
+    own_vpx_img_(true), // frees only the vpx_image struct, not 'data'
+    display_width_(display_width),
+    display_height_(display_height)
+{
+  if (not vpx_img_) {
+    throw runtime_error("RawImage: failed to wrap an external buffer");
+  }
+}
+
 RawImage::~RawImage()
 {
   // free vpx_image only if the class owns it
@@ -187,31 +355,67 @@ RawImage::~RawImage()
   }
 }
 
-void RawImage::copy_from_yuyv(const string_view src)
+// copy a plane row by row unless both are contiguous
+static void copy_plane(const uint8_t * src, const int src_stride,
+                       uint8_t * dst, const int dst_stride,
+                       const uint16_t width, const uint16_t height)
 {
-  // expects YUYV to have size of 2 * W * H
-  if (src.size() != y_size() * 2) {
-    throw runtime_error("RawImage: invalid YUYV size");
+  if (src_stride == width and dst_stride == width) {
+    memcpy(dst, src, static_cast<size_t>(width) * height);
+    return;
   }
 
-  uint8_t * dst_y = y_plane();
-  uint8_t * dst_u = u_plane();
-  uint8_t * dst_v = v_plane();
+  for (uint16_t row = 0; row < height; row++) {
+    memcpy(dst + row * dst_stride, src + row * src_stride, width);
+  }
+}
 
-  // copy Y plane
-  const uint8_t * p = reinterpret_cast<const uint8_t *>(src.data());
-  for (unsigned i = 0; i < y_size(); i++, p += 2) {
-    *dst_y++ = *p;
+void RawImage::copy_from(const RawImage & src)
+{
+  if (src.display_width_ != display_width_ or
+      src.display_height_ != display_height_) {
+    throw runtime_error("RawImage: image dimensions don't match");
   }
 
-  // copy U and V planes
-  p = reinterpret_cast<const uint8_t *>(src.data());
-  for (unsigned i = 0; i < display_height_ / 2; i++, p += 2 * display_width_) {
-    for (unsigned j = 0; j < display_width_ / 2; j++, p += 4) {
-      *dst_u++ = p[1];
-      *dst_v++ = p[3];
-    }
+  copy_plane(src.y_plane(), src.y_stride(), y_plane(), y_stride(),
+             display_width_, display_height_);
+  copy_plane(src.u_plane(), src.u_stride(), u_plane(), u_stride(),
+             display_width_ / 2, display_height_ / 2);
+  copy_plane(src.v_plane(), src.v_stride(), v_plane(), v_stride(),
+             display_width_ / 2, display_height_ / 2);
+}
+
+void RawImage::copy_from_yuyv(const string_view src, const int src_stride)
+{
+  const int stride = src_stride ? src_stride : 2 * display_width_;
+
+  // expects YUYV to have at least H rows of 2 * W bytes
+  if (stride < 2 * display_width_ or
+      src.size() < static_cast<size_t>(stride) * (display_height_ - 1) + 2 * display_width_) {
+    throw runtime_error("RawImage: invalid YUYV size");
+  }
+
+  yuyv_to_i420(reinterpret_cast<const uint8_t *>(src.data()), stride,
+               y_plane(), y_stride(), u_plane(), u_stride(), v_plane(), v_stride(),
+               display_width_, display_height_);
+}
+
+void RawImage::copy_from_nv12(const string_view src, const int src_stride)
+{
+  const int stride = src_stride ? src_stride : display_width_;
+
+  // expects a Y plane of H rows followed by an interleaved UV plane of H / 2
+  if (stride < display_width_ or
+      src.size() < static_cast<size_t>(stride) * (display_height_ * 3 / 2 - 1) + display_width_) {
+    throw runtime_error("RawImage: invalid NV12 size");
   }
+
+  const uint8_t * data = reinterpret_cast<const uint8_t *>(src.data());
+
+  copy_plane(data, stride, y_plane(), y_stride(), display_width_, display_height_);
+  nv12_uv_to_i420(data + static_cast<size_t>(stride) * display_height_, stride,
+                  u_plane(), u_stride(), v_plane(), v_stride(),
+                  display_width_ / 2, display_height_ / 2);
 }
 
 void RawImage::copy_y_from(const string_view src)
@@ -220,7 +424,8 @@ void RawImage::copy_y_from(const string_view src)
     throw runtime_error("RawImage: invalid size for Y plane");
   }
 
-  memcpy(y_plane(), src.data(), src.size());
+  copy_plane(reinterpret_cast<const uint8_t *>(src.data()), display_width_,
+             y_plane(), y_stride(), display_width_, display_height_);
 }
 
 void RawImage::copy_u_from(const string_view src)
@@ -229,7 +434,8 @@ void RawImage::copy_u_from(const string_view src)
     throw runtime_error("RawImage: invalid size for U plane");
   }
 
-  memcpy(u_plane(), src.data(), src.size());
+  copy_plane(reinterpret_cast<const uint8_t *>(src.data()), display_width_ / 2,
+             u_plane(), u_stride(), display_width_ / 2, display_height_ / 2);
 }
 
 void RawImage::copy_v_from(const string_view src)
@@ -238,74 +444,97 @@ void RawImage::copy_v_from(const string_view src)
     throw runtime_error("RawImage: invalid size for V plane");
   }
 
-  memcpy(v_plane(), src.data(), src.size());
+  copy_plane(reinterpret_cast<const uint8_t *>(src.data()), display_width_ / 2,
+             v_plane(), v_stride(), display_width_ / 2, display_height_ / 2);
 }
 
 
-void RawImage::yuv_to_rgb(const uint8_t* y_plane, const uint8_t* u_plane, const uint8_t* v_plane, uint8_t* rgb_data, uint16_t width, uint16_t height, int y_stride, int u_stride, int v_stride) {
-  for (uint16_t y = 0; y < height; ++y) {
-    for (uint16_t x = 0; x < width; ++x) {
-      // Get Y, U, and V values
-      uint8_t Y = y_plane[y * y_stride + x];
-      uint8_t U = u_plane[(y / 2) * u_stride + (x / 2)];
-      uint8_t V = v_plane[(y / 2) * v_stride + (x / 2)];
-
-      // Convert YUV to RGB
-      int C = Y - 16;
-      int D = U - 128;
-      int E = V - 128;
-
-      uint8_t r = static_cast<uint8_t>(std::clamp((298 * C + 409 * E + 128) >> 8, 0, 255));
-      uint8_t g = static_cast<uint8_t>(std::clamp((298 * C - 100 * D - 208 * E + 128) >> 8, 0, 255));
-      uint8_t b = static_cast<uint8_t>(std::clamp((298 * C + 516 * D + 128) >> 8, 0, 255));
-
-      // Assign to rgb_data
-      int rgb_index = (y * width + x) * 3;
-      rgb_data[rgb_index] = r;
-      rgb_data[rgb_index + 1] = g;
-      rgb_data[rgb_index + 2] = b;
-    }
+ColorSpace RawImage::color_space() const
+{
+  ColorSpace color_space;
+  color_space.matrix = vpx_img_->cs == VPX_CS_BT_709 ? ColorMatrix::BT709
+                                                     : ColorMatrix::BT601;
+  color_space.full_range = vpx_img_->range == VPX_CR_FULL_RANGE;
+  return color_space;
+}
+
+void RawImage::to_rgbx(uint8_t * dst, const int dst_stride,
+                       const ColorSpace & color_space, ThreadPool * pool) const
+{
+  const auto convert = [&](const uint16_t row, const uint16_t num_rows) {
+    i420_to_rgbx(y_plane() + row * y_stride(), y_stride(),
+                 u_plane() + row / 2 * u_stride(), u_stride(),
+                 v_plane() + row / 2 * v_stride(), v_stride(),
+                 dst + row * dst_stride, dst_stride,
+                 display_width_, num_rows, color_space);
+  };
+
+  if (not pool or pool->size() < 2) {
+    convert(0, display_height_);
+    return;
   }
+
+  // a few bands per thread for balance; bands start on even rows so that
+  // they don't share chroma rows
+  const size_t num_bands = pool->size() * 4;
+  const size_t band_rows = ((display_height_ + num_bands - 1) / num_bands + 1) & ~size_t(1);
+
+  pool->parallel_for((display_height_ + band_rows - 1) / band_rows, [&](const size_t band) {
+    const size_t row = band * band_rows;
+    convert(row, min(band_rows, display_height_ - row));
+  });
 }
 
+void RawImage::save_frame(const string & file_path, ThreadPool * pool) const
+{
+  save_frame(file_path, color_space(), pool);
+}
 
-void RawImage::save_frame(const std::string file_path) {
-  // Convert YUV to RGB
-  std::vector<uint8_t> rgb_data(display_width_ * display_height_ * 3); // RGB has 3 bytes per pixel
-  yuv_to_rgb(y_plane(), u_plane(), v_plane(), rgb_data.data(), display_width_, display_height_, y_stride(), u_stride(), v_stride());
+void RawImage::save_frame(const string & file_path, const ColorSpace & color_space,
+                          ThreadPool * pool) const
+{
+  // convert YUV to RGBX
+  const int rgbx_stride = display_width_ * 4;
+  vector<uint8_t> rgbx_data(static_cast<size_t>(rgbx_stride) * display_height_);
+  to_rgbx(rgbx_data.data(), rgbx_stride, color_space, pool);
+
+  vector<png_bytep> rows(display_height_);
+  for (uint16_t y = 0; y < display_height_; ++y) {
+    rows[y] = &rgbx_data[static_cast<size_t>(y) * rgbx_stride];
+  }
 
   // Save RGB data as PNG
   FILE *fp = fopen(file_path.c_str(), "wb");
   if (!fp) {
-    throw std::runtime_error("Failed to open file for writing");
+    throw runtime_error("Failed to open file for writing");
   }
 
   png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
   if (!png_ptr) {
     fclose(fp);
-    throw std::runtime_error("Failed to create PNG write structure");
+    throw runtime_error("Failed to create PNG write structure");
   }
 
   png_infop info_ptr = png_create_info_struct(png_ptr);
   if (!info_ptr) {
     png_destroy_write_struct(&png_ptr, (png_infopp)nullptr);
     fclose(fp);
-    throw std::runtime_error("Failed to create PNG info structure");
+    throw runtime_error("Failed to create PNG info structure");
   }
 
   if (setjmp(png_jmpbuf(png_ptr))) {
     png_destroy_write_struct(&png_ptr, &info_ptr);
     fclose(fp);
-    throw std::runtime_error("PNG write error occurred");
+    throw runtime_error("PNG write error occurred");
   }
 
   png_init_io(png_ptr, fp);
   png_set_IHDR(png_ptr, info_ptr, display_width_, display_height_, 8, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
   png_write_info(png_ptr, info_ptr);
 
-  for (uint16_t y = 0; y < display_height_; ++y) {
-    png_write_row(png_ptr, &rgb_data[y * display_width_ * 3]);
-  }
+  // drop the X byte of each pixel
+  png_set_filler(png_ptr, 0, PNG_FILLER_AFTER);
+  png_write_image(png_ptr, rows.data());
 
   png_write_end(png_ptr, nullptr);
   png_destroy_write_struct(&png_ptr, &info_ptr);
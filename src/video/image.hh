@@ -8,6 +8,9 @@ extern "C" {
 #include <string_view>
 #include <vector>
 #include <cmath>
+#include <memory>
+#include <optional>
+#include <utility>
 
 #include <png.h>
 #include <stdexcept>
@@ -15,6 +18,10 @@ extern "C" {
 #include <cstdint>
 #include <algorithm>
 
+#include "color_convert.hh"
+
+class ThreadPool;
+
 // wrapper class for vpx_image of format I420
 class RawImage
 {
@@ -25,6 +32,11 @@ public:
   // hold a non-owning pointer to an existing vpx_image
   RawImage(vpx_image_t * const vpx_img);
 
+  // view an external buffer holding the Y, U and V planes back to back
+  // without copying it; the buffer must outlive the RawImage
+  RawImage(const uint16_t display_width, const uint16_t display_height,
+           uint8_t * const data);
+
   // free the vpx_image only if the class owns it
   ~RawImage();
 
@@ -49,17 +61,31 @@ public:
   int u_stride() const { return vpx_img_->stride[VPX_PLANE_U]; }
   int v_stride() const { return vpx_img_->stride[VPX_PLANE_V]; }
 
-  // copy image data from a YUYV-formatted buffer
-  void copy_from_yuyv(const std::string_view src);
+  // color space signaled in the vpx_image (BT.601 limited range if unset)
+  ColorSpace color_space() const;
+
+  // convert image data from a YUYV- or NV12-formatted buffer whose rows
+  // are 'src_stride' bytes apart (0: packed rows)
+  void copy_from_yuyv(const std::string_view src, const int src_stride = 0);
+  void copy_from_nv12(const std::string_view src, const int src_stride = 0);
+
+  // copy the pixels of an image of the same dimensions (strides may differ)
+  void copy_from(const RawImage & src);
 
   // copy plane data from a buffer
   void copy_y_from(const std::string_view src);
   void copy_u_from(const std::string_view src);
   void copy_v_from(const std::string_view src);
 
-  // svae image as a PNG file
-  void save_frame(const std::string file_path);
-  void yuv_to_rgb(const uint8_t* y_plane, const uint8_t* u_plane, const uint8_t* v_plane, uint8_t* rgb_data, uint16_t width, uint16_t height, int y_stride, int u_stride, int v_stride);
+  // convert to packed RGBX (4 bytes per pixel) in 'dst', whose rows are
+  // 'dst_stride' bytes apart, splitting the rows across 'pool' if provided
+  void to_rgbx(uint8_t * dst, const int dst_stride, const ColorSpace & color_space,
+               ThreadPool * pool = nullptr) const;
+
+  // save image as a PNG file (converted on 'pool' if provided)
+  void save_frame(const std::string & file_path, ThreadPool * pool = nullptr) const;
+  void save_frame(const std::string & file_path, const ColorSpace & color_space,
+                  ThreadPool * pool = nullptr) const;
 
   // forbid copy and move operators  
   RawImage(const RawImage & other) = delete;
@@ -79,44 +105,123 @@ private:
   uint16_t display_height_;
 };
 
+class FramePool;
+
+// releases a RawImage back to the FramePool it was acquired from, or
+// deletes it if it was allocated on its own
+struct FrameRecycler
+{
+  FramePool * pool {nullptr};
+  void operator()(RawImage * img) const;
+};
+
+using PooledImage = std::unique_ptr<RawImage, FrameRecycler>;
+
+// acquire an image from 'pool' if provided, or allocate a standalone one
+PooledImage make_pooled_image(FramePool * pool, const uint16_t display_width,
+                              const uint16_t display_height);
+
 
 class TiledImage
 {
 public:
-    TiledImage(uint16_t frame_width, uint16_t frame_height, uint16_t n_row, uint16_t n_col);
-    ~TiledImage();
+    // the frame and the tiles are taken from the pools if provided
+    TiledImage(uint16_t frame_width, uint16_t frame_height, uint16_t n_row, uint16_t n_col,
+               FramePool * frame_pool = nullptr, FramePool * tile_pool = nullptr);
     void partition();
     void merge();
+
+    // flag the tiles whose pixels changed since 'prev', i.e., differ by more
+    // than 'threshold' per pixel on average (0: flag any difference)
+    std::vector<bool> changed_tiles(const TiledImage & prev,
+                                    const double threshold = 0) const;
+
+    // partition only the tiles flagged in 'mask' (indexed by row * n_col + col)
+    void partition(const std::vector<bool> & mask);
+
+    // copy the frame pixels of the tiles flagged in 'mask' from 'src' (e.g.,
+    // to keep the content last encoded for each tile)
+    void copy_tiles(const TiledImage & src, const std::vector<bool> & mask);
+
     void threaded_partition_tile(uint16_t row, uint16_t col);
     void threaded_merge_tile(uint16_t row, uint16_t col);
-    RawImage & get_frame() { return frame_img; }
+    RawImage & get_frame() { return *frame_img; }
     RawImage & get_tile(uint16_t row, uint16_t col) { return *tiles[row * n_col_ + col]; }
 
 private:
-    RawImage frame_img;
+    PooledImage frame_img;
     uint16_t n_row_;
     uint16_t n_col_;
     uint16_t frame_width_;
     uint16_t frame_height_;
     uint16_t tile_width_;
     uint16_t tile_height_;
-    std::vector<RawImage*> tiles;
+    std::vector<PooledImage> tiles;
 };
 
 
+// crops windows out of full frames and outputs them at a fixed resolution
+class ImageCropper
+{
+public:
+  ImageCropper(const uint16_t output_width, const uint16_t output_height);
+
+  // crop the window of width x height centered at (viewpoint_x, viewpoint_y),
+  // shifted to fit within 'frame', and return it at the output resolution:
+  // a window of the output size is a zero-copy view into 'frame' (snapped
+  // to even pixels); any other window, or any window if 'subpixel' is set,
+  // is resampled into an internal buffer
+  const RawImage & crop(const RawImage & frame,
+                        const double viewpoint_x, const double viewpoint_y,
+                        const uint16_t width, const uint16_t height,
+                        const bool subpixel = false);
+
+  // the last cropped frame (valid while the source frame is alive)
+  const RawImage & get_cropped_frame() const;
+
+  // top left corner of the last cropped window in the source frame
+  std::pair<double, double> crop_origin() const { return {crop_x_, crop_y_}; }
+
+  uint16_t output_width() const { return output_width_; }
+  uint16_t output_height() const { return output_height_; }
+
+  // forbid copy and move operators (view_ points into view_vpx_img_)
+  ImageCropper(const ImageCropper & other) = delete;
+  const ImageCropper & operator=(const ImageCropper & other) = delete;
+  ImageCropper(ImageCropper && other) = delete;
+  ImageCropper & operator=(ImageCropper && other) = delete;
+
+private:
+  uint16_t output_width_;
+  uint16_t output_height_;
+
+  // non-owning vpx_image pointing at a sub-rectangle of the source frame
+  vpx_image_t view_vpx_img_ {};
+  std::optional<RawImage> view_ {};
+
+  // resampled output, allocated on first use
+  std::unique_ptr<RawImage> scaled_img_ {};
+
+  const RawImage * cropped_ {nullptr};
+  double crop_x_ {0.0};
+  double crop_y_ {0.0};
+};
+
 class CroppedImage {
 public:
-  CroppedImage(uint16_t frame_width, uint16_t frame_height, uint16_t crop_width, uint16_t crop_height);
+  // the frame is taken from 'frame_pool' if provided
+  CroppedImage(uint16_t frame_width, uint16_t frame_height, uint16_t crop_width, uint16_t crop_height,
+               FramePool * frame_pool = nullptr);
   void crop(float viewpoint_x, float viewpoint_y, uint16_t  width, uint16_t  height);
-  RawImage & get_frame() { return frame_img; }
-  RawImage & get_cropped_frame() { return cropped_img; }
+  RawImage & get_frame() { return *frame_img; }
+  const RawImage & get_cropped_frame() const { return cropper_.get_cropped_frame(); }
 
     // ... other member functions and constructors
 private:
   uint16_t frame_width_;
   uint16_t frame_height_;
-  RawImage frame_img;
-  RawImage cropped_img;
+  PooledImage frame_img;
+  ImageCropper cropper_;
 };
 
 #endif /* IMAGE_HH */
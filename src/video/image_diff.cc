@@ -0,0 +1,100 @@
+#include <cstdlib>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "image_diff.hh"
+#include "cpu_features.hh"
+
+using namespace std;
+
+namespace {
+  uint64_t row_sad_scalar(const uint8_t * a, const uint8_t * b,
+                          const uint16_t width)
+  {
+    uint64_t sad = 0;
+    for (uint16_t i = 0; i < width; i++) {
+      sad += abs(a[i] - b[i]);
+    }
+    return sad;
+  }
+
+#if defined(__x86_64__)
+  __attribute__((target("sse2")))
+  uint64_t row_sad_sse2(const uint8_t * a, const uint8_t * b,
+                        const uint16_t width)
+  {
+    __m128i acc = _mm_setzero_si128();
+    uint16_t i = 0;
+
+    for (; i + 16 <= width; i += 16) {
+      const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+      const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+      // two 64-bit partial sums of absolute differences
+      acc = _mm_add_epi64(acc, _mm_sad_epu8(va, vb));
+    }
+
+    const uint64_t sad = _mm_cvtsi128_si64(acc)
+                         + _mm_cvtsi128_si64(_mm_unpackhi_epi64(acc, acc));
+    return sad + row_sad_scalar(a + i, b + i, width - i);
+  }
+
+  __attribute__((target("avx2")))
+  uint64_t row_sad_avx2(const uint8_t * a, const uint8_t * b,
+                        const uint16_t width)
+  {
+    __m256i acc = _mm256_setzero_si256();
+    uint16_t i = 0;
+
+    for (; i + 32 <= width; i += 32) {
+      const __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+      const __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i));
+      // four 64-bit partial sums of absolute differences
+      acc = _mm256_add_epi64(acc, _mm256_sad_epu8(va, vb));
+    }
+
+    const __m128i sum = _mm_add_epi64(_mm256_castsi256_si128(acc),
+                                      _mm256_extracti128_si256(acc, 1));
+    const uint64_t sad = _mm_cvtsi128_si64(sum)
+                         + _mm_cvtsi128_si64(_mm_unpackhi_epi64(sum, sum));
+    return sad + row_sad_scalar(a + i, b + i, width - i);
+  }
+#endif
+
+  using RowSAD = uint64_t (*)(const uint8_t *, const uint8_t *, const uint16_t);
+
+  RowSAD select_row_sad()
+  {
+#if defined(__x86_64__)
+    if (cpu_features().avx2) {
+      return row_sad_avx2;
+    }
+    if (cpu_features().sse2) {
+      return row_sad_sse2;
+    }
+#endif
+    return row_sad_scalar;
+  }
+}
+
+uint64_t plane_sad(const uint8_t * a, const int a_stride,
+                   const uint8_t * b, const int b_stride,
+                   const uint16_t width, const uint16_t height,
+                   const uint64_t limit)
+{
+  static const RowSAD row_sad = select_row_sad();
+
+  uint64_t sad = 0;
+
+  for (uint16_t row = 0; row < height; row++) {
+    sad += row_sad(a + row * a_stride, b + row * b_stride, width);
+
+    // early exit as soon as the difference is known to be large enough
+    if (sad > limit) {
+      break;
+    }
+  }
+
+  return sad;
+}
@@ -0,0 +1,16 @@
+#ifndef IMAGE_DIFF_HH
+#define IMAGE_DIFF_HH
+
+#include <cstdint>
+#include <limits>
+
+// sum of absolute differences (SAD) between two 8-bit planes of the same
+// dimensions; gives up once the running SAD exceeds 'limit', in which case
+// the returned value is only guaranteed to be greater than 'limit'
+// (dispatches to AVX2 or SSE2 at runtime when available)
+uint64_t plane_sad(const uint8_t * a, const int a_stride,
+                   const uint8_t * b, const int b_stride,
+                   const uint16_t width, const uint16_t height,
+                   const uint64_t limit = std::numeric_limits<uint64_t>::max());
+
+#endif /* IMAGE_DIFF_HH */
@@ -0,0 +1,195 @@
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "image_scaler.hh"
+#include "cpu_features.hh"
+
+using namespace std;
+
+namespace {
+  // bilinear weights are in Q8 fixed point
+  constexpr int WEIGHT_BITS = 8;
+  constexpr int WEIGHT_ONE = 1 << WEIGHT_BITS;
+
+  // source sample positions of each output pixel along one dimension
+  struct Taps
+  {
+    vector<int> pos {};     // the first of the two source samples to blend
+    vector<int> weight {};  // weight of the second sample
+  };
+
+  Taps compute_taps(const double src_start, const double src_len,
+                    const int src_limit, const int dst_len)
+  {
+    Taps taps;
+    taps.pos.resize(dst_len);
+    taps.weight.resize(dst_len);
+
+    const double step = src_len / dst_len;
+    for (int i = 0; i < dst_len; i++) {
+      // align the centers of the source and destination pixels
+      const double p = clamp(src_start + (i + 0.5) * step - 0.5,
+                             0.0, static_cast<double>(src_limit - 1));
+      const int p0 = min(static_cast<int>(p), max(src_limit - 2, 0));
+
+      taps.pos[i] = p0;
+      taps.weight[i] = min(static_cast<int>(lround((p - p0) * WEIGHT_ONE)),
+                           WEIGHT_ONE);
+    }
+
+    return taps;
+  }
+
+  void blend_rows_scalar(const uint8_t * a, const uint8_t * b, uint8_t * dst,
+                         const int len, const int weight)
+  {
+    const int inv_weight = WEIGHT_ONE - weight;
+    for (int i = 0; i < len; i++) {
+      dst[i] = (a[i] * inv_weight + b[i] * weight + WEIGHT_ONE / 2) >> WEIGHT_BITS;
+    }
+  }
+
+#if defined(__x86_64__)
+  // a * (256 - w) + b * w never exceeds 255 * 256, so 16-bit lanes suffice
+  __attribute__((target("sse2")))
+  void blend_rows_sse2(const uint8_t * a, const uint8_t * b, uint8_t * dst,
+                       const int len, const int weight)
+  {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i wa = _mm_set1_epi16(static_cast<short>(WEIGHT_ONE - weight));
+    const __m128i wb = _mm_set1_epi16(static_cast<short>(weight));
+    const __m128i half = _mm_set1_epi16(WEIGHT_ONE / 2);
+
+    int i = 0;
+    for (; i + 16 <= len; i += 16) {
+      const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+      const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+
+      __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(va, zero), wa),
+                                 _mm_mullo_epi16(_mm_unpacklo_epi8(vb, zero), wb));
+      __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(va, zero), wa),
+                                 _mm_mullo_epi16(_mm_unpackhi_epi8(vb, zero), wb));
+      lo = _mm_srli_epi16(_mm_add_epi16(lo, half), WEIGHT_BITS);
+      hi = _mm_srli_epi16(_mm_add_epi16(hi, half), WEIGHT_BITS);
+
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_packus_epi16(lo, hi));
+    }
+
+    blend_rows_scalar(a + i, b + i, dst + i, len - i, weight);
+  }
+
+  __attribute__((target("avx2")))
+  void blend_rows_avx2(const uint8_t * a, const uint8_t * b, uint8_t * dst,
+                       const int len, const int weight)
+  {
+    const __m256i wa = _mm256_set1_epi16(static_cast<short>(WEIGHT_ONE - weight));
+    const __m256i wb = _mm256_set1_epi16(static_cast<short>(weight));
+    const __m256i half = _mm256_set1_epi16(WEIGHT_ONE / 2);
+
+    int i = 0;
+    for (; i + 16 <= len; i += 16) {
+      const __m256i va = _mm256_cvtepu8_epi16(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i)));
+      const __m256i vb = _mm256_cvtepu8_epi16(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i)));
+
+      __m256i sum = _mm256_add_epi16(_mm256_mullo_epi16(va, wa),
+                                     _mm256_mullo_epi16(vb, wb));
+      sum = _mm256_srli_epi16(_mm256_add_epi16(sum, half), WEIGHT_BITS);
+
+      // pack the 16 words back into bytes (packus works within 128-bit lanes)
+      const __m128i packed = _mm_packus_epi16(_mm256_castsi256_si128(sum),
+                                              _mm256_extracti128_si256(sum, 1));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), packed);
+    }
+
+    blend_rows_scalar(a + i, b + i, dst + i, len - i, weight);
+  }
+#endif
+
+  using BlendRows = void (*)(const uint8_t *, const uint8_t *, uint8_t *,
+                             const int, const int);
+
+  BlendRows select_blend_rows()
+  {
+#if defined(__x86_64__)
+    if (cpu_features().avx2) {
+      return blend_rows_avx2;
+    }
+    if (cpu_features().sse2) {
+      return blend_rows_sse2;
+    }
+#endif
+    return blend_rows_scalar;
+  }
+
+  void scale_plane(const uint8_t * src, const int src_stride,
+                   const int src_plane_width, const int src_plane_height,
+                   const double x, const double y,
+                   const double width, const double height,
+                   uint8_t * dst, const int dst_stride,
+                   const int dst_width, const int dst_height)
+  {
+    static const BlendRows blend_rows = select_blend_rows();
+
+    const Taps col_taps = compute_taps(x, width, src_plane_width, dst_width);
+    const Taps row_taps = compute_taps(y, height, src_plane_height, dst_height);
+
+    // only the source columns covered by the window are blended vertically
+    const int col_begin = col_taps.pos.front();
+    const int col_end = min(col_taps.pos.back() + 2, src_plane_width);
+    vector<uint8_t> row_buf(col_end - col_begin + 1);
+
+    for (int i = 0; i < dst_height; i++) {
+      const int r0 = row_taps.pos[i];
+      const int r1 = min(r0 + 1, src_plane_height - 1);
+
+      // vertical pass into a temporary row
+      blend_rows(src + r0 * src_stride + col_begin,
+                 src + r1 * src_stride + col_begin,
+                 row_buf.data(), col_end - col_begin, row_taps.weight[i]);
+      row_buf[col_end - col_begin] = row_buf[col_end - col_begin - 1];
+
+      // horizontal pass from the temporary row
+      uint8_t * dst_row = dst + i * dst_stride;
+      for (int j = 0; j < dst_width; j++) {
+        const uint8_t * p = row_buf.data() + col_taps.pos[j] - col_begin;
+        const int w = col_taps.weight[j];
+        dst_row[j] = (p[0] * (WEIGHT_ONE - w) + p[1] * w + WEIGHT_ONE / 2) >> WEIGHT_BITS;
+      }
+    }
+  }
+}
+
+void scale_image(const RawImage & src,
+                 const double src_x, const double src_y,
+                 const double src_width, const double src_height,
+                 RawImage & dst)
+{
+  if (src_width <= 0 or src_height <= 0) {
+    throw runtime_error("scale_image: empty source window");
+  }
+
+  const int w = src.display_width();
+  const int h = src.display_height();
+
+  scale_plane(src.y_plane(), src.y_stride(), w, h,
+              src_x, src_y, src_width, src_height,
+              dst.y_plane(), dst.y_stride(),
+              dst.display_width(), dst.display_height());
+
+  // chroma planes are subsampled by 2 in both dimensions
+  scale_plane(src.u_plane(), src.u_stride(), w / 2, h / 2,
+              src_x / 2, src_y / 2, src_width / 2, src_height / 2,
+              dst.u_plane(), dst.u_stride(),
+              dst.display_width() / 2, dst.display_height() / 2);
+  scale_plane(src.v_plane(), src.v_stride(), w / 2, h / 2,
+              src_x / 2, src_y / 2, src_width / 2, src_height / 2,
+              dst.v_plane(), dst.v_stride(),
+              dst.display_width() / 2, dst.display_height() / 2);
+}
@@ -0,0 +1,15 @@
+#ifndef IMAGE_SCALER_HH
+#define IMAGE_SCALER_HH
+
+#include "image.hh"
+
+// bilinearly resample the window of 'src' whose top left corner is at
+// (src_x, src_y) and whose size is src_width x src_height into all of 'dst';
+// the window may have subpixel position and size, and is clamped to 'src'
+// (rows are blended with AVX2 or SSE2 when available)
+void scale_image(const RawImage & src,
+                 const double src_x, const double src_y,
+                 const double src_width, const double src_height,
+                 RawImage & dst);
+
+#endif /* IMAGE_SCALER_HH */
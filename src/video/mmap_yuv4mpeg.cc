@@ -0,0 +1,131 @@
+#include <sys/stat.h>
+#include <cstring>
+#include <iostream>
+
+#include "mmap_yuv4mpeg.hh"
+#include "yuv4mpeg.hh"
+#include "exception.hh"
+
+using namespace std;
+
+MMap MMapYUV4MPEG::map_file(const FileDescriptor & fd)
+{
+  struct stat st;
+  check_syscall(fstat(fd.fd_num(), &st));
+
+  if (st.st_size <= 0) {
+    throw runtime_error("MMapYUV4MPEG: empty file");
+  }
+
+  return MMap(st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd.fd_num(), 0);
+}
+
+MMapYUV4MPEG::MMapYUV4MPEG(const string & video_file_path,
+                           const uint16_t display_width,
+                           const uint16_t display_height,
+                           const bool loop)
+  : fd_(check_syscall(open(video_file_path.c_str(), O_RDONLY))),
+    display_width_(display_width),
+    display_height_(display_height),
+    loop_(loop),
+    mmap_(map_file(fd_))
+{
+  const char * const data = reinterpret_cast<const char *>(mmap_.addr());
+  const size_t length = mmap_.length();
+
+  // locate the end of the line starting at 'pos'
+  const auto line_end = [&](const size_t pos) -> size_t
+  {
+    const void * nl = memchr(data + pos, '\n', length - pos);
+    if (nl == nullptr) {
+      throw runtime_error("MMapYUV4MPEG: unterminated header line");
+    }
+    return static_cast<const char *>(nl) - data;
+  };
+
+  const string y4m_signature = "YUV4MPEG2";
+  if (length < y4m_signature.size() or
+      string_view(data, y4m_signature.size()) != y4m_signature) {
+    throw runtime_error("invalid YUV4MPEG2 file signature");
+  }
+
+  size_t pos = y4m_signature.size();
+  size_t eol = line_end(pos);
+  check_y4m_header(string(data + pos, eol - pos), display_width, display_height);
+  pos = eol + 1;
+
+  // index every frame: a "FRAME" line (possibly with parameters) + payload
+  const string frame_signature = "FRAME";
+  while (pos < length) {
+    if (length - pos < frame_signature.size() or
+        string_view(data + pos, frame_signature.size()) != frame_signature) {
+      throw runtime_error("invalid YUV4MPEG2 input format");
+    }
+
+    eol = line_end(pos);
+    pos = eol + 1;
+
+    if (length - pos < frame_size()) {
+      cerr << "MMapYUV4MPEG: ignored a truncated frame at the end" << endl;
+      break;
+    }
+
+    offsets_.emplace_back(pos);
+    frames_.emplace_back(make_unique<RawImage>(display_width_, display_height_,
+                                               mmap_.addr() + pos));
+    pos += frame_size();
+  }
+
+  if (frames_.empty()) {
+    throw runtime_error("MMapYUV4MPEG: no frames found");
+  }
+
+  // frames are mostly read in order, so read ahead aggressively
+  mmap_.advise(MADV_SEQUENTIAL);
+}
+
+const RawImage & MMapYUV4MPEG::frame(const size_t index) const
+{
+  return *frames_.at(index);
+}
+
+const RawImage * MMapYUV4MPEG::next_frame()
+{
+  if (next_ >= frames_.size()) {
+    if (not loop_) {
+      return nullptr;
+    }
+
+    // rewinding breaks the sequential pattern; prefetch the first frame
+    seek(0);
+  }
+
+  return frames_[next_++].get();
+}
+
+void MMapYUV4MPEG::seek(const size_t index)
+{
+  if (index >= frames_.size()) {
+    throw runtime_error("MMapYUV4MPEG: frame index out of range");
+  }
+
+  next_ = index;
+  mmap_.advise(MADV_WILLNEED, offsets_[index], frame_size());
+}
+
+bool MMapYUV4MPEG::read_frame(RawImage & raw_img)
+{
+  if (raw_img.display_width() != display_width_ or
+      raw_img.display_height() != display_height_) {
+    throw runtime_error("MMapYUV4MPEG: image dimensions don't match");
+  }
+
+  const RawImage * const src = next_frame();
+  if (src == nullptr) {
+    return false;
+  }
+
+  raw_img.copy_from(*src);
+
+  return true;
+}
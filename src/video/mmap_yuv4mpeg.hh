@@ -0,0 +1,66 @@
+#ifndef MMAP_YUV4MPEG_HH
+#define MMAP_YUV4MPEG_HH
+
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "file_descriptor.hh"
+#include "mmap.hh"
+#include "video_input.hh"
+
+// YUV4MPEG2 file mapped into memory: frames are indexed once when opened
+// and exposed as RawImage views into the mapping without any copying
+class MMapYUV4MPEG : public VideoInput
+{
+public:
+  MMapYUV4MPEG(const std::string & video_file_path,
+               const uint16_t display_width,
+               const uint16_t display_height,
+               const bool loop = true);
+
+  size_t frame_size() const { return display_width_ * display_height_ * 3 / 2; }
+  size_t num_frames() const { return frames_.size(); }
+
+  // zero-copy view of frame 'index' (valid as long as this object)
+  const RawImage & frame(const size_t index) const;
+
+  // view of the next frame in order, wrapping around to the first frame in
+  // the 'loop' mode; nullptr past the last frame otherwise
+  const RawImage * next_frame();
+
+  // make 'index' the next frame to return
+  void seek(const size_t index);
+  size_t position() const { return next_; }
+
+  // copy the next frame into raw_img (prefer next_frame() to avoid copying)
+  bool read_frame(RawImage & raw_img) override;
+
+  // accessors
+  uint16_t display_width() const override { return display_width_; }
+  uint16_t display_height() const override { return display_height_; }
+
+private:
+  FileDescriptor fd_;
+  uint16_t display_width_;
+  uint16_t display_height_;
+
+  // loop over the file infinitely
+  bool loop_;
+
+  // the whole file mapped copy-on-write, so that writing to a frame view
+  // never modifies the file
+  MMap mmap_;
+
+  // file offsets of the frame payloads and a view of each frame
+  std::vector<size_t> offsets_ {};
+  std::vector<std::unique_ptr<RawImage>> frames_ {};
+
+  // index of the next frame to return
+  size_t next_ {0};
+
+  // map the entire file
+  static MMap map_file(const FileDescriptor & fd);
+};
+
+#endif /* MMAP_YUV4MPEG_HH */
@@ -0,0 +1,148 @@
+#include <stdexcept>
+
+#include "prefetch_video_input.hh"
+
+using namespace std;
+
+static unique_ptr<VideoInput> check_input(unique_ptr<VideoInput> input,
+                                          const size_t capacity)
+{
+  if (not input) {
+    throw runtime_error("PrefetchVideoInput: null input");
+  }
+
+  if (capacity == 0) {
+    throw runtime_error("PrefetchVideoInput: capacity must be positive");
+  }
+
+  return input;
+}
+
+PrefetchVideoInput::PrefetchVideoInput(unique_ptr<VideoInput> input,
+                                       const size_t capacity,
+                                       const FramePool::HugePages huge_pages)
+  : input_(check_input(move(input), capacity)),
+    display_width_(input_->display_width()),
+    display_height_(input_->display_height()),
+    pool_(display_width_, display_height_, capacity, huge_pages), ring_()
+{
+  // the memory in use is bounded by the ring allocated upfront
+  for (size_t i = 0; i < capacity; i++) {
+    ring_.emplace_back(pool_.acquire());
+  }
+
+  reader_ = thread(&PrefetchVideoInput::reader_main, this);
+}
+
+PrefetchVideoInput::~PrefetchVideoInput()
+{
+  stop_ = true;
+  wake_up(reader_waiting_);
+
+  if (reader_.joinable()) {
+    reader_.join();
+  }
+}
+
+void PrefetchVideoInput::wake_up(atomic<bool> & waiting)
+{
+  // the waiting thread checks its condition while holding the mutex, so
+  // taking it here ensures the notification is not missed
+  if (waiting) {
+    { lock_guard<mutex> lock(mtx_); }
+    cv_.notify_all();
+  }
+}
+
+void PrefetchVideoInput::reader_main()
+{
+  try {
+    while (not stop_) {
+      const uint64_t tail = tail_.load(memory_order_relaxed);
+
+      // wait for a free slot
+      if (tail - head_.load(memory_order_acquire) == ring_.size()) {
+        unique_lock<mutex> lock(mtx_);
+        reader_waiting_ = true;
+        cv_.wait(lock, [&] {
+          return stop_ or tail - head_.load() < ring_.size();
+        });
+        reader_waiting_ = false;
+        continue;
+      }
+
+      if (not input_->read_frame(*ring_[tail % ring_.size()])) {
+        break;
+      }
+
+      // publish the frame (sequentially consistent so that it is ordered
+      // before checking if the consumer is waiting)
+      tail_.store(tail + 1);
+      wake_up(consumer_waiting_);
+    }
+  } catch (...) {
+    error_ = current_exception();
+  }
+
+  eof_ = true;
+  wake_up(consumer_waiting_);
+}
+
+const RawImage * PrefetchVideoInput::acquire_frame()
+{
+  if (acquired_) {
+    throw runtime_error("PrefetchVideoInput: previous frame not released");
+  }
+
+  const uint64_t head = head_.load(memory_order_relaxed);
+
+  if (tail_.load(memory_order_acquire) == head) {
+    if (not eof_) {
+      num_underruns_++;
+    }
+
+    unique_lock<mutex> lock(mtx_);
+    consumer_waiting_ = true;
+    cv_.wait(lock, [&] { return eof_ or tail_.load() != head; });
+    consumer_waiting_ = false;
+
+    if (tail_.load() == head) { // input has ended
+      if (error_) {
+        rethrow_exception(error_);
+      }
+      return nullptr;
+    }
+  }
+
+  acquired_ = true;
+  return ring_[head % ring_.size()].get();
+}
+
+void PrefetchVideoInput::release_frame()
+{
+  if (not acquired_) {
+    throw runtime_error("PrefetchVideoInput: no frame to release");
+  }
+
+  acquired_ = false;
+  head_.store(head_.load(memory_order_relaxed) + 1);
+  wake_up(reader_waiting_);
+}
+
+bool PrefetchVideoInput::read_frame(RawImage & raw_img)
+{
+  if (raw_img.display_width() != display_width_ or
+      raw_img.display_height() != display_height_) {
+    throw runtime_error("PrefetchVideoInput: image dimensions don't match");
+  }
+
+  const RawImage * const src = acquire_frame();
+  if (src == nullptr) {
+    return false;
+  }
+
+  raw_img.copy_from(*src);
+
+  release_frame();
+  return true;
+}
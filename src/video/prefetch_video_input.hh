@@ -0,0 +1,85 @@
+#ifndef PREFETCH_VIDEO_INPUT_HH
+#define PREFETCH_VIDEO_INPUT_HH
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <exception>
+
+#include "video_input.hh"
+#include "frame_pool.hh"
+
+// decorates a VideoInput with a reader thread that reads frames ahead into
+// a bounded ring of RawImages preallocated from a FramePool; frames are handed over to the
+// (single) consumer through lock-free ring indices, and a mutex is only
+// taken to put an idle thread to sleep or wake it up
+class PrefetchVideoInput : public VideoInput
+{
+public:
+  // take over 'input' and read up to 'capacity' frames ahead of the consumer
+  PrefetchVideoInput(std::unique_ptr<VideoInput> input, const size_t capacity = 8,
+                     const FramePool::HugePages huge_pages = FramePool::HugePages::TRANSPARENT);
+  ~PrefetchVideoInput();
+
+  uint16_t display_width() const override { return display_width_; }
+  uint16_t display_height() const override { return display_height_; }
+
+  // borrow the next frame without copying (waiting for it if not read yet);
+  // it stays valid until release_frame(); nullptr once the input has ended
+  const RawImage * acquire_frame();
+  void release_frame();
+
+  // copy the next frame into raw_img
+  bool read_frame(RawImage & raw_img) override;
+
+  // number of times a frame was not ready when requested
+  uint64_t num_underruns() const { return num_underruns_.load(); }
+
+  // number of frames ready to be consumed
+  size_t num_prefetched() const { return tail_.load() - head_.load(); }
+
+  // forbid copying and moving
+  PrefetchVideoInput(const PrefetchVideoInput & other) = delete;
+  const PrefetchVideoInput & operator=(const PrefetchVideoInput & other) = delete;
+  PrefetchVideoInput(PrefetchVideoInput && other) = delete;
+  PrefetchVideoInput & operator=(PrefetchVideoInput && other) = delete;
+
+private:
+  std::unique_ptr<VideoInput> input_;
+  uint16_t display_width_;
+  uint16_t display_height_;
+
+  // ring of frames; slot i % size holds the i-th frame read
+  FramePool pool_;
+  std::vector<PooledImage> ring_;
+
+  // frames [head_, tail_) are ready; only the consumer advances head_ and
+  // only the reader thread advances tail_
+  std::atomic<uint64_t> head_ {0};
+  std::atomic<uint64_t> tail_ {0};
+  bool acquired_ {false}; // consumer holds the frame at head_
+
+  std::atomic<bool> eof_ {false};
+  std::atomic<bool> stop_ {false};
+  std::exception_ptr error_ {}; // set by the reader thread before eof_
+
+  // sleeping and waking up when the ring is empty or full
+  std::mutex mtx_ {};
+  std::condition_variable cv_ {};
+  std::atomic<bool> consumer_waiting_ {false};
+  std::atomic<bool> reader_waiting_ {false};
+
+  // stats
+  std::atomic<uint64_t> num_underruns_ {0};
+
+  std::thread reader_ {};
+
+  void reader_main();
+  void wake_up(std::atomic<bool> & waiting);
+};
+
+#endif /* PREFETCH_VIDEO_INPUT_HH */
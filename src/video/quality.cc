@@ -0,0 +1,575 @@
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include "quality.hh"
+#include "cpu_features.hh"
+#include "conversion.hh"
+#include "thread_pool.hh"
+
+using namespace std;
+
+namespace {
+  // SSIM constants (K1 = 0.01, K2 = 0.03) scaled by the squared number of
+  // samples in a window, as the sums below are not normalized
+  constexpr double WINDOW_SAMPLES = 64;
+  constexpr double C1 = 0.01 * 255 * 0.01 * 255 * WINDOW_SAMPLES * WINDOW_SAMPLES;
+  constexpr double C2 = 0.03 * 255 * 0.03 * 255 * WINDOW_SAMPLES * WINDOW_SAMPLES;
+
+  // MS-SSIM weights of each scale (Wang et al.)
+  constexpr double MS_SSIM_WEIGHTS[] = {0.0448, 0.2856, 0.3001, 0.2363, 0.1333};
+  constexpr size_t MS_SSIM_SCALES = sizeof(MS_SSIM_WEIGHTS) / sizeof(double);
+
+  // a read-only 8-bit plane
+  struct Plane
+  {
+    const uint8_t * data;
+    int stride;
+    uint16_t width;
+    uint16_t height;
+  };
+
+  // sums over a 4x4 block of samples a (reference) and b (distorted)
+  struct BlockSums
+  {
+    uint32_t a, b, aa, bb, ab;
+  };
+
+  // sum of squared errors over a row
+  uint64_t row_sse_scalar(const uint8_t * a, const uint8_t * b,
+                          const uint16_t width)
+  {
+    uint64_t sse = 0;
+    for (uint16_t i = 0; i < width; i++) {
+      const int d = a[i] - b[i];
+      sse += d * d;
+    }
+    return sse;
+  }
+
+  // sums of the 'num_blocks' 4x4 blocks starting at a and b
+  void block_row_scalar(const uint8_t * a, const int a_stride,
+                        const uint8_t * b, const int b_stride,
+                        const uint16_t num_blocks, BlockSums * out)
+  {
+    for (uint16_t k = 0; k < num_blocks; k++) {
+      BlockSums s {0, 0, 0, 0, 0};
+
+      for (int row = 0; row < 4; row++) {
+        for (int col = 4 * k; col < 4 * k + 4; col++) {
+          const uint32_t va = a[row * a_stride + col];
+          const uint32_t vb = b[row * b_stride + col];
+          s.a += va;
+          s.b += vb;
+          s.aa += va * va;
+          s.bb += vb * vb;
+          s.ab += va * vb;
+        }
+      }
+
+      out[k] = s;
+    }
+  }
+
+  // blocks out of 32-bit lanes, each summing two adjacent columns
+  void gather_blocks(const uint32_t a[], const uint32_t b[], const uint32_t aa[],
+                     const uint32_t bb[], const uint32_t ab[],
+                     const unsigned int num_blocks, BlockSums * out)
+  {
+    for (unsigned int k = 0; k < num_blocks; k++) {
+      out[k] = {a[2 * k] + a[2 * k + 1], b[2 * k] + b[2 * k + 1],
+                aa[2 * k] + aa[2 * k + 1], bb[2 * k] + bb[2 * k + 1],
+                ab[2 * k] + ab[2 * k + 1]};
+    }
+  }
+
+#if defined(__x86_64__)
+  __attribute__((target("sse2")))
+  uint64_t row_sse_sse2(const uint8_t * a, const uint8_t * b,
+                        const uint16_t width)
+  {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc = _mm_setzero_si128(); // cannot overflow within a row
+    uint16_t i = 0;
+
+    for (; i + 16 <= width; i += 16) {
+      const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+      const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+      const __m128i lo = _mm_sub_epi16(_mm_unpacklo_epi8(va, zero), _mm_unpacklo_epi8(vb, zero));
+      const __m128i hi = _mm_sub_epi16(_mm_unpackhi_epi8(va, zero), _mm_unpackhi_epi8(vb, zero));
+      acc = _mm_add_epi32(acc, _mm_add_epi32(_mm_madd_epi16(lo, lo), _mm_madd_epi16(hi, hi)));
+    }
+
+    alignas(16) uint32_t lanes[4];
+    _mm_store_si128(reinterpret_cast<__m128i *>(lanes), acc);
+    return static_cast<uint64_t>(lanes[0]) + lanes[1] + lanes[2] + lanes[3]
+           + row_sse_scalar(a + i, b + i, width - i);
+  }
+
+  __attribute__((target("sse2")))
+  void block_row_sse2(const uint8_t * a, const int a_stride,
+                      const uint8_t * b, const int b_stride,
+                      const uint16_t num_blocks, BlockSums * out)
+  {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi16(1);
+    uint16_t k = 0;
+
+    // two blocks at a time
+    for (; k + 2 <= num_blocks; k += 2) {
+      __m128i sa = zero, sb = zero, saa = zero, sbb = zero, sab = zero;
+
+      for (int row = 0; row < 4; row++) {
+        const __m128i va = _mm_unpacklo_epi8(_mm_loadl_epi64(
+          reinterpret_cast<const __m128i *>(a + row * a_stride + 4 * k)), zero);
+        const __m128i vb = _mm_unpacklo_epi8(_mm_loadl_epi64(
+          reinterpret_cast<const __m128i *>(b + row * b_stride + 4 * k)), zero);
+
+        sa = _mm_add_epi32(sa, _mm_madd_epi16(va, one));
+        sb = _mm_add_epi32(sb, _mm_madd_epi16(vb, one));
+        saa = _mm_add_epi32(saa, _mm_madd_epi16(va, va));
+        sbb = _mm_add_epi32(sbb, _mm_madd_epi16(vb, vb));
+        sab = _mm_add_epi32(sab, _mm_madd_epi16(va, vb));
+      }
+
+      alignas(16) uint32_t lanes[5][4];
+      _mm_store_si128(reinterpret_cast<__m128i *>(lanes[0]), sa);
+      _mm_store_si128(reinterpret_cast<__m128i *>(lanes[1]), sb);
+      _mm_store_si128(reinterpret_cast<__m128i *>(lanes[2]), saa);
+      _mm_store_si128(reinterpret_cast<__m128i *>(lanes[3]), sbb);
+      _mm_store_si128(reinterpret_cast<__m128i *>(lanes[4]), sab);
+      gather_blocks(lanes[0], lanes[1], lanes[2], lanes[3], lanes[4], 2, out + k);
+    }
+
+    block_row_scalar(a + 4 * k, a_stride, b + 4 * k, b_stride,
+                     num_blocks - k, out + k);
+  }
+
+  __attribute__((target("avx2")))
+  uint64_t row_sse_avx2(const uint8_t * a, const uint8_t * b,
+                        const uint16_t width)
+  {
+    __m256i acc = _mm256_setzero_si256(); // cannot overflow within a row
+    uint16_t i = 0;
+
+    for (; i + 32 <= width; i += 32) {
+      const __m128i * pa = reinterpret_cast<const __m128i *>(a + i);
+      const __m128i * pb = reinterpret_cast<const __m128i *>(b + i);
+      const __m256i lo = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128(pa)),
+                                          _mm256_cvtepu8_epi16(_mm_loadu_si128(pb)));
+      const __m256i hi = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128(pa + 1)),
+                                          _mm256_cvtepu8_epi16(_mm_loadu_si128(pb + 1)));
+      acc = _mm256_add_epi32(acc, _mm256_add_epi32(_mm256_madd_epi16(lo, lo),
+                                                   _mm256_madd_epi16(hi, hi)));
+    }
+
+    alignas(32) uint32_t lanes[8];
+    _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), acc);
+
+    uint64_t sse = 0;
+    for (const uint32_t lane : lanes) {
+      sse += lane;
+    }
+    return sse + row_sse_scalar(a + i, b + i, width - i);
+  }
+
+  __attribute__((target("avx2")))
+  void block_row_avx2(const uint8_t * a, const int a_stride,
+                      const uint8_t * b, const int b_stride,
+                      const uint16_t num_blocks, BlockSums * out)
+  {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi16(1);
+    uint16_t k = 0;
+
+    // four blocks at a time
+    for (; k + 4 <= num_blocks; k += 4) {
+      __m256i sa = zero, sb = zero, saa = zero, sbb = zero, sab = zero;
+
+      for (int row = 0; row < 4; row++) {
+        const __m256i va = _mm256_cvtepu8_epi16(_mm_loadu_si128(
+          reinterpret_cast<const __m128i *>(a + row * a_stride + 4 * k)));
+        const __m256i vb = _mm256_cvtepu8_epi16(_mm_loadu_si128(
+          reinterpret_cast<const __m128i *>(b + row * b_stride + 4 * k)));
+
+        sa = _mm256_add_epi32(sa, _mm256_madd_epi16(va, one));
+        sb = _mm256_add_epi32(sb, _mm256_madd_epi16(vb, one));
+        saa = _mm256_add_epi32(saa, _mm256_madd_epi16(va, va));
+        sbb = _mm256_add_epi32(sbb, _mm256_madd_epi16(vb, vb));
+        sab = _mm256_add_epi32(sab, _mm256_madd_epi16(va, vb));
+      }
+
+      alignas(32) uint32_t lanes[5][8];
+      _mm256_store_si256(reinterpret_cast<__m256i *>(lanes[0]), sa);
+      _mm256_store_si256(reinterpret_cast<__m256i *>(lanes[1]), sb);
+      _mm256_store_si256(reinterpret_cast<__m256i *>(lanes[2]), saa);
+      _mm256_store_si256(reinterpret_cast<__m256i *>(lanes[3]), sbb);
+      _mm256_store_si256(reinterpret_cast<__m256i *>(lanes[4]), sab);
+      gather_blocks(lanes[0], lanes[1], lanes[2], lanes[3], lanes[4], 4, out + k);
+    }
+
+    block_row_scalar(a + 4 * k, a_stride, b + 4 * k, b_stride,
+                     num_blocks - k, out + k);
+  }
+#elif defined(__aarch64__)
+  uint64_t row_sse_neon(const uint8_t * a, const uint8_t * b,
+                        const uint16_t width)
+  {
+    uint32x4_t acc = vdupq_n_u32(0); // cannot overflow within a row
+    uint16_t i = 0;
+
+    for (; i + 16 <= width; i += 16) {
+      const uint8x16_t d = vabdq_u8(vld1q_u8(a + i), vld1q_u8(b + i));
+      acc = vpadalq_u16(acc, vmull_u8(vget_low_u8(d), vget_low_u8(d)));
+      acc = vpadalq_u16(acc, vmull_u8(vget_high_u8(d), vget_high_u8(d)));
+    }
+
+    return vaddlvq_u32(acc) + row_sse_scalar(a + i, b + i, width - i);
+  }
+
+  void block_row_neon(const uint8_t * a, const int a_stride,
+                      const uint8_t * b, const int b_stride,
+                      const uint16_t num_blocks, BlockSums * out)
+  {
+    uint16_t k = 0;
+
+    // two blocks at a time
+    for (; k + 2 <= num_blocks; k += 2) {
+      uint32x4_t sa = vdupq_n_u32(0), sb = sa, saa = sa, sbb = sa, sab = sa;
+
+      for (int row = 0; row < 4; row++) {
+        const uint8x8_t va = vld1_u8(a + row * a_stride + 4 * k);
+        const uint8x8_t vb = vld1_u8(b + row * b_stride + 4 * k);
+
+        sa = vpadalq_u16(sa, vmovl_u8(va));
+        sb = vpadalq_u16(sb, vmovl_u8(vb));
+        saa = vpadalq_u16(saa, vmull_u8(va, va));
+        sbb = vpadalq_u16(sbb, vmull_u8(vb, vb));
+        sab = vpadalq_u16(sab, vmull_u8(va, vb));
+      }
+
+      uint32_t lanes[5][4];
+      vst1q_u32(lanes[0], sa);
+      vst1q_u32(lanes[1], sb);
+      vst1q_u32(lanes[2], saa);
+      vst1q_u32(lanes[3], sbb);
+      vst1q_u32(lanes[4], sab);
+      gather_blocks(lanes[0], lanes[1], lanes[2], lanes[3], lanes[4], 2, out + k);
+    }
+
+    block_row_scalar(a + 4 * k, a_stride, b + 4 * k, b_stride,
+                     num_blocks - k, out + k);
+  }
+#endif
+
+  struct Kernels
+  {
+    const char * name;
+    uint64_t (*row_sse)(const uint8_t *, const uint8_t *, const uint16_t);
+    void (*block_row)(const uint8_t *, const int, const uint8_t *, const int,
+                      const uint16_t, BlockSums *);
+  };
+
+  Kernels select_kernels()
+  {
+#if defined(__x86_64__)
+    if (cpu_features().avx2) {
+      return {"avx2", row_sse_avx2, block_row_avx2};
+    }
+    if (cpu_features().sse2) {
+      return {"sse2", row_sse_sse2, block_row_sse2};
+    }
+#elif defined(__aarch64__)
+    if (cpu_features().neon) {
+      return {"neon", row_sse_neon, block_row_neon};
+    }
+#endif
+    return {"scalar", row_sse_scalar, block_row_scalar};
+  }
+
+  const Kernels & kernels()
+  {
+    static const Kernels selected = select_kernels();
+    return selected;
+  }
+
+  // run fn(begin, end) over contiguous bands covering [0, n), on 'pool' if
+  // provided, and return the result of each band
+  template<typename Fn>
+  auto run_bands(ThreadPool * pool, const size_t n, const Fn & fn)
+    -> vector<decltype(fn(size_t(), size_t()))>
+  {
+    // a few bands per thread for balance
+    const size_t num_bands = max<size_t>(1, min(n, pool ? pool->size() * 4 : 1));
+    const size_t band_size = (n + num_bands - 1) / num_bands;
+
+    vector<decltype(fn(size_t(), size_t()))> results(num_bands);
+    const auto run = [&](const size_t band) {
+      results[band] = fn(min(n, band * band_size), min(n, (band + 1) * band_size));
+    };
+
+    if (pool and num_bands > 1) {
+      pool->parallel_for(num_bands, run);
+    } else {
+      for (size_t band = 0; band < num_bands; band++) {
+        run(band);
+      }
+    }
+
+    return results;
+  }
+
+  uint64_t plane_sse(const Plane & a, const Plane & b, ThreadPool * pool)
+  {
+    const auto row_sse = kernels().row_sse;
+
+    uint64_t sse = 0;
+    for (const uint64_t band_sse : run_bands(pool, a.height,
+        [&](const size_t begin, const size_t end) {
+          uint64_t s = 0;
+          for (size_t row = begin; row < end; row++) {
+            s += row_sse(a.data + row * a.stride, b.data + row * b.stride, a.width);
+          }
+          return s;
+        })) {
+      sse += band_sse;
+    }
+
+    return sse;
+  }
+
+  double sse_to_psnr(const uint64_t sse, const uint64_t num_samples)
+  {
+    if (sse == 0) {
+      return FrameQuality::MAX_PSNR;
+    }
+
+    return min(FrameQuality::MAX_PSNR,
+               10 * log10(255.0 * 255.0 * num_samples / sse));
+  }
+
+  // totals of SSIM (luminance * contrast-structure) and contrast-structure
+  // over the windows of a plane
+  struct SSIMSums
+  {
+    double ssim {0};
+    double cs {0};
+    uint64_t num_windows {0};
+
+    double mean_ssim() const { return num_windows ? ssim / num_windows : 1.0; }
+    double mean_cs() const { return num_windows ? cs / num_windows : 1.0; }
+  };
+
+  // an 8x8 window made of four 4x4 blocks
+  void add_window(const BlockSums & s00, const BlockSums & s01,
+                  const BlockSums & s10, const BlockSums & s11, SSIMSums & sums)
+  {
+    const double a = static_cast<double>(s00.a) + s01.a + s10.a + s11.a;
+    const double b = static_cast<double>(s00.b) + s01.b + s10.b + s11.b;
+    const double aa = static_cast<double>(s00.aa) + s01.aa + s10.aa + s11.aa;
+    const double bb = static_cast<double>(s00.bb) + s01.bb + s10.bb + s11.bb;
+    const double ab = static_cast<double>(s00.ab) + s01.ab + s10.ab + s11.ab;
+
+    const double luminance = (2 * a * b + C1) / (a * a + b * b + C1);
+    const double cs = (2 * (WINDOW_SAMPLES * ab - a * b) + C2)
+                      / (WINDOW_SAMPLES * (aa + bb) - a * a - b * b + C2);
+
+    sums.ssim += luminance * cs;
+    sums.cs += cs;
+    sums.num_windows++;
+  }
+
+  SSIMSums plane_ssim(const Plane & a, const Plane & b, ThreadPool * pool)
+  {
+    const uint16_t block_cols = a.width / 4;
+    const uint16_t block_rows = a.height / 4;
+    if (block_cols < 2 or block_rows < 2) {
+      return {}; // no window fits
+    }
+
+    const auto block_row = kernels().block_row;
+
+    // window row i covers block rows i and i + 1
+    const auto band_sums = run_bands(pool, block_rows - 1,
+      [&](const size_t begin, const size_t end) {
+        SSIMSums sums;
+        vector<BlockSums> above(block_cols), below(block_cols);
+
+        block_row(a.data + 4 * begin * a.stride, a.stride,
+                  b.data + 4 * begin * b.stride, b.stride, block_cols, above.data());
+
+        for (size_t i = begin; i < end; i++) {
+          block_row(a.data + 4 * (i + 1) * a.stride, a.stride,
+                    b.data + 4 * (i + 1) * b.stride, b.stride, block_cols, below.data());
+
+          for (uint16_t j = 0; j + 1 < block_cols; j++) {
+            add_window(above[j], above[j + 1], below[j], below[j + 1], sums);
+          }
+
+          swap(above, below);
+        }
+
+        return sums;
+      });
+
+    SSIMSums sums;
+    for (const auto & s : band_sums) {
+      sums.ssim += s.ssim;
+      sums.cs += s.cs;
+      sums.num_windows += s.num_windows;
+    }
+    return sums;
+  }
+
+  // halve a plane by averaging 2x2 blocks into 'dst' (packed rows); 'dst'
+  // may be the source itself as every output precedes its inputs
+  Plane downscale(const Plane & src, uint8_t * dst)
+  {
+    const uint16_t width = src.width / 2;
+    const uint16_t height = src.height / 2;
+
+    for (uint16_t y = 0; y < height; y++) {
+      const uint8_t * row0 = src.data + 2 * y * src.stride;
+      const uint8_t * row1 = row0 + src.stride;
+
+      for (uint16_t x = 0; x < width; x++) {
+        dst[y * width + x] = static_cast<uint8_t>(
+          (row0[2 * x] + row0[2 * x + 1] + row1[2 * x] + row1[2 * x + 1] + 2) >> 2);
+      }
+    }
+
+    return {dst, width, width, height};
+  }
+
+  double percentile(const vector<double> & sorted, const double p)
+  {
+    if (sorted.empty()) {
+      return 0;
+    }
+
+    // nearest rank
+    const size_t rank = static_cast<size_t>(ceil(p / 100 * sorted.size()));
+    return sorted[min(sorted.size() - 1, rank > 0 ? rank - 1 : 0)];
+  }
+}
+
+QualityScorer::QualityScorer(ThreadPool * pool, const bool ms_ssim)
+  : pool_(pool), ms_ssim_(ms_ssim)
+{}
+
+const char * QualityScorer::kernel()
+{
+  return kernels().name;
+}
+
+FrameQuality QualityScorer::score(const RawImage & reference,
+                                  const RawImage & distorted)
+{
+  if (reference.display_width() != distorted.display_width() or
+      reference.display_height() != distorted.display_height()) {
+    throw runtime_error("QualityScorer: image dimensions don't match");
+  }
+
+  const uint16_t width = reference.display_width();
+  const uint16_t height = reference.display_height();
+
+  const Plane ref_y {reference.y_plane(), reference.y_stride(), width, height};
+  const Plane dist_y {distorted.y_plane(), distorted.y_stride(), width, height};
+  const Plane ref_u {reference.u_plane(), reference.u_stride(),
+                     static_cast<uint16_t>(width / 2), static_cast<uint16_t>(height / 2)};
+  const Plane dist_u {distorted.u_plane(), distorted.u_stride(), ref_u.width, ref_u.height};
+  const Plane ref_v {reference.v_plane(), reference.v_stride(), ref_u.width, ref_u.height};
+  const Plane dist_v {distorted.v_plane(), distorted.v_stride(), ref_u.width, ref_u.height};
+
+  FrameQuality quality;
+
+  // PSNR
+  const uint64_t y_samples = static_cast<uint64_t>(width) * height;
+  const uint64_t uv_samples = static_cast<uint64_t>(ref_u.width) * ref_u.height;
+  const uint64_t sse_y = plane_sse(ref_y, dist_y, pool_);
+  const uint64_t sse_u = plane_sse(ref_u, dist_u, pool_);
+  const uint64_t sse_v = plane_sse(ref_v, dist_v, pool_);
+
+  quality.psnr_y = sse_to_psnr(sse_y, y_samples);
+  quality.psnr_u = sse_to_psnr(sse_u, uv_samples);
+  quality.psnr_v = sse_to_psnr(sse_v, uv_samples);
+  quality.psnr = sse_to_psnr(sse_y + sse_u + sse_v, y_samples + 2 * uv_samples);
+
+  // SSIM (the first scale of MS-SSIM)
+  const SSIMSums full = plane_ssim(ref_y, dist_y, pool_);
+  quality.ssim = full.mean_ssim();
+
+  if (not ms_ssim_) {
+    return quality;
+  }
+
+  // scales that still fit at least one window
+  size_t num_scales = 1;
+  while (num_scales < MS_SSIM_SCALES and
+         (width >> num_scales) >= 8 and (height >> num_scales) >= 8) {
+    num_scales++;
+  }
+
+  double weight_sum = 0;
+  for (size_t i = 0; i < num_scales; i++) {
+    weight_sum += MS_SSIM_WEIGHTS[i];
+  }
+
+  scaled_ref_.resize(y_samples / 4);
+  scaled_dist_.resize(y_samples / 4);
+
+  Plane ref = ref_y, dist = dist_y;
+  double ms_ssim = 1.0;
+
+  for (size_t scale = 0; scale < num_scales; scale++) {
+    const SSIMSums sums = scale == 0 ? full : plane_ssim(ref, dist, pool_);
+    const double weight = MS_SSIM_WEIGHTS[scale] / weight_sum;
+
+    // contrast-structure at every scale, and luminance at the coarsest
+    const double term = scale + 1 < num_scales ? sums.mean_cs() : sums.mean_ssim();
+    ms_ssim *= pow(max(term, 0.0), weight);
+
+    if (scale + 1 < num_scales) {
+      ref = downscale(ref, scaled_ref_.data());
+      dist = downscale(dist, scaled_dist_.data());
+    }
+  }
+
+  quality.ms_ssim = ms_ssim;
+  return quality;
+}
+
+string QualitySummary::str(const bool with_ms_ssim) const
+{
+  const auto summarize = [this](const string & name,
+                                double FrameQuality::*metric,
+                                const int precision) {
+    vector<double> values;
+    double total = 0;
+    for (const auto & frame : frames_) {
+      values.push_back(frame.*metric);
+      total += frame.*metric;
+    }
+    sort(values.begin(), values.end());
+
+    const double mean = values.empty() ? 0 : total / values.size();
+    return name + ": mean=" + double_to_string(mean, precision)
+           + " min=" + double_to_string(values.empty() ? 0 : values.front(), precision)
+           + " p1=" + double_to_string(percentile(values, 1), precision)
+           + " p5=" + double_to_string(percentile(values, 5), precision)
+           + " p50=" + double_to_string(percentile(values, 50), precision)
+           + " p95=" + double_to_string(percentile(values, 95), precision) + "\n";
+  };
+
+  return "Frames: " + to_string(frames_.size()) + "\n"
+         + summarize("PSNR (dB)", &FrameQuality::psnr, 2)
+         + summarize("PSNR-Y (dB)", &FrameQuality::psnr_y, 2)
+         + summarize("SSIM", &FrameQuality::ssim, 4)
+         + (with_ms_ssim ? summarize("MS-SSIM", &FrameQuality::ms_ssim, 4) : "");
+}
@@ -0,0 +1,68 @@
+#ifndef QUALITY_HH
+#define QUALITY_HH
+
+#include <cstdint>
+#include <vector>
+#include <string>
+
+#include "image.hh"
+
+class ThreadPool;
+
+// objective quality of a distorted frame against its reference
+struct FrameQuality
+{
+  // PSNR (dB) of each plane, and over all samples (capped at MAX_PSNR)
+  double psnr_y {0}, psnr_u {0}, psnr_v {0}, psnr {0};
+
+  // SSIM and MS-SSIM of luma
+  double ssim {0};
+  double ms_ssim {0};
+
+  static constexpr double MAX_PSNR = 100.0;
+};
+
+// computes PSNR and SSIM over 8x8 windows sliding by 4 pixels, as libvpx
+// does, and MS-SSIM over up to 5 scales (fewer if the frame is too small);
+// the row kernels are vectorized (AVX2, SSE2 or NEON at runtime), and the
+// rows of a frame are split across 'pool' if provided
+class QualityScorer
+{
+public:
+  explicit QualityScorer(ThreadPool * pool = nullptr, const bool ms_ssim = true);
+
+  FrameQuality score(const RawImage & reference, const RawImage & distorted);
+
+  // instruction set the kernels dispatch to
+  static const char * kernel();
+
+  // forbid copying (holds a pointer to the pool)
+  QualityScorer(const QualityScorer & other) = delete;
+  const QualityScorer & operator=(const QualityScorer & other) = delete;
+
+private:
+  ThreadPool * pool_;
+  bool ms_ssim_;
+
+  // downscaled luma for MS-SSIM, reused across frames
+  std::vector<uint8_t> scaled_ref_ {};
+  std::vector<uint8_t> scaled_dist_ {};
+};
+
+// collects per-frame scores and summarizes them
+class QualitySummary
+{
+public:
+  void add(const FrameQuality & quality) { frames_.push_back(quality); }
+
+  size_t size() const { return frames_.size(); }
+
+  // mean, min and percentiles (1st, 5th, 50th, 95th) of PSNR, SSIM and
+  // (if scored) MS-SSIM, one metric per line
+  std::string str(const bool with_ms_ssim = true) const;
+
+private:
+  std::vector<FrameQuality> frames_ {};
+};
+
+#endif /* QUALITY_HH */
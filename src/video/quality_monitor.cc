@@ -0,0 +1,164 @@
+#include <stdexcept>
+
+#include "quality_monitor.hh"
+
+using namespace std;
+
+QualityMonitor::QualityMonitor(const string & source_path,
+                               const uint16_t display_width,
+                               const uint16_t display_height,
+                               const size_t max_pending, const size_t num_threads)
+  : source_(source_path, display_width, display_height, true),
+    source_img_(display_width, display_height),
+    pool_(display_width, display_height, max_pending + 1),
+    max_pending_(max_pending), scorers_(num_threads), scorer_(&scorers_)
+{
+  if (max_pending == 0) {
+    throw runtime_error("QualityMonitor: max_pending must be positive");
+  }
+
+  worker_ = thread(&QualityMonitor::worker_main, this);
+}
+
+QualityMonitor::~QualityMonitor()
+{
+  {
+    lock_guard<mutex> lock(mtx_);
+    stop_ = true;
+  }
+  cv_.notify_one();
+
+  if (worker_.joinable()) {
+    worker_.join();
+  }
+}
+
+bool QualityMonitor::submit(const RawImage & img, const uint32_t frame_id)
+{
+  if (img.display_width() != pool_.display_width() or
+      img.display_height() != pool_.display_height()) {
+    throw runtime_error("QualityMonitor: frame dimensions don't match");
+  }
+
+  account(frame_id);
+
+  {
+    lock_guard<mutex> lock(mtx_);
+
+    if (error_) {
+      exception_ptr error = error_;
+      error_ = nullptr;
+      rethrow_exception(error);
+    }
+
+    if (queue_.size() >= max_pending_) {
+      num_dropped_++;
+      return false;
+    }
+  }
+
+  PooledImage copy = pool_.acquire();
+  copy->copy_from(img);
+
+  {
+    lock_guard<mutex> lock(mtx_);
+    queue_.push_back({frame_id, move(copy)});
+  }
+  cv_.notify_one();
+
+  return true;
+}
+
+void QualityMonitor::repeat(const uint32_t frame_id)
+{
+  account(frame_id);
+}
+
+void QualityMonitor::account(const uint32_t frame_id)
+{
+  if (frame_id < next_frame_id_) {
+    return; // out of order, which the scoring thread rejects
+  }
+
+  num_missing_ += frame_id - next_frame_id_;
+  next_frame_id_ = static_cast<uint64_t>(frame_id) + 1;
+}
+
+QualityMonitor::Interval QualityMonitor::take_interval()
+{
+  lock_guard<mutex> lock(mtx_);
+
+  Interval interval = interval_;
+  if (interval.num_frames > 0) {
+    interval.avg_psnr /= interval.num_frames;
+    interval.avg_ssim /= interval.num_frames;
+  }
+
+  interval_ = Interval();
+  return interval;
+}
+
+void QualityMonitor::flush()
+{
+  unique_lock<mutex> lock(mtx_);
+  idle_cv_.wait(lock, [this] { return queue_.empty() and not busy_; });
+}
+
+string QualityMonitor::summary() const
+{
+  lock_guard<mutex> lock(mtx_);
+  return summary_.str();
+}
+
+void QualityMonitor::worker_main()
+{
+  while (true) {
+    Job job;
+
+    {
+      unique_lock<mutex> lock(mtx_);
+      cv_.wait(lock, [this] { return stop_ or not queue_.empty(); });
+
+      if (queue_.empty()) { // stop_ must be true
+        return;
+      }
+
+      job = move(queue_.front());
+      queue_.pop_front();
+      busy_ = true;
+    }
+
+    try {
+      if (job.frame_id < next_source_id_) {
+        throw runtime_error("QualityMonitor: frame IDs must increase");
+      }
+
+      // the source frame this one was encoded from
+      while (next_source_id_ <= job.frame_id) {
+        source_.read_frame(source_img_);
+        next_source_id_++;
+      }
+
+      const FrameQuality quality = scorer_.score(source_img_, *job.img);
+      job.img.reset();
+
+      lock_guard<mutex> lock(mtx_);
+      interval_.num_frames++;
+      interval_.avg_psnr += quality.psnr; // sums until taken
+      interval_.avg_ssim += quality.ssim;
+      summary_.add(quality);
+      num_scored_++;
+    } catch (...) {
+      lock_guard<mutex> lock(mtx_);
+      if (not error_) {
+        error_ = current_exception();
+      }
+    }
+
+    {
+      lock_guard<mutex> lock(mtx_);
+      busy_ = false;
+    }
+    idle_cv_.notify_all();
+  }
+}
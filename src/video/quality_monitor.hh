@@ -0,0 +1,115 @@
+#ifndef QUALITY_MONITOR_HH
+#define QUALITY_MONITOR_HH
+
+#include <cstdint>
+#include <string>
+#include <deque>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <exception>
+
+#include "image.hh"
+#include "frame_pool.hh"
+#include "thread_pool.hh"
+#include "yuv4mpeg.hh"
+#include "quality.hh"
+
+// scores decoded frames live against a local copy of the source on a
+// background thread: submit() only copies the frame (or drops it if
+// 'max_pending' frames are queued), and the scoring thread reads the source
+// up to the frame's ID (looping over it as the sender does) and scores it
+// with the rows split across a ThreadPool; a frame ID that is neither
+// submitted nor repeated (e.g., a frame never decoded) is counted as missing
+class QualityMonitor
+{
+public:
+  QualityMonitor(const std::string & source_path,
+                 const uint16_t display_width, const uint16_t display_height,
+                 const size_t max_pending = 2, const size_t num_threads = 0);
+
+  // scores the frames still queued
+  ~QualityMonitor();
+
+  // queue decoded frame 'frame_id' to be scored (frame IDs must increase);
+  // returns false if it was dropped, and throws if scoring failed
+  bool submit(const RawImage & img, const uint32_t frame_id);
+
+  // account for frame 'frame_id' being a repeat of the previous one (not
+  // scored, but not missing either)
+  void repeat(const uint32_t frame_id);
+
+  // frames scored since the last call and their average PSNR and SSIM
+  struct Interval
+  {
+    unsigned int num_frames {0};
+    double avg_psnr {0};
+    double avg_ssim {0};
+  };
+  Interval take_interval();
+
+  // wait until the queued frames are scored
+  void flush();
+
+  // summary of all the frames scored so far
+  std::string summary() const;
+
+  // stats
+  uint64_t num_scored() const { return num_scored_.load(); }
+  uint64_t num_dropped() const { return num_dropped_.load(); }
+  uint64_t num_missing() const { return num_missing_.load(); }
+
+  // forbid copying and moving
+  QualityMonitor(const QualityMonitor & other) = delete;
+  const QualityMonitor & operator=(const QualityMonitor & other) = delete;
+  QualityMonitor(QualityMonitor && other) = delete;
+  QualityMonitor & operator=(QualityMonitor && other) = delete;
+
+private:
+  struct Job
+  {
+    uint32_t frame_id {};
+    PooledImage img {};
+  };
+
+  // used by the scoring thread only
+  YUV4MPEG source_;
+  RawImage source_img_;
+  uint64_t next_source_id_ {0}; // ID of the next source frame to read
+
+  // the next frame ID expected (used by the submitting thread only)
+  uint64_t next_frame_id_ {0};
+
+  // a buffer for each queued frame plus the one being scored
+  FramePool pool_;
+  size_t max_pending_;
+
+  ThreadPool scorers_;
+  QualityScorer scorer_;
+
+  mutable std::mutex mtx_ {};
+  std::condition_variable cv_ {};
+  std::condition_variable idle_cv_ {};
+  std::deque<Job> queue_ {};
+  bool busy_ {false}; // a frame is being scored
+  std::exception_ptr error_ {};
+  bool stop_ {false};
+
+  // guarded by mtx_
+  Interval interval_ {};
+  QualitySummary summary_ {};
+
+  std::atomic<uint64_t> num_scored_ {0};
+  std::atomic<uint64_t> num_dropped_ {0};
+  std::atomic<uint64_t> num_missing_ {0};
+
+  // count the frame IDs skipped before 'frame_id' as missing
+  void account(const uint32_t frame_id);
+
+  std::thread worker_ {};
+
+  void worker_main();
+};
+
+#endif /* QUALITY_MONITOR_HH */
@@ -0,0 +1,166 @@
+#include <getopt.h>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <memory>
+#include <chrono>
+
+#include "yuv4mpeg.hh"
+#include "y4m_recorder.hh"
+#include "quality.hh"
+#include "thread_pool.hh"
+#include "conversion.hh"
+
+using namespace std;
+using namespace std::chrono;
+
+void print_usage(const string & program_name)
+{
+  cerr <<
+  "Usage: " << program_name << " [options] width height source.y4m recording.y4m\n\n"
+  "Score each frame of a recording (e.g., made with --record) against the\n"
+  "source frame of the same frame ID (or index if untagged), looping over\n"
+  "the source as the sender does. Per-frame scores are output as CSV and a\n"
+  "summary is printed at the end. A recording made with --record has a frame\n"
+  "for every frame ID, so a frame ID skipped (which would leave the frames\n"
+  "scored against possibly misaligned source frames) is warned about.\n\n"
+  "Options:\n"
+  "-o, --output <file>     file to output per-frame CSV to (default: stdout)\n"
+  "-j, --threads <n>       threads to score each frame with (default: all CPUs)\n"
+  "--no-ms-ssim            skip MS-SSIM\n"
+  "--strict                fail on a skipped frame ID instead"
+  << endl;
+}
+
+int main(int argc, char * argv[])
+{
+  string output_path;
+  size_t num_threads = 0;
+  bool ms_ssim = true;
+  bool strict = false;
+
+  const option cmd_line_opts[] = {
+    {"output",     required_argument, nullptr, 'o'},
+    {"threads",    required_argument, nullptr, 'j'},
+    {"no-ms-ssim", no_argument,       nullptr, 'M'},
+    {"strict",     no_argument,       nullptr, 'S'},
+    { nullptr,     0,                 nullptr,  0 },
+  };
+
+  while (true) {
+    const int opt = getopt_long(argc, argv, "o:j:", cmd_line_opts, nullptr);
+    if (opt == -1) {
+      break;
+    }
+
+    switch (opt) {
+      case 'o':
+        output_path = optarg;
+        break;
+      case 'j':
+        num_threads = strict_stoi(optarg);
+        break;
+      case 'M':
+        ms_ssim = false;
+        break;
+      case 'S':
+        strict = true;
+        break;
+      default:
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+
+  if (optind != argc - 4) {
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  const auto width = narrow_cast<uint16_t>(strict_stoi(argv[optind]));
+  const auto height = narrow_cast<uint16_t>(strict_stoi(argv[optind + 1]));
+
+  YUV4MPEG source(argv[optind + 2], width, height, true);
+  YUV4MPEG recording(argv[optind + 3], width, height, false);
+
+  ofstream output_file;
+  if (not output_path.empty()) {
+    output_file.open(output_path);
+    if (not output_file) {
+      throw runtime_error("failed to open " + output_path);
+    }
+  }
+  ostream & output = output_path.empty() ? cout : output_file;
+
+  unique_ptr<ThreadPool> pool;
+  if (num_threads != 1) {
+    pool = make_unique<ThreadPool>(num_threads);
+  }
+  QualityScorer scorer(pool.get(), ms_ssim);
+  QualitySummary summary;
+
+  cerr << "Kernel: " << QualityScorer::kernel() << ", threads: "
+       << (pool ? pool->size() : 1) << endl;
+
+  RawImage source_img(width, height);
+  RawImage recorded_img(width, height);
+  uint64_t next_source_id = 0; // ID of the next source frame to read
+  uint64_t num_skipped = 0;    // frame IDs skipped by a tagged recording
+
+  output << "frame_id,psnr_y,psnr_u,psnr_v,psnr,ssim,ms_ssim\n";
+
+  const auto start = steady_clock::now();
+
+  for (uint64_t index = 0; recording.read_frame(recorded_img); index++) {
+    const uint64_t frame_id = y4m_frame_id(recording.frame_header()).value_or(index);
+
+    if (frame_id < next_source_id) {
+      throw runtime_error("frame IDs must increase (frame ID "
+                          + to_string(frame_id) + " after "
+                          + to_string(next_source_id - 1) + ")");
+    }
+
+    // the recorder fills any gap with repeats, so a gap means frames went
+    // missing from the recording (or it was not made by Y4MRecorder)
+    if (frame_id > next_source_id) {
+      const string gap = "frame IDs " + to_string(next_source_id) + " to "
+                         + to_string(frame_id - 1) + " are missing from the recording";
+      if (strict) {
+        throw runtime_error(gap);
+      }
+
+      if (num_skipped == 0) {
+        cerr << "Warning: " << gap << " (further gaps are only counted)" << endl;
+      }
+      num_skipped += frame_id - next_source_id;
+    }
+
+    while (next_source_id <= frame_id) {
+      source.read_frame(source_img);
+      next_source_id++;
+    }
+
+    const FrameQuality q = scorer.score(source_img, recorded_img);
+    summary.add(q);
+
+    output << frame_id << "," << double_to_string(q.psnr_y, 3) << ","
+           << double_to_string(q.psnr_u, 3) << ","
+           << double_to_string(q.psnr_v, 3) << ","
+           << double_to_string(q.psnr, 3) << ","
+           << double_to_string(q.ssim, 5) << ","
+           << (ms_ssim ? double_to_string(q.ms_ssim, 5) : "") << "\n";
+  }
+
+  const double elapsed_s = duration<double>(steady_clock::now() - start).count();
+
+  if (num_skipped > 0) {
+    cerr << "Warning: " << num_skipped << " frame IDs were missing from the recording"
+         << endl;
+  }
+
+  cerr << summary.str(ms_ssim) << "Scored in " << double_to_string(elapsed_s)
+       << " s (" << double_to_string(summary.size() / elapsed_s) << " frames/s)"
+       << endl;
+
+  return EXIT_SUCCESS;
+}
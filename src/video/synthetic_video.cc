@@ -0,0 +1,466 @@
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include "synthetic_video.hh"
+#include "cpu_features.hh"
+#include "conversion.hh"
+#include "split.hh"
+
+using namespace std;
+
+namespace {
+  // noise comes from 8 xorshift32 generators, each yielding 4 bytes per
+  // step; every kernel below keeps this exact layout so that the output
+  // does not depend on the instruction set
+  constexpr unsigned int NOISE_LANES = 8;
+  constexpr unsigned int NOISE_STEP = 4 * NOISE_LANES; // pixels
+
+  // murmur3's finalizer
+  uint32_t mix32(uint32_t x)
+  {
+    x ^= x >> 16;
+    x *= 0x85EBCA6B;
+    x ^= x >> 13;
+    x *= 0xC2B2AE35;
+    x ^= x >> 16;
+    return x;
+  }
+
+  void seed_noise(uint32_t state[NOISE_LANES], const uint32_t key)
+  {
+    for (unsigned int lane = 0; lane < NOISE_LANES; lane++) {
+      state[lane] = mix32(key + lane * 0x9E3779B9);
+      if (state[lane] == 0) {
+        state[lane] = 1; // xorshift is stuck at zero
+      }
+    }
+  }
+
+  // a row of the pattern ((x0 + i) << shift) ^ row_value, plus noise within
+  // [-noise_mask / 2, noise_mask / 2] if noise_mask is nonzero
+  void pattern_row_scalar(uint8_t * dst, const uint16_t width,
+                          const uint8_t x0, const uint8_t row_value,
+                          const unsigned int shift, uint32_t state[NOISE_LANES],
+                          const uint8_t noise_mask)
+  {
+    uint8_t noise[NOISE_STEP];
+
+    for (uint16_t i = 0; i < width; i++) {
+      if (noise_mask and i % NOISE_STEP == 0) {
+        for (unsigned int lane = 0; lane < NOISE_LANES; lane++) {
+          uint32_t x = state[lane];
+          x ^= x << 13;
+          x ^= x >> 17;
+          x ^= x << 5;
+          state[lane] = x;
+
+          // little-endian, as stored by the vector kernels
+          for (unsigned int b = 0; b < 4; b++) {
+            noise[4 * lane + b] = static_cast<uint8_t>(x >> (8 * b));
+          }
+        }
+      }
+
+      int pixel = static_cast<uint8_t>((x0 + i) << shift) ^ row_value;
+
+      if (noise_mask) {
+        // same saturating arithmetic as the vector kernels
+        pixel = min(pixel + (noise[i % NOISE_STEP] & noise_mask), 255);
+        pixel = max(pixel - (noise_mask >> 1), 0);
+      }
+
+      dst[i] = static_cast<uint8_t>(pixel);
+    }
+  }
+
+  // pattern bytes of the first NOISE_STEP pixels, and their increment for
+  // each following NOISE_STEP pixels (wrapping around like the pattern)
+  void pattern_start(uint8_t start[NOISE_STEP], const uint8_t x0,
+                     const unsigned int shift)
+  {
+    for (unsigned int i = 0; i < NOISE_STEP; i++) {
+      start[i] = static_cast<uint8_t>((x0 + i) << shift);
+    }
+  }
+
+  uint8_t pattern_step(const unsigned int shift)
+  {
+    return static_cast<uint8_t>(NOISE_STEP << shift);
+  }
+
+#if defined(__x86_64__)
+  __attribute__((target("sse2")))
+  inline __m128i xorshift_sse2(__m128i x)
+  {
+    x = _mm_xor_si128(x, _mm_slli_epi32(x, 13));
+    x = _mm_xor_si128(x, _mm_srli_epi32(x, 17));
+    return _mm_xor_si128(x, _mm_slli_epi32(x, 5));
+  }
+
+  __attribute__((target("sse2")))
+  void pattern_row_sse2(uint8_t * dst, const uint16_t width,
+                        const uint8_t x0, const uint8_t row_value,
+                        const unsigned int shift, uint32_t state[NOISE_LANES],
+                        const uint8_t noise_mask)
+  {
+    uint8_t start[NOISE_STEP];
+    pattern_start(start, x0, shift);
+
+    __m128i base0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(start));
+    __m128i base1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(start + 16));
+    const __m128i step = _mm_set1_epi8(static_cast<char>(pattern_step(shift)));
+    const __m128i row = _mm_set1_epi8(static_cast<char>(row_value));
+    const __m128i mask = _mm_set1_epi8(static_cast<char>(noise_mask));
+    const __m128i half = _mm_set1_epi8(static_cast<char>(noise_mask >> 1));
+
+    __m128i s0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(state));
+    __m128i s1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(state + 4));
+
+    uint16_t i = 0;
+    for (; i + NOISE_STEP <= width; i += NOISE_STEP) {
+      __m128i p0 = _mm_xor_si128(base0, row);
+      __m128i p1 = _mm_xor_si128(base1, row);
+
+      if (noise_mask) {
+        s0 = xorshift_sse2(s0);
+        s1 = xorshift_sse2(s1);
+        p0 = _mm_subs_epu8(_mm_adds_epu8(p0, _mm_and_si128(s0, mask)), half);
+        p1 = _mm_subs_epu8(_mm_adds_epu8(p1, _mm_and_si128(s1, mask)), half);
+      }
+
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), p0);
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i + 16), p1);
+
+      base0 = _mm_add_epi8(base0, step);
+      base1 = _mm_add_epi8(base1, step);
+    }
+
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(state), s0);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(state + 4), s1);
+
+    pattern_row_scalar(dst + i, width - i, static_cast<uint8_t>(x0 + i),
+                       row_value, shift, state, noise_mask);
+  }
+
+  __attribute__((target("avx2")))
+  void pattern_row_avx2(uint8_t * dst, const uint16_t width,
+                        const uint8_t x0, const uint8_t row_value,
+                        const unsigned int shift, uint32_t state[NOISE_LANES],
+                        const uint8_t noise_mask)
+  {
+    uint8_t start[NOISE_STEP];
+    pattern_start(start, x0, shift);
+
+    __m256i base = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(start));
+    const __m256i step = _mm256_set1_epi8(static_cast<char>(pattern_step(shift)));
+    const __m256i row = _mm256_set1_epi8(static_cast<char>(row_value));
+    const __m256i mask = _mm256_set1_epi8(static_cast<char>(noise_mask));
+    const __m256i half = _mm256_set1_epi8(static_cast<char>(noise_mask >> 1));
+
+    __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(state));
+
+    uint16_t i = 0;
+    for (; i + NOISE_STEP <= width; i += NOISE_STEP) {
+      __m256i p = _mm256_xor_si256(base, row);
+
+      if (noise_mask) {
+        s = _mm256_xor_si256(s, _mm256_slli_epi32(s, 13));
+        s = _mm256_xor_si256(s, _mm256_srli_epi32(s, 17));
+        s = _mm256_xor_si256(s, _mm256_slli_epi32(s, 5));
+        p = _mm256_subs_epu8(_mm256_adds_epu8(p, _mm256_and_si256(s, mask)), half);
+      }
+
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), p);
+      base = _mm256_add_epi8(base, step);
+    }
+
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(state), s);
+
+    pattern_row_scalar(dst + i, width - i, static_cast<uint8_t>(x0 + i),
+                       row_value, shift, state, noise_mask);
+  }
+#elif defined(__aarch64__)
+  inline uint32x4_t xorshift_neon(uint32x4_t x)
+  {
+    x = veorq_u32(x, vshlq_n_u32(x, 13));
+    x = veorq_u32(x, vshrq_n_u32(x, 17));
+    return veorq_u32(x, vshlq_n_u32(x, 5));
+  }
+
+  void pattern_row_neon(uint8_t * dst, const uint16_t width,
+                        const uint8_t x0, const uint8_t row_value,
+                        const unsigned int shift, uint32_t state[NOISE_LANES],
+                        const uint8_t noise_mask)
+  {
+    uint8_t start[NOISE_STEP];
+    pattern_start(start, x0, shift);
+
+    uint8x16_t base0 = vld1q_u8(start);
+    uint8x16_t base1 = vld1q_u8(start + 16);
+    const uint8x16_t step = vdupq_n_u8(pattern_step(shift));
+    const uint8x16_t row = vdupq_n_u8(row_value);
+    const uint8x16_t mask = vdupq_n_u8(noise_mask);
+    const uint8x16_t half = vdupq_n_u8(noise_mask >> 1);
+
+    uint32x4_t s0 = vld1q_u32(state);
+    uint32x4_t s1 = vld1q_u32(state + 4);
+
+    uint16_t i = 0;
+    for (; i + NOISE_STEP <= width; i += NOISE_STEP) {
+      uint8x16_t p0 = veorq_u8(base0, row);
+      uint8x16_t p1 = veorq_u8(base1, row);
+
+      if (noise_mask) {
+        s0 = xorshift_neon(s0);
+        s1 = xorshift_neon(s1);
+        p0 = vqsubq_u8(vqaddq_u8(p0, vandq_u8(vreinterpretq_u8_u32(s0), mask)), half);
+        p1 = vqsubq_u8(vqaddq_u8(p1, vandq_u8(vreinterpretq_u8_u32(s1), mask)), half);
+      }
+
+      vst1q_u8(dst + i, p0);
+      vst1q_u8(dst + i + 16, p1);
+
+      base0 = vaddq_u8(base0, step);
+      base1 = vaddq_u8(base1, step);
+    }
+
+    vst1q_u32(state, s0);
+    vst1q_u32(state + 4, s1);
+
+    pattern_row_scalar(dst + i, width - i, static_cast<uint8_t>(x0 + i),
+                       row_value, shift, state, noise_mask);
+  }
+#endif
+
+  using PatternRow = void (*)(uint8_t *, const uint16_t, const uint8_t,
+                              const uint8_t, const unsigned int, uint32_t *,
+                              const uint8_t);
+
+  PatternRow select_pattern_row()
+  {
+#if defined(__x86_64__)
+    if (cpu_features().avx2) {
+      return pattern_row_avx2;
+    }
+    if (cpu_features().sse2) {
+      return pattern_row_sse2;
+    }
+#elif defined(__aarch64__)
+    if (cpu_features().neon) {
+      return pattern_row_neon;
+    }
+#endif
+    return pattern_row_scalar;
+  }
+
+  // a 5x7 bitmap font (one byte per row, most significant of 5 bits on the
+  // left) covering the banner text
+  struct Glyph
+  {
+    char c;
+    uint8_t rows[7];
+  };
+
+  constexpr Glyph FONT[] = {
+    {'0', {0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E}},
+    {'1', {0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E}},
+    {'2', {0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F}},
+    {'3', {0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E}},
+    {'4', {0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02}},
+    {'5', {0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E}},
+    {'6', {0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E}},
+    {'7', {0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08}},
+    {'8', {0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E}},
+    {'9', {0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C}},
+    {'A', {0x0E, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11}},
+    {'C', {0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E}},
+    {'E', {0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F}},
+    {'F', {0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10}},
+    {'G', {0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F}},
+    {'H', {0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11}},
+    {'I', {0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E}},
+    {'M', {0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11}},
+    {'N', {0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11}},
+    {'R', {0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11}},
+    {'S', {0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E}},
+    {'T', {0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04}},
+    {'Y', {0x11, 0x11, 0x0A, 0x04, 0x04, 0x04, 0x04}},
+  };
+
+  const Glyph * find_glyph(const char c)
+  {
+    for (const auto & glyph : FONT) {
+      if (glyph.c == c) {
+        return &glyph;
+      }
+    }
+    return nullptr; // drawn as a space
+  }
+}
+
+SyntheticVideoConfig SyntheticVideoConfig::parse(const string & options)
+{
+  SyntheticVideoConfig config;
+
+  for (const auto & option : split(options, ",")) {
+    if (option.empty()) {
+      continue;
+    }
+
+    const auto pos = option.find('=');
+    if (pos == string::npos) {
+      throw runtime_error("SyntheticVideo: expected key=value but got " + option);
+    }
+
+    const string key = option.substr(0, pos);
+    const string value = option.substr(pos + 1);
+
+    if (key == "complexity") {
+      config.complexity = stod(value);
+    } else if (key == "scene") {
+      config.scene_length = strict_stoi(value);
+    } else if (key == "speed") {
+      config.speed = strict_stoi(value);
+    } else if (key == "text") {
+      config.text = strict_stoi(value) != 0;
+    } else if (key == "seed") {
+      config.seed = strict_stoi(value);
+    } else if (key == "frames") {
+      config.num_frames = strict_stoll(value);
+    } else {
+      throw runtime_error("SyntheticVideo: unknown option " + key);
+    }
+  }
+
+  return config;
+}
+
+SyntheticVideo::SyntheticVideo(const uint16_t display_width,
+                               const uint16_t display_height,
+                               const SyntheticVideoConfig & config)
+  : display_width_(display_width), display_height_(display_height),
+    config_(config), detail_shift_(), noise_mask_()
+{
+  if (config.complexity < 0 or config.complexity > 1) {
+    throw runtime_error("SyntheticVideo: complexity must be within [0, 1]");
+  }
+
+  // finer XOR pattern (more edges) and up to +-32 of noise as complexity grows
+  detail_shift_ = lround(config.complexity * 3);
+  noise_mask_ = static_cast<uint8_t>((1u << lround(config.complexity * 6)) - 1);
+}
+
+bool SyntheticVideo::read_frame(RawImage & raw_img)
+{
+  if (config_.num_frames and frame_num_ >= config_.num_frames) {
+    return false;
+  }
+
+  generate_frame(frame_num_++, raw_img);
+  return true;
+}
+
+void SyntheticVideo::generate_frame(const uint64_t frame_num,
+                                    RawImage & raw_img) const
+{
+  static const PatternRow pattern_row = select_pattern_row();
+
+  if (raw_img.display_width() != display_width_ or
+      raw_img.display_height() != display_height_) {
+    throw runtime_error("SyntheticVideo: image dimensions don't match");
+  }
+
+  // each scene has its own pattern position, motion and colors
+  const uint64_t scene = config_.scene_length ? frame_num / config_.scene_length : 0;
+  const uint64_t t = frame_num - scene * config_.scene_length;
+  const uint32_t scene_key = mix32(config_.seed ^ mix32(static_cast<uint32_t>(scene) + 1));
+
+  const int64_t dx = (scene_key & 1) ? config_.speed : -static_cast<int64_t>(config_.speed);
+  const int64_t dy = (scene_key & 2) ? config_.speed / 2 : -static_cast<int64_t>(config_.speed / 2);
+  const auto ox = static_cast<uint8_t>((scene_key >> 8) + dx * static_cast<int64_t>(t));
+  const auto oy = static_cast<uint8_t>((scene_key >> 16) + dy * static_cast<int64_t>(t));
+
+  const uint32_t frame_key = mix32(config_.seed ^ static_cast<uint32_t>(frame_num * 0x9E3779B9));
+  uint32_t state[NOISE_LANES];
+
+  // luma: pattern plus noise
+  for (uint16_t row = 0; row < display_height_; row++) {
+    seed_noise(state, frame_key ^ (row * 0x85EBCA6B));
+    pattern_row(raw_img.y_plane() + row * raw_img.y_stride(), display_width_,
+                ox, static_cast<uint8_t>((oy + row) << detail_shift_),
+                detail_shift_, state, noise_mask_);
+  }
+
+  // chroma: a coarser noiseless pattern tinted by the scene
+  const auto u_tint = static_cast<uint8_t>(scene_key >> 24);
+  const auto v_tint = static_cast<uint8_t>(scene_key >> 4);
+  for (uint16_t row = 0; row < display_height_ / 2; row++) {
+    const auto row_value = static_cast<uint8_t>((oy / 2 + row) << detail_shift_);
+    pattern_row(raw_img.u_plane() + row * raw_img.u_stride(), display_width_ / 2,
+                ox / 2, row_value ^ u_tint, detail_shift_, state, 0);
+    pattern_row(raw_img.v_plane() + row * raw_img.v_stride(), display_width_ / 2,
+                static_cast<uint8_t>(ox / 2 + 64), row_value ^ v_tint, detail_shift_, state, 0);
+  }
+
+  if (config_.text) {
+    draw_banner(frame_num, raw_img);
+  }
+}
+
+void SyntheticVideo::draw_banner(const uint64_t frame_num, RawImage & raw_img) const
+{
+  string frame_str = to_string(frame_num);
+  frame_str = string(frame_str.size() < 6 ? 6 - frame_str.size() : 0, '0') + frame_str;
+  const string text = "RINGMASTER SYNTHETIC FRAME " + frame_str;
+
+  // glyphs of 5x7 cells with a cell of spacing, scaled with the frame
+  const int scale = max(1, display_height_ / 90);
+  const int advance = 6 * scale;
+  const int band_height = 9 * scale;
+  const int band_top = display_height_ - band_height - scale;
+  if (band_top < 0) {
+    return;
+  }
+
+  // a dark band with neutral chroma across the frame
+  for (int row = band_top; row < band_top + band_height; row++) {
+    memset(raw_img.y_plane() + row * raw_img.y_stride(), 16, display_width_);
+  }
+  for (int row = band_top / 2; row < (band_top + band_height + 1) / 2; row++) {
+    memset(raw_img.u_plane() + row * raw_img.u_stride(), 128, display_width_ / 2);
+    memset(raw_img.v_plane() + row * raw_img.v_stride(), 128, display_width_ / 2);
+  }
+
+  // scroll from right to left, wrapping around (starting at the left edge)
+  const int text_width = text.size() * advance;
+  const uint64_t span = display_width_ + text_width;
+  const int left = display_width_ - static_cast<int>(
+    (frame_num * 2 * scale + display_width_) % span);
+
+  for (size_t k = 0; k < text.size(); k++) {
+    const Glyph * glyph = find_glyph(text[k]);
+    const int glyph_left = left + static_cast<int>(k) * advance;
+    if (not glyph or glyph_left + advance <= 0 or glyph_left >= display_width_) {
+      continue;
+    }
+
+    for (int gy = 0; gy < 7 * scale; gy++) {
+      uint8_t * dst = raw_img.y_plane() + (band_top + scale + gy) * raw_img.y_stride();
+      const uint8_t bits = glyph->rows[gy / scale];
+
+      for (int gx = 0; gx < 5 * scale; gx++) {
+        const int x = glyph_left + gx;
+        if (x >= 0 and x < display_width_ and (bits & (0x10 >> (gx / scale)))) {
+          dst[x] = 235;
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,69 @@
+#ifndef SYNTHETIC_VIDEO_HH
+#define SYNTHETIC_VIDEO_HH
+
+#include <cstdint>
+#include <string>
+
+#include "video_input.hh"
+
+struct SyntheticVideoConfig
+{
+  // 0: smooth moving pattern; 1: fine detail and heavy noise
+  double complexity {0.5};
+
+  // frames between scene cuts (0: a single scene)
+  unsigned int scene_length {300};
+
+  // pixels per frame the pattern moves by
+  unsigned int speed {4};
+
+  // overlay a scrolling banner with the frame number
+  bool text {true};
+
+  uint32_t seed {1};
+
+  // frames before read_frame() reports the end (0: endless)
+  uint64_t num_frames {0};
+
+  // parse comma-separated "key=value" options, e.g., "complexity=0.8,
+  // scene=120,speed=8,text=0,seed=3,frames=600"
+  static SyntheticVideoConfig parse(const std::string & options);
+};
+
+// generates frames procedurally (no disk I/O): a moving XOR pattern plus
+// noise, whose detail and amplitude follow the complexity, with a scene cut
+// (new pattern, motion, colors and noise) every scene_length frames; rows
+// are generated with SIMD where available, and the output only depends on
+// the configuration and the frame number, on any CPU
+class SyntheticVideo : public VideoInput
+{
+public:
+  SyntheticVideo(const uint16_t display_width, const uint16_t display_height,
+                 const SyntheticVideoConfig & config = SyntheticVideoConfig());
+
+  uint16_t display_width() const override { return display_width_; }
+  uint16_t display_height() const override { return display_height_; }
+
+  // generate the next frame into raw_img
+  bool read_frame(RawImage & raw_img) override;
+
+  // generate frame 'frame_num' into raw_img
+  void generate_frame(const uint64_t frame_num, RawImage & raw_img) const;
+
+  uint64_t frame_num() const { return frame_num_; }
+
+private:
+  uint16_t display_width_;
+  uint16_t display_height_;
+  SyntheticVideoConfig config_;
+
+  // derived from the complexity
+  unsigned int detail_shift_;
+  uint8_t noise_mask_;
+
+  uint64_t frame_num_ {0};
+
+  void draw_banner(const uint64_t frame_num, RawImage & raw_img) const;
+};
+
+#endif /* SYNTHETIC_VIDEO_HH */
@@ -2,6 +2,7 @@
 #include <cassert>
 #include <cstring>
 #include <iostream>
+#include <algorithm>
 
 #include "v4l2.hh"
 #include "exception.hh"
@@ -28,15 +29,17 @@ VideoDevice::VideoDevice(const string & video_device_path,
   }
 
   // set pixel format and resolution
+  pixel_format_ = negotiate_pixel_format();
+
   v4l2_format fmt {};
   fmt.type = buffer_type;
-  fmt.fmt.pix.pixelformat = pixel_format;
+  fmt.fmt.pix.pixelformat = pixel_format_;
   fmt.fmt.pix.width = display_width;
   fmt.fmt.pix.height = display_height;
   check_syscall(ioctl(fd_.fd_num(), VIDIOC_S_FMT, &fmt));
 
-  if (fmt.fmt.pix.pixelformat != pixel_format) {
-    throw runtime_error("cannot set pixel format to be YUYV");
+  if (fmt.fmt.pix.pixelformat != pixel_format_) {
+    throw runtime_error("cannot set pixel format to be " + pixel_format_name());
   }
 
   if (fmt.fmt.pix.width != display_width or
@@ -44,6 +47,15 @@ VideoDevice::VideoDevice(const string & video_device_path,
     throw runtime_error("cannot set video resolution as specified");
   }
 
+  bytes_per_line_ = fmt.fmt.pix.bytesperline;
+  if (pixel_format_ == V4L2_PIX_FMT_YUV420 and bytes_per_line_ % 2) {
+    throw runtime_error("unsupported YUV420 line padding");
+  }
+
+  if (pixel_format_ != V4L2_PIX_FMT_YUV420) {
+    converted_img_ = make_unique<RawImage>(display_width_, display_height_);
+  }
+
   // inform the device about the buffers about to be allocated
   v4l2_requestbuffers buf_req {};
   buf_req.type = buffer_type;
@@ -71,6 +83,10 @@ VideoDevice::VideoDevice(const string & video_device_path,
       buf_info_.length, PROT_READ | PROT_WRITE, MAP_SHARED,
       fd_.fd_num(), buf_info_.m.offset);
 
+    if (pixel_format_ == V4L2_PIX_FMT_YUV420) {
+      add_buffer_view(buf_mem_.back().addr());
+    }
+
     // enqueue buffer
     check_syscall(ioctl(fd_.fd_num(), VIDIOC_QBUF, &buf_info_));
   }
@@ -91,33 +107,163 @@ void VideoDevice::set_blocking(const bool blocking)
   fd_.set_blocking(blocking);
 }
 
-bool VideoDevice::read_frame(RawImage & raw_img)
+uint32_t VideoDevice::negotiate_pixel_format() const
 {
-  if (raw_img.display_width() != display_width_ or
-      raw_img.display_height() != display_height_) {
-    throw runtime_error("VideoDevice: image dimensions don't match");
+  // enumerate the formats supported by the device
+  vector<uint32_t> supported;
+
+  v4l2_fmtdesc desc {};
+  desc.type = buffer_type;
+  while (ioctl(fd_.fd_num(), VIDIOC_ENUM_FMT, &desc) == 0) {
+    supported.emplace_back(desc.pixelformat);
+    desc.index++;
+  }
+
+  for (const uint32_t format : PREFERRED_FORMATS) {
+    if (find(supported.begin(), supported.end(), format) != supported.end()) {
+      return format;
+    }
+  }
+
+  throw runtime_error("this device supports none of YUV420, NV12 or YUYV");
+}
+
+string VideoDevice::pixel_format_name() const
+{
+  // fourcc code packed in little-endian order
+  string name;
+  for (int i = 0; i < 4; i++) {
+    name += static_cast<char>((pixel_format_ >> (8 * i)) & 0xFF);
+  }
+  return name;
+}
+
+void VideoDevice::add_buffer_view(uint8_t * data)
+{
+  // V4L2's YUV420 is I420 with chroma rows half as long as luma rows
+  const int uv_stride = bytes_per_line_ / 2;
+  uint8_t * u = data + static_cast<size_t>(bytes_per_line_) * display_height_;
+  uint8_t * v = u + static_cast<size_t>(uv_stride) * display_height_ / 2;
+
+  // let vpx_img_wrap fill in the format fields, then lay out the planes
+  auto vpx_img = make_unique<vpx_image_t>();
+  if (not vpx_img_wrap(vpx_img.get(), VPX_IMG_FMT_I420,
+                       display_width_, display_height_, 1, data)) {
+    throw runtime_error("VideoDevice: failed to wrap a V4L2 buffer");
   }
 
+  vpx_img->planes[VPX_PLANE_Y] = data;
+  vpx_img->planes[VPX_PLANE_U] = u;
+  vpx_img->planes[VPX_PLANE_V] = v;
+  vpx_img->stride[VPX_PLANE_Y] = bytes_per_line_;
+  vpx_img->stride[VPX_PLANE_U] = uv_stride;
+  vpx_img->stride[VPX_PLANE_V] = uv_stride;
+
+  buf_imgs_.emplace_back(make_unique<RawImage>(vpx_img.get()));
+  buf_vpx_imgs_.emplace_back(move(vpx_img));
+}
+
+bool VideoDevice::dequeue_buffer()
+{
   memset(&buf_info_, 0, sizeof(buf_info_));
   buf_info_.type = buffer_type;
   buf_info_.memory = V4L2_MEMORY_MMAP;
 
   // try to dequeue a frame
-  if (ioctl(fd_.fd_num(), VIDIOC_DQBUF, &buf_info_) < 0) {
-    return false;
-  }
+  return ioctl(fd_.fd_num(), VIDIOC_DQBUF, &buf_info_) == 0;
+}
 
-  // convert pixel format
+void VideoDevice::enqueue_buffer()
+{
+  check_syscall(ioctl(fd_.fd_num(), VIDIOC_QBUF, &buf_info_));
+}
+
+void VideoDevice::convert_buffer(RawImage & raw_img) const
+{
   const MMap & frame_buf = buf_mem_.at(buf_info_.index);
+  const string_view data {reinterpret_cast<const char *>(frame_buf.addr()),
+                          frame_buf.length()};
 
-  // frame_buf.size() is actually greater than the expected YUYV size
-  raw_img.copy_from_yuyv({
-    reinterpret_cast<const char *>(frame_buf.addr()),
-    static_cast<size_t>(display_width_ * display_height_ * 2)
-  });
+  switch (pixel_format_) {
+    case V4L2_PIX_FMT_YUV420:
+      raw_img.copy_from(*buf_imgs_.at(buf_info_.index));
+      break;
 
-  // enqueue the buffer back
-  check_syscall(ioctl(fd_.fd_num(), VIDIOC_QBUF, &buf_info_));
+    case V4L2_PIX_FMT_NV12:
+      raw_img.copy_from_nv12(data, bytes_per_line_);
+      break;
+
+    case V4L2_PIX_FMT_YUYV:
+      raw_img.copy_from_yuyv(data, bytes_per_line_);
+      break;
+
+    default:
+      throw runtime_error("VideoDevice: unexpected pixel format");
+  }
+}
+
+const RawImage * VideoDevice::acquire_frame()
+{
+  if (acquired_) {
+    throw runtime_error("VideoDevice: previous frame not released");
+  }
+
+  if (not dequeue_buffer()) {
+    return nullptr;
+  }
+  acquired_ = true;
+
+  if (pixel_format_ == V4L2_PIX_FMT_YUV420) {
+    return buf_imgs_.at(buf_info_.index).get();
+  }
+
+  // give the buffer back to the driver if converting it fails
+  try {
+    convert_buffer(*converted_img_);
+  } catch (...) {
+    acquired_ = false;
+    enqueue_buffer();
+    throw;
+  }
+
+  return converted_img_.get();
+}
+
+void VideoDevice::release_frame()
+{
+  if (not acquired_) {
+    throw runtime_error("VideoDevice: no frame to release");
+  }
+
+  acquired_ = false;
+  enqueue_buffer();
+}
+
+bool VideoDevice::read_frame(RawImage & raw_img)
+{
+  if (raw_img.display_width() != display_width_ or
+      raw_img.display_height() != display_height_) {
+    throw runtime_error("VideoDevice: image dimensions don't match");
+  }
+
+  if (acquired_) {
+    throw runtime_error("VideoDevice: previous frame not released");
+  }
+
+  if (not dequeue_buffer()) {
+    return false;
+  }
+
+  // convert pixel format straight into raw_img, and enqueue the buffer
+  // back even if that fails
+  try {
+    convert_buffer(raw_img);
+  } catch (...) {
+    enqueue_buffer();
+    throw;
+  }
+
+  enqueue_buffer();
 
   return true;
 }
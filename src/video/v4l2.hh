@@ -3,10 +3,12 @@
 
 extern "C" {
 #include <linux/videodev2.h>
+#include <vpx/vpx_image.h>
 }
 
 #include <string>
 #include <vector>
+#include <memory>
 
 #include "file_descriptor.hh"
 #include "mmap.hh"
@@ -23,9 +25,19 @@ public:
   // video device defaults to blocking mode
   void set_blocking(const bool blocking);
 
+  // borrow the next captured frame, valid until release_frame(): a
+  // zero-copy view of the V4L2 buffer if captured in YUV420, or else the
+  // frame converted into an internal image; nullptr if no frame is ready
+  const RawImage * acquire_frame();
+  void release_frame();
+
   // try to fetch a video frame from webmcam into raw_img
   bool read_frame(RawImage & raw_img) override;
 
+  // negotiated capture format (V4L2_PIX_FMT_*) and its name, e.g., "NV12"
+  uint32_t pixel_format() const { return pixel_format_; }
+  std::string pixel_format_name() const;
+
   // accessors
   FileDescriptor & fd() { return fd_; }
   uint16_t display_width() const override { return display_width_; }
@@ -36,13 +48,40 @@ private:
   uint16_t display_width_;
   uint16_t display_height_;
 
+  uint32_t pixel_format_ {};
+  int bytes_per_line_ {}; // of the first plane
+
   v4l2_buffer buf_info_ {}; // allocate a buffer info to reuse
   std::vector<MMap> buf_mem_ {}; // memory region for V4L2 buffers
 
+  // zero-copy I420 views of buf_mem_ (YUV420 capture only)
+  std::vector<std::unique_ptr<vpx_image_t>> buf_vpx_imgs_ {};
+  std::vector<std::unique_ptr<RawImage>> buf_imgs_ {};
+
+  // frame converted from other formats by acquire_frame()
+  std::unique_ptr<RawImage> converted_img_ {};
+  bool acquired_ {false}; // buf_info_ holds a dequeued buffer
+
+  // pick the first of PREFERRED_FORMATS the device supports
+  uint32_t negotiate_pixel_format() const;
+  void add_buffer_view(uint8_t * data);
+
+  // dequeue into buf_info_ (false if none ready), and enqueue it back
+  bool dequeue_buffer();
+  void enqueue_buffer();
+
+  // copy or convert the dequeued buffer into raw_img
+  void convert_buffer(RawImage & raw_img) const;
+
   // constants
-  static constexpr uint32_t pixel_format = V4L2_PIX_FMT_YUYV;
   static constexpr uint32_t buffer_type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
   static constexpr size_t NUM_BUFFERS = 4;
+
+  // capture formats from the cheapest to convert to I420: none, NV12
+  // deinterleaves chroma only, YUYV unpacks every pixel
+  static constexpr uint32_t PREFERRED_FORMATS[] = {
+    V4L2_PIX_FMT_YUV420, V4L2_PIX_FMT_NV12, V4L2_PIX_FMT_YUYV
+  };
 };
 
 #endif /* V4L2_HH */
@@ -0,0 +1,66 @@
+#include "video_source.hh"
+#include "yuv4mpeg.hh"
+#include "file_camera.hh"
+#include "v4l2.hh"
+#include "synthetic_video.hh"
+
+using namespace std;
+
+namespace {
+  enum class SourceType { Y4M, V4L2, FILE_CAMERA, SYNTHETIC };
+
+  // split 'spec' into the type of source and its path
+  pair<SourceType, string> parse_spec(const string & spec)
+  {
+    const auto starts_with = [&spec](const string & prefix) {
+      return spec.compare(0, prefix.size(), prefix) == 0;
+    };
+
+    if (starts_with("v4l2:")) {
+      return {SourceType::V4L2, spec.substr(5)};
+    }
+
+    if (starts_with("/dev/video")) {
+      return {SourceType::V4L2, spec};
+    }
+
+    if (starts_with("file-camera:")) {
+      return {SourceType::FILE_CAMERA, spec.substr(12)};
+    }
+
+    if (starts_with("synthetic:") or spec == "synthetic") {
+      return {SourceType::SYNTHETIC, spec.substr(min<size_t>(spec.size(), 10))};
+    }
+
+    return {SourceType::Y4M, spec};
+  }
+}
+
+unique_ptr<VideoInput> open_video_input(const string & spec,
+                                        const uint16_t display_width,
+                                        const uint16_t display_height,
+                                        const uint16_t frame_rate)
+{
+  const auto [type, path] = parse_spec(spec);
+
+  switch (type) {
+    case SourceType::V4L2:
+      return make_unique<VideoDevice>(path, display_width, display_height);
+
+    case SourceType::FILE_CAMERA:
+      return make_unique<FileCamera>(path, display_width, display_height, frame_rate);
+
+    case SourceType::SYNTHETIC:
+      return make_unique<SyntheticVideo>(display_width, display_height,
+                                         SyntheticVideoConfig::parse(path));
+
+    default:
+      return make_unique<YUV4MPEG>(path, display_width, display_height);
+  }
+}
+
+bool is_live_video_input(const string & spec)
+{
+  const SourceType type = parse_spec(spec).first;
+  return type == SourceType::V4L2 or type == SourceType::FILE_CAMERA;
+}
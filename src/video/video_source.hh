@@ -0,0 +1,24 @@
+#ifndef VIDEO_SOURCE_HH
+#define VIDEO_SOURCE_HH
+
+#include <string>
+#include <memory>
+
+#include "video_input.hh"
+
+// open the video input described by 'spec':
+//   /dev/videoN or v4l2:<device>    a V4L2 camera (in blocking mode)
+//   file-camera:<y4m>               a y4m file paced like a camera
+//   synthetic[:<options>]           procedurally generated frames (options
+//                                   in SyntheticVideoConfig::parse())
+//   <y4m>                           a y4m file read as fast as requested
+std::unique_ptr<VideoInput> open_video_input(const std::string & spec,
+                                             const uint16_t display_width,
+                                             const uint16_t display_height,
+                                             const uint16_t frame_rate);
+
+// if the input produces frames in real time by itself (and should thus be
+// read on a CaptureThread rather than paced by the reader)
+bool is_live_video_input(const std::string & spec);
+
+#endif /* VIDEO_SOURCE_HH */
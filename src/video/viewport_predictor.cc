@@ -0,0 +1,78 @@
+#include <cmath>
+#include <stdexcept>
+
+#include "viewport_predictor.hh"
+
+using namespace std;
+
+ViewportPredictor::ViewportPredictor(const double alpha, const double beta,
+                                     const uint64_t timeout_us)
+  : alpha_(alpha), beta_(beta), timeout_us_(timeout_us)
+{
+  if (alpha <= 0 or alpha > 1 or beta < 0 or beta > 2) {
+    throw runtime_error("ViewportPredictor: invalid alpha or beta");
+  }
+}
+
+bool ViewportPredictor::timed_out(const uint64_t now_us) const
+{
+  return last_ts_ and now_us > *last_ts_ + timeout_us_;
+}
+
+void ViewportPredictor::update(const uint64_t ts_us, const double x, const double y)
+{
+  // the motion before a timeout says nothing about the motion after it
+  if (timed_out(ts_us)) {
+    reset();
+  }
+
+  if (not last_ts_ or ts_us <= *last_ts_) {
+    // first sample, or no time elapsed to estimate the velocity from
+    if (not last_ts_) {
+      x_ = x;
+      y_ = y;
+    } else {
+      x_ += alpha_ * (x - x_);
+      y_ += alpha_ * (y - y_);
+    }
+    last_ts_ = max(ts_us, last_ts_.value_or(0));
+    return;
+  }
+
+  const double dt = (ts_us - *last_ts_) / 1e6; // seconds
+
+  // predict with constant velocity, then correct with the residuals
+  const double residual_x = x - (x_ + vx_ * dt);
+  const double residual_y = y - (y_ + vy_ * dt);
+
+  x_ += vx_ * dt + alpha_ * residual_x;
+  y_ += vy_ * dt + alpha_ * residual_y;
+  vx_ += beta_ * residual_x / dt;
+  vy_ += beta_ * residual_y / dt;
+
+  last_ts_ = ts_us;
+}
+
+pair<double, double> ViewportPredictor::predict(const uint64_t now_us,
+                                                const uint64_t horizon_us) const
+{
+  if (not last_ts_ or timed_out(now_us)) {
+    return {x_, y_};
+  }
+
+  const uint64_t ts_us = min(now_us, *last_ts_) + horizon_us;
+  const double dt = (ts_us - *last_ts_) / 1e6;
+  return {x_ + vx_ * dt, y_ + vy_ * dt};
+}
+
+bool ViewportPredictor::moving(const double min_speed, const uint64_t now_us) const
+{
+  return not timed_out(now_us) and hypot(vx_, vy_) > min_speed;
+}
+
+void ViewportPredictor::reset()
+{
+  last_ts_.reset();
+  vx_ = 0.0;
+  vy_ = 0.0;
+}
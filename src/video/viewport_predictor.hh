@@ -0,0 +1,54 @@
+#ifndef VIEWPORT_PREDICTOR_HH
+#define VIEWPORT_PREDICTOR_HH
+
+#include <cstdint>
+#include <optional>
+#include <utility>
+
+// predicts where a moving viewport center will be, using an alpha-beta
+// filter (a steady-state Kalman filter with a constant-velocity model)
+// over the viewport updates received so far; without an update for
+// 'timeout_us' (e.g., an idle client or a lost update), the viewport is
+// deemed to have stopped where it was last seen
+class ViewportPredictor
+{
+public:
+  // alpha: weight of a new position sample; beta: weight of its velocity
+  ViewportPredictor(const double alpha = 0.6, const double beta = 0.2,
+                    const uint64_t timeout_us = 200000);
+
+  // feed the viewport center observed at 'ts_us'
+  void update(const uint64_t ts_us, const double x, const double y);
+
+  // extrapolate the viewport center to 'horizon_us' past 'now_us', but no
+  // further than 'horizon_us' past the last update (and not at all once it
+  // timed out)
+  std::pair<double, double> predict(const uint64_t now_us,
+                                    const uint64_t horizon_us) const;
+
+  // estimated velocity in pixels per second
+  std::pair<double, double> velocity() const { return {vx_, vy_}; }
+
+  // if the viewport moves faster than 'min_speed' pixels per second and has
+  // been updated within the timeout as of 'now_us'
+  bool moving(const double min_speed, const uint64_t now_us) const;
+
+  // forget the motion so far (e.g., after the viewport jumps)
+  void reset();
+
+private:
+  // if no sample arrived within the timeout as of 'now_us'
+  bool timed_out(const uint64_t now_us) const;
+
+  double alpha_;
+  double beta_;
+  uint64_t timeout_us_;
+
+  std::optional<uint64_t> last_ts_ {}; // timestamp of the last sample
+  double x_ {0.0};
+  double y_ {0.0};
+  double vx_ {0.0};
+  double vy_ {0.0};
+};
+
+#endif /* VIEWPORT_PREDICTOR_HH */
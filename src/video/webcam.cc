@@ -55,25 +55,26 @@ int main(int argc, char * argv[])
   // create a video device and set it to non-blocking
   VideoDevice cam(video_device_path, width, height);
   cam.set_blocking(false);
+  cerr << "Capturing " << cam.pixel_format_name() << " frames" << endl;
 
   // create an SDL display
   VideoDisplay display(width, height);
 
-  // allocate a raw image
-  RawImage raw_img(width, height);
-
   // poll video frames from camera
   Poller poller;
 
   poller.register_event(cam.fd(), Poller::In,
     [&]()
     {
-      if (not cam.read_frame(raw_img)) {
+      // borrow the frame (without copying if captured in YUV420)
+      const RawImage * raw_img = cam.acquire_frame();
+      if (not raw_img) {
         cerr << "try to read frame from camera later" << endl;
         return;
       }
 
-      display.show_frame(raw_img);
+      display.show_frame(*raw_img);
+      cam.release_frame();
     }
   );
 
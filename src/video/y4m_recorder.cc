@@ -0,0 +1,200 @@
+#include <cstring>
+#include <stdexcept>
+
+#include "y4m_recorder.hh"
+#include "exception.hh"
+#include "conversion.hh"
+#include "split.hh"
+
+using namespace std;
+
+Y4MRecorder::Y4MRecorder(const string & file_path,
+                         const uint16_t display_width,
+                         const uint16_t display_height,
+                         const uint16_t frame_rate, const size_t max_pending)
+  : fd_(check_syscall(open(file_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644))),
+    display_width_(display_width), display_height_(display_height),
+    pool_(display_width, display_height, max_pending + 1),
+    max_pending_(max_pending)
+{
+  if (max_pending == 0) {
+    throw runtime_error("Y4MRecorder: max_pending must be positive");
+  }
+
+  // 4:2:0 with chroma sited like libvpx's I420 output
+  fd_.write_all("YUV4MPEG2 W" + to_string(display_width)
+                + " H" + to_string(display_height)
+                + " F" + to_string(frame_rate) + ":1 Ip A1:1 C420jpeg\n");
+
+  // black in limited range until the first frame
+  const size_t y_size = static_cast<size_t>(display_width) * display_height;
+  planes_.assign(y_size, 16);
+  planes_.append(y_size / 2, static_cast<char>(128));
+
+  writer_ = thread(&Y4MRecorder::writer_main, this);
+}
+
+Y4MRecorder::~Y4MRecorder()
+{
+  {
+    lock_guard<mutex> lock(mtx_);
+    stop_ = true;
+  }
+  cv_.notify_one();
+
+  if (writer_.joinable()) {
+    writer_.join();
+  }
+}
+
+bool Y4MRecorder::fill_up_to(const uint32_t frame_id)
+{
+  if (next_frame_id_ and frame_id < *next_frame_id_) {
+    return false;
+  }
+
+  // frames skipped since the last recorded one
+  for (uint32_t id = next_frame_id_.value_or(0); id < frame_id; id++) {
+    enqueue({id, nullptr});
+  }
+
+  next_frame_id_ = frame_id + 1;
+  return true;
+}
+
+bool Y4MRecorder::record(const RawImage & img, const uint32_t frame_id)
+{
+  if (img.display_width() != display_width_ or
+      img.display_height() != display_height_) {
+    throw runtime_error("Y4MRecorder: frame dimensions don't match");
+  }
+
+  bool has_room;
+  {
+    lock_guard<mutex> lock(mtx_);
+
+    if (error_) {
+      exception_ptr error = error_;
+      error_ = nullptr;
+      rethrow_exception(error);
+    }
+
+    has_room = num_pending_ < max_pending_;
+  }
+
+  if (not fill_up_to(frame_id)) {
+    return true; // already recorded
+  }
+
+  if (not has_room) {
+    num_dropped_++;
+    enqueue({frame_id, nullptr});
+    return false;
+  }
+
+  PooledImage copy = pool_.acquire();
+  copy->copy_from(img);
+  enqueue({frame_id, move(copy)});
+
+  return true;
+}
+
+void Y4MRecorder::repeat(const uint32_t frame_id)
+{
+  if (fill_up_to(frame_id)) {
+    enqueue({frame_id, nullptr});
+  }
+}
+
+void Y4MRecorder::enqueue(Job && job)
+{
+  {
+    lock_guard<mutex> lock(mtx_);
+    if (job.img) {
+      num_pending_++;
+    }
+    queue_.emplace_back(move(job));
+  }
+  cv_.notify_one();
+}
+
+void Y4MRecorder::writer_main()
+{
+  const size_t y_size = static_cast<size_t>(display_width_) * display_height_;
+  const uint16_t uv_width = display_width_ / 2;
+  const uint16_t uv_height = display_height_ / 2;
+
+  // pack a plane of width x height into planes_ at 'offset'
+  const auto pack = [this](const uint8_t * src, const int stride,
+                           const uint16_t width, const uint16_t height,
+                           const size_t offset) {
+    for (uint16_t row = 0; row < height; row++) {
+      memcpy(planes_.data() + offset + static_cast<size_t>(row) * width,
+             src + row * stride, width);
+    }
+  };
+
+  while (true) {
+    Job job;
+
+    {
+      unique_lock<mutex> lock(mtx_);
+      cv_.wait(lock, [this] { return stop_ or not queue_.empty(); });
+
+      if (queue_.empty()) { // stop_ must be true
+        return;
+      }
+
+      job = move(queue_.front());
+      queue_.pop_front();
+    }
+
+    try {
+      const bool repeated = not job.img;
+
+      if (job.img) {
+        const RawImage & img = *job.img;
+        pack(img.y_plane(), img.y_stride(), display_width_, display_height_, 0);
+        pack(img.u_plane(), img.u_stride(), uv_width, uv_height, y_size);
+        pack(img.v_plane(), img.v_stride(), uv_width, uv_height,
+             y_size + static_cast<size_t>(uv_width) * uv_height);
+
+        // return the buffer before the (slower) write
+        job.img.reset();
+        {
+          lock_guard<mutex> lock(mtx_);
+          num_pending_--;
+        }
+      }
+
+      // frame parameters starting with 'X' are ignored by y4m readers
+      fd_.write_all("FRAME Xframe_id=" + to_string(job.frame_id)
+                    + (repeated ? " Xrepeat=1\n" : "\n"));
+      fd_.write_all(planes_);
+
+      if (repeated) {
+        num_repeated_++;
+      } else {
+        num_recorded_++;
+      }
+    } catch (...) {
+      lock_guard<mutex> lock(mtx_);
+      if (not error_) {
+        error_ = current_exception();
+      }
+    }
+  }
+}
+
+optional<uint32_t> y4m_frame_id(const string & frame_header)
+{
+  static const string tag = "Xframe_id=";
+
+  for (const auto & param : split(frame_header, " ")) {
+    if (param.compare(0, tag.size(), tag) == 0) {
+      return narrow_cast<uint32_t>(strict_stoll(param.substr(tag.size())));
+    }
+  }
+
+  return nullopt;
+}
@@ -0,0 +1,96 @@
+#ifndef Y4M_RECORDER_HH
+#define Y4M_RECORDER_HH
+
+#include <cstdint>
+#include <string>
+#include <deque>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <exception>
+#include <optional>
+
+#include "file_descriptor.hh"
+#include "image.hh"
+#include "frame_pool.hh"
+
+// records frames into a YUV4MPEG2 file on a background thread, one frame
+// per frame ID so that the recording stays aligned with the source (e.g.,
+// for computing PSNR or SSIM against it): a frame ID that is skipped, or a
+// frame that arrives while 'max_pending' frames are queued, is recorded as
+// a repeat of the previous frame; record() thus never blocks on I/O
+class Y4MRecorder
+{
+public:
+  Y4MRecorder(const std::string & file_path,
+              const uint16_t display_width, const uint16_t display_height,
+              const uint16_t frame_rate, const size_t max_pending = 8);
+
+  // writes the frames still queued
+  ~Y4MRecorder();
+
+  // record 'img' as frame 'frame_id' (IDs start from 0, and an ID at or
+  // below the last recorded one is ignored); returns false if the frame was
+  // recorded as a repeat instead, and throws if writing an earlier frame failed
+  bool record(const RawImage & img, const uint32_t frame_id);
+
+  // record frame 'frame_id' as a repeat of the previous frame
+  void repeat(const uint32_t frame_id);
+
+  // stats: frames written as received and as repeats, and frames that
+  // were repeated because too many were queued
+  uint64_t num_recorded() const { return num_recorded_.load(); }
+  uint64_t num_repeated() const { return num_repeated_.load(); }
+  uint64_t num_dropped() const { return num_dropped_.load(); }
+
+  // forbid copying and moving
+  Y4MRecorder(const Y4MRecorder & other) = delete;
+  const Y4MRecorder & operator=(const Y4MRecorder & other) = delete;
+  Y4MRecorder(Y4MRecorder && other) = delete;
+  Y4MRecorder & operator=(Y4MRecorder && other) = delete;
+
+private:
+  struct Job
+  {
+    uint32_t frame_id {};
+    PooledImage img {}; // null: repeat the previous frame
+  };
+
+  FileDescriptor fd_;
+  uint16_t display_width_;
+  uint16_t display_height_;
+
+  // a buffer for each queued frame plus the one being written
+  FramePool pool_;
+  size_t max_pending_;
+
+  // the next frame ID to record (used by the recording thread only)
+  std::optional<uint32_t> next_frame_id_ {};
+
+  std::mutex mtx_ {};
+  std::condition_variable cv_ {};
+  std::deque<Job> queue_ {};
+  size_t num_pending_ {0}; // jobs in queue_ holding a frame
+  std::exception_ptr error_ {};
+  bool stop_ {false};
+
+  std::atomic<uint64_t> num_recorded_ {0};
+  std::atomic<uint64_t> num_repeated_ {0};
+  std::atomic<uint64_t> num_dropped_ {0};
+
+  // the last frame written, packed (starts out black)
+  std::string planes_ {};
+
+  std::thread writer_ {};
+
+  // queue repeats up to (excluding) 'frame_id' and return if it is new
+  bool fill_up_to(const uint32_t frame_id);
+  void enqueue(Job && job);
+  void writer_main();
+};
+
+// the frame ID tagged by Y4MRecorder in the header of a y4m frame, if any
+std::optional<uint32_t> y4m_frame_id(const std::string & frame_header);
+
+#endif /* Y4M_RECORDER_HH */
@@ -8,21 +8,10 @@
 
 using namespace std;
 
-YUV4MPEG::YUV4MPEG(const string & video_file_path,
-                   const uint16_t display_width,
-                   const uint16_t display_height,
-                   const bool loop)
-  : fd_(check_syscall(open(video_file_path.c_str(), O_RDONLY))),
-    display_width_(display_width),
-    display_height_(display_height),
-    loop_(loop)
+void check_y4m_header(const string & header,
+                      const uint16_t display_width,
+                      const uint16_t display_height)
 {
-  const string y4m_signature = "YUV4MPEG2";
-  if (fd_.readn(y4m_signature.size()) != y4m_signature) {
-    throw runtime_error("invalid YUV4MPEG2 file signature");
-  }
-
-  const string & header = fd_.getline();
   const vector<string> & tokens = split(header, " ");
 
   for (const auto & token : tokens) {
@@ -59,6 +48,39 @@ YUV4MPEG::YUV4MPEG(const string & video_file_path,
   }
 }
 
+YUV4MPEG::YUV4MPEG(const string & video_file_path,
+                   const uint16_t display_width,
+                   const uint16_t display_height,
+                   const bool loop)
+  : fd_(check_syscall(open(video_file_path.c_str(), O_RDONLY))),
+    reader_(fd_),
+    display_width_(display_width),
+    display_height_(display_height),
+    loop_(loop)
+{
+  const string y4m_signature = "YUV4MPEG2";
+  const string header = reader_.getline();
+  if (header.substr(0, y4m_signature.size()) != y4m_signature) {
+    throw runtime_error("invalid YUV4MPEG2 file signature");
+  }
+
+  check_y4m_header(header.substr(y4m_signature.size()),
+                   display_width, display_height);
+}
+
+void YUV4MPEG::read_plane(uint8_t * plane, const int stride,
+                          const uint16_t width, const uint16_t height)
+{
+  if (stride == width) {
+    reader_.readn(plane, static_cast<size_t>(width) * height);
+    return;
+  }
+
+  for (uint16_t row = 0; row < height; row++) {
+    reader_.readn(plane + row * stride, width);
+  }
+}
+
 bool YUV4MPEG::read_frame(RawImage & raw_img)
 {
   if (raw_img.display_width() != display_width_ or
@@ -66,16 +88,16 @@ bool YUV4MPEG::read_frame(RawImage & raw_img)
     throw runtime_error("YUV4MPEG: image dimensions don't match");
   }
 
-  string frame_header = fd_.getline();
+  string frame_header = reader_.getline();
 
-  if (fd_.eof() and frame_header.empty()) {
+  if (reader_.eof() and frame_header.empty()) {
     if (loop_) {
       // reset the file offset to the beginning and skip the header line
-      fd_.reset_offset();
-      fd_.getline();
+      reader_.reset_offset();
+      reader_.getline();
 
       // should read "FRAME" again
-      frame_header = fd_.getline();
+      frame_header = reader_.getline();
     } else {
       // cannot read past end of file if not set to the 'loop' mode
       return false;
@@ -85,11 +107,15 @@ bool YUV4MPEG::read_frame(RawImage & raw_img)
   if (frame_header.substr(0, 5) != "FRAME") {
     throw runtime_error("invalid YUV4MPEG2 input format");
   }
-
-  // read Y, U, V planes in order
-  raw_img.copy_y_from(fd_.readn(y_size()));
-  raw_img.copy_u_from(fd_.readn(uv_size()));
-  raw_img.copy_v_from(fd_.readn(uv_size()));
+  frame_header_ = move(frame_header);
+
+  // read Y, U, V planes in order, directly into raw_img
+  read_plane(raw_img.y_plane(), raw_img.y_stride(),
+             display_width_, display_height_);
+  read_plane(raw_img.u_plane(), raw_img.u_stride(),
+             display_width_ / 2, display_height_ / 2);
+  read_plane(raw_img.v_plane(), raw_img.v_stride(),
+             display_width_ / 2, display_height_ / 2);
 
   return true;
 }
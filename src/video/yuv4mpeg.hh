@@ -6,8 +6,15 @@
 #include <thread>
 
 #include "file_descriptor.hh"
+#include "buffered_reader.hh"
 #include "video_input.hh"
 
+// validate the YUV4MPEG2 stream header (following the signature) against
+// the expected dimensions and 4:2:0 color space
+void check_y4m_header(const std::string & header,
+                      const uint16_t display_width,
+                      const uint16_t display_height);
+
 class YUV4MPEG : public VideoInput
 {
 public:
@@ -25,19 +32,28 @@ public:
 
   // accessors
   FileDescriptor & fd() { return fd_; }
+  const std::string & frame_header() const { return frame_header_; } // of the last frame read
   uint16_t display_width() const override { return display_width_; }
   uint16_t display_height() const override { return display_height_; }
 
 private:
   FileDescriptor fd_;
+  BufferedReader reader_; // reads from fd_
   uint16_t display_width_;
   uint16_t display_height_;
 
   // loop over the file infinitely
   bool loop_;
 
+  // e.g., "FRAME" followed by frame parameters
+  std::string frame_header_ {};
+
   // thread-safe
   std::mutex mtx_ {};
+
+  // read a plane of width x height into rows 'stride' bytes apart
+  void read_plane(uint8_t * plane, const int stride,
+                  const uint16_t width, const uint16_t height);
 };
 
 #endif /* YUV4MPEG_HH */
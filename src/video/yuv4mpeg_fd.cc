@@ -15,25 +15,22 @@ YUV4MPEG::YUV4MPEG(const string & video_file_path,
   : fd_y_(check_syscall(open(video_file_path.c_str(), O_RDONLY))),
     fd_u_(check_syscall(open(video_file_path.c_str(), O_RDONLY))),
     fd_v_(check_syscall(open(video_file_path.c_str(), O_RDONLY))),
+    reader_y_(fd_y_), reader_u_(fd_u_), reader_v_(fd_v_),
     display_width_(display_width),
     display_height_(display_height),
     loop_(loop)
 {
   const string y4m_signature = "YUV4MPEG2";
-  if (fd_y_.readn(y4m_signature.size()) != y4m_signature) {
-    throw runtime_error("invalid YUV4MPEG2 file signature");
-  }
-  if (fd_u_.readn(y4m_signature.size()) != y4m_signature) {
-    throw runtime_error("invalid YUV4MPEG2 file signature");
-  }
-  if (fd_v_.readn(y4m_signature.size()) != y4m_signature) {
+  const string header = reader_y_.getline();
+  if (header.substr(0, y4m_signature.size()) != y4m_signature) {
     throw runtime_error("invalid YUV4MPEG2 file signature");
   }
 
-  const string & header = fd_y_.getline();
-  const string & header_u  = fd_u_.getline();
-  const string & header_v  = fd_v_.getline();
-  const vector<string> & tokens = split(header, " ");
+  // the U and V readers only skip the header
+  reader_u_.getline();
+  reader_v_.getline();
+
+  const vector<string> & tokens = split(header.substr(y4m_signature.size()), " ");
 
   for (const auto & token : tokens) {
     if (token.empty()) {
@@ -65,7 +62,19 @@ YUV4MPEG::YUV4MPEG(const string & video_file_path,
   }
 }
 
+// read a plane into an image that may pad its rows
+static void read_plane(BufferedReader & reader, uint8_t * plane, const int stride,
+                       const uint16_t width, const uint16_t height)
+{
+  if (stride == width) {
+    reader.readn(plane, static_cast<size_t>(width) * height);
+    return;
+  }
 
+  for (uint16_t row = 0; row < height; row++) {
+    reader.readn(plane + row * stride, width);
+  }
+}
 
 bool YUV4MPEG::read_frame(RawImage & raw_img)
 {
@@ -81,16 +90,16 @@ bool YUV4MPEG::read_frame(RawImage & raw_img)
   lock_guard<mutex> lock(mtx_);
 
   auto read_y = [&]() {
-    string frame_header = fd_y_.getline();
+    string frame_header = reader_y_.getline();
 
-    if (fd_y_.eof() and frame_header.empty()) {
+    if (reader_y_.eof() and frame_header.empty()) {
       if (loop_) {
         // reset the file offset to the beginning and skip the header line
-        fd_y_.reset_offset();
-        fd_y_.getline();
+        reader_y_.reset_offset();
+        reader_y_.getline();
 
         // should read "FRAME" again
-        frame_header = fd_y_.getline();
+        frame_header = reader_y_.getline();
       } else {
         // cannot read past end of file if not set to the 'loop' mode
         // return false;
@@ -101,20 +110,23 @@ bool YUV4MPEG::read_frame(RawImage & raw_img)
       throw runtime_error("invalid YUV4MPEG2 input format");
     }
 
-    raw_img.copy_y_from(fd_y_.readn(y_size()));
+    read_plane(reader_y_, raw_img.y_plane(), raw_img.y_stride(),
+               display_width_, display_height_);
+    // skip U and V to the next frame header
+    reader_y_.skip(2 * uv_size());
   };
 
   auto read_u = [&]() {
-    string frame_header = fd_u_.getline();
+    string frame_header = reader_u_.getline();
 
-    if (fd_u_.eof() and frame_header.empty()) {
+    if (reader_u_.eof() and frame_header.empty()) {
       if (loop_) {
         // reset the file offset to the beginning and skip the header line
-        fd_u_.reset_offset();
-        fd_u_.getline();
+        reader_u_.reset_offset();
+        reader_u_.getline();
 
         // should read "FRAME" again
-        frame_header = fd_u_.getline();
+        frame_header = reader_u_.getline();
       } else {
         // cannot read past end of file if not set to the 'loop' mode
         // return false;
@@ -125,21 +137,23 @@ bool YUV4MPEG::read_frame(RawImage & raw_img)
       throw runtime_error("invalid YUV4MPEG2 input format");
     }
 
-    fd_u_.seek(y_size(), SEEK_CUR);
-    raw_img.copy_u_from(fd_u_.readn(uv_size()));
+    reader_u_.skip(y_size());
+    read_plane(reader_u_, raw_img.u_plane(), raw_img.u_stride(),
+               display_width_ / 2, display_height_ / 2);
+    reader_u_.skip(uv_size());
   };
 
   auto read_v = [&]() {
-    string frame_header = fd_v_.getline();
+    string frame_header = reader_v_.getline();
 
-    if (fd_v_.eof() and frame_header.empty()) {
+    if (reader_v_.eof() and frame_header.empty()) {
       if (loop_) {
         // reset the file offset to the beginning and skip the header line
-        fd_v_.reset_offset();
-        fd_v_.getline();
+        reader_v_.reset_offset();
+        reader_v_.getline();
 
         // should read "FRAME" again
-        frame_header = fd_v_.getline();
+        frame_header = reader_v_.getline();
       } else {
         // cannot read past end of file if not set to the 'loop' mode
         // return false;
@@ -150,8 +164,9 @@ bool YUV4MPEG::read_frame(RawImage & raw_img)
       throw runtime_error("invalid YUV4MPEG2 input format");
     }
 
-    fd_v_.seek(y_size() + uv_size(), SEEK_CUR);
-    raw_img.copy_u_from(fd_v_.readn(uv_size()));
+    reader_v_.skip(y_size() + uv_size());
+    read_plane(reader_v_, raw_img.v_plane(), raw_img.v_stride(),
+               display_width_ / 2, display_height_ / 2);
   };
 
   thread thread_y(read_y);
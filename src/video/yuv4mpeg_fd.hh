@@ -7,6 +7,7 @@
 #include <future>
 
 #include "file_descriptor.hh"
+#include "buffered_reader.hh"
 #include "video_input.hh"
 
 class YUV4MPEG : public VideoInput
@@ -35,6 +36,9 @@ private:
   FileDescriptor fd_y_;
   FileDescriptor fd_u_;
   FileDescriptor fd_v_;
+  BufferedReader reader_y_; // reads from fd_y_
+  BufferedReader reader_u_; // reads from fd_u_
+  BufferedReader reader_v_; // reads from fd_v_
   uint16_t display_width_;
   uint16_t display_height_;
 